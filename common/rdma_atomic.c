@@ -0,0 +1,167 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <infiniband/verbs.h>
+#include "rdma_atomic.h"
+
+static int op_done(void *arg, struct ibv_wc *wc) {
+    struct rdma_atomic *a = arg;
+
+    if (wc->status != IBV_WC_SUCCESS) {
+        printf("[RDMA][ERR] one-sided op %lu failed status=%s\n",
+               wc->wr_id, ibv_wc_status_str(wc->status));
+        a->failed = 1;
+        return -1;
+    }
+    a->done++;
+    return 0;
+}
+
+int rdma_atomic_init(struct rdma_atomic *a, struct rdma_conn *conn) {
+    memset(a, 0, sizeof(*a));
+    a->conn = conn;
+    if (conn->dev->attr.atomic_cap == IBV_ATOMIC_NONE) {
+        RDMA_LOG("device reports no atomic support");
+        return -1;
+    }
+    /* a cache line of its own: the HCA writes it behind the CPU's back */
+    if (posix_memalign((void **)&a->word, 64, 64))
+        return -1;
+    memset(a->word, 0, 64);
+    a->mr = ibv_reg_mr(conn->dev->pd, a->word, 64, IBV_ACCESS_LOCAL_WRITE);
+    if (!a->mr) {
+        RDMA_ERR("ibv_reg_mr failed");
+        free(a->word);
+        return -1;
+    }
+    rdma_poller_init(&a->poller, conn->send_cq, conn->cfg.poll_batch, op_done, a);
+    if (rdma_poller_set_channel(&a->poller, conn->channel, conn->cfg.spin_us)) {
+        rdma_atomic_fini(a);
+        return -1;
+    }
+    return 0;
+}
+
+void rdma_atomic_fini(struct rdma_atomic *a) {
+    rdma_poller_close(&a->poller);
+    if (a->mr)
+        ibv_dereg_mr(a->mr);
+    free(a->word);
+    a->mr = NULL;
+    a->word = NULL;
+}
+
+static int post_wait(struct rdma_atomic *a, struct ibv_send_wr *wr) {
+    struct ibv_sge sge = {
+        .addr = (uintptr_t)a->word,
+        .length = sizeof(uint64_t),
+        .lkey = a->mr->lkey
+    };
+    struct ibv_send_wr *bad;
+
+    if (a->failed)
+        return -1;
+    wr->wr_id = a->done;
+    wr->sg_list = &sge;
+    wr->num_sge = 1;
+    wr->send_flags = IBV_SEND_SIGNALED;
+    if (ibv_post_send(a->conn->qp, wr, &bad)) {
+        RDMA_ERR("ibv_post_send failed");
+        return -1;
+    }
+    return rdma_poller_wait(&a->poller, 1) < 0 ? -1 : 0;
+}
+
+int rdma_atomic_fadd(struct rdma_atomic *a, uint64_t raddr, uint64_t add, uint64_t *old) {
+    struct ibv_send_wr wr = {
+        .opcode = IBV_WR_ATOMIC_FETCH_AND_ADD,
+        .wr.atomic.remote_addr = raddr,
+        .wr.atomic.compare_add = add,
+        .wr.atomic.rkey = a->conn->remote.rkey
+    };
+    if (post_wait(a, &wr))
+        return -1;
+    if (old)
+        *old = *(volatile uint64_t *)a->word;
+    return 0;
+}
+
+int rdma_atomic_cas(struct rdma_atomic *a, uint64_t raddr, uint64_t expect, uint64_t swap,
+                    uint64_t *old) {
+    struct ibv_send_wr wr = {
+        .opcode = IBV_WR_ATOMIC_CMP_AND_SWP,
+        .wr.atomic.remote_addr = raddr,
+        .wr.atomic.compare_add = expect,
+        .wr.atomic.swap = swap,
+        .wr.atomic.rkey = a->conn->remote.rkey
+    };
+    if (post_wait(a, &wr))
+        return -1;
+    if (old)
+        *old = *(volatile uint64_t *)a->word;
+    return 0;
+}
+
+int rdma_atomic_read(struct rdma_atomic *a, uint64_t raddr, uint64_t *val) {
+    struct ibv_send_wr wr = {
+        .opcode = IBV_WR_RDMA_READ,
+        .wr.rdma.remote_addr = raddr,
+        .wr.rdma.rkey = a->conn->remote.rkey
+    };
+    if (post_wait(a, &wr))
+        return -1;
+    *val = *(volatile uint64_t *)a->word;
+    return 0;
+}
+
+int rdma_atomic_write(struct rdma_atomic *a, uint64_t raddr, uint64_t val) {
+    struct ibv_send_wr wr = {
+        .opcode = IBV_WR_RDMA_WRITE,
+        .wr.rdma.remote_addr = raddr,
+        .wr.rdma.rkey = a->conn->remote.rkey
+    };
+    *a->word = val;
+    return post_wait(a, &wr);
+}
+
+int rdma_lock_acquire(struct rdma_atomic *a, uint64_t raddr, uint64_t id, uint64_t *retries) {
+    uint64_t backoff = 0;
+
+    for (;;) {
+        uint64_t old;
+        if (rdma_atomic_cas(a, raddr, 0, id, &old))
+            return -1;
+        if (!old)
+            return 0;
+        if (old == id) {
+            RDMA_LOG("lock at 0x%lx already held by this id %lu", raddr, id);
+            return -1;
+        }
+        if (retries)
+            (*retries)++;
+
+        /* every failed CAS is a round trip the holder's release queues behind */
+        backoff = backoff ? backoff * 2 : 250;
+        if (backoff > RDMA_LOCK_BACKOFF_NS)
+            backoff = RDMA_LOCK_BACKOFF_NS;
+        uint64_t until = rdma_now_ns() + backoff;
+        while (rdma_now_ns() < until);
+    }
+}
+
+int rdma_lock_release(struct rdma_atomic *a, uint64_t raddr, uint64_t id) {
+    uint64_t old;
+
+    /*
+     * CAS rather than a WRITE of 0: atomics and plain writes to the same
+     * word are not guaranteed atomic with respect to each other.
+     */
+    if (rdma_atomic_cas(a, raddr, id, 0, &old))
+        return -1;
+    if (old != id) {
+        RDMA_LOG("lock at 0x%lx held by %lu, not %lu", raddr, old, id);
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include <stdint.h>
+#include "rdma_conn.h"
+#include "rdma_poll.h"
+
+/*
+ * One-sided operations on 8-byte words in the peer's exported region
+ * (conn->remote), each posted signaled and waited for. The peer must
+ * have registered the region with IBV_ACCESS_REMOTE_ATOMIC; its CPU
+ * takes no part. The caller owns conn->send_cq while these run.
+ */
+struct rdma_atomic {
+    struct rdma_conn   *conn;
+    struct ibv_mr      *mr;
+    uint64_t           *word;           /* fetched values and READ/WRITE data */
+    struct rdma_poller  poller;
+    int                 failed;
+    uint64_t            done;
+};
+
+int  rdma_atomic_init(struct rdma_atomic *a, struct rdma_conn *conn);
+void rdma_atomic_fini(struct rdma_atomic *a);
+
+/* raddr is absolute, 8-byte aligned; *old gets the word's previous value */
+int  rdma_atomic_fadd(struct rdma_atomic *a, uint64_t raddr, uint64_t add, uint64_t *old);
+int  rdma_atomic_cas(struct rdma_atomic *a, uint64_t raddr, uint64_t expect, uint64_t swap,
+                     uint64_t *old);
+/* plain 8-byte RDMA READ / WRITE, for data guarded by a lock below */
+int  rdma_atomic_read(struct rdma_atomic *a, uint64_t raddr, uint64_t *val);
+int  rdma_atomic_write(struct rdma_atomic *a, uint64_t raddr, uint64_t val);
+
+/*
+ * Spinlock in a remote word: 0 is free, otherwise it holds the owner's
+ * id (non-zero, unique per holder). acquire retries its CAS with a
+ * doubling backoff capped at RDMA_LOCK_BACKOFF_NS and adds the failed
+ * attempts to *retries when given.
+ */
+#define RDMA_LOCK_BACKOFF_NS  16000ull
+
+int  rdma_lock_acquire(struct rdma_atomic *a, uint64_t raddr, uint64_t id, uint64_t *retries);
+int  rdma_lock_release(struct rdma_atomic *a, uint64_t raddr, uint64_t id);
@@ -0,0 +1,65 @@
+#pragma once
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include "rdma_common.h"
+
+/* same columns as the perftest *_bw tools, plus plain msgs/s */
+static inline void rdma_bw_header(void) {
+    printf(" %-10s %-12s %-12s %-14s %-12s\n",
+           "#bytes", "#iterations", "BW[GB/s]", "MsgRate[Mpps]", "msgs/s");
+}
+
+static inline void rdma_bw_print(size_t size, uint64_t iters, uint64_t ns) {
+    double sec = ns / 1e9;
+    printf(" %-10zu %-12lu %-12.3f %-14.3f %-12.0f\n",
+           size, iters, size * iters / sec / 1e9, iters / sec / 1e6, iters / sec);
+}
+
+/* "64K", "4M", "2G" -> bytes */
+static inline uint64_t rdma_parse_size(const char *s) {
+    char *end;
+    uint64_t v = strtoull(s, &end, 0);
+
+    switch (*end) {
+    case 'g': case 'G': v <<= 10; /* fall through */
+    case 'm': case 'M': v <<= 10; /* fall through */
+    case 'k': case 'K': v <<= 10; break;
+    }
+    return v;
+}
+
+/* user + system CPU time of the whole process */
+static inline uint64_t rdma_cpu_ns(void) {
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000000ull +
+           (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) * 1000ull;
+}
+
+/* ---------- cycle counter for per-iteration latency samples ---------- */
+
+static inline uint64_t rdma_cycles(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    uint32_t lo, hi;
+    __asm__ __volatile__("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+#else
+    return rdma_now_ns();
+#endif
+}
+
+/* TSC ticks per ns, measured against CLOCK_MONOTONIC over ~20 ms */
+static inline double rdma_cycles_per_ns(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    uint64_t t0 = rdma_now_ns(), c0 = rdma_cycles();
+    usleep(20000);
+    uint64_t t1 = rdma_now_ns(), c1 = rdma_cycles();
+    return (double)(c1 - c0) / (t1 - t0);
+#else
+    return 1.0;
+#endif
+}
@@ -0,0 +1,71 @@
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <infiniband/verbs.h>
+#include "rdma_bulk.h"
+#include "rdma_poll.h"
+
+#define BULK_POST_BATCH 16      /* READs chained per doorbell */
+
+static int read_done(void *arg, struct ibv_wc *wc) {
+    if (wc->status != IBV_WC_SUCCESS) {
+        printf("[RDMA][ERR] READ chunk %lu failed status=%s\n",
+               wc->wr_id, ibv_wc_status_str(wc->status));
+        return -1;
+    }
+    (*(uint64_t *)arg)++;
+    return 0;
+}
+
+int rdma_read_bulk(struct rdma_conn *conn, void *dst, uint32_t lkey,
+                   uint64_t raddr, uint32_t rkey, uint64_t len,
+                   uint32_t chunk, uint32_t depth) {
+    struct ibv_sge sge[BULK_POST_BATCH];
+    struct ibv_send_wr wr[BULK_POST_BATCH], *bad;
+    struct rdma_poller poller;
+    uint64_t posted = 0, done = 0;
+
+    if (!chunk || !depth)
+        return -1;
+    uint64_t nchunks = (len + chunk - 1) / chunk;
+    if (depth > conn->cfg.max_send_wr)
+        depth = conn->cfg.max_send_wr;
+    rdma_poller_init(&poller, conn->send_cq, conn->cfg.poll_batch, read_done, &done);
+
+    while (done < nchunks) {
+        int n = 0;
+        while (n < BULK_POST_BATCH && posted + n < nchunks && posted + n - done < depth) {
+            uint64_t off = (posted + n) * chunk;
+            uint32_t bytes = len - off < chunk ? len - off : chunk;
+
+            sge[n] = (struct ibv_sge) {
+                .addr = (uintptr_t)dst + off,
+                .length = bytes,
+                .lkey = lkey
+            };
+            wr[n] = (struct ibv_send_wr) {
+                .wr_id = posted + n,
+                .opcode = IBV_WR_RDMA_READ,
+                .sg_list = &sge[n],
+                .num_sge = 1,
+                .send_flags = IBV_SEND_SIGNALED,
+                .wr.rdma.remote_addr = raddr + off,
+                .wr.rdma.rkey = rkey
+            };
+            if (n)
+                wr[n - 1].next = &wr[n];
+            n++;
+        }
+        if (n) {
+            if (ibv_post_send(conn->qp, wr, &bad)) {
+                RDMA_ERR("ibv_post_send READ chunk %lu failed", bad->wr_id);
+                return -1;
+            }
+            posted += n;
+        }
+
+        if (rdma_poller_poll(&poller) < 0)
+            return -1;
+    }
+    return 0;
+}
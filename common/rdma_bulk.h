@@ -0,0 +1,12 @@
+#pragma once
+#include <stdint.h>
+#include "rdma_conn.h"
+
+/*
+ * Pull len bytes from (raddr, rkey) into dst with RDMA READs of at most
+ * chunk bytes, keeping up to depth of them outstanding. The caller
+ * registered dst with lkey and owns conn->send_cq for the duration.
+ */
+int rdma_read_bulk(struct rdma_conn *conn, void *dst, uint32_t lkey,
+                   uint64_t raddr, uint32_t rkey, uint64_t len,
+                   uint32_t chunk, uint32_t depth);
@@ -0,0 +1,27 @@
+#pragma once
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <time.h>
+#include <infiniband/verbs.h>
+
+#define RDMA_LOG(fmt, ...)  printf("[RDMA] " fmt "\n", ##__VA_ARGS__)
+#define RDMA_ERR(fmt, ...)  printf("[RDMA][ERR] " fmt " (errno=%d:%s)\n", ##__VA_ARGS__, errno, strerror(errno))
+
+/* exchanged over TCP before the QP goes to RTR */
+struct qp_info {
+    uint32_t qp_num;
+    uint32_t rkey;
+    uint64_t addr;
+    uint64_t len;       /* bytes exported at addr */
+    uint8_t  gid[16];
+    uint32_t mtu;       /* enum ibv_mtu: the largest path MTU this side takes */
+    uint32_t rd_atom;   /* max_dest_rd_atomic: READs/atomics this side serves at once */
+};
+
+static inline uint64_t rdma_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
@@ -0,0 +1,550 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/tcp.h>
+#include <infiniband/verbs.h>
+#include "rdma_conn.h"
+
+/* ---------- config ---------- */
+
+void rdma_cfg_init(struct rdma_cfg *cfg) {
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->dev_name           = NULL;
+    cfg->ib_port            = 1;
+    cfg->gid_index          = -1;   /* RoCE v2 / IPv4, see find_gid_index() */
+    cfg->path_mtu           = 0;    /* the port's active_mtu */
+    cfg->tcp_port           = RDMA_TCP_PORT;
+
+    cfg->cq_depth           = 0;
+    cfg->max_send_wr        = 10;
+    cfg->max_recv_wr        = 10;
+    cfg->max_send_sge       = 1;
+    cfg->max_recv_sge       = 1;
+    cfg->max_inline_data    = 256;
+    cfg->poll_batch         = 16;
+    cfg->cq_hist            = 0;
+    cfg->spin_us            = -1;
+
+    cfg->hop_limit          = 64;
+    cfg->timeout            = 14;
+    cfg->retry_cnt          = 7;
+    cfg->rnr_retry          = 7;
+    cfg->min_rnr_timer      = 12;
+    cfg->max_rd_atomic      = 1;
+    cfg->max_dest_rd_atomic = 1;
+    cfg->access_flags       = IBV_ACCESS_LOCAL_WRITE;
+}
+
+enum ibv_mtu rdma_mtu_from_int(int mtu) {
+    switch (mtu) {
+    case 256:  return IBV_MTU_256;
+    case 512:  return IBV_MTU_512;
+    case 1024: return IBV_MTU_1024;
+    case 2048: return IBV_MTU_2048;
+    case 4096: return IBV_MTU_4096;
+    default:   return 0;
+    }
+}
+
+int rdma_mtu_to_int(enum ibv_mtu mtu) {
+    return mtu >= IBV_MTU_256 && mtu <= IBV_MTU_4096 ? 128 << mtu : 0;
+}
+
+int rdma_cfg_parse_opt(struct rdma_cfg *cfg, int opt, const char *arg) {
+    switch (opt) {
+    case RDMA_OPT_DEV:       cfg->dev_name = arg; break;
+    case RDMA_OPT_IB_PORT:   cfg->ib_port = atoi(arg); break;
+    case RDMA_OPT_GID_INDEX: cfg->gid_index = atoi(arg); break;
+    case RDMA_OPT_TCP_PORT:  cfg->tcp_port = atoi(arg); break;
+    case RDMA_OPT_CQ_DEPTH:  cfg->cq_depth = atoi(arg); break;
+    case RDMA_OPT_SQ_DEPTH:  cfg->max_send_wr = atoi(arg); break;
+    case RDMA_OPT_RQ_DEPTH:  cfg->max_recv_wr = atoi(arg); break;
+    case RDMA_OPT_HOP_LIMIT: cfg->hop_limit = atoi(arg); break;
+    case RDMA_OPT_TIMEOUT:   cfg->timeout = atoi(arg); break;
+    case RDMA_OPT_RETRY:     cfg->retry_cnt = atoi(arg); break;
+    case RDMA_OPT_RNR_RETRY: cfg->rnr_retry = atoi(arg); break;
+    case RDMA_OPT_RNR_TIMER: cfg->min_rnr_timer = atoi(arg); break;
+    case RDMA_OPT_POLL_BATCH: cfg->poll_batch = atoi(arg); break;
+    case RDMA_OPT_CQ_HIST:   cfg->cq_hist = 1; break;
+    case RDMA_OPT_INLINE:    cfg->max_inline_data = atoi(arg); break;
+    case RDMA_OPT_SPIN_US:   cfg->spin_us = atoi(arg); break;
+    case RDMA_OPT_SGE:
+        cfg->max_send_sge = cfg->max_recv_sge = atoi(arg);
+        break;
+    case RDMA_OPT_RD_ATOMIC:
+        cfg->max_rd_atomic = cfg->max_dest_rd_atomic = atoi(arg);
+        break;
+    case RDMA_OPT_MTU:
+        cfg->path_mtu = rdma_mtu_from_int(atoi(arg));
+        if (!cfg->path_mtu) {
+            printf("invalid --mtu %s (256/512/1024/2048/4096)\n", arg);
+            return -1;
+        }
+        break;
+    default:
+        return -1;
+    }
+    return 0;
+}
+
+void rdma_cfg_usage(void) {
+    printf("RDMA options:\n"
+           "  --dev <name>        IB device (default: first one with an active port)\n"
+           "  --ib-port <n>       IB port (default: 1)\n"
+           "  --gid-idx <n>       GID index (default: RoCE v2 IPv4 entry; 0 on InfiniBand)\n"
+           "  --mtu <bytes>       path MTU 256..4096 (default: the port's active MTU)\n"
+           "  --tcp-port <n>      bootstrap TCP port (default: %d)\n"
+           "  --cq-depth <n>      CQ entries (default: sq + rq depth)\n"
+           "  --sq-depth <n>      max_send_wr (default: 10)\n"
+           "  --rq-depth <n>      max_recv_wr (default: 10)\n"
+           "  --hop-limit <n>     GRH hop limit (default: 64)\n"
+           "  --timeout <n>       local ACK timeout exponent (default: 14)\n"
+           "  --retry <n>         retry count (default: 7)\n"
+           "  --rnr-retry <n>     RNR retry count (default: 7)\n"
+           "  --rnr-timer <n>     min RNR NAK timer (default: 12)\n"
+           "  --poll-batch <n>    CQEs per ibv_poll_cq, 1..64 (default: 16)\n"
+           "  --cq-hist           print the CQEs-per-poll histogram\n"
+           "  --inline <bytes>    max_inline_data to request, 0 disables (default: 256)\n"
+           "  --rd-atomic <n>     outstanding RDMA READ/atomics per QP, 0 = device max (default: 1)\n"
+           "  --spin-us <n>       busy-poll n us, then sleep on the CQ's completion channel\n"
+           "                      (default: -1, never sleep)\n"
+           "  --sge <n>           scatter/gather entries per send and receive WR (default: 1)\n",
+           RDMA_TCP_PORT);
+}
+
+/* ---------- device ---------- */
+
+/* cfg->dev_name, or the first device whose port is ACTIVE, or the first device */
+static struct ibv_context *open_device(struct ibv_device **list, const struct rdma_cfg *cfg) {
+    for (int i = 0; list[i]; i++) {
+        const char *name = ibv_get_device_name(list[i]);
+        if (cfg->dev_name && strcmp(name, cfg->dev_name))
+            continue;
+        struct ibv_context *ctx = ibv_open_device(list[i]);
+        if (!ctx) {
+            RDMA_ERR("ibv_open_device %s failed", name);
+            if (cfg->dev_name)
+                return NULL;
+            continue;
+        }
+        struct ibv_port_attr port;
+        if (cfg->dev_name ||
+            (!ibv_query_port(ctx, cfg->ib_port, &port) && port.state == IBV_PORT_ACTIVE))
+            return ctx;
+        ibv_close_device(ctx);
+    }
+    if (cfg->dev_name) {
+        RDMA_ERR("device %s not found", cfg->dev_name);
+        return NULL;
+    }
+    /* nothing active: rdma_dev_open() reports the first one's port state */
+    struct ibv_context *ctx = ibv_open_device(list[0]);
+    if (!ctx)
+        RDMA_ERR("ibv_open_device %s failed", ibv_get_device_name(list[0]));
+    return ctx;
+}
+
+/* ::ffff:a.b.c.d */
+static int gid_is_ipv4(const union ibv_gid *gid) {
+    static const uint8_t prefix[12] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff};
+    return !memcmp(gid->raw, prefix, sizeof(prefix));
+}
+
+/*
+ * InfiniBand: 0. RoCE: the first RoCE v2 entry in the port's GID table
+ * with an IPv4-mapped address; else the first RoCE v2 entry; else 0.
+ * The table order decides: with several IPv4 addresses, or VLANs, pass
+ * --gid-idx for the one the peer routes to.
+ */
+static int find_gid_index(struct rdma_dev *dev) {
+    if (dev->port_attr.link_layer != IBV_LINK_LAYER_ETHERNET)
+        return 0;
+
+    int v2 = -1;
+    for (int i = 0; i < dev->port_attr.gid_tbl_len; i++) {
+        struct ibv_gid_entry e;
+        if (ibv_query_gid_ex(dev->ctx, dev->ib_port, i, &e, 0))
+            continue;       /* unpopulated */
+        if (e.gid_type != IBV_GID_TYPE_ROCE_V2)
+            continue;
+        if (gid_is_ipv4(&e.gid))
+            return i;
+        if (v2 < 0)
+            v2 = i;
+    }
+    if (v2 < 0)
+        RDMA_LOG("No RoCE v2 GID on port %u, using index 0", dev->ib_port);
+    return v2 < 0 ? 0 : v2;
+}
+
+struct rdma_dev *rdma_dev_open(const struct rdma_cfg *cfg) {
+    struct ibv_device **dev_list = ibv_get_device_list(NULL);
+    if (!dev_list || !dev_list[0]) {
+        RDMA_ERR("no RDMA device found");
+        if (dev_list)
+            ibv_free_device_list(dev_list);
+        return NULL;
+    }
+
+    struct rdma_dev *dev = calloc(1, sizeof(*dev));
+    dev->ib_port = cfg->ib_port;
+
+    dev->ctx = open_device(dev_list, cfg);
+    ibv_free_device_list(dev_list);
+    if (!dev->ctx)
+        goto err;
+
+    dev->pd = ibv_alloc_pd(dev->ctx);
+    if (!dev->pd) {
+        RDMA_ERR("ibv_alloc_pd failed");
+        goto err;
+    }
+
+    if (ibv_query_device(dev->ctx, &dev->attr)) {
+        RDMA_ERR("ibv_query_device failed");
+        goto err;
+    }
+
+    if (ibv_query_port(dev->ctx, dev->ib_port, &dev->port_attr)) {
+        RDMA_ERR("ibv_query_port %u failed", dev->ib_port);
+        goto err;
+    }
+    if (dev->port_attr.state != IBV_PORT_ACTIVE)
+        RDMA_LOG("Port %u is %s", dev->ib_port, ibv_port_state_str(dev->port_attr.state));
+
+    dev->gid_index = cfg->gid_index >= 0 ? cfg->gid_index : find_gid_index(dev);
+    if (ibv_query_gid(dev->ctx, dev->ib_port, dev->gid_index, &dev->gid)) {
+        RDMA_ERR("ibv_query_gid idx %d failed", dev->gid_index);
+        goto err;
+    }
+    RDMA_LOG("Device %s port %u (%s, active MTU %d) gid_idx %d",
+             ibv_get_device_name(dev->ctx->device), dev->ib_port,
+             dev->port_attr.link_layer == IBV_LINK_LAYER_ETHERNET ? "RoCE" : "InfiniBand",
+             rdma_mtu_to_int(dev->port_attr.active_mtu), dev->gid_index);
+    return dev;
+
+err:
+    rdma_dev_close(dev);
+    return NULL;
+}
+
+void rdma_dev_close(struct rdma_dev *dev) {
+    if (!dev)
+        return;
+    if (dev->pd)
+        ibv_dealloc_pd(dev->pd);
+    if (dev->ctx)
+        ibv_close_device(dev->ctx);
+    free(dev);
+}
+
+int64_t rdma_dev_counter(const struct rdma_dev *dev, const char *name) {
+    static const char *const dirs[] = {"hw_counters", "counters"};
+    char path[256];
+    long long v;
+
+    for (int i = 0; i < 2; i++) {
+        snprintf(path, sizeof(path), "/sys/class/infiniband/%s/ports/%u/%s/%s",
+                 ibv_get_device_name(dev->ctx->device), dev->ib_port, dirs[i], name);
+        FILE *f = fopen(path, "r");
+        if (!f)
+            continue;
+        int ok = fscanf(f, "%lld", &v) == 1;
+        fclose(f);
+        if (ok)
+            return v;
+    }
+    return -1;
+}
+
+/* ---------- connection ---------- */
+
+struct rdma_conn *rdma_conn_create(struct rdma_dev *dev, const struct rdma_cfg *cfg,
+                                   struct ibv_cq *cq) {
+    return rdma_conn_create_srq(dev, cfg, cq, NULL);
+}
+
+struct rdma_conn *rdma_conn_create_srq(struct rdma_dev *dev, const struct rdma_cfg *cfg,
+                                       struct ibv_cq *cq, struct ibv_srq *srq) {
+    struct rdma_conn *conn = calloc(1, sizeof(*conn));
+    conn->dev = dev;
+    conn->cfg = *cfg;
+    conn->sock = -1;
+
+    /* 0 asks for whatever the device supports */
+    if (!conn->cfg.max_rd_atomic)
+        conn->cfg.max_rd_atomic = dev->attr.max_qp_init_rd_atom;
+    if (!conn->cfg.max_dest_rd_atomic)
+        conn->cfg.max_dest_rd_atomic = dev->attr.max_qp_rd_atom;
+    if (conn->cfg.max_send_sge > (uint32_t)dev->attr.max_sge)
+        conn->cfg.max_send_sge = dev->attr.max_sge;
+    if (conn->cfg.max_recv_sge > (uint32_t)dev->attr.max_sge)
+        conn->cfg.max_recv_sge = dev->attr.max_sge;
+
+    if (!cq) {
+        int depth = cfg->cq_depth ? cfg->cq_depth
+                                  : (int)(cfg->max_send_wr + cfg->max_recv_wr);
+        if (cfg->spin_us >= 0) {
+            conn->channel = ibv_create_comp_channel(dev->ctx);
+            if (!conn->channel) {
+                RDMA_ERR("ibv_create_comp_channel failed");
+                free(conn);
+                return NULL;
+            }
+        }
+        cq = ibv_create_cq(dev->ctx, depth, NULL, conn->channel, 0);
+        if (!cq) {
+            RDMA_ERR("ibv_create_cq depth %d failed", depth);
+            if (conn->channel)
+                ibv_destroy_comp_channel(conn->channel);
+            free(conn);
+            return NULL;
+        }
+        conn->own_cq = 1;
+    }
+    conn->send_cq = cq;
+    conn->recv_cq = cq;
+
+    struct ibv_qp_init_attr qpia = {
+        .send_cq = conn->send_cq,
+        .recv_cq = conn->recv_cq,
+        .srq = srq,
+        .qp_type = IBV_QPT_RC,
+        .cap = {
+            .max_send_wr = cfg->max_send_wr,
+            .max_recv_wr = srq ? 0 : cfg->max_recv_wr,
+            .max_send_sge = conn->cfg.max_send_sge,
+            .max_recv_sge = conn->cfg.max_recv_sge,
+            .max_inline_data = cfg->max_inline_data
+        }
+    };
+    /* devices cap inline data differently: back off rather than fail */
+    for (;;) {
+        conn->qp = ibv_create_qp(dev->pd, &qpia);
+        if (conn->qp || !qpia.cap.max_inline_data)
+            break;
+        qpia.cap.max_inline_data /= 2;
+    }
+    if (!conn->qp) {
+        RDMA_ERR("ibv_create_qp failed");
+        goto err;
+    }
+    conn->max_inline = qpia.cap.max_inline_data;
+
+    struct ibv_qp_attr attr = {
+        .qp_state = IBV_QPS_INIT,
+        .port_num = dev->ib_port,
+        .pkey_index = 0,
+        .qp_access_flags = cfg->access_flags
+    };
+    if (ibv_modify_qp(conn->qp, &attr,
+        IBV_QP_STATE |
+        IBV_QP_PORT |
+        IBV_QP_PKEY_INDEX |
+        IBV_QP_ACCESS_FLAGS)) {
+        RDMA_ERR("QP to INIT failed");
+        goto err;
+    }
+
+    conn->local.qp_num = conn->qp->qp_num;
+    memcpy(conn->local.gid, &dev->gid, 16);
+    /* never above the port's active MTU */
+    enum ibv_mtu active = dev->port_attr.active_mtu;
+    conn->local.mtu = cfg->path_mtu && cfg->path_mtu < active ? cfg->path_mtu : active;
+    conn->local.rd_atom = conn->cfg.max_dest_rd_atomic;
+    return conn;
+
+err:
+    rdma_conn_destroy(conn);
+    return NULL;
+}
+
+int rdma_conn_exchange(struct rdma_conn *conn, int sock, enum rdma_role role) {
+    conn->sock = sock;
+
+    /* server speaks first, client answers */
+    if (role == RDMA_ROLE_SERVER) {
+        if (rdma_sock_write(sock, &conn->local, sizeof(conn->local)) ||
+            rdma_sock_read(sock, &conn->remote, sizeof(conn->remote)))
+            return -1;
+    } else {
+        if (rdma_sock_read(sock, &conn->remote, sizeof(conn->remote)) ||
+            rdma_sock_write(sock, &conn->local, sizeof(conn->local)))
+            return -1;
+    }
+    return 0;
+}
+
+int rdma_conn_connect(struct rdma_conn *conn) {
+    const struct rdma_cfg *cfg = &conn->cfg;
+
+    /* the smaller side's; 0 from a peer that did not say */
+    enum ibv_mtu mtu = conn->remote.mtu;
+    if (!mtu || mtu > conn->local.mtu)
+        mtu = conn->local.mtu;
+    conn->cfg.path_mtu = mtu;
+    /* never more READs/atomics in flight than the peer serves */
+    if (conn->remote.rd_atom && conn->remote.rd_atom < conn->cfg.max_rd_atomic)
+        conn->cfg.max_rd_atomic = conn->remote.rd_atom;
+
+    /* ---------- RTR ---------- */
+    struct ibv_qp_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.qp_state = IBV_QPS_RTR;
+    attr.path_mtu = cfg->path_mtu;
+    attr.dest_qp_num = conn->remote.qp_num;
+    attr.rq_psn = 0;
+    attr.max_dest_rd_atomic = cfg->max_dest_rd_atomic;
+    attr.min_rnr_timer = cfg->min_rnr_timer;
+
+    attr.ah_attr.is_global = 1;
+    attr.ah_attr.port_num = conn->dev->ib_port;
+    attr.ah_attr.grh.hop_limit = cfg->hop_limit;
+    attr.ah_attr.grh.sgid_index = conn->dev->gid_index;
+    memcpy(&attr.ah_attr.grh.dgid, conn->remote.gid, 16);
+
+    if (ibv_modify_qp(conn->qp, &attr,
+        IBV_QP_STATE |
+        IBV_QP_AV |
+        IBV_QP_PATH_MTU |
+        IBV_QP_DEST_QPN |
+        IBV_QP_RQ_PSN |
+        IBV_QP_MAX_DEST_RD_ATOMIC |
+        IBV_QP_MIN_RNR_TIMER)) {
+        RDMA_ERR("QP to RTR failed");
+        return -1;
+    }
+
+    /* ---------- RTS ---------- */
+    memset(&attr, 0, sizeof(attr));
+    attr.qp_state = IBV_QPS_RTS;
+    attr.timeout = cfg->timeout;
+    attr.retry_cnt = cfg->retry_cnt;
+    attr.rnr_retry = cfg->rnr_retry;
+    attr.sq_psn = 0;
+    attr.max_rd_atomic = cfg->max_rd_atomic;
+
+    if (ibv_modify_qp(conn->qp, &attr,
+        IBV_QP_STATE |
+        IBV_QP_TIMEOUT |
+        IBV_QP_RETRY_CNT |
+        IBV_QP_RNR_RETRY |
+        IBV_QP_SQ_PSN |
+        IBV_QP_MAX_QP_RD_ATOMIC)) {
+        RDMA_ERR("QP to RTS failed");
+        return -1;
+    }
+    return 0;
+}
+
+int rdma_conn_handshake(struct rdma_conn *conn, int sock, enum rdma_role role) {
+    if (rdma_conn_exchange(conn, sock, role))
+        return -1;
+    return rdma_conn_connect(conn);
+}
+
+void rdma_conn_destroy(struct rdma_conn *conn) {
+    if (!conn)
+        return;
+    if (conn->qp)
+        ibv_destroy_qp(conn->qp);
+    if (conn->own_cq && conn->send_cq)
+        ibv_destroy_cq(conn->send_cq);
+    if (conn->channel)
+        ibv_destroy_comp_channel(conn->channel);
+    if (conn->sock >= 0)
+        close(conn->sock);
+    free(conn);
+}
+
+/* ---------- TCP bootstrap ---------- */
+
+int rdma_tcp_listen(uint16_t port, int backlog) {
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0) {
+        RDMA_ERR("socket failed");
+        return -1;
+    }
+    int one = 1;
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(port),
+        .sin_addr.s_addr = INADDR_ANY
+    };
+    if (bind(sock, (struct sockaddr*)&addr, sizeof(addr)) ||
+        listen(sock, backlog)) {
+        RDMA_ERR("bind/listen on port %u failed", port);
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+int rdma_tcp_connect(const char *host, uint16_t port) {
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0) {
+        RDMA_ERR("socket failed");
+        return -1;
+    }
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(port)
+    };
+    if (inet_pton(AF_INET, host, &addr.sin_addr) != 1) {
+        printf("[RDMA][ERR] bad address %s\n", host);
+        close(sock);
+        return -1;
+    }
+    if (connect(sock, (struct sockaddr*)&addr, sizeof(addr))) {
+        RDMA_ERR("connect %s:%u failed", host, port);
+        close(sock);
+        return -1;
+    }
+    int one = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return sock;
+}
+
+int rdma_sock_write(int sock, const void *buf, size_t len) {
+    const char *p = buf;
+    while (len) {
+        ssize_t n = write(sock, p, len);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0) {
+            RDMA_ERR("socket write failed");
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+int rdma_sock_read(int sock, void *buf, size_t len) {
+    char *p = buf;
+    while (len) {
+        ssize_t n = read(sock, p, len);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0) {
+            RDMA_ERR("socket read failed");
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+int rdma_sock_barrier(int sock) {
+    char c = 0;
+    if (rdma_sock_write(sock, &c, 1) || rdma_sock_read(sock, &c, 1))
+        return -1;
+    return 0;
+}
@@ -0,0 +1,167 @@
+#pragma once
+#include <stdint.h>
+#include <getopt.h>
+#include <infiniband/verbs.h>
+#include "rdma_common.h"
+
+#define RDMA_TCP_PORT 18515
+
+/* ---------- tunables shared by every program ---------- */
+struct rdma_cfg {
+    const char  *dev_name;          /* NULL: the first device whose ib_port is ACTIVE */
+    uint8_t      ib_port;
+    int          gid_index;         /* -1: discovered, see rdma_dev_open() */
+    enum ibv_mtu path_mtu;          /* 0: the port's active MTU; the peer's may lower it */
+    uint16_t     tcp_port;
+
+    int          cq_depth;          /* 0: max_send_wr + max_recv_wr */
+    uint32_t     max_send_wr;
+    uint32_t     max_recv_wr;
+    uint32_t     max_send_sge;      /* capped at the device's max_sge */
+    uint32_t     max_recv_sge;
+    uint32_t     max_inline_data;   /* requested; halved until the device accepts */
+    int          poll_batch;        /* CQEs drained per ibv_poll_cq */
+    int          cq_hist;           /* print the CQEs-per-poll histogram */
+    int          spin_us;           /* -1: busy-poll only; else spin this long, then sleep */
+
+    uint8_t      hop_limit;
+    uint8_t      timeout;
+    uint8_t      retry_cnt;
+    uint8_t      rnr_retry;
+    uint8_t      min_rnr_timer;
+    uint8_t      max_rd_atomic;      /* 0: device max_qp_init_rd_atom; the peer may lower it */
+    uint8_t      max_dest_rd_atomic; /* 0: device max_qp_rd_atom */
+    int          access_flags;
+};
+
+enum {
+    RDMA_OPT_DEV = 0x100,
+    RDMA_OPT_IB_PORT,
+    RDMA_OPT_GID_INDEX,
+    RDMA_OPT_MTU,
+    RDMA_OPT_TCP_PORT,
+    RDMA_OPT_CQ_DEPTH,
+    RDMA_OPT_SQ_DEPTH,
+    RDMA_OPT_RQ_DEPTH,
+    RDMA_OPT_HOP_LIMIT,
+    RDMA_OPT_TIMEOUT,
+    RDMA_OPT_RETRY,
+    RDMA_OPT_RNR_RETRY,
+    RDMA_OPT_RNR_TIMER,
+    RDMA_OPT_POLL_BATCH,
+    RDMA_OPT_CQ_HIST,
+    RDMA_OPT_INLINE,
+    RDMA_OPT_RD_ATOMIC,
+    RDMA_OPT_SPIN_US,
+    RDMA_OPT_SGE,
+};
+
+/* splice into a program's getopt_long() option table */
+#define RDMA_CFG_LONG_OPTIONS \
+    {"dev",       required_argument, NULL, RDMA_OPT_DEV}, \
+    {"ib-port",   required_argument, NULL, RDMA_OPT_IB_PORT}, \
+    {"gid-idx",   required_argument, NULL, RDMA_OPT_GID_INDEX}, \
+    {"mtu",       required_argument, NULL, RDMA_OPT_MTU}, \
+    {"tcp-port",  required_argument, NULL, RDMA_OPT_TCP_PORT}, \
+    {"cq-depth",  required_argument, NULL, RDMA_OPT_CQ_DEPTH}, \
+    {"sq-depth",  required_argument, NULL, RDMA_OPT_SQ_DEPTH}, \
+    {"rq-depth",  required_argument, NULL, RDMA_OPT_RQ_DEPTH}, \
+    {"hop-limit", required_argument, NULL, RDMA_OPT_HOP_LIMIT}, \
+    {"timeout",   required_argument, NULL, RDMA_OPT_TIMEOUT}, \
+    {"retry",     required_argument, NULL, RDMA_OPT_RETRY}, \
+    {"rnr-retry", required_argument, NULL, RDMA_OPT_RNR_RETRY}, \
+    {"rnr-timer", required_argument, NULL, RDMA_OPT_RNR_TIMER}, \
+    {"poll-batch", required_argument, NULL, RDMA_OPT_POLL_BATCH}, \
+    {"cq-hist",   no_argument,       NULL, RDMA_OPT_CQ_HIST}, \
+    {"inline",    required_argument, NULL, RDMA_OPT_INLINE}, \
+    {"rd-atomic", required_argument, NULL, RDMA_OPT_RD_ATOMIC}, \
+    {"spin-us",   required_argument, NULL, RDMA_OPT_SPIN_US}, \
+    {"sge",       required_argument, NULL, RDMA_OPT_SGE}
+
+void rdma_cfg_init(struct rdma_cfg *cfg);
+/* returns 0 if opt was one of RDMA_CFG_LONG_OPTIONS, -1 otherwise */
+int  rdma_cfg_parse_opt(struct rdma_cfg *cfg, int opt, const char *arg);
+void rdma_cfg_usage(void);
+
+enum ibv_mtu rdma_mtu_from_int(int mtu);
+int          rdma_mtu_to_int(enum ibv_mtu mtu);
+
+/* ---------- device: one per process, shared by all connections ---------- */
+struct rdma_dev {
+    struct ibv_context *ctx;
+    struct ibv_pd      *pd;
+    uint8_t             ib_port;
+    int                 gid_index;
+    union ibv_gid       gid;
+    struct ibv_device_attr attr;
+    struct ibv_port_attr port_attr;     /* ib_port's, at open */
+};
+
+/*
+ * Open cfg->dev_name, or the first device whose port is ACTIVE. With
+ * cfg->gid_index < 0 the GID is discovered: index 0 on InfiniBand, on
+ * RoCE the first RoCE v2 entry holding an IPv4 address (else the first
+ * RoCE v2 entry, else 0).
+ */
+struct rdma_dev *rdma_dev_open(const struct rdma_cfg *cfg);
+void             rdma_dev_close(struct rdma_dev *dev);
+/*
+ * A port counter from sysfs, hw_counters/<name> or counters/<name>, e.g.
+ * out_of_buffer: packets that found no receive posted (RNR NAKs sent).
+ * -1 if the driver does not expose it.
+ */
+int64_t          rdma_dev_counter(const struct rdma_dev *dev, const char *name);
+
+/* ---------- connection: one RC QP plus its qp_info exchange ---------- */
+enum rdma_role {
+    RDMA_ROLE_SERVER,
+    RDMA_ROLE_CLIENT,
+};
+
+struct rdma_conn {
+    struct rdma_dev *dev;
+    struct rdma_cfg  cfg;
+    struct ibv_cq   *send_cq;
+    struct ibv_cq   *recv_cq;
+    int              own_cq;
+    struct ibv_comp_channel *channel;   /* own CQ's, when cfg.spin_us >= 0 */
+    struct ibv_qp   *qp;
+    uint32_t         max_inline;        /* granted max_inline_data */
+    struct qp_info   local;
+    struct qp_info   remote;
+    int              sock;
+};
+
+/*
+ * Create the QP and move it to INIT. With cq == NULL the connection
+ * creates (and later destroys) its own CQ of cfg->cq_depth entries,
+ * attached to a completion channel when cfg->spin_us >= 0.
+ */
+struct rdma_conn *rdma_conn_create(struct rdma_dev *dev, const struct rdma_cfg *cfg,
+                                   struct ibv_cq *cq);
+/* same, but receives come from srq and cfg->max_recv_wr is ignored */
+struct rdma_conn *rdma_conn_create_srq(struct rdma_dev *dev, const struct rdma_cfg *cfg,
+                                       struct ibv_cq *cq, struct ibv_srq *srq);
+/* swap qp_info over sock; set local.addr/rkey before calling */
+int  rdma_conn_exchange(struct rdma_conn *conn, int sock, enum rdma_role role);
+/*
+ * INIT -> RTR -> RTS against conn->remote; cfg.path_mtu becomes the
+ * smaller side's, cfg.max_rd_atomic at most the peer's max_dest_rd_atomic
+ */
+int  rdma_conn_connect(struct rdma_conn *conn);
+/* rdma_conn_exchange() followed by rdma_conn_connect() */
+int  rdma_conn_handshake(struct rdma_conn *conn, int sock, enum rdma_role role);
+void rdma_conn_destroy(struct rdma_conn *conn);
+
+/* IBV_SEND_INLINE when a payload of len bytes fits the QP's inline limit */
+static inline unsigned int rdma_inline_flag(const struct rdma_conn *conn, size_t len) {
+    return len <= conn->max_inline ? IBV_SEND_INLINE : 0;
+}
+
+/* ---------- TCP bootstrap ---------- */
+int rdma_tcp_listen(uint16_t port, int backlog);
+int rdma_tcp_connect(const char *host, uint16_t port);
+int rdma_sock_write(int sock, const void *buf, size_t len);
+int rdma_sock_read(int sock, void *buf, size_t len);
+/* both sides call it; returns once the peer has reached the same point */
+int rdma_sock_barrier(int sock);
@@ -0,0 +1,291 @@
+#pragma once
+#include <coroutine>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <infiniband/verbs.h>
+extern "C" {
+#include "rdma_conn.h"
+#include "rdma_poll.h"
+}
+
+/*
+ * C++20 coroutines over the completion queue.
+ *
+ *     rdma::task worker(rdma::connection &c, rdma::buf b, rdma::remote r) {
+ *         rdma::result res = co_await c.read(b, r);
+ *         ...
+ *     }
+ *     sched.spawn(worker(conn, b, r));
+ *     sched.run();
+ *
+ * Every awaited operation is one signaled WR whose wr_id points at the
+ * awaiter living in the suspended coroutine's frame; the scheduler polls
+ * the CQ and resumes whoever each completion names. A connection counts
+ * its send and receive queue credits and parks operations that find the
+ * queue full, posting them as completions come back, so any number of
+ * coroutines can have an operation in flight on one QP.
+ *
+ * Single-threaded: one scheduler per thread, owning every CQ of its
+ * connections. Buffers must stay registered until the awaited op resumes.
+ */
+namespace rdma {
+
+struct result {
+    enum ibv_wc_status  status;
+    uint32_t            bytes;          /* receives: bytes that arrived */
+
+    bool ok() const { return status == IBV_WC_SUCCESS; }
+};
+
+/* registered local memory */
+struct buf {
+    void       *addr;
+    uint32_t    len;
+    uint32_t    lkey;
+};
+
+/* the peer's memory, as exported in qp_info */
+struct remote {
+    uint64_t    addr;
+    uint32_t    rkey;
+};
+
+class scheduler;
+class connection;
+
+/* a detached coroutine, started (and later destroyed) by scheduler::spawn() */
+class task {
+public:
+    struct promise_type {
+        scheduler  *sched = nullptr;
+
+        task get_return_object() {
+            return task(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+        ~promise_type();
+    };
+
+    task(task &&o) noexcept : h_(o.h_) { o.h_ = nullptr; }
+    task(const task &) = delete;
+    ~task() {
+        if (h_)
+            h_.destroy();
+    }
+
+private:
+    friend class scheduler;
+    explicit task(std::coroutine_handle<promise_type> h) : h_(h) {}
+    std::coroutine_handle<promise_type> h_;
+};
+
+/* one WR, awaited */
+class op {
+public:
+    enum kind { SEND, RECV, READ, WRITE };
+
+    op(connection &c, kind k, const buf &b, const remote &r = {})
+        : conn_(c), kind_(k), sge_{(uintptr_t)b.addr, b.len, b.lkey}, remote_(r) {}
+
+    bool await_ready() const noexcept { return false; }
+    bool await_suspend(std::coroutine_handle<> h);
+    result await_resume() const noexcept { return res_; }
+
+private:
+    friend class connection;
+    friend class scheduler;
+
+    connection             &conn_;
+    kind                    kind_;
+    struct ibv_sge          sge_;
+    remote                  remote_;
+    std::coroutine_handle<> h_;
+    result                  res_{IBV_WC_SUCCESS, 0};
+    op                     *next_ = nullptr;    /* waiting for a queue credit */
+};
+
+/* an RC QP (rdma_conn) whose completions go to one scheduler */
+class connection {
+public:
+    connection(scheduler &s, struct rdma_conn *c)
+        : sched_(s), conn_(c), sq_depth_(c->cfg.max_send_wr), rq_depth_(c->cfg.max_recv_wr) {}
+
+    op send(const buf &b) { return op(*this, op::SEND, b); }
+    op recv(const buf &b) { return op(*this, op::RECV, b); }
+    /* remote -> b */
+    op read(const buf &b, const remote &r) { return op(*this, op::READ, b, r); }
+    /* b -> remote */
+    op write(const buf &b, const remote &r) { return op(*this, op::WRITE, b, r); }
+
+    struct rdma_conn *raw() const { return conn_; }
+    uint64_t parked() const { return parked_; }
+
+private:
+    friend class op;
+    friend class scheduler;
+
+    /* post now, or park until a credit comes back; false if the post failed */
+    bool submit(op *o);
+    bool post(op *o);
+    void complete(op *o);
+
+    scheduler          &sched_;
+    struct rdma_conn   *conn_;
+    uint32_t            sq_depth_, rq_depth_;
+    uint32_t            sq_used_ = 0, rq_used_ = 0;
+    op                 *sq_wait_ = nullptr, *sq_wait_tail_ = nullptr;
+    op                 *rq_wait_ = nullptr, *rq_wait_tail_ = nullptr;
+    uint64_t            parked_ = 0;
+};
+
+class scheduler {
+public:
+    explicit scheduler(struct ibv_cq *cq) : cq_(cq) {}
+
+    void spawn(task t) {
+        auto h = t.h_;
+        t.h_ = nullptr;
+        h.promise().sched = this;
+        live_++;
+        h.resume();
+    }
+
+    /* let the other ready coroutines run */
+    struct yield_op {
+        scheduler &s;
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> h) { s.ready_.push_back(h); }
+        void await_resume() const noexcept {}
+    };
+    yield_op yield() { return yield_op{*this}; }
+
+    /* reap one batch and resume its coroutines; returns WCs seen or -1 */
+    int poll() {
+        struct ibv_wc wc[RDMA_POLL_MAX_BATCH];
+        int n = ibv_poll_cq(cq_, RDMA_POLL_MAX_BATCH, wc);
+        if (n < 0) {
+            RDMA_ERR("ibv_poll_cq failed");
+            return -1;
+        }
+        for (int i = 0; i < n; i++) {
+            op *o = reinterpret_cast<op *>(wc[i].wr_id);
+            o->res_ = {wc[i].status, wc[i].byte_len};
+            o->conn_.complete(o);
+            o->h_.resume();
+        }
+        return n;
+    }
+
+    /* until every spawned task has returned; -1 on a CQ error */
+    int run() {
+        while (live_) {
+            while (!ready_.empty()) {
+                auto h = ready_.front();
+                ready_.pop_front();
+                h.resume();
+            }
+            if (live_ && poll() < 0)
+                return -1;
+        }
+        return 0;
+    }
+
+    uint64_t live() const { return live_; }
+
+private:
+    friend class connection;
+    friend struct task::promise_type;
+
+    struct ibv_cq                          *cq_;
+    uint64_t                                live_ = 0;
+    std::deque<std::coroutine_handle<>>     ready_;
+};
+
+inline task::promise_type::~promise_type() {
+    if (sched)
+        sched->live_--;
+}
+
+inline bool op::await_suspend(std::coroutine_handle<> h) {
+    h_ = h;
+    /* a refused post resumes at once, with the error in the result */
+    return conn_.submit(this);
+}
+
+inline bool connection::post(op *o) {
+    if (o->kind_ == op::RECV) {
+        struct ibv_recv_wr wr = {}, *bad;
+        wr.wr_id = reinterpret_cast<uintptr_t>(o);
+        wr.sg_list = &o->sge_;
+        wr.num_sge = 1;
+        if (ibv_post_recv(conn_->qp, &wr, &bad)) {
+            RDMA_ERR("ibv_post_recv failed");
+            return false;
+        }
+        rq_used_++;
+        return true;
+    }
+    static const enum ibv_wr_opcode opcodes[] = {IBV_WR_SEND, IBV_WR_SEND, IBV_WR_RDMA_READ,
+                                                 IBV_WR_RDMA_WRITE};
+    struct ibv_send_wr wr = {}, *bad;
+    wr.wr_id = reinterpret_cast<uintptr_t>(o);
+    wr.opcode = opcodes[o->kind_];
+    wr.sg_list = &o->sge_;
+    wr.num_sge = 1;
+    wr.send_flags = IBV_SEND_SIGNALED;
+    if (o->kind_ != op::READ)
+        wr.send_flags |= rdma_inline_flag(conn_, o->sge_.length);
+    wr.wr.rdma.remote_addr = o->remote_.addr;
+    wr.wr.rdma.rkey = o->remote_.rkey;
+    if (ibv_post_send(conn_->qp, &wr, &bad)) {
+        RDMA_ERR("ibv_post_send failed");
+        return false;
+    }
+    sq_used_++;
+    return true;
+}
+
+inline bool connection::submit(op *o) {
+    bool recv = o->kind_ == op::RECV;
+    if ((recv ? rq_used_ < rq_depth_ : sq_used_ < sq_depth_)) {
+        if (post(o))
+            return true;
+        o->res_ = {IBV_WC_GENERAL_ERR, 0};
+        return false;
+    }
+    op *&head = recv ? rq_wait_ : sq_wait_;
+    op *&tail = recv ? rq_wait_tail_ : sq_wait_tail_;
+    o->next_ = nullptr;
+    if (tail)
+        tail->next_ = o;
+    else
+        head = o;
+    tail = o;
+    parked_++;
+    return true;
+}
+
+/* o's WR is done: hand its credit to the first op parked for the same queue */
+inline void connection::complete(op *o) {
+    bool recv = o->kind_ == op::RECV;
+    (recv ? rq_used_ : sq_used_)--;
+    op *&head = recv ? rq_wait_ : sq_wait_;
+    op *&tail = recv ? rq_wait_tail_ : sq_wait_tail_;
+    while (head) {
+        op *w = head;
+        head = w->next_;
+        if (!head)
+            tail = nullptr;
+        if (post(w))
+            break;
+        /* resumed through the ready queue so the caller's loop stays flat */
+        w->res_ = {IBV_WC_GENERAL_ERR, 0};
+        sched_.ready_.push_back(w->h_);
+    }
+}
+
+} // namespace rdma
@@ -0,0 +1,211 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <arpa/inet.h>
+#include <infiniband/verbs.h>
+#include "rdma_fc.h"
+#include "rdma_poll.h"
+
+/* wr_id: kind << 32 | buffer index */
+enum { WR_RECV, WR_SEND, WR_CREDIT };
+
+#define WR_ID(kind, idx)  ((uint64_t)(kind) << 32 | (idx))
+
+static int post_recv(struct rdma_fc *fc, uint32_t slot) {
+    struct rdma_buf *b = &fc->rx->bufs[slot];
+    struct ibv_sge sge = {
+        .addr = (uintptr_t)b->addr,
+        .length = fc->max_msg,
+        .lkey = b->lkey
+    };
+    struct ibv_recv_wr wr = {
+        .wr_id = WR_ID(WR_RECV, slot),
+        .sg_list = &sge,
+        .num_sge = 1
+    }, *bad;
+    if (ibv_post_recv(fc->conn->qp, &wr, &bad)) {
+        RDMA_ERR("ibv_post_recv flow control buffer %u failed", slot);
+        return -1;
+    }
+    return 0;
+}
+
+int rdma_fc_init(struct rdma_fc *fc, struct rdma_conn *conn, uint32_t depth, uint32_t max_msg) {
+    memset(fc, 0, sizeof(*fc));
+    fc->conn = conn;
+    fc->depth = depth;
+    fc->max_msg = max_msg;
+
+    fc->rx = rdma_pool_create(conn->dev->pd, max_msg, depth, IBV_ACCESS_LOCAL_WRITE);
+    fc->tx = rdma_pool_create(conn->dev->pd, max_msg, depth, IBV_ACCESS_LOCAL_WRITE);
+    fc->line = rdma_pool_create(conn->dev->pd, 2 * sizeof(uint32_t), 1,
+                                IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_WRITE);
+    fc->tx_free = calloc(depth, sizeof(*fc->tx_free));
+    fc->rx_slot = calloc(depth, sizeof(*fc->rx_slot));
+    fc->rx_len = calloc(depth, sizeof(*fc->rx_len));
+    if (!fc->rx || !fc->tx || !fc->line || !fc->tx_free || !fc->rx_slot || !fc->rx_len) {
+        rdma_fc_fini(fc);
+        return -1;
+    }
+    struct rdma_buf *l = &fc->line->bufs[0];
+    fc->credit = l->addr;
+    fc->credit_src = (uint32_t *)l->addr + 1;
+    *fc->credit = 0;
+    conn->local.addr = (uintptr_t)l->addr;
+    conn->local.rkey = l->rkey;
+    conn->local.len = sizeof(uint32_t);
+
+    for (uint32_t i = 0; i < depth; i++)
+        fc->tx_free[fc->tx_nfree++] = depth - 1 - i;
+    for (uint32_t i = 0; i < depth; i++) {
+        if (post_recv(fc, i)) {
+            rdma_fc_fini(fc);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void rdma_fc_fini(struct rdma_fc *fc) {
+    rdma_pool_destroy(fc->rx);
+    rdma_pool_destroy(fc->tx);
+    rdma_pool_destroy(fc->line);
+    free(fc->tx_free);
+    free(fc->rx_slot);
+    free(fc->rx_len);
+    memset(fc, 0, sizeof(*fc));
+}
+
+/* the peer's count: from the last message or its credit WRITE, whichever is ahead */
+static void take_credits(struct rdma_fc *fc, uint32_t reposted) {
+    if ((int32_t)(reposted - fc->peer_reposted) > 0)
+        fc->peer_reposted = reposted;
+}
+
+uint32_t rdma_fc_credits(struct rdma_fc *fc) {
+    take_credits(fc, *fc->credit);
+    return fc->depth - (fc->sent - fc->peer_reposted);
+}
+
+int rdma_fc_send(struct rdma_fc *fc, const void *msg, uint32_t len) {
+    if (len > fc->max_msg) {
+        RDMA_LOG("flow control: %u byte message, max %u", len, fc->max_msg);
+        return -1;
+    }
+    if (!fc->tx_nfree || !rdma_fc_credits(fc)) {
+        fc->stalls++;
+        return 1;
+    }
+    uint32_t slot = fc->tx_free[--fc->tx_nfree];
+    struct rdma_buf *b = &fc->tx->bufs[slot];
+    memcpy(b->addr, msg, len);
+    struct ibv_sge sge = {
+        .addr = (uintptr_t)b->addr,
+        .length = len,
+        .lkey = b->lkey
+    };
+    struct ibv_send_wr wr = {
+        .wr_id = WR_ID(WR_SEND, slot),
+        .sg_list = &sge,
+        .num_sge = 1,
+        .opcode = IBV_WR_SEND_WITH_IMM,
+        .send_flags = IBV_SEND_SIGNALED | rdma_inline_flag(fc->conn, len),
+        .imm_data = htonl(fc->reposted)
+    }, *bad;
+    if (ibv_post_send(fc->conn->qp, &wr, &bad)) {
+        RDMA_ERR("ibv_post_send flow control message of %u bytes failed", len);
+        fc->tx_free[fc->tx_nfree++] = slot;
+        return -1;
+    }
+    fc->advertised = fc->reposted;
+    fc->sent++;
+    return 0;
+}
+
+/* WRITE the reposted count once half the window is owed or the peer has none left */
+static int return_credits(struct rdma_fc *fc) {
+    uint32_t owed = fc->reposted - fc->advertised;
+    uint32_t peer_credits = fc->depth - (fc->arrived - fc->advertised);
+
+    if (!owed || fc->credit_busy || (owed < fc->depth / 2 && peer_credits))
+        return 0;
+
+    /* a later WRITE may carry a newer count than it was posted for: harmless */
+    *fc->credit_src = fc->reposted;
+    struct ibv_sge sge = {
+        .addr = (uintptr_t)fc->credit_src,
+        .length = sizeof(uint32_t),
+        .lkey = fc->line->bufs[0].lkey
+    };
+    struct ibv_send_wr wr = {
+        .wr_id = WR_ID(WR_CREDIT, 0),
+        .sg_list = &sge,
+        .num_sge = 1,
+        .opcode = IBV_WR_RDMA_WRITE,
+        .send_flags = IBV_SEND_SIGNALED | rdma_inline_flag(fc->conn, sizeof(uint32_t))
+    }, *bad;
+    wr.wr.rdma.remote_addr = fc->conn->remote.addr;
+    wr.wr.rdma.rkey = fc->conn->remote.rkey;
+    if (ibv_post_send(fc->conn->qp, &wr, &bad)) {
+        RDMA_ERR("ibv_post_send credit WRITE failed");
+        return -1;
+    }
+    fc->advertised = fc->reposted;
+    fc->credit_busy = 1;
+    fc->updates++;
+    return 0;
+}
+
+const void *rdma_fc_peek(struct rdma_fc *fc, uint32_t *len) {
+    if (fc->rx_head == fc->rx_tail)
+        return NULL;
+    uint32_t i = fc->rx_head % fc->depth;
+    *len = fc->rx_len[i];
+    return fc->rx->bufs[fc->rx_slot[i]].addr;
+}
+
+int rdma_fc_release(struct rdma_fc *fc) {
+    uint32_t slot = fc->rx_slot[fc->rx_head++ % fc->depth];
+
+    if (post_recv(fc, slot))
+        return -1;
+    fc->reposted++;
+    return return_credits(fc);
+}
+
+int rdma_fc_poll(struct rdma_fc *fc) {
+    struct ibv_wc wc[RDMA_POLL_MAX_BATCH];
+
+    int n = ibv_poll_cq(fc->conn->send_cq, RDMA_POLL_MAX_BATCH, wc);
+    if (n < 0) {
+        RDMA_ERR("ibv_poll_cq failed");
+        return -1;
+    }
+    for (int i = 0; i < n; i++) {
+        uint32_t idx = (uint32_t)wc[i].wr_id;
+        if (wc[i].status != IBV_WC_SUCCESS) {
+            RDMA_LOG("flow control WR %#lx failed status=%s", wc[i].wr_id,
+                     ibv_wc_status_str(wc[i].status));
+            return -1;
+        }
+        switch (wc[i].wr_id >> 32) {
+        case WR_SEND:
+            fc->tx_free[fc->tx_nfree++] = idx;
+            break;
+        case WR_CREDIT:
+            fc->credit_busy = 0;
+            break;
+        case WR_RECV:
+            take_credits(fc, ntohl(wc[i].imm_data));
+            fc->rx_slot[fc->rx_tail % fc->depth] = idx;
+            fc->rx_len[fc->rx_tail % fc->depth] = wc[i].byte_len;
+            fc->rx_tail++;
+            fc->arrived++;
+            break;
+        }
+    }
+    if (return_credits(fc))
+        return -1;
+    return n;
+}
@@ -0,0 +1,78 @@
+#pragma once
+#include <stdint.h>
+#include <infiniband/verbs.h>
+#include "rdma_conn.h"
+#include "rdma_pool.h"
+
+/*
+ * Credit-based flow control for SEND/RECV on one RC QP.
+ *
+ * Each side posts depth receives of max_msg bytes. A sender may have
+ * depth - (sent - reposted) messages outstanding, where reposted is the
+ * peer's count of receives it has posted again; rdma_fc_send() refuses
+ * anything beyond that, so a message never finds the receive queue
+ * empty and RNR NAKs (with their millisecond back-off) cannot happen.
+ * Arrived messages are handed out in order by peek(); release()
+ * reposts the buffer.
+ *
+ * The reposted count travels in the immediate data of every message,
+ * so replies carry credits for free. A side with nothing to send
+ * RDMA WRITEs it into the peer's credit word instead, once half the
+ * window is owed or as soon as the peer has run out. Those updates use
+ * no receive, so they are never owed back themselves. Counts are
+ * 32 bit and wrap; the newer of two is the one ahead modulo 2^32.
+ */
+struct rdma_fc {
+    struct rdma_conn   *conn;
+    uint32_t            depth;
+    uint32_t            max_msg;
+
+    struct rdma_pool   *rx;             /* depth receives */
+    struct rdma_pool   *tx;             /* depth messages in flight */
+    uint32_t           *tx_free;
+    uint32_t            tx_nfree;
+
+    /* exported as conn->local: [0] takes the peer's count, [1] sends ours */
+    struct rdma_pool   *line;
+    volatile uint32_t  *credit;
+    uint32_t           *credit_src;
+    int                 credit_busy;    /* a credit WRITE is in flight */
+
+    /* send half */
+    uint32_t            sent;
+    uint32_t            peer_reposted;  /* newest count seen from the peer */
+
+    /* receive half */
+    uint32_t            arrived;
+    uint32_t            reposted;
+    uint32_t            advertised;     /* reposted as last sent to the peer */
+    uint32_t           *rx_slot;        /* arrived messages, oldest at head */
+    uint32_t           *rx_len;
+    uint32_t            rx_head, rx_tail;
+
+    uint64_t            updates;        /* credit WRITEs */
+    uint64_t            stalls;         /* sends refused for lack of credit */
+};
+
+/*
+ * conn needs max_send_wr >= depth + 1, max_recv_wr >= depth and
+ * IBV_ACCESS_REMOTE_WRITE; both sides use the same depth and max_msg.
+ * Posts the receives and sets conn->local, so call it before the
+ * handshake.
+ */
+int  rdma_fc_init(struct rdma_fc *fc, struct rdma_conn *conn, uint32_t depth, uint32_t max_msg);
+void rdma_fc_fini(struct rdma_fc *fc);
+
+/* messages that may be sent right now */
+uint32_t rdma_fc_credits(struct rdma_fc *fc);
+
+/* copy len bytes out; 0: sent, 1: no credit or send buffer, poll and retry, -1: error */
+int  rdma_fc_send(struct rdma_fc *fc, const void *msg, uint32_t len);
+
+/* the oldest arrived message, or NULL */
+const void *rdma_fc_peek(struct rdma_fc *fc, uint32_t *len);
+/* done with what peek returned: repost it and return credits when due */
+int  rdma_fc_release(struct rdma_fc *fc);
+
+/* reap completions, queue arrivals, return credits; returns WCs seen or -1 */
+int  rdma_fc_poll(struct rdma_fc *fc);
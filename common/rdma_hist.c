@@ -0,0 +1,80 @@
+#include <stdio.h>
+#include <string.h>
+#include "rdma_hist.h"
+
+static int bucket_of(uint64_t v) {
+    if (v < RDMA_HIST_SUB)
+        return v;
+    int msb = 63 - __builtin_clzll(v);
+    int shift = msb - RDMA_HIST_SUB_BITS;
+    return ((shift + 1) << RDMA_HIST_SUB_BITS) + ((v >> shift) & (RDMA_HIST_SUB - 1));
+}
+
+static uint64_t bucket_mid(int idx) {
+    if (idx < RDMA_HIST_SUB)
+        return idx;
+    int shift = (idx >> RDMA_HIST_SUB_BITS) - 1;
+    uint64_t low = (uint64_t)(RDMA_HIST_SUB + (idx & (RDMA_HIST_SUB - 1))) << shift;
+    return low + ((1ull << shift) >> 1);
+}
+
+void rdma_hist_init(struct rdma_hist *h) {
+    memset(h, 0, sizeof(*h));
+    h->min = UINT64_MAX;
+}
+
+void rdma_hist_add(struct rdma_hist *h, uint64_t v) {
+    h->bucket[bucket_of(v)]++;
+    h->count++;
+    h->sum += v;
+    if (v < h->min)
+        h->min = v;
+    if (v > h->max)
+        h->max = v;
+}
+
+void rdma_hist_merge(struct rdma_hist *dst, const struct rdma_hist *src) {
+    for (int i = 0; i < RDMA_HIST_NBUCKETS; i++)
+        dst->bucket[i] += src->bucket[i];
+    dst->count += src->count;
+    dst->sum += src->sum;
+    if (src->min < dst->min)
+        dst->min = src->min;
+    if (src->max > dst->max)
+        dst->max = src->max;
+}
+
+uint64_t rdma_hist_percentile(const struct rdma_hist *h, double q) {
+    if (!h->count)
+        return 0;
+    uint64_t rank = (uint64_t)(q * h->count);
+    if (rank >= h->count)
+        rank = h->count - 1;
+
+    uint64_t seen = 0;
+    for (int i = 0; i < RDMA_HIST_NBUCKETS; i++) {
+        seen += h->bucket[i];
+        if (seen > rank) {
+            uint64_t v = bucket_mid(i);
+            /* the exact extremes are known, never report past them */
+            return v < h->min ? h->min : v > h->max ? h->max : v;
+        }
+    }
+    return h->max;
+}
+
+void rdma_hist_header(void) {
+    printf(" %-10s %-10s %-10s %-10s %-10s %-10s %-10s %-10s\n",
+           "#bytes", "#iters", "min[us]", "p50[us]", "p99[us]", "p99.9[us]", "max[us]", "avg[us]");
+}
+
+void rdma_hist_print(const struct rdma_hist *h, uint64_t size) {
+    printf(" %-10lu %-10lu %-10.2f %-10.2f %-10.2f %-10.2f %-10.2f %-10.2f\n",
+           size, h->count,
+           h->count ? h->min / 1e3 : 0.0,
+           rdma_hist_percentile(h, 0.50) / 1e3,
+           rdma_hist_percentile(h, 0.99) / 1e3,
+           rdma_hist_percentile(h, 0.999) / 1e3,
+           h->max / 1e3,
+           h->count ? h->sum / h->count / 1e3 : 0.0);
+}
@@ -0,0 +1,30 @@
+#pragma once
+#include <stdint.h>
+
+/*
+ * Log-bucketed latency histogram: values below 16 get exact buckets,
+ * every power of two above that is split into 16 linear sub-buckets,
+ * so a percentile is off by at most 1/16 of its value.
+ */
+#define RDMA_HIST_SUB_BITS  4
+#define RDMA_HIST_SUB       (1 << RDMA_HIST_SUB_BITS)
+#define RDMA_HIST_NBUCKETS  ((64 - RDMA_HIST_SUB_BITS + 1) << RDMA_HIST_SUB_BITS)
+
+struct rdma_hist {
+    uint64_t count;
+    uint64_t min;
+    uint64_t max;
+    double   sum;
+    uint64_t bucket[RDMA_HIST_NBUCKETS];
+};
+
+void     rdma_hist_init(struct rdma_hist *h);
+void     rdma_hist_add(struct rdma_hist *h, uint64_t v);
+/* fold src into dst, e.g. per-thread histograms into a total */
+void     rdma_hist_merge(struct rdma_hist *dst, const struct rdma_hist *src);
+/* value at quantile q in [0, 1]; the midpoint of the bucket it falls in */
+uint64_t rdma_hist_percentile(const struct rdma_hist *h, double q);
+
+/* one row per histogram, values in ns printed as usec */
+void     rdma_hist_header(void);
+void     rdma_hist_print(const struct rdma_hist *h, uint64_t size);
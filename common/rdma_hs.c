@@ -0,0 +1,75 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <infiniband/verbs.h>
+#include "rdma_hs.h"
+
+int rdma_hs_send(int sock, uint32_t seq, const struct qp_info *recs, uint32_t n) {
+    struct rdma_hs_hdr hdr = { .count = n, .seq = seq };
+    if (rdma_sock_write(sock, &hdr, sizeof(hdr)))
+        return -1;
+    return n ? rdma_sock_write(sock, recs, (size_t)n * sizeof(*recs)) : 0;
+}
+
+int rdma_hs_recv(int sock, uint32_t *seq, struct qp_info *recs, uint32_t max) {
+    struct rdma_hs_hdr hdr;
+    if (rdma_sock_read(sock, &hdr, sizeof(hdr)))
+        return -1;
+    if (hdr.count > max) {
+        RDMA_LOG("handshake batch of %u records, expected at most %u", hdr.count, max);
+        return -1;
+    }
+    if (seq)
+        *seq = hdr.seq;
+    if (hdr.count && rdma_sock_read(sock, recs, (size_t)hdr.count * sizeof(*recs)))
+        return -1;
+    return hdr.count;
+}
+
+struct connect_job {
+    struct rdma_conn **conns;
+    uint32_t           first, n, stride;
+    int                ret;
+};
+
+static void *connect_worker(void *arg) {
+    struct connect_job *job = arg;
+    for (uint32_t i = job->first; i < job->n; i += job->stride) {
+        if (rdma_conn_connect(job->conns[i])) {
+            job->ret = -1;
+            break;
+        }
+    }
+    return NULL;
+}
+
+int rdma_conn_connect_many(struct rdma_conn **conns, uint32_t n, int nthreads) {
+    if (nthreads < 1)
+        nthreads = 1;
+    if ((uint32_t)nthreads > n)
+        nthreads = n ? n : 1;
+
+    pthread_t tid[nthreads];
+    int spawned[nthreads];
+    struct connect_job jobs[nthreads];
+    for (int i = 0; i < nthreads; i++) {
+        jobs[i] = (struct connect_job) {
+            .conns = conns, .first = i, .n = n, .stride = nthreads
+        };
+        /* job 0, and any job that gets no thread, runs on the caller */
+        spawned[i] = i && !pthread_create(&tid[i], NULL, connect_worker, &jobs[i]);
+        if (i && !spawned[i])
+            connect_worker(&jobs[i]);
+    }
+    connect_worker(&jobs[0]);
+
+    int ret = 0;
+    for (int i = 0; i < nthreads; i++) {
+        if (spawned[i])
+            pthread_join(tid[i], NULL);
+        ret |= jobs[i].ret;
+    }
+    return ret ? -1 : 0;
+}
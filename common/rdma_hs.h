@@ -0,0 +1,29 @@
+#pragma once
+#include <stdint.h>
+#include "rdma_conn.h"
+
+/*
+ * Batched bootstrap: instead of one qp_info per TCP round trip, a
+ * header and up to RDMA_HS_MAX_BATCH records travel together, and the
+ * peer answers with as many of its own, record i pairing with i.
+ */
+#define RDMA_HS_MAX_BATCH 1024
+
+struct rdma_hs_hdr {
+    uint32_t count;             /* qp_info records that follow */
+    uint32_t seq;               /* batch number, echoed in the reply */
+};
+
+#define RDMA_HS_MSG_MAX (sizeof(struct rdma_hs_hdr) + RDMA_HS_MAX_BATCH * sizeof(struct qp_info))
+
+/* blocking: one header plus n records */
+int rdma_hs_send(int sock, uint32_t seq, const struct qp_info *recs, uint32_t n);
+/* blocking: returns the record count (at most max) or -1 */
+int rdma_hs_recv(int sock, uint32_t *seq, struct qp_info *recs, uint32_t max);
+
+/*
+ * INIT -> RTR -> RTS for n connections whose remote is filled in,
+ * spread over nthreads threads: ibv_modify_qp is a command to the
+ * device, and several of them can be in flight at once.
+ */
+int rdma_conn_connect_many(struct rdma_conn **conns, uint32_t n, int nthreads);
@@ -0,0 +1,290 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <infiniband/verbs.h>
+#include "rdma_common.h"
+#include "rdma_mrc.h"
+
+#define OVERLAP_BATCH 16
+
+/* ---------- interval tree ---------- */
+
+static uintptr_t max_end(const struct rdma_mrc_entry *e) {
+    return e ? e->max_end : 0;
+}
+
+static void update(struct rdma_mrc_entry *e) {
+    e->max_end = e->end;
+    if (max_end(e->left) > e->max_end)
+        e->max_end = max_end(e->left);
+    if (max_end(e->right) > e->max_end)
+        e->max_end = max_end(e->right);
+}
+
+/* in-order position; equal starts are told apart by address */
+static int before(const struct rdma_mrc_entry *a, const struct rdma_mrc_entry *b) {
+    return a->start < b->start || (a->start == b->start && a < b);
+}
+
+static struct rdma_mrc_entry *rot_right(struct rdma_mrc_entry *e) {
+    struct rdma_mrc_entry *l = e->left;
+    e->left = l->right;
+    l->right = e;
+    update(e);
+    update(l);
+    return l;
+}
+
+static struct rdma_mrc_entry *rot_left(struct rdma_mrc_entry *e) {
+    struct rdma_mrc_entry *r = e->right;
+    e->right = r->left;
+    r->left = e;
+    update(e);
+    update(r);
+    return r;
+}
+
+static struct rdma_mrc_entry *tree_insert(struct rdma_mrc_entry *root, struct rdma_mrc_entry *n) {
+    if (!root)
+        return n;
+    if (before(n, root)) {
+        root->left = tree_insert(root->left, n);
+        if (root->left->prio > root->prio)
+            return rot_right(root);
+    } else {
+        root->right = tree_insert(root->right, n);
+        if (root->right->prio > root->prio)
+            return rot_left(root);
+    }
+    update(root);
+    return root;
+}
+
+static struct rdma_mrc_entry *tree_join(struct rdma_mrc_entry *a, struct rdma_mrc_entry *b) {
+    if (!a)
+        return b;
+    if (!b)
+        return a;
+    if (a->prio > b->prio) {
+        a->right = tree_join(a->right, b);
+        update(a);
+        return a;
+    }
+    b->left = tree_join(a, b->left);
+    update(b);
+    return b;
+}
+
+static struct rdma_mrc_entry *tree_remove(struct rdma_mrc_entry *root, struct rdma_mrc_entry *n) {
+    if (root == n)
+        return tree_join(n->left, n->right);
+    if (before(n, root))
+        root->left = tree_remove(root->left, n);
+    else
+        root->right = tree_remove(root->right, n);
+    update(root);
+    return root;
+}
+
+/* an entry with start <= a and end >= b */
+static struct rdma_mrc_entry *tree_cover(struct rdma_mrc_entry *e, uintptr_t a, uintptr_t b) {
+    while (e && e->max_end >= b) {
+        struct rdma_mrc_entry *l = tree_cover(e->left, a, b);
+        if (l)
+            return l;
+        /* everything from here on starts later */
+        if (e->start > a)
+            return NULL;
+        if (e->end >= b)
+            return e;
+        e = e->right;
+    }
+    return NULL;
+}
+
+/* up to max entries overlapping [a, b), in address order */
+static int tree_overlaps(struct rdma_mrc_entry *e, uintptr_t a, uintptr_t b,
+                         struct rdma_mrc_entry **out, int n, int max) {
+    while (e && n < max && e->max_end > a) {
+        n = tree_overlaps(e->left, a, b, out, n, max);
+        if (e->start >= b || n == max)
+            break;
+        if (e->end > a)
+            out[n++] = e;
+        e = e->right;
+    }
+    return n;
+}
+
+/* ---------- LRU ---------- */
+
+static void lru_unlink(struct rdma_mrc_entry *e) {
+    e->prev->next = e->next;
+    e->next->prev = e->prev;
+}
+
+static void lru_push(struct rdma_mrc *c, struct rdma_mrc_entry *e) {
+    e->prev = c->lru.prev;
+    e->next = &c->lru;
+    c->lru.prev->next = e;
+    c->lru.prev = e;
+}
+
+static void lru_touch(struct rdma_mrc *c, struct rdma_mrc_entry *e) {
+    lru_unlink(e);
+    lru_push(c, e);
+}
+
+/* ---------- cache ---------- */
+
+static void dereg(struct rdma_mrc *c, struct rdma_mrc_entry *e) {
+    uint64_t t0 = rdma_now_ns();
+    if (ibv_dereg_mr(e->mr))
+        RDMA_ERR("ibv_dereg_mr [%#lx, %#lx) failed", e->start, e->end);
+    c->stats.dereg_ns += rdma_now_ns() - t0;
+    c->stats.deregs++;
+    c->pinned -= e->end - e->start;
+    free(e);
+}
+
+/* out of the tree and the LRU; deregistered now, or by the last put */
+static void drop(struct rdma_mrc *c, struct rdma_mrc_entry *e) {
+    c->root = tree_remove(c->root, e);
+    lru_unlink(e);
+    c->entries--;
+    if (e->refs)
+        e->dead = 1;
+    else
+        dereg(c, e);
+}
+
+struct rdma_mrc *rdma_mrc_create(struct ibv_pd *pd, int access, size_t budget) {
+    struct rdma_mrc *c = calloc(1, sizeof(*c));
+    if (!c)
+        return NULL;
+    c->pd = pd;
+    c->access = access;
+    c->budget = budget;
+    c->rng = 2463534242u;
+    c->page = sysconf(_SC_PAGESIZE);
+    c->lru.prev = c->lru.next = &c->lru;
+    return c;
+}
+
+void rdma_mrc_destroy(struct rdma_mrc *c) {
+    if (!c)
+        return;
+    while (c->lru.next != &c->lru) {
+        struct rdma_mrc_entry *e = c->lru.next;
+        if (e->refs)
+            RDMA_LOG("MR cache: [%#lx, %#lx) destroyed with %u holders", e->start, e->end, e->refs);
+        e->refs = 0;
+        drop(c, e);
+    }
+    free(c);
+}
+
+struct rdma_mrc_entry *rdma_mrc_get(struct rdma_mrc *c, const void *addr, size_t len) {
+    uintptr_t a = (uintptr_t)addr & ~(c->page - 1);
+    uintptr_t b = ((uintptr_t)addr + (len ? len : 1) + c->page - 1) & ~(c->page - 1);
+
+    c->stats.lookups++;
+    struct rdma_mrc_entry *e = tree_cover(c->root, a, b);
+    if (e) {
+        c->stats.hits++;
+        e->refs++;
+        lru_touch(c, e);
+        return e;
+    }
+    c->stats.misses++;
+
+    /* idle registrations we overlap are folded into the new one */
+    struct rdma_mrc_entry *ov[OVERLAP_BATCH];
+    int n = tree_overlaps(c->root, a, b, ov, 0, OVERLAP_BATCH);
+    for (int i = 0; i < n; i++) {
+        uintptr_t ua = ov[i]->start < a ? ov[i]->start : a;
+        uintptr_t ub = ov[i]->end > b ? ov[i]->end : b;
+        /* neighbours in one heap would otherwise chain into a single huge MR */
+        if (ov[i]->refs || ub - ua > c->budget / RDMA_MRC_MERGE_DIV)
+            continue;
+        a = ua;
+        b = ub;
+        c->stats.merged++;
+        drop(c, ov[i]);
+    }
+
+    size_t size = b - a;
+    while (c->pinned + size > c->budget) {
+        struct rdma_mrc_entry *v = c->lru.next;
+        while (v != &c->lru && v->refs)
+            v = v->next;
+        if (v == &c->lru) {
+            c->stats.refused++;
+            return NULL;
+        }
+        c->stats.evictions++;
+        drop(c, v);
+    }
+
+    e = calloc(1, sizeof(*e));
+    if (!e)
+        return NULL;
+    uint64_t t0 = rdma_now_ns();
+    e->mr = ibv_reg_mr(c->pd, (void *)a, size, c->access);
+    c->stats.reg_ns += rdma_now_ns() - t0;
+    c->stats.regs++;
+    if (!e->mr) {
+        RDMA_ERR("ibv_reg_mr [%#lx, %#lx) failed", a, b);
+        free(e);
+        return NULL;
+    }
+    e->start = a;
+    e->end = b;
+    e->refs = 1;
+    c->rng ^= c->rng << 13;
+    c->rng ^= c->rng >> 17;
+    c->rng ^= c->rng << 5;
+    e->prio = c->rng;
+    e->max_end = b;
+    c->root = tree_insert(c->root, e);
+    lru_push(c, e);
+    c->entries++;
+    c->pinned += size;
+    return e;
+}
+
+void rdma_mrc_put(struct rdma_mrc *c, struct rdma_mrc_entry *e) {
+    if (--e->refs)
+        return;
+    if (e->dead)
+        dereg(c, e);
+    else
+        lru_touch(c, e);
+}
+
+void rdma_mrc_invalidate(struct rdma_mrc *c, const void *addr, size_t len) {
+    uintptr_t a = (uintptr_t)addr, b = a + len;
+    struct rdma_mrc_entry *ov[OVERLAP_BATCH];
+    int n;
+
+    while ((n = tree_overlaps(c->root, a, b, ov, 0, OVERLAP_BATCH)) > 0) {
+        for (int i = 0; i < n; i++) {
+            c->stats.invalidations++;
+            drop(c, ov[i]);
+        }
+    }
+}
+
+double rdma_mrc_miss_ns(const struct rdma_mrc *c) {
+    const struct rdma_mrc_stats *s = &c->stats;
+    double ns = s->regs ? (double)s->reg_ns / s->regs : 0;
+    if (s->deregs)
+        ns += (double)s->dereg_ns / s->deregs;
+    return ns;
+}
+
+uint64_t rdma_mrc_saved_ns(const struct rdma_mrc *c) {
+    return (uint64_t)(c->stats.hits * rdma_mrc_miss_ns(c));
+}
@@ -0,0 +1,88 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <infiniband/verbs.h>
+
+#define RDMA_MRC_MERGE_DIV 16  /* merged registrations stay within budget / 16 */
+
+/*
+ * Registration cache for buffers the application did not allocate from
+ * a pool: rdma_mrc_get() returns an MR covering [addr, addr + len),
+ * registering one only when no cached registration covers the range.
+ *
+ * Registrations are page-aligned and kept in an interval tree (a treap
+ * on start address, each node carrying the largest end in its subtree),
+ * so covering and overlapping lookups skip every subtree that ends too
+ * early. A miss absorbs the idle registrations it overlaps into one
+ * larger MR, up to budget / RDMA_MRC_MERGE_DIV bytes. Idle
+ * registrations sit on an LRU list and are deregistered oldest first
+ * whenever the pinned bytes would exceed the budget; ones held by a get
+ * are never evicted.
+ *
+ * The cache cannot see free() or munmap(): call rdma_mrc_invalidate()
+ * before memory that may be cached goes back to the allocator, or a
+ * later buffer at the same address would hit a registration of the old
+ * pages. Not thread-safe; use one cache per thread.
+ */
+struct rdma_mrc_entry {
+    uintptr_t               start;
+    uintptr_t               end;            /* exclusive, page-aligned */
+    struct ibv_mr          *mr;
+    uint32_t                refs;           /* gets not yet put */
+    int                     dead;           /* invalidated while held */
+
+    /* interval tree */
+    struct rdma_mrc_entry  *left, *right;
+    uint32_t                prio;
+    uintptr_t               max_end;        /* of this subtree */
+
+    /* LRU, head = least recently used */
+    struct rdma_mrc_entry  *prev, *next;
+};
+
+struct rdma_mrc_stats {
+    uint64_t    lookups;
+    uint64_t    hits;
+    uint64_t    misses;
+    uint64_t    merged;         /* idle registrations absorbed by a miss */
+    uint64_t    evictions;      /* deregistered to stay within budget */
+    uint64_t    invalidations;
+    uint64_t    refused;        /* held registrations left no room */
+    uint64_t    regs;
+    uint64_t    reg_ns;         /* spent in ibv_reg_mr */
+    uint64_t    dereg_ns;       /* spent in ibv_dereg_mr */
+    uint64_t    deregs;
+};
+
+struct rdma_mrc {
+    struct ibv_pd          *pd;
+    int                     access;
+    size_t                  budget;         /* pinned bytes */
+    size_t                  pinned;
+    uint32_t                entries;
+    uint32_t                rng;
+    size_t                  page;
+
+    struct rdma_mrc_entry  *root;
+    struct rdma_mrc_entry   lru;            /* list sentinel */
+    struct rdma_mrc_stats   stats;
+};
+
+struct rdma_mrc *rdma_mrc_create(struct ibv_pd *pd, int access, size_t budget);
+/* deregisters everything; no entry may still be held */
+void rdma_mrc_destroy(struct rdma_mrc *c);
+
+/*
+ * A registration covering [addr, addr + len), held until rdma_mrc_put().
+ * NULL if ibv_reg_mr fails or the range cannot fit the budget next to
+ * the registrations currently held.
+ */
+struct rdma_mrc_entry *rdma_mrc_get(struct rdma_mrc *c, const void *addr, size_t len);
+void rdma_mrc_put(struct rdma_mrc *c, struct rdma_mrc_entry *e);
+
+/* forget every registration overlapping [addr, addr + len) */
+void rdma_mrc_invalidate(struct rdma_mrc *c, const void *addr, size_t len);
+
+/* ns a register + deregister pair costs on average, and that much per hit */
+double   rdma_mrc_miss_ns(const struct rdma_mrc *c);
+uint64_t rdma_mrc_saved_ns(const struct rdma_mrc *c);
@@ -0,0 +1,286 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <infiniband/verbs.h>
+#include "rdma_msg.h"
+#include "rdma_poll.h"
+#include "rdma_sgl.h"
+
+/* wr_id: kind << 32 | index */
+enum { WR_RECV, WR_SEND, WR_READ };
+
+enum { IN_QUEUED, IN_READING, IN_READ, IN_DELIVERED };
+
+#define WR_ID(kind, idx)  ((uint64_t)(kind) << 32 | (idx))
+
+static int post_recv(struct rdma_msg *m, uint32_t slot) {
+    struct rdma_buf *b = &m->rx->bufs[slot];
+    struct rdma_sgl l;
+
+    rdma_sgl_reset(&l);
+    rdma_sgl_add(&l, b->addr, sizeof(struct rdma_msg_hdr) + m->eager_max, b->lkey);
+    return rdma_post_recv_sgl(m->conn, &l, WR_ID(WR_RECV, slot));
+}
+
+int rdma_msg_init(struct rdma_msg *m, struct rdma_conn *conn, uint32_t depth, uint32_t eager_max,
+                  const struct rdma_msg_ops *ops, void *arg) {
+    memset(m, 0, sizeof(*m));
+    m->conn = conn;
+    m->ops = *ops;
+    m->arg = arg;
+    m->depth = depth;
+    m->eager_max = eager_max;
+    m->threshold = eager_max;
+    m->sq_depth = conn->cfg.max_send_wr;
+    m->max_reads = conn->cfg.max_rd_atomic ? conn->cfg.max_rd_atomic : 1;
+
+    size_t slot = sizeof(struct rdma_msg_hdr) + eager_max;
+    m->rx = rdma_pool_create(conn->dev->pd, slot, depth, IBV_ACCESS_LOCAL_WRITE);
+    m->tx = rdma_pool_create(conn->dev->pd, slot, depth, IBV_ACCESS_LOCAL_WRITE);
+    /* eager messages hold receive buffers, rendezvous ones are bounded by the sender's window */
+    m->in_size = 2 * depth;
+    m->in = calloc(m->in_size, sizeof(*m->in));
+    m->tx_free = calloc(depth, sizeof(*m->tx_free));
+    m->tx_ctx = calloc(depth, sizeof(*m->tx_ctx));
+    m->tx_eager = calloc(depth, 1);
+    if (!m->rx || !m->tx || !m->in || !m->tx_free || !m->tx_ctx || !m->tx_eager) {
+        rdma_msg_fini(m);
+        return -1;
+    }
+    for (uint32_t i = 0; i < depth; i++)
+        m->tx_free[m->tx_nfree++] = depth - 1 - i;
+    for (uint32_t i = 0; i < depth; i++) {
+        if (post_recv(m, i)) {
+            rdma_msg_fini(m);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void rdma_msg_fini(struct rdma_msg *m) {
+    rdma_pool_destroy(m->rx);
+    rdma_pool_destroy(m->tx);
+    free(m->in);
+    free(m->tx_free);
+    free(m->tx_ctx);
+    free(m->tx_eager);
+    memset(m, 0, sizeof(*m));
+}
+
+/* a header slot and a send-queue entry, or -1 */
+static int take_slot(struct rdma_msg *m) {
+    if (!m->tx_nfree || m->sq_used >= m->sq_depth)
+        return -1;
+    return m->tx_free[--m->tx_nfree];
+}
+
+static int post_hdr(struct rdma_msg *m, uint32_t slot, struct rdma_sgl *l) {
+    if (rdma_post_sgl(m->conn, IBV_WR_SEND, l, WR_ID(WR_SEND, slot), IBV_SEND_SIGNALED, 0, 0, 0)) {
+        m->tx_free[m->tx_nfree++] = slot;
+        return -1;
+    }
+    m->sq_used++;
+    return 0;
+}
+
+int rdma_msg_send(struct rdma_msg *m, const void *buf, uint32_t len, struct ibv_mr *mr, uint64_t ctx) {
+    int eager = len <= m->threshold && len <= m->eager_max;
+
+    if (!eager && !mr) {
+        RDMA_LOG("%u byte message above the eager threshold needs an MR", len);
+        return -1;
+    }
+    if (!eager && m->rndv_out >= m->depth)
+        return 1;
+    int slot = take_slot(m);
+    if (slot < 0)
+        return 1;
+
+    struct rdma_buf *b = &m->tx->bufs[slot];
+    struct rdma_msg_hdr *h = b->addr;
+    struct rdma_sgl l;
+    h->len = len;
+    h->id = ctx;
+    rdma_sgl_reset(&l);
+    rdma_sgl_add(&l, h, sizeof(*h), b->lkey);
+    if (eager) {
+        h->type = RDMA_MSG_EAGER;
+        if (mr) {
+            rdma_sgl_add(&l, buf, len, mr->lkey);
+        } else {
+            memcpy(h + 1, buf, len);
+            rdma_sgl_add(&l, h + 1, len, b->lkey);
+        }
+    } else {
+        h->type = RDMA_MSG_RNDV;
+        h->addr = (uintptr_t)buf;
+        h->rkey = mr->rkey;
+    }
+    m->tx_ctx[slot] = ctx;
+    m->tx_eager[slot] = eager;
+    if (post_hdr(m, slot, &l))
+        return -1;
+    if (eager) {
+        m->eager_sent++;
+    } else {
+        m->rndv_sent++;
+        m->rndv_out++;
+    }
+    return 0;
+}
+
+static int send_fin(struct rdma_msg *m, uint64_t id) {
+    int slot = take_slot(m);
+    if (slot < 0)
+        return 1;
+    struct rdma_buf *b = &m->tx->bufs[slot];
+    struct rdma_msg_hdr *h = b->addr;
+    struct rdma_sgl l;
+    h->type = RDMA_MSG_FIN;
+    h->len = 0;
+    h->id = id;
+    m->tx_eager[slot] = 0;
+    rdma_sgl_reset(&l);
+    rdma_sgl_add(&l, h, sizeof(*h), b->lkey);
+    return post_hdr(m, slot, &l);
+}
+
+/* READs in arrival order, as far as the QP's READ limit and ops.alloc allow */
+static int issue_reads(struct rdma_msg *m) {
+    for (; m->in_issue < m->in_tail; m->in_issue++) {
+        struct rdma_msg_in *e = &m->in[m->in_issue % m->in_size];
+        if (e->type != RDMA_MSG_RNDV)
+            continue;
+        if (m->reads >= m->max_reads || m->sq_used >= m->sq_depth)
+            return 0;
+        if (!e->buf && !(e->buf = m->ops.alloc(m->arg, e->len, &e->lkey)))
+            return 0;
+
+        struct ibv_sge sge = {
+            .addr = (uintptr_t)e->buf,
+            .length = e->len,
+            .lkey = e->lkey
+        };
+        struct ibv_send_wr wr = {
+            .wr_id = WR_ID(WR_READ, m->in_issue % m->in_size),
+            .opcode = IBV_WR_RDMA_READ,
+            .sg_list = &sge,
+            .num_sge = 1,
+            .send_flags = IBV_SEND_SIGNALED,
+            .wr.rdma.remote_addr = e->raddr,
+            .wr.rdma.rkey = e->rkey
+        }, *bad;
+        if (ibv_post_send(m->conn->qp, &wr, &bad)) {
+            RDMA_ERR("ibv_post_send rendezvous READ of %u bytes failed", e->len);
+            return -1;
+        }
+        e->state = IN_READING;
+        m->reads++;
+        m->sq_used++;
+    }
+    return 0;
+}
+
+/* hand over everything at the head that is complete; FIN each rendezvous */
+static int deliver(struct rdma_msg *m) {
+    while (m->in_head < m->in_tail) {
+        struct rdma_msg_in *e = &m->in[m->in_head % m->in_size];
+        if (e->type == RDMA_MSG_EAGER) {
+            struct rdma_msg_hdr *h = m->rx->bufs[e->slot].addr;
+            m->ops.recv(m->arg, h + 1, e->len, 0);
+            m->eager_recvd++;
+            if (post_recv(m, e->slot))
+                return -1;
+        } else {
+            if (e->state == IN_QUEUED || e->state == IN_READING)
+                return 0;
+            if (e->state == IN_READ) {
+                m->ops.recv(m->arg, e->buf, e->len, 1);
+                m->rndv_recvd++;
+                e->state = IN_DELIVERED;
+            }
+            int ret = send_fin(m, e->id);
+            if (ret)
+                return ret < 0 ? -1 : 0;
+        }
+        m->in_head++;
+    }
+    return 0;
+}
+
+static int on_recv(struct rdma_msg *m, uint32_t slot, uint32_t byte_len) {
+    const struct rdma_msg_hdr *h = m->rx->bufs[slot].addr;
+
+    if (byte_len < sizeof(*h)) {
+        RDMA_LOG("%u byte message without a header", byte_len);
+        return -1;
+    }
+    if (h->type == RDMA_MSG_FIN) {
+        m->rndv_out--;
+        uint64_t id = h->id;
+        if (post_recv(m, slot))
+            return -1;
+        m->ops.sent(m->arg, id);
+        return 0;
+    }
+    if (m->in_tail - m->in_head == m->in_size) {
+        RDMA_LOG("delivery queue overflow: peer's depth exceeds %u", m->depth);
+        return -1;
+    }
+    struct rdma_msg_in *e = &m->in[m->in_tail++ % m->in_size];
+    memset(e, 0, sizeof(*e));
+    e->type = h->type;
+    e->len = h->len;
+    if (h->type == RDMA_MSG_EAGER) {
+        e->slot = slot;
+        return 0;
+    }
+    if (h->type != RDMA_MSG_RNDV) {
+        RDMA_LOG("unknown message type %u", h->type);
+        return -1;
+    }
+    e->state = IN_QUEUED;
+    e->id = h->id;
+    e->raddr = h->addr;
+    e->rkey = h->rkey;
+    return post_recv(m, slot);
+}
+
+int rdma_msg_poll(struct rdma_msg *m) {
+    struct ibv_wc wc[RDMA_POLL_MAX_BATCH];
+
+    int n = ibv_poll_cq(m->conn->send_cq, RDMA_POLL_MAX_BATCH, wc);
+    if (n < 0) {
+        RDMA_ERR("ibv_poll_cq failed");
+        return -1;
+    }
+    for (int i = 0; i < n; i++) {
+        uint32_t kind = wc[i].wr_id >> 32, idx = (uint32_t)wc[i].wr_id;
+        if (wc[i].status != IBV_WC_SUCCESS) {
+            RDMA_LOG("message WR kind %u failed status=%s", kind, ibv_wc_status_str(wc[i].status));
+            return -1;
+        }
+        switch (kind) {
+        case WR_RECV:
+            if (on_recv(m, idx, wc[i].byte_len))
+                return -1;
+            break;
+        case WR_SEND:
+            m->sq_used--;
+            m->tx_free[m->tx_nfree++] = idx;
+            if (m->tx_eager[idx])
+                m->ops.sent(m->arg, m->tx_ctx[idx]);
+            break;
+        case WR_READ:
+            m->sq_used--;
+            m->reads--;
+            m->in[idx].state = IN_READ;
+            break;
+        }
+    }
+    if (issue_reads(m) || deliver(m))
+        return -1;
+    return n;
+}
@@ -0,0 +1,109 @@
+#pragma once
+#include <stdint.h>
+#include <infiniband/verbs.h>
+#include "rdma_conn.h"
+#include "rdma_pool.h"
+
+/*
+ * Messaging over one RC QP with two paths chosen by size.
+ *
+ * Eager (len <= threshold): header and payload go out as one SEND into
+ * a pre-posted receive buffer of eager_max bytes; the payload is
+ * gathered from the caller's MR, or copied behind the header when it
+ * has none. The receiver is handed a pointer into its receive buffer.
+ *
+ * Rendezvous (len > threshold): the SEND carries only a descriptor
+ * (address, rkey, length, the sender's context, as in qp_info); the
+ * receiver asks ops.alloc for a destination, pulls the payload with
+ * RDMA READ straight into it and answers with a FIN, which is when the
+ * sender learns through ops.sent that it may reuse the buffer.
+ *
+ * Messages are delivered in the order they were sent: an eager message
+ * behind a rendezvous waits (holding its receive buffer) until that
+ * READ has completed. Every WR is signaled; the layer owns conn's CQ.
+ * Callbacks run inside rdma_msg_poll() and must not call it; they may
+ * call rdma_msg_send().
+ */
+enum rdma_msg_type {
+    RDMA_MSG_EAGER = 1,
+    RDMA_MSG_RNDV,
+    RDMA_MSG_FIN,
+};
+
+struct rdma_msg_hdr {
+    uint32_t type;
+    uint32_t len;           /* payload bytes */
+    uint64_t id;            /* RNDV, FIN: the sender's context */
+    uint64_t addr;          /* RNDV: where to READ the payload */
+    uint32_t rkey;
+    uint32_t rsvd;
+};
+
+struct rdma_msg_ops {
+    /* a message arrived; eager data is only valid during the call */
+    void  (*recv)(void *arg, void *data, uint32_t len, int rndv);
+    /* rendezvous: a registered destination for len bytes, NULL to try again later */
+    void *(*alloc)(void *arg, uint32_t len, uint32_t *lkey);
+    /* the buffer given to rdma_msg_send() with ctx may be reused */
+    void  (*sent)(void *arg, uint64_t ctx);
+};
+
+/* an incoming message waiting to be delivered in order */
+struct rdma_msg_in {
+    uint32_t    type;           /* RDMA_MSG_EAGER or RDMA_MSG_RNDV */
+    uint32_t    state;
+    uint32_t    slot;           /* EAGER: receive buffer */
+    uint32_t    len;
+    uint64_t    id;
+    uint64_t    raddr;
+    uint32_t    rkey;
+    uint32_t    lkey;
+    void       *buf;
+};
+
+struct rdma_msg {
+    struct rdma_conn   *conn;
+    struct rdma_msg_ops ops;
+    void               *arg;
+    uint32_t            depth;
+    uint32_t            eager_max;
+    uint32_t            threshold;      /* <= eager_max; rdma_msg_send() reads it every call */
+
+    struct rdma_pool   *rx;             /* depth receive buffers */
+    struct rdma_pool   *tx;             /* depth header slots, eager copies behind the header */
+    uint32_t           *tx_free;
+    uint32_t            tx_nfree;
+    uint64_t           *tx_ctx;         /* eager: reported through ops.sent on completion */
+    uint8_t            *tx_eager;
+
+    uint32_t            sq_used;
+    uint32_t            sq_depth;
+    uint32_t            rndv_out;       /* our rendezvous sends not yet FIN'd */
+
+    /* [head, issue): READs posted or done; [issue, tail): not yet posted */
+    struct rdma_msg_in *in;
+    uint32_t            in_size;
+    uint64_t            in_head, in_issue, in_tail;
+    uint32_t            reads;          /* in flight */
+    uint32_t            max_reads;
+
+    uint64_t            eager_sent, rndv_sent, eager_recvd, rndv_recvd;
+};
+
+/*
+ * depth receives are posted and depth messages of each kind may be in
+ * flight: conn needs max_recv_wr >= depth, max_send_sge >= 2, and for
+ * rendezvous both sides' buffers registered with REMOTE_READ.
+ */
+int  rdma_msg_init(struct rdma_msg *m, struct rdma_conn *conn, uint32_t depth, uint32_t eager_max,
+                   const struct rdma_msg_ops *ops, void *arg);
+void rdma_msg_fini(struct rdma_msg *m);
+
+/*
+ * Send len bytes at buf, within mr (NULL: eager only, copied). ctx comes
+ * back through ops.sent. 0: posted, 1: out of slots, poll and retry, -1: error.
+ */
+int  rdma_msg_send(struct rdma_msg *m, const void *buf, uint32_t len, struct ibv_mr *mr, uint64_t ctx);
+
+/* reap completions, post READs and FINs, deliver; returns WCs seen or -1 */
+int  rdma_msg_poll(struct rdma_msg *m);
@@ -0,0 +1,137 @@
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <infiniband/verbs.h>
+#include "rdma_common.h"
+#include "rdma_poll.h"
+
+void rdma_poller_init(struct rdma_poller *p, struct ibv_cq *cq, int batch,
+                      rdma_wc_handler handler, void *arg) {
+    memset(p, 0, sizeof(*p));
+    if (batch < 1)
+        batch = 1;
+    if (batch > RDMA_POLL_MAX_BATCH)
+        batch = RDMA_POLL_MAX_BATCH;
+    p->cq = cq;
+    p->batch = batch;
+    p->handler = handler;
+    p->arg = arg;
+    p->epfd = -1;
+}
+
+int rdma_poller_set_channel(struct rdma_poller *p, struct ibv_comp_channel *channel, int spin_us) {
+    if (!channel)
+        return 0;
+    fcntl(channel->fd, F_SETFL, fcntl(channel->fd, F_GETFL) | O_NONBLOCK);
+
+    p->epfd = epoll_create1(0);
+    struct epoll_event ev = { .events = EPOLLIN };
+    if (p->epfd < 0 || epoll_ctl(p->epfd, EPOLL_CTL_ADD, channel->fd, &ev)) {
+        RDMA_ERR("epoll setup for the completion channel failed");
+        rdma_poller_close(p);
+        return -1;
+    }
+    p->channel = channel;
+    p->spin_ns = spin_us > 0 ? (uint64_t)spin_us * 1000 : 0;
+    return 0;
+}
+
+void rdma_poller_close(struct rdma_poller *p) {
+    if (p->epfd >= 0)
+        close(p->epfd);
+    p->epfd = -1;
+    p->channel = NULL;
+}
+
+int rdma_poller_poll(struct rdma_poller *p) {
+    struct ibv_wc wc[RDMA_POLL_MAX_BATCH];
+
+    int n = ibv_poll_cq(p->cq, p->batch, wc);
+    if (n < 0) {
+        RDMA_ERR("ibv_poll_cq failed");
+        return -1;
+    }
+    if (p->hist_on) {
+        p->polls++;
+        p->cqes += n;
+        p->hist[n]++;
+    }
+
+    for (int i = 0; i < n; i++) {
+        if (p->handler(p->arg, &wc[i]))
+            return -1;
+    }
+    return n;
+}
+
+/* arm the CQ and sleep until its next completion event; 0 means poll again */
+static int poller_sleep(struct rdma_poller *p) {
+    if (ibv_req_notify_cq(p->cq, 0)) {
+        RDMA_ERR("ibv_req_notify_cq failed");
+        return -1;
+    }
+    /* a CQE that arrived before the arm raises no event */
+    int n = rdma_poller_poll(p);
+    if (n)
+        return n;
+
+    p->sleeps++;
+    struct epoll_event ev;
+    while (epoll_wait(p->epfd, &ev, 1, -1) < 0) {
+        if (errno != EINTR) {
+            RDMA_ERR("epoll_wait failed");
+            return -1;
+        }
+    }
+    struct ibv_cq *cq;
+    void *ctx;
+    if (!ibv_get_cq_event(p->channel, &cq, &ctx))
+        ibv_ack_cq_events(cq, 1);
+    return 0;
+}
+
+int rdma_poller_block(struct rdma_poller *p) {
+    int n;
+
+    if (!p->channel) {
+        while (!(n = rdma_poller_poll(p)));
+        return n;
+    }
+
+    uint64_t start = rdma_now_ns();
+    uint64_t spin = p->avg_wait_ns <= p->spin_ns || !(p->waits++ % 64) ? p->spin_ns : 0;
+    for (;;) {
+        if ((n = rdma_poller_poll(p)))
+            break;
+        if (rdma_now_ns() - start >= spin && (n = poller_sleep(p)))
+            break;
+    }
+    int64_t waited = rdma_now_ns() - start;
+    p->avg_wait_ns += (waited - (int64_t)p->avg_wait_ns) / 8;
+    return n;
+}
+
+int rdma_poller_wait(struct rdma_poller *p, int n) {
+    while (n > 0) {
+        int got = rdma_poller_block(p);
+        if (got < 0)
+            return -1;
+        n -= got;
+    }
+    return 0;
+}
+
+void rdma_poller_print_hist(const struct rdma_poller *p) {
+    uint64_t busy = p->polls - p->hist[0];
+
+    printf("CQEs per poll (batch %d): %lu polls, %lu empty, %.2f CQEs per non-empty poll\n",
+           p->batch, p->polls, p->hist[0], busy ? (double)p->cqes / busy : 0.0);
+    for (int i = 1; i <= p->batch; i++) {
+        if (!p->hist[i])
+            continue;
+        printf("  %3d: %12lu  %6.2f%%\n", i, p->hist[i], 100.0 * p->hist[i] / busy);
+    }
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include <stdint.h>
+#include <infiniband/verbs.h>
+
+#define RDMA_POLL_MAX_BATCH 64
+
+/* called for every drained CQE; a non-zero return stops the batch */
+typedef int (*rdma_wc_handler)(void *arg, struct ibv_wc *wc);
+
+struct rdma_poller {
+    struct ibv_cq   *cq;
+    int              batch;
+    rdma_wc_handler  handler;
+    void            *arg;
+
+    int              hist_on;
+    uint64_t         polls;
+    uint64_t         cqes;
+    uint64_t         hist[RDMA_POLL_MAX_BATCH + 1];   /* hist[n]: polls that returned n CQEs */
+
+    /* hybrid busy-poll / interrupt mode, see rdma_poller_set_channel() */
+    struct ibv_comp_channel *channel;
+    int              epfd;
+    uint64_t         spin_ns;           /* budget before arming the CQ */
+    uint64_t         avg_wait_ns;       /* moving average of rdma_poller_block() waits */
+    uint64_t         waits;
+    uint64_t         sleeps;            /* waits that ended up in epoll_wait() */
+};
+
+void rdma_poller_init(struct rdma_poller *p, struct ibv_cq *cq, int batch,
+                      rdma_wc_handler handler, void *arg);
+/* one ibv_poll_cq of up to p->batch CQEs; returns CQEs handled or -1 */
+int  rdma_poller_poll(struct rdma_poller *p);
+/*
+ * Poll until at least one CQE was handled; returns how many, or -1.
+ * Without a channel this spins. With one it spins for the spin budget
+ * and then arms the CQ and sleeps in epoll_wait() on the channel. The
+ * spin is skipped while recent waits averaged longer than the budget,
+ * since spinning would not have caught them anyway; every 64th wait
+ * spins regardless to notice when traffic picks up again.
+ */
+int  rdma_poller_block(struct rdma_poller *p);
+/* switch to the hybrid mode above; cq must have been created on channel */
+int  rdma_poller_set_channel(struct rdma_poller *p, struct ibv_comp_channel *channel, int spin_us);
+void rdma_poller_close(struct rdma_poller *p);
+/* rdma_poller_block() until n CQEs have been handled */
+int  rdma_poller_wait(struct rdma_poller *p, int n);
+void rdma_poller_print_hist(const struct rdma_poller *p);
@@ -0,0 +1,132 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <infiniband/verbs.h>
+#include "rdma_common.h"
+#include "rdma_pool.h"
+
+#define ALIGN_UP(x, a)  (((x) + (a) - 1) / (a) * (a))
+
+static int slab_map(struct rdma_pool_slab *s, size_t len) {
+    s->len = ALIGN_UP(len, RDMA_POOL_HUGEPAGE);
+    s->base = mmap(NULL, s->len, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (s->base != MAP_FAILED) {
+        s->huge = 1;
+        return 0;
+    }
+
+    /* no reserved hugepages: ask for transparent ones instead */
+    s->base = mmap(NULL, s->len, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (s->base == MAP_FAILED) {
+        s->base = NULL;
+        return -1;
+    }
+    madvise(s->base, s->len, MADV_HUGEPAGE);
+    return 0;
+}
+
+struct rdma_pool *rdma_pool_create(struct ibv_pd *pd, size_t buf_size, uint32_t nbufs, int access) {
+    if (!buf_size || !nbufs)
+        return NULL;
+
+    struct rdma_pool *pool = calloc(1, sizeof(*pool));
+    if (!pool)
+        return NULL;
+    pool->buf_size = ALIGN_UP(buf_size, 64);
+    pool->nbufs = nbufs;
+
+    /* buffers never straddle slabs; oversized ones get a slab each */
+    uint32_t per_slab = pool->buf_size < RDMA_POOL_SLAB_SIZE ?
+                        RDMA_POOL_SLAB_SIZE / pool->buf_size : 1;
+    pool->nslabs = (nbufs + per_slab - 1) / per_slab;
+    pool->slabs = calloc(pool->nslabs, sizeof(*pool->slabs));
+    pool->bufs = calloc(nbufs, sizeof(*pool->bufs));
+    pool->next = calloc(nbufs, sizeof(*pool->next));
+    if (!pool->slabs || !pool->bufs || !pool->next)
+        goto err;
+
+    int huge = 0;
+    for (uint32_t i = 0; i < pool->nslabs; i++) {
+        struct rdma_pool_slab *s = &pool->slabs[i];
+        uint32_t first = i * per_slab;
+        uint32_t n = nbufs - first < per_slab ? nbufs - first : per_slab;
+
+        if (slab_map(s, (size_t)n * pool->buf_size)) {
+            RDMA_ERR("mmap slab of %lu bytes failed", (size_t)n * pool->buf_size);
+            goto err;
+        }
+        s->mr = ibv_reg_mr(pd, s->base, s->len, access);
+        if (!s->mr) {
+            RDMA_ERR("ibv_reg_mr slab of %lu bytes failed", s->len);
+            goto err;
+        }
+        huge += s->huge;
+
+        for (uint32_t j = 0; j < n; j++) {
+            struct rdma_buf *b = &pool->bufs[first + j];
+            b->addr = (char *)s->base + (size_t)j * pool->buf_size;
+            b->lkey = s->mr->lkey;
+            b->rkey = s->mr->rkey;
+            b->mr = s->mr;
+            b->idx = first + j;
+        }
+    }
+
+    for (uint32_t i = 0; i < nbufs; i++)
+        pool->next[i] = i + 1 < nbufs ? i + 2 : 0;
+    pool->head = 1;
+
+    RDMA_LOG("MR pool: %u x %lu B in %u slab(s), %d on hugepages",
+             nbufs, pool->buf_size, pool->nslabs, huge);
+    return pool;
+
+err:
+    rdma_pool_destroy(pool);
+    return NULL;
+}
+
+void rdma_pool_destroy(struct rdma_pool *pool) {
+    if (!pool)
+        return;
+    for (uint32_t i = 0; pool->slabs && i < pool->nslabs; i++) {
+        struct rdma_pool_slab *s = &pool->slabs[i];
+        if (s->mr)
+            ibv_dereg_mr(s->mr);
+        if (s->base)
+            munmap(s->base, s->len);
+    }
+    free(pool->slabs);
+    free(pool->bufs);
+    free(pool->next);
+    free(pool);
+}
+
+/* Treiber stack; the tag in the upper half of head defeats ABA */
+struct rdma_buf *rdma_pool_get(struct rdma_pool *pool) {
+    uint64_t old = __atomic_load_n(&pool->head, __ATOMIC_ACQUIRE);
+    for (;;) {
+        uint32_t top = (uint32_t)old;
+        if (!top)
+            return NULL;
+        uint32_t next = __atomic_load_n(&pool->next[top - 1], __ATOMIC_RELAXED);
+        uint64_t new = ((old >> 32) + 1) << 32 | next;
+        if (__atomic_compare_exchange_n(&pool->head, &old, new, 1,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE))
+            return &pool->bufs[top - 1];
+    }
+}
+
+void rdma_pool_put(struct rdma_pool *pool, struct rdma_buf *buf) {
+    uint64_t old = __atomic_load_n(&pool->head, __ATOMIC_RELAXED);
+    for (;;) {
+        __atomic_store_n(&pool->next[buf->idx], (uint32_t)old, __ATOMIC_RELAXED);
+        uint64_t new = ((old >> 32) + 1) << 32 | (buf->idx + 1);
+        if (__atomic_compare_exchange_n(&pool->head, &old, new, 1,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+            return;
+    }
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <infiniband/verbs.h>
+
+#define RDMA_POOL_HUGEPAGE   (2ul << 20)
+#define RDMA_POOL_SLAB_SIZE  (64ul << 20)   /* registered as one MR */
+
+/* a fixed-size buffer carved out of a registered slab */
+struct rdma_buf {
+    void          *addr;
+    uint32_t       lkey;
+    uint32_t       rkey;
+    struct ibv_mr *mr;              /* the slab's MR */
+    uint32_t       idx;
+};
+
+struct rdma_pool_slab {
+    void          *base;
+    size_t         len;
+    int            huge;            /* MAP_HUGETLB, not the 4 KiB fallback */
+    struct ibv_mr *mr;
+};
+
+struct rdma_pool {
+    size_t                 buf_size;    /* stride: requested size rounded to 64 B */
+    uint32_t               nbufs;
+    uint32_t               nslabs;
+    struct rdma_pool_slab *slabs;
+    struct rdma_buf       *bufs;
+    uint32_t              *next;        /* freelist links, index + 1, 0 ends */
+    uint64_t               head;        /* ABA tag << 32 | index + 1 */
+};
+
+/*
+ * Map nbufs buffers of buf_size bytes on 2 MiB hugepages (4 KiB pages with
+ * MADV_HUGEPAGE when none are reserved) and register them slab by slab.
+ */
+struct rdma_pool *rdma_pool_create(struct ibv_pd *pd, size_t buf_size, uint32_t nbufs, int access);
+void              rdma_pool_destroy(struct rdma_pool *pool);
+
+/* lock-free; get returns NULL when the pool is empty */
+struct rdma_buf *rdma_pool_get(struct rdma_pool *pool);
+void             rdma_pool_put(struct rdma_pool *pool, struct rdma_buf *buf);
@@ -0,0 +1,174 @@
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <infiniband/verbs.h>
+#include "rdma_ring.h"
+#include "rdma_poll.h"
+
+#define ALIGN8(x)  (((x) + 7u) & ~7u)
+
+static uint32_t rec_size(uint32_t len) {
+    return sizeof(struct rdma_ring_hdr) + ALIGN8(len) + sizeof(struct rdma_ring_trl);
+}
+
+/* 0 never names a record: it is what an empty slot's trailer holds */
+static uint32_t next_seq(uint32_t seq) {
+    return seq + 1 ? seq + 1 : 1;
+}
+
+int rdma_ring_init(struct rdma_ring *r, struct rdma_conn *conn, void *region, uint32_t lkey,
+                   uint32_t size) {
+    if (size < RDMA_RING_MIN || size % 64) {
+        RDMA_LOG("ring size %u: needs a multiple of 64, at least %d", size, RDMA_RING_MIN);
+        return -1;
+    }
+    memset(r, 0, sizeof(*r));
+    r->conn = conn;
+    r->size = size;
+    r->lkey = lkey;
+    r->rx = region;
+    r->credit = (volatile uint64_t *)((char *)region + size);
+    r->credit_src = (uint64_t *)((char *)region + size + 8);
+    r->stage = (char *)region + size + 64;
+    r->rx_seq = 1;
+    r->tx_seq = 1;
+    r->sq_depth = conn->cfg.max_send_wr;
+    return 0;
+}
+
+int rdma_ring_poll(struct rdma_ring *r) {
+    struct ibv_wc wc[RDMA_POLL_MAX_BATCH];
+
+    int n = ibv_poll_cq(r->conn->send_cq, RDMA_POLL_MAX_BATCH, wc);
+    if (n < 0) {
+        RDMA_ERR("ibv_poll_cq failed");
+        return -1;
+    }
+    for (int i = 0; i < n; i++) {
+        if (wc[i].status != IBV_WC_SUCCESS) {
+            RDMA_LOG("ring WRITE %lu failed status=%s", wc[i].wr_id,
+                     ibv_wc_status_str(wc[i].status));
+            return -1;
+        }
+        /* the signaled WR retires every unsignaled one before it */
+        r->completed = wc[i].wr_id + 1;
+    }
+    return n;
+}
+
+/* WRITE len bytes from local to the peer's region at off */
+static int post_write(struct rdma_ring *r, const void *local, uint64_t off, uint32_t len) {
+    while (r->posted - r->completed >= r->sq_depth) {
+        if (rdma_ring_poll(r) < 0)
+            return -1;
+    }
+    struct ibv_sge sge = {
+        .addr = (uintptr_t)local,
+        .length = len,
+        .lkey = r->lkey
+    };
+    int signal = (r->posted + 1) % (r->sq_depth / 2 ? r->sq_depth / 2 : 1) == 0;
+    struct ibv_send_wr wr = {
+        .wr_id = r->posted,
+        .opcode = IBV_WR_RDMA_WRITE,
+        .sg_list = &sge,
+        .num_sge = 1,
+        .send_flags = (signal ? IBV_SEND_SIGNALED : 0) | rdma_inline_flag(r->conn, len),
+        .wr.rdma.remote_addr = r->conn->remote.addr + off,
+        .wr.rdma.rkey = r->conn->remote.rkey
+    }, *bad;
+    if (ibv_post_send(r->conn->qp, &wr, &bad)) {
+        RDMA_ERR("ibv_post_send ring WRITE failed");
+        return -1;
+    }
+    r->posted++;
+    return 0;
+}
+
+int rdma_ring_send(struct rdma_ring *r, const void *msg, uint32_t len) {
+    if (len > rdma_ring_max_msg(r))
+        return -1;
+    uint32_t size = rec_size(len);
+    uint32_t phys = r->tail % r->size;
+    uint32_t skip = phys + size > r->size ? r->size - phys : 0;
+
+    if (r->tail + skip + size - *r->credit > r->size) {
+        r->stalls++;
+        return rdma_ring_poll(r) < 0 ? -1 : 1;
+    }
+
+    if (skip) {
+        struct rdma_ring_hdr *w = (struct rdma_ring_hdr *)(r->stage + phys);
+        w->len = RDMA_RING_WRAP;
+        w->seq = r->tx_seq;
+        r->tx_seq = next_seq(r->tx_seq);
+        if (post_write(r, w, phys, sizeof(*w)))
+            return -1;
+        r->tail += skip;
+        phys = 0;
+    }
+
+    char *rec = r->stage + phys;
+    struct rdma_ring_hdr *h = (struct rdma_ring_hdr *)rec;
+    struct rdma_ring_trl *t = (struct rdma_ring_trl *)(rec + size - sizeof(*t));
+    h->len = len;
+    h->seq = r->tx_seq;
+    memcpy(h + 1, msg, len);
+    t->seq = r->tx_seq;
+    t->zero = 0;
+    r->tx_seq = next_seq(r->tx_seq);
+    if (post_write(r, rec, phys, size))
+        return -1;
+    r->tail += size;
+    return 0;
+}
+
+const void *rdma_ring_peek(struct rdma_ring *r, uint32_t *len) {
+    for (;;) {
+        uint32_t phys = r->head % r->size;
+        const volatile struct rdma_ring_hdr *h = (const volatile struct rdma_ring_hdr *)(r->rx + phys);
+        if (h->seq != r->rx_seq)
+            return NULL;
+
+        uint32_t n = h->len;
+        if (n == RDMA_RING_WRAP) {
+            /* the skipped tail may hold last lap's payload where a later trailer lands */
+            memset(r->rx + phys, 0, r->size - phys);
+            r->head += r->size - phys;
+            r->rx_seq = next_seq(r->rx_seq);
+            continue;
+        }
+        /* the length comes from remote memory: a torn or bad one is not a record yet */
+        if (n > rdma_ring_max_msg(r))
+            return NULL;
+        uint32_t size = rec_size(n);
+        if (phys + size > r->size)
+            return NULL;
+        const volatile struct rdma_ring_trl *t =
+            (const volatile struct rdma_ring_trl *)(r->rx + phys + size - sizeof(*t));
+        if (t->seq != r->rx_seq)
+            return NULL;
+        /* the payload must not be read ahead of the trailer */
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        *len = n;
+        return (const char *)(h + 1);
+    }
+}
+
+int rdma_ring_release(struct rdma_ring *r) {
+    uint32_t phys = r->head % r->size;
+    const struct rdma_ring_hdr *h = (const struct rdma_ring_hdr *)(r->rx + phys);
+    uint32_t size = rec_size(h->len);
+
+    /* zeroed before its credit goes back: no stale word can pass for a later trailer */
+    memset(r->rx + phys, 0, size);
+    r->head += size;
+    r->rx_seq = next_seq(r->rx_seq);
+    if (r->head - r->credited < r->size / 4)
+        return 0;
+
+    /* a later WRITE may carry a newer head than it was posted for: harmless */
+    *r->credit_src = r->head;
+    r->credited = r->head;
+    return post_write(r, r->credit_src, r->size, sizeof(uint64_t));
+}
@@ -0,0 +1,95 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include "rdma_conn.h"
+
+/*
+ * Message channel over RDMA WRITE, one ring per direction.
+ *
+ * Each endpoint exports a region laid out as [ring | credit line |
+ * staging copy of the peer's ring]. The producer builds a record in
+ * its staging area at the offset it will occupy in the consumer's ring
+ * and WRITEs it there:
+ *
+ *     u32 len | u32 seq | payload, padded to 8 | u32 seq | u32 0
+ *
+ * The consumer polls its ring at head: the header's seq says a record
+ * has started to land, the trailer's that all of it has (a WRITE is
+ * placed in address order on the HCAs this targets). Sequence numbers
+ * tell a new record from last lap's header, but a trailer lands where
+ * old payload was, and old payload can hold any value: the consumer
+ * zeroes every record it releases, and the span a wrap marker skips,
+ * before the producer gets the space back. A record that would straddle
+ * the end is preceded by a header-only wrap marker.
+ *
+ * Every ring_size / 4 bytes consumed, the consumer WRITEs its head into
+ * the producer's credit line; the producer never lets tail - credit
+ * exceed the ring. Records are limited to ring_size / 4 so that this
+ * always leaves room for the next one.
+ */
+#define RDMA_RING_WRAP    UINT32_MAX
+#define RDMA_RING_MIN     4096
+
+struct rdma_ring_hdr {
+    uint32_t len;
+    uint32_t seq;
+};
+
+struct rdma_ring_trl {
+    uint32_t seq;
+    uint32_t zero;
+};
+
+struct rdma_ring {
+    struct rdma_conn   *conn;
+    uint32_t            size;
+    uint32_t            lkey;
+
+    /* receive half: the peer's records land in rx */
+    char               *rx;
+    uint64_t            head;           /* bytes consumed */
+    uint32_t            rx_seq;         /* expected at head */
+    uint64_t            credited;       /* head last written back */
+    uint64_t           *credit_src;     /* registered copy of head for that WRITE */
+
+    /* send half */
+    char               *stage;
+    volatile uint64_t  *credit;         /* the peer's head, written by the peer */
+    uint64_t            tail;           /* bytes produced */
+    uint32_t            tx_seq;
+    uint64_t            stalls;         /* sends refused for lack of credit */
+
+    /* both halves' WRITEs share the send queue: signal every sq_depth / 2 */
+    uint32_t            sq_depth;
+    uint64_t            posted;
+    uint64_t            completed;
+};
+
+/* bytes to register and export for a ring of size bytes */
+static inline size_t rdma_ring_region_len(uint32_t size) {
+    return 2 * (size_t)size + 64;
+}
+
+/* largest message rdma_ring_send() takes */
+static inline uint32_t rdma_ring_max_msg(const struct rdma_ring *r) {
+    return r->size / 4 - sizeof(struct rdma_ring_hdr) - sizeof(struct rdma_ring_trl);
+}
+
+/*
+ * region: rdma_ring_region_len(size) zeroed bytes registered with lkey
+ * and REMOTE_WRITE, exported as conn->local. The peer uses the same size.
+ * The ring owns conn->send_cq; size is a multiple of 64, >= RDMA_RING_MIN.
+ */
+int  rdma_ring_init(struct rdma_ring *r, struct rdma_conn *conn, void *region, uint32_t lkey,
+                    uint32_t size);
+
+/* 0: sent, 1: no room until the consumer returns credits, -1: error */
+int  rdma_ring_send(struct rdma_ring *r, const void *msg, uint32_t len);
+
+/* the payload of the record at head, or NULL if none has fully landed */
+const void *rdma_ring_peek(struct rdma_ring *r, uint32_t *len);
+/* done with what peek returned; returns credits when due */
+int  rdma_ring_release(struct rdma_ring *r);
+
+/* reap send completions without blocking; -1 on a failed WRITE */
+int  rdma_ring_poll(struct rdma_ring *r);
@@ -0,0 +1,237 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <infiniband/verbs.h>
+#include "rdma_rpc.h"
+#include "rdma_poll.h"
+
+/* wr_id: kind << 32 | buffer index */
+enum { WR_RECV, WR_SEND };
+
+#define WR_ID(kind, idx)  ((uint64_t)(kind) << 32 | (idx))
+
+static int post_recv(struct rdma_rpc *r, uint32_t slot) {
+    struct rdma_buf *b = &r->rx->bufs[slot];
+    struct ibv_sge sge = {
+        .addr = (uintptr_t)b->addr,
+        .length = sizeof(struct rdma_rpc_hdr) + r->max_msg,
+        .lkey = b->lkey
+    };
+    struct ibv_recv_wr wr = {
+        .wr_id = WR_ID(WR_RECV, slot),
+        .sg_list = &sge,
+        .num_sge = 1
+    }, *bad;
+    if (ibv_post_recv(r->conn->qp, &wr, &bad)) {
+        RDMA_ERR("ibv_post_recv RPC buffer %u failed", slot);
+        return -1;
+    }
+    return 0;
+}
+
+int rdma_rpc_init(struct rdma_rpc *r, struct rdma_conn *conn, uint32_t depth, uint32_t max_msg,
+                  const struct rdma_rpc_registry *reg) {
+    memset(r, 0, sizeof(*r));
+    r->conn = conn;
+    r->reg = reg;
+    r->depth = depth;
+    r->max_msg = max_msg;
+
+    size_t slot = sizeof(struct rdma_rpc_hdr) + max_msg;
+    r->rx = rdma_pool_create(conn->dev->pd, slot, 2 * depth, IBV_ACCESS_LOCAL_WRITE);
+    r->tx = rdma_pool_create(conn->dev->pd, slot, 2 * depth, IBV_ACCESS_LOCAL_WRITE);
+    r->tx_free = calloc(2 * depth, sizeof(*r->tx_free));
+    r->calls = calloc(depth, sizeof(*r->calls));
+    r->call_free = calloc(depth, sizeof(*r->call_free));
+    r->backlog = calloc(depth, sizeof(*r->backlog));
+    if (!r->rx || !r->tx || !r->tx_free || !r->calls || !r->call_free || !r->backlog) {
+        rdma_rpc_fini(r);
+        return -1;
+    }
+    for (uint32_t i = 0; i < 2 * depth; i++)
+        r->tx_free[r->tx_nfree++] = 2 * depth - 1 - i;
+    for (uint32_t i = 0; i < depth; i++)
+        r->call_free[r->call_nfree++] = depth - 1 - i;
+    r->seq = 1;
+    for (uint32_t i = 0; i < 2 * depth; i++) {
+        if (post_recv(r, i)) {
+            rdma_rpc_fini(r);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void rdma_rpc_fini(struct rdma_rpc *r) {
+    rdma_pool_destroy(r->rx);
+    rdma_pool_destroy(r->tx);
+    free(r->tx_free);
+    free(r->calls);
+    free(r->call_free);
+    free(r->backlog);
+    memset(r, 0, sizeof(*r));
+}
+
+int rdma_rpc_register(struct rdma_rpc_registry *reg, uint16_t method, rdma_rpc_handler fn, void *arg) {
+    if (method >= RDMA_RPC_MAX_METHODS || reg->fn[method]) {
+        RDMA_LOG("RPC method %u: out of range or taken", method);
+        return -1;
+    }
+    reg->fn[method] = fn;
+    reg->arg[method] = arg;
+    return 0;
+}
+
+/* the header and len bytes behind it in send buffer slot */
+static int post_send(struct rdma_rpc *r, uint32_t slot, uint32_t len) {
+    struct rdma_buf *b = &r->tx->bufs[slot];
+    uint32_t n = sizeof(struct rdma_rpc_hdr) + len;
+    struct ibv_sge sge = {
+        .addr = (uintptr_t)b->addr,
+        .length = n,
+        .lkey = b->lkey
+    };
+    struct ibv_send_wr wr = {
+        .wr_id = WR_ID(WR_SEND, slot),
+        .opcode = IBV_WR_SEND,
+        .sg_list = &sge,
+        .num_sge = 1,
+        .send_flags = IBV_SEND_SIGNALED | rdma_inline_flag(r->conn, n)
+    }, *bad;
+    if (ibv_post_send(r->conn->qp, &wr, &bad)) {
+        RDMA_ERR("ibv_post_send RPC of %u bytes failed", n);
+        r->tx_free[r->tx_nfree++] = slot;
+        return -1;
+    }
+    return 0;
+}
+
+int rdma_rpc_call(struct rdma_rpc *r, uint16_t method, const void *req, uint32_t len,
+                  rdma_rpc_done done, void *arg, uint64_t ctx) {
+    if (len > r->max_msg) {
+        RDMA_LOG("RPC method %u: %u byte request, max %u", method, len, r->max_msg);
+        return -1;
+    }
+    if (!r->call_nfree || !r->tx_nfree)
+        return 1;
+
+    uint32_t cs = r->call_free[--r->call_nfree];
+    uint32_t slot = r->tx_free[--r->tx_nfree];
+    struct rdma_rpc_call *call = &r->calls[cs];
+    /* wrap before seq * depth + slot would */
+    if ((uint64_t)(r->seq + 1) * r->depth > UINT32_MAX)
+        r->seq = 1;
+    call->req_id = r->seq++ * r->depth + cs;
+    call->done = done;
+    call->arg = arg;
+    call->ctx = ctx;
+
+    struct rdma_rpc_hdr *h = r->tx->bufs[slot].addr;
+    h->req_id = call->req_id;
+    h->method = method;
+    h->reply = 0;
+    h->status = 0;
+    h->len = len;
+    memcpy(h + 1, req, len);
+    if (post_send(r, slot, len)) {
+        call->req_id = 0;
+        r->call_free[r->call_nfree++] = cs;
+        return -1;
+    }
+    return 0;
+}
+
+/* run the handler for the request in receive slot rs; 1 if no send buffer is free */
+static int serve(struct rdma_rpc *r, uint32_t rs) {
+    const struct rdma_rpc_hdr *q = r->rx->bufs[rs].addr;
+
+    if (!r->tx_nfree)
+        return 1;
+    uint32_t slot = r->tx_free[--r->tx_nfree];
+    struct rdma_rpc_hdr *h = r->tx->bufs[slot].addr;
+    uint32_t len = 0;
+    int status = RDMA_RPC_ENOMETHOD;
+
+    if (r->reg && q->method < RDMA_RPC_MAX_METHODS && r->reg->fn[q->method])
+        status = r->reg->fn[q->method](r->reg->arg[q->method], q + 1, q->len, h + 1, &len);
+    if (len > r->max_msg) {
+        len = 0;
+        status = RDMA_RPC_ETOOBIG;
+    }
+    h->req_id = q->req_id;
+    h->method = q->method;
+    h->reply = 1;
+    h->status = status;
+    h->len = len;
+    r->served++;
+    if (post_send(r, slot, len) || post_recv(r, rs))
+        return -1;
+    return 0;
+}
+
+static int complete(struct rdma_rpc *r, uint32_t rs) {
+    const struct rdma_rpc_hdr *h = r->rx->bufs[rs].addr;
+    struct rdma_rpc_call *call = &r->calls[h->req_id % r->depth];
+
+    if (call->req_id != h->req_id) {
+        r->stale++;
+        return post_recv(r, rs);
+    }
+    call->req_id = 0;
+    r->call_free[r->call_nfree++] = h->req_id % r->depth;
+    r->calls_done++;
+    call->done(call->arg, call->ctx, h->status, h + 1, h->len);
+    return post_recv(r, rs);
+}
+
+int rdma_rpc_poll(struct rdma_rpc *r) {
+    struct ibv_wc wc[RDMA_POLL_MAX_BATCH];
+
+    int n = ibv_poll_cq(r->conn->send_cq, RDMA_POLL_MAX_BATCH, wc);
+    if (n < 0) {
+        RDMA_ERR("ibv_poll_cq failed");
+        return -1;
+    }
+    /* send completions first: they free the buffers replies go out in */
+    for (int i = 0; i < n; i++) {
+        if (wc[i].status != IBV_WC_SUCCESS) {
+            RDMA_LOG("RPC WR %#lx failed status=%s", wc[i].wr_id, ibv_wc_status_str(wc[i].status));
+            return -1;
+        }
+        if (wc[i].wr_id >> 32 == WR_SEND)
+            r->tx_free[r->tx_nfree++] = (uint32_t)wc[i].wr_id;
+    }
+    while (r->bl_head != r->bl_tail) {
+        int ret = serve(r, r->backlog[r->bl_head % r->depth]);
+        if (ret < 0)
+            return -1;
+        if (ret)
+            break;
+        r->bl_head++;
+    }
+    for (int i = 0; i < n; i++) {
+        if (wc[i].wr_id >> 32 != WR_RECV)
+            continue;
+        uint32_t rs = (uint32_t)wc[i].wr_id;
+        const struct rdma_rpc_hdr *h = r->rx->bufs[rs].addr;
+        int ret;
+        if (wc[i].byte_len < sizeof(*h) || wc[i].byte_len - sizeof(*h) != h->len) {
+            RDMA_LOG("RPC message of %u bytes with a bad header", wc[i].byte_len);
+            return -1;
+        }
+        if (h->reply) {
+            ret = complete(r, rs);
+        } else {
+            /* in arrival order: behind anything already waiting */
+            ret = r->bl_head != r->bl_tail ? 1 : serve(r, rs);
+            if (ret == 1) {
+                r->backlog[r->bl_tail++ % r->depth] = rs;
+                ret = 0;
+            }
+        }
+        if (ret)
+            return -1;
+    }
+    return n;
+}
@@ -0,0 +1,106 @@
+#pragma once
+#include <stdint.h>
+#include <infiniband/verbs.h>
+#include "rdma_conn.h"
+#include "rdma_pool.h"
+
+#define RDMA_RPC_MAX_METHODS  256
+
+/* reply status; handlers return their own codes below these */
+#define RDMA_RPC_OK           0
+#define RDMA_RPC_ENOMETHOD    254
+#define RDMA_RPC_ETOOBIG      255
+
+/*
+ * Request/response RPC over SEND/RECV on one RC QP.
+ *
+ * Every message is a 16 byte header plus up to max_msg bytes of
+ * arguments or results, received into pre-posted buffers. Calls carry
+ * a request id; replies echo it, so any number of calls up to depth can
+ * be outstanding on one QP and complete in whatever order the peer
+ * answers. The request id is seq * depth + call slot, so a reply finds
+ * its call without a search and a stale id is recognised.
+ *
+ * Either side can call and serve: requests are dispatched to the
+ * handler registered for their method, which writes its result straight
+ * into the reply's send buffer. Handlers and completion callbacks run
+ * inside rdma_rpc_poll(). A side that does both can have the peer's
+ * depth calls and the replies to its own depth calls arriving at once,
+ * so 2 * depth receives are posted.
+ */
+struct rdma_rpc_hdr {
+    uint32_t req_id;
+    uint16_t method;
+    uint8_t  reply;
+    uint8_t  status;
+    uint32_t len;           /* bytes after the header */
+    uint32_t rsvd;
+};
+
+/* resp has room for max_msg bytes; returns RDMA_RPC_OK or an error status */
+typedef int (*rdma_rpc_handler)(void *arg, const void *req, uint32_t len,
+                                void *resp, uint32_t *resp_len);
+
+struct rdma_rpc_registry {
+    rdma_rpc_handler    fn[RDMA_RPC_MAX_METHODS];
+    void               *arg[RDMA_RPC_MAX_METHODS];
+};
+
+/* resp is only valid during the call */
+typedef void (*rdma_rpc_done)(void *arg, uint64_t ctx, int status, const void *resp, uint32_t len);
+
+struct rdma_rpc_call {
+    uint32_t        req_id;     /* 0: free */
+    rdma_rpc_done   done;
+    void           *arg;
+    uint64_t        ctx;
+};
+
+struct rdma_rpc {
+    struct rdma_conn           *conn;
+    const struct rdma_rpc_registry *reg;   /* NULL: calls only */
+    uint32_t                    depth;
+    uint32_t                    max_msg;
+
+    struct rdma_pool           *rx;        /* 2 * depth: calls and replies */
+    struct rdma_pool           *tx;        /* 2 * depth: calls and replies */
+    uint32_t                   *tx_free;
+    uint32_t                    tx_nfree;
+
+    struct rdma_rpc_call       *calls;     /* depth */
+    uint32_t                   *call_free;
+    uint32_t                    call_nfree;
+    uint32_t                    seq;
+
+    /* requests that found no free send buffer, by receive slot */
+    uint32_t                   *backlog;
+    uint32_t                    bl_head, bl_tail;
+
+    uint64_t                    calls_done, served, stale;
+};
+
+/*
+ * conn needs max_send_wr >= 2 * depth and max_recv_wr >= 2 * depth; both
+ * sides use the same depth and max_msg. reg may be shared between endpoints.
+ */
+int  rdma_rpc_init(struct rdma_rpc *r, struct rdma_conn *conn, uint32_t depth, uint32_t max_msg,
+                   const struct rdma_rpc_registry *reg);
+void rdma_rpc_fini(struct rdma_rpc *r);
+
+int  rdma_rpc_register(struct rdma_rpc_registry *reg, uint16_t method, rdma_rpc_handler fn, void *arg);
+
+/*
+ * Call method with len bytes of arguments (copied). done(arg, ctx, ...)
+ * runs when the reply arrives. 0: sent, 1: depth calls outstanding or no
+ * send buffer, poll and retry, -1: error.
+ */
+int  rdma_rpc_call(struct rdma_rpc *r, uint16_t method, const void *req, uint32_t len,
+                   rdma_rpc_done done, void *arg, uint64_t ctx);
+
+/* outstanding calls */
+static inline uint32_t rdma_rpc_inflight(const struct rdma_rpc *r) {
+    return r->depth - r->call_nfree;
+}
+
+/* reap completions, serve requests, complete calls; returns WCs seen or -1 */
+int  rdma_rpc_poll(struct rdma_rpc *r);
@@ -0,0 +1,70 @@
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <arpa/inet.h>
+#include <infiniband/verbs.h>
+#include "rdma_sgl.h"
+
+int rdma_sgl_add(struct rdma_sgl *l, const void *addr, uint32_t len, uint32_t lkey) {
+    if (!len)
+        return 0;
+    if (l->n) {
+        struct ibv_sge *last = &l->sge[l->n - 1];
+        if (last->lkey == lkey && last->addr + last->length == (uintptr_t)addr) {
+            last->length += len;
+            l->len += len;
+            return 0;
+        }
+    }
+    if (l->n == RDMA_SGL_MAX)
+        return -1;
+    l->sge[l->n++] = (struct ibv_sge){
+        .addr = (uintptr_t)addr,
+        .length = len,
+        .lkey = lkey
+    };
+    l->len += len;
+    return 0;
+}
+
+int rdma_post_sgl(struct rdma_conn *conn, enum ibv_wr_opcode op, const struct rdma_sgl *l,
+                  uint64_t wr_id, unsigned int flags, uint64_t raddr, uint32_t rkey, uint32_t imm) {
+    if ((uint32_t)l->n > conn->cfg.max_send_sge) {
+        RDMA_LOG("%d SGEs, QP takes %u (--sge)", l->n, conn->cfg.max_send_sge);
+        return -1;
+    }
+    struct ibv_send_wr wr = {
+        .wr_id = wr_id,
+        .opcode = op,
+        .sg_list = (struct ibv_sge *)l->sge,
+        .num_sge = l->n,
+        .send_flags = (flags & ~IBV_SEND_INLINE) | rdma_inline_flag(conn, l->len),
+        .imm_data = htonl(imm)
+    }, *bad;
+    if (op == IBV_WR_RDMA_WRITE || op == IBV_WR_RDMA_WRITE_WITH_IMM) {
+        wr.wr.rdma.remote_addr = raddr;
+        wr.wr.rdma.rkey = rkey;
+    }
+    if (ibv_post_send(conn->qp, &wr, &bad)) {
+        RDMA_ERR("ibv_post_send %d SGEs, %u bytes failed", l->n, l->len);
+        return -1;
+    }
+    return 0;
+}
+
+int rdma_post_recv_sgl(struct rdma_conn *conn, const struct rdma_sgl *l, uint64_t wr_id) {
+    if ((uint32_t)l->n > conn->cfg.max_recv_sge) {
+        RDMA_LOG("%d SGEs, QP takes %u (--sge)", l->n, conn->cfg.max_recv_sge);
+        return -1;
+    }
+    struct ibv_recv_wr wr = {
+        .wr_id = wr_id,
+        .sg_list = (struct ibv_sge *)l->sge,
+        .num_sge = l->n
+    }, *bad;
+    if (ibv_post_recv(conn->qp, &wr, &bad)) {
+        RDMA_ERR("ibv_post_recv %d SGEs failed", l->n);
+        return -1;
+    }
+    return 0;
+}
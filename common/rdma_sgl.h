@@ -0,0 +1,39 @@
+#pragma once
+#include <stdint.h>
+#include <infiniband/verbs.h>
+#include "rdma_conn.h"
+
+#define RDMA_SGL_MAX 16
+
+/*
+ * Scatter/gather list for one WR. A message assembled from a header and
+ * separately registered application buffers goes out as one SEND or
+ * WRITE that the HCA gathers, and a receive can scatter a header into
+ * one buffer and the payload straight into its destination, so neither
+ * side memcpy's into a contiguous bounce buffer. The QP needs
+ * max_send_sge / max_recv_sge (--sge) of at least the entries used.
+ */
+struct rdma_sgl {
+    struct ibv_sge  sge[RDMA_SGL_MAX];
+    int             n;
+    uint32_t        len;            /* sum of the entries */
+};
+
+static inline void rdma_sgl_reset(struct rdma_sgl *l) {
+    l->n = 0;
+    l->len = 0;
+}
+
+/* append len bytes at addr; merged into the last entry when they are adjacent
+ * under the same key, skipped when empty. -1 when the list is full */
+int  rdma_sgl_add(struct rdma_sgl *l, const void *addr, uint32_t len, uint32_t lkey);
+
+/*
+ * Post l as one WR: IBV_WR_SEND[_WITH_IMM] ignores raddr/rkey, and
+ * IBV_WR_RDMA_WRITE[_WITH_IMM] places the entries back to back at raddr.
+ * Inlined when the total fits. -1 if l has more entries than the QP.
+ */
+int  rdma_post_sgl(struct rdma_conn *conn, enum ibv_wr_opcode op, const struct rdma_sgl *l,
+                   uint64_t wr_id, unsigned int flags, uint64_t raddr, uint32_t rkey, uint32_t imm);
+/* post l as one receive: an incoming message fills the entries in order */
+int  rdma_post_recv_sgl(struct rdma_conn *conn, const struct rdma_sgl *l, uint64_t wr_id);
@@ -0,0 +1,122 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sched.h>
+#include <pthread.h>
+#include <infiniband/verbs.h>
+#include "rdma_common.h"
+#include "rdma_shard.h"
+
+int rdma_shard_init(struct rdma_shard *s, struct rdma_dev *dev, int id, int cpu,
+                    int cq_depth, size_t buf_size, uint32_t nbufs, int access) {
+    memset(s, 0, sizeof(*s));
+    s->id = id;
+    s->cpu = cpu;
+    s->dev = dev;
+
+    if (cq_depth > dev->attr.max_cqe)
+        cq_depth = dev->attr.max_cqe;
+    s->cq = ibv_create_cq(dev->ctx, cq_depth, NULL, NULL, 0);
+    if (!s->cq) {
+        RDMA_ERR("shard %d: ibv_create_cq depth %d failed", id, cq_depth);
+        return -1;
+    }
+    s->pool = rdma_pool_create(dev->pd, buf_size, nbufs, access);
+    if (!s->pool) {
+        ibv_destroy_cq(s->cq);
+        return -1;
+    }
+    return 0;
+}
+
+void rdma_shard_destroy(struct rdma_shard *s) {
+    for (int i = 0; i < s->nconns; i++)
+        rdma_conn_destroy(s->conns[i]);
+    s->nconns = 0;
+    rdma_pool_destroy(s->pool);
+    if (s->cq)
+        ibv_destroy_cq(s->cq);
+}
+
+struct rdma_conn *rdma_shard_add_conn(struct rdma_shard *s, const struct rdma_cfg *cfg) {
+    if (s->nconns == RDMA_SHARD_MAX_CONNS) {
+        RDMA_LOG("shard %d: connection table full", s->id);
+        return NULL;
+    }
+    struct rdma_conn *conn = rdma_conn_create(s->dev, cfg, s->cq);
+    if (conn)
+        s->conns[s->nconns++] = conn;
+    return conn;
+}
+
+int rdma_pin_cpu(int cpu) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (err) {
+        errno = err;
+        RDMA_ERR("pin to cpu %d failed", cpu);
+        return -1;
+    }
+    return 0;
+}
+
+static void *shard_main(void *arg) {
+    struct rdma_shard *s = arg;
+
+    if (s->cpu >= 0 && rdma_pin_cpu(s->cpu)) {
+        s->ret = -1;
+        return NULL;
+    }
+    s->ret = s->fn(s);
+    return NULL;
+}
+
+int rdma_shard_start(struct rdma_shard *s, int (*fn)(struct rdma_shard *s), void *arg) {
+    s->fn = fn;
+    s->arg = arg;
+    s->stop = 0;
+    s->ret = 0;
+    int err = pthread_create(&s->thread, NULL, shard_main, s);
+    if (err) {
+        errno = err;
+        RDMA_ERR("shard %d: pthread_create failed", s->id);
+        return -1;
+    }
+    return 0;
+}
+
+int rdma_shard_join(struct rdma_shard *s) {
+    if (pthread_join(s->thread, NULL))
+        return -1;
+    return s->ret;
+}
+
+int rdma_parse_cpus(const char *list, int *cpus, int max) {
+    int n = 0;
+    const char *p = list;
+
+    while (*p) {
+        char *end;
+        long lo = strtol(p, &end, 10), hi = lo;
+        if (end == p || lo < 0)
+            return -1;
+        if (*end == '-') {
+            p = end + 1;
+            hi = strtol(p, &end, 10);
+            if (end == p || hi < lo)
+                return -1;
+        }
+        for (long c = lo; c <= hi && n < max; c++)
+            cpus[n++] = c;
+        if (*end == ',')
+            end++;
+        else if (*end)
+            return -1;
+        p = end;
+    }
+    return n;
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include <stdint.h>
+#include <pthread.h>
+#include <infiniband/verbs.h>
+#include "rdma_conn.h"
+#include "rdma_pool.h"
+
+#define RDMA_SHARD_MAX_CONNS 64
+
+/*
+ * One worker core: a thread pinned to cpu that alone polls cq, which
+ * every QP of the shard completes on, and alone touches the shard's
+ * buffer pool. Nothing is shared between shards on the data path.
+ */
+struct rdma_shard {
+    int                id;
+    int                cpu;             /* -1: not pinned */
+    struct rdma_dev   *dev;
+    struct ibv_cq     *cq;
+    struct rdma_pool  *pool;
+    struct rdma_conn  *conns[RDMA_SHARD_MAX_CONNS];
+    int                nconns;
+
+    pthread_t          thread;
+    int              (*fn)(struct rdma_shard *s);
+    void              *arg;
+    int                ret;
+    volatile int       stop;
+
+    /* written by the shard thread only */
+    uint64_t           msgs;
+    uint64_t           bytes;
+    uint64_t           ns;
+};
+
+int  rdma_shard_init(struct rdma_shard *s, struct rdma_dev *dev, int id, int cpu,
+                     int cq_depth, size_t buf_size, uint32_t nbufs, int access);
+void rdma_shard_destroy(struct rdma_shard *s);
+/* a QP completing on the shard's CQ; the shard destroys it */
+struct rdma_conn *rdma_shard_add_conn(struct rdma_shard *s, const struct rdma_cfg *cfg);
+/* run fn(s) on a new thread pinned to s->cpu */
+int  rdma_shard_start(struct rdma_shard *s, int (*fn)(struct rdma_shard *s), void *arg);
+/* returns fn's return value, or -1 if the thread could not be joined */
+int  rdma_shard_join(struct rdma_shard *s);
+
+int  rdma_pin_cpu(int cpu);
+/* "0,2,4-7" -> cpus[]; returns the count, or -1 on a malformed list */
+int  rdma_parse_cpus(const char *list, int *cpus, int max);
@@ -0,0 +1,77 @@
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <infiniband/verbs.h>
+#include "rdma_common.h"
+#include "rdma_sq.h"
+
+void rdma_sq_init(struct rdma_sq *sq, struct ibv_qp *qp, uint32_t depth,
+                  int signal_every, int batch) {
+    memset(sq, 0, sizeof(*sq));
+    sq->qp = qp;
+    sq->depth = depth;
+
+    /* a window without a signaled WR could never be retired */
+    if (signal_every < 1)
+        signal_every = 1;
+    if ((uint32_t)signal_every > depth)
+        signal_every = depth;
+    sq->signal_every = signal_every;
+
+    if (batch < 1)
+        batch = 1;
+    if (batch > RDMA_SQ_MAX_BATCH)
+        batch = RDMA_SQ_MAX_BATCH;
+    if ((uint32_t)batch > depth)
+        batch = depth;
+    sq->batch = batch;
+}
+
+int rdma_sq_post(struct rdma_sq *sq, const struct ibv_send_wr *tmpl, uint64_t remaining) {
+    uint64_t n = rdma_sq_credits(sq);
+    if (n > (uint64_t)sq->batch)
+        n = sq->batch;
+    if (n > remaining)
+        n = remaining;
+    if (!n)
+        return 0;
+
+    uint32_t len = 0;
+    for (int i = 0; i < tmpl->num_sge; i++)
+        len += tmpl->sg_list[i].length;
+    unsigned int flags = tmpl->send_flags & ~(IBV_SEND_SIGNALED | IBV_SEND_INLINE);
+    if (len <= sq->max_inline)
+        flags |= IBV_SEND_INLINE;
+
+    for (uint64_t i = 0; i < n; i++) {
+        struct ibv_send_wr *wr = &sq->wr[i];
+        uint64_t seq = sq->posted + i;
+
+        *wr = *tmpl;
+        wr->wr_id = seq;
+        wr->send_flags = flags;
+        if ((seq + 1) % sq->signal_every == 0 || (i == n - 1 && n == remaining))
+            wr->send_flags |= IBV_SEND_SIGNALED;
+        wr->next = i + 1 < n ? &sq->wr[i + 1] : NULL;
+    }
+
+    struct ibv_send_wr *bad;
+    if (ibv_post_send(sq->qp, sq->wr, &bad)) {
+        RDMA_ERR("ibv_post_send failed at wr_id %lu", bad->wr_id);
+        sq->posted += bad - sq->wr;
+        return -1;
+    }
+    sq->posted += n;
+    sq->doorbells++;
+    return n;
+}
+
+int rdma_sq_complete(struct rdma_sq *sq, const struct ibv_wc *wc) {
+    if (wc->status != IBV_WC_SUCCESS) {
+        printf("[RDMA][ERR] wr_id %lu failed status=%s\n",
+               wc->wr_id, ibv_wc_status_str(wc->status));
+        return -1;
+    }
+    sq->completed = wc->wr_id + 1;
+    return 0;
+}
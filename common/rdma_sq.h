@@ -0,0 +1,44 @@
+#pragma once
+#include <stdint.h>
+#include <infiniband/verbs.h>
+
+#define RDMA_SQ_MAX_BATCH 64
+
+/*
+ * Send-queue credits with selective signaling and doorbell batching.
+ *
+ * Every signal_every-th WR (and the last one of a run) is signaled; its
+ * completion retires all earlier unsignaled WRs, since an RC send queue
+ * completes in order. Up to batch WRs are chained through ->next so one
+ * ibv_post_send rings the doorbell once. posted - completed never
+ * exceeds depth, so the send queue cannot overflow.
+ */
+struct rdma_sq {
+    struct ibv_qp      *qp;
+    uint32_t            depth;
+    int                 signal_every;
+    int                 batch;
+    uint32_t            max_inline;     /* 0: never inline */
+
+    uint64_t            posted;
+    uint64_t            completed;
+    uint64_t            doorbells;
+
+    struct ibv_send_wr  wr[RDMA_SQ_MAX_BATCH];
+};
+
+void rdma_sq_init(struct rdma_sq *sq, struct ibv_qp *qp, uint32_t depth,
+                  int signal_every, int batch);
+
+static inline uint32_t rdma_sq_credits(const struct rdma_sq *sq) {
+    return sq->depth - (uint32_t)(sq->posted - sq->completed);
+}
+
+/*
+ * Post up to one batch of copies of tmpl, bounded by the free credits
+ * and by remaining (the WRs left in the run). wr_id is set to the WR's
+ * sequence number. Returns the number posted, or -1.
+ */
+int rdma_sq_post(struct rdma_sq *sq, const struct ibv_send_wr *tmpl, uint64_t remaining);
+/* account a send-queue completion; returns -1 on a failed WR */
+int rdma_sq_complete(struct rdma_sq *sq, const struct ibv_wc *wc);
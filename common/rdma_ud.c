@@ -0,0 +1,166 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <infiniband/verbs.h>
+#include "rdma_ud.h"
+
+struct rdma_ud *rdma_ud_create(struct rdma_dev *dev, const struct rdma_cfg *cfg, struct ibv_cq *cq) {
+    struct rdma_ud *ud = calloc(1, sizeof(*ud));
+    ud->dev = dev;
+
+    enum ibv_mtu active = dev->port_attr.active_mtu;
+    ud->mtu = rdma_mtu_to_int(cfg->path_mtu && cfg->path_mtu < active ? cfg->path_mtu : active);
+
+    if (!cq) {
+        int depth = cfg->cq_depth ? cfg->cq_depth
+                                  : (int)(cfg->max_send_wr + cfg->max_recv_wr);
+        cq = ibv_create_cq(dev->ctx, depth, NULL, NULL, 0);
+        if (!cq) {
+            RDMA_ERR("ibv_create_cq depth %d failed", depth);
+            free(ud);
+            return NULL;
+        }
+        ud->own_cq = 1;
+    }
+    ud->cq = cq;
+
+    uint32_t max_sge = dev->attr.max_sge;
+    struct ibv_qp_init_attr qpia = {
+        .send_cq = cq,
+        .recv_cq = cq,
+        .qp_type = IBV_QPT_UD,
+        .cap = {
+            .max_send_wr = cfg->max_send_wr,
+            .max_recv_wr = cfg->max_recv_wr,
+            .max_send_sge = cfg->max_send_sge < max_sge ? cfg->max_send_sge : max_sge,
+            .max_recv_sge = cfg->max_recv_sge < max_sge ? cfg->max_recv_sge : max_sge,
+            .max_inline_data = cfg->max_inline_data
+        }
+    };
+    for (;;) {
+        ud->qp = ibv_create_qp(dev->pd, &qpia);
+        if (ud->qp || !qpia.cap.max_inline_data)
+            break;
+        qpia.cap.max_inline_data /= 2;
+    }
+    if (!ud->qp) {
+        RDMA_ERR("ibv_create_qp UD failed");
+        goto err;
+    }
+    ud->max_inline = qpia.cap.max_inline_data;
+
+    /* no remote to learn: INIT, RTR and RTS back to back */
+    struct ibv_qp_attr attr = {
+        .qp_state = IBV_QPS_INIT,
+        .pkey_index = 0,
+        .port_num = dev->ib_port,
+        .qkey = RDMA_UD_QKEY
+    };
+    if (ibv_modify_qp(ud->qp, &attr,
+        IBV_QP_STATE | IBV_QP_PKEY_INDEX | IBV_QP_PORT | IBV_QP_QKEY)) {
+        RDMA_ERR("UD QP to INIT failed");
+        goto err;
+    }
+    memset(&attr, 0, sizeof(attr));
+    attr.qp_state = IBV_QPS_RTR;
+    if (ibv_modify_qp(ud->qp, &attr, IBV_QP_STATE)) {
+        RDMA_ERR("UD QP to RTR failed");
+        goto err;
+    }
+    attr.qp_state = IBV_QPS_RTS;
+    attr.sq_psn = 0;
+    if (ibv_modify_qp(ud->qp, &attr, IBV_QP_STATE | IBV_QP_SQ_PSN)) {
+        RDMA_ERR("UD QP to RTS failed");
+        goto err;
+    }
+
+    ud->local.qp_num = ud->qp->qp_num;
+    memcpy(ud->local.gid, &dev->gid, 16);
+    return ud;
+
+err:
+    rdma_ud_destroy(ud);
+    return NULL;
+}
+
+void rdma_ud_destroy(struct rdma_ud *ud) {
+    if (!ud)
+        return;
+    if (ud->qp)
+        ibv_destroy_qp(ud->qp);
+    if (ud->own_cq && ud->cq)
+        ibv_destroy_cq(ud->cq);
+    free(ud);
+}
+
+/* ---------- address-handle cache ---------- */
+
+int rdma_ah_cache_init(struct rdma_ah_cache *c, struct rdma_dev *dev,
+                       const struct rdma_cfg *cfg, uint32_t size) {
+    memset(c, 0, sizeof(*c));
+    c->dev = dev;
+    c->hop_limit = cfg->hop_limit;
+    for (c->size = 16; c->size < 2 * size; c->size *= 2);
+    c->slots = calloc(c->size, sizeof(*c->slots));
+    return c->slots ? 0 : -1;
+}
+
+void rdma_ah_cache_destroy(struct rdma_ah_cache *c) {
+    for (uint32_t i = 0; c->slots && i < c->size; i++) {
+        if (c->slots[i].ah)
+            ibv_destroy_ah(c->slots[i].ah);
+    }
+    free(c->slots);
+    c->slots = NULL;
+}
+
+static uint32_t ah_hash(const uint8_t *gid, uint32_t qpn) {
+    uint32_t h = 2166136261u;
+    for (int i = 0; i < 16; i++)
+        h = (h ^ gid[i]) * 16777619u;
+    return (h ^ qpn) * 16777619u;
+}
+
+struct rdma_ah_entry *rdma_ah_lookup(struct rdma_ah_cache *c, const struct qp_info *remote) {
+    uint32_t mask = c->size - 1;
+    uint32_t h = ah_hash(remote->gid, remote->qp_num) & mask;
+
+    for (;; h = (h + 1) & mask) {
+        struct rdma_ah_entry *e = &c->slots[h];
+        if (!e->ah)
+            break;
+        if (e->qpn == remote->qp_num && !memcmp(e->gid, remote->gid, 16)) {
+            c->hits++;
+            return e;
+        }
+    }
+
+    /* keep the table at most half full so probes stay short */
+    if (2 * (c->used + 1) > c->size) {
+        RDMA_LOG("AH cache full (%u entries)", c->used);
+        return NULL;
+    }
+    struct ibv_ah_attr attr = {
+        .is_global = 1,
+        .port_num = c->dev->ib_port,
+        .grh = {
+            .hop_limit = c->hop_limit,
+            .sgid_index = c->dev->gid_index
+        }
+    };
+    memcpy(&attr.grh.dgid, remote->gid, 16);
+    struct ibv_ah *ah = ibv_create_ah(c->dev->pd, &attr);
+    if (!ah) {
+        RDMA_ERR("ibv_create_ah for qpn %u failed", remote->qp_num);
+        return NULL;
+    }
+
+    struct rdma_ah_entry *e = &c->slots[h];
+    memcpy(e->gid, remote->gid, 16);
+    e->qpn = remote->qp_num;
+    e->ah = ah;
+    c->used++;
+    c->misses++;
+    return e;
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <stdint.h>
+#include <infiniband/verbs.h>
+#include "rdma_conn.h"
+
+#define RDMA_UD_QKEY  0x11111111
+#define RDMA_UD_GRH   40            /* every UD receive starts with the GRH */
+
+/*
+ * One UD QP talks to any number of peers: the destination travels in
+ * each WR (address handle + remote QPN) instead of living in the QP.
+ */
+struct rdma_ud {
+    struct rdma_dev *dev;
+    struct ibv_cq   *cq;
+    int              own_cq;
+    struct ibv_qp   *qp;
+    uint32_t         max_inline;
+    uint32_t         mtu;           /* largest payload: the port's active MTU */
+    struct qp_info   local;
+};
+
+/* UD QP moved straight to RTS; cq == NULL gives it its own */
+struct rdma_ud *rdma_ud_create(struct rdma_dev *dev, const struct rdma_cfg *cfg, struct ibv_cq *cq);
+void            rdma_ud_destroy(struct rdma_ud *ud);
+
+/*
+ * UD drops instead of retrying, so messages carry their own order: a
+ * flow is one logical sender -> receiver stream, seq counts its messages.
+ */
+struct rdma_ud_hdr {
+    uint32_t flow;
+    uint32_t seq;
+};
+
+/* ---------- address-handle cache, keyed by remote GID + QPN ---------- */
+struct rdma_ah_entry {
+    uint8_t        gid[16];
+    uint32_t       qpn;
+    struct ibv_ah *ah;              /* NULL: free slot */
+};
+
+struct rdma_ah_cache {
+    struct rdma_dev      *dev;
+    uint8_t               hop_limit;
+    uint32_t              size;     /* power of two */
+    uint32_t              used;
+    struct rdma_ah_entry *slots;
+    uint64_t              hits;
+    uint64_t              misses;
+};
+
+int  rdma_ah_cache_init(struct rdma_ah_cache *c, struct rdma_dev *dev,
+                        const struct rdma_cfg *cfg, uint32_t size);
+void rdma_ah_cache_destroy(struct rdma_ah_cache *c);
+/* the cached AH for remote, created on first use; NULL if full or on error */
+struct rdma_ah_entry *rdma_ah_lookup(struct rdma_ah_cache *c, const struct qp_info *remote);
+
+/* fill the UD part of a send WR for entry */
+static inline void rdma_ud_wr_dest(struct ibv_send_wr *wr, const struct rdma_ah_entry *e) {
+    wr->wr.ud.ah = e->ah;
+    wr->wr.ud.remote_qpn = e->qpn;
+    wr->wr.ud.remote_qkey = RDMA_UD_QKEY;
+}
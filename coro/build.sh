@@ -0,0 +1,11 @@
+#!/bin/bash
+
+COMMON="-I../common ../common/rdma_conn.c ../common/rdma_pool.c"
+FLAGS="-O2 -Wall -Wextra"
+
+gcc $FLAGS server.c $COMMON -o server -libverbs
+
+# the client is C++20 (common/rdma_coro.hpp) over the C library
+gcc $FLAGS -I../common -c ../common/rdma_conn.c ../common/rdma_pool.c
+g++ $FLAGS -std=c++20 client.cpp -I../common rdma_conn.o rdma_pool.o -o client -libverbs
+rm -f rdma_conn.o rdma_pool.o
@@ -0,0 +1,256 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <getopt.h>
+#include <infiniband/verbs.h>
+#include "rdma_coro.hpp"
+extern "C" {
+#include "rdma_pool.h"
+#include "rdma_bench.h"
+}
+#include "coro_proto.h"
+
+#define LOG(fmt, ...)  printf("[CLIENT] " fmt "\n", ##__VA_ARGS__)
+#define ERR(fmt, ...)  printf("[CLIENT][ERR] " fmt " (errno=%d:%s)\n", ##__VA_ARGS__, errno, strerror(errno))
+
+struct bench {
+    struct rdma_conn   *rc;
+    int                 test;
+    uint32_t            size;
+    uint32_t            slots;
+    char               *local;
+    uint32_t            lkey;
+    uint64_t            raddr;
+    uint32_t            rkey;
+    uint64_t            bad;
+};
+
+/* ---------- raw verbs: a window of WRs, each reposted from its own completion ---------- */
+
+static int raw_post(struct bench *b, uint64_t slot) {
+    uint64_t off = slot % b->slots * b->size;
+    struct ibv_sge sge = {
+        .addr = (uintptr_t)b->local + off,
+        .length = b->size,
+        .lkey = b->lkey
+    };
+    struct ibv_send_wr wr = {}, *bad;
+    wr.wr_id = slot;
+    wr.sg_list = &sge;
+    wr.num_sge = 1;
+    wr.opcode = b->test == TEST_READ ? IBV_WR_RDMA_READ :
+                b->test == TEST_WRITE ? IBV_WR_RDMA_WRITE : IBV_WR_SEND;
+    wr.send_flags = IBV_SEND_SIGNALED;
+    if (b->test != TEST_READ)
+        wr.send_flags |= rdma_inline_flag(b->rc, b->size);
+    wr.wr.rdma.remote_addr = b->raddr + off;
+    wr.wr.rdma.rkey = b->rkey;
+    if (ibv_post_send(b->rc->qp, &wr, &bad)) {
+        ERR("ibv_post_send failed");
+        return -1;
+    }
+    return 0;
+}
+
+/* returns the run's wall time in ns, 0 on error */
+static uint64_t run_raw(struct bench *b, uint32_t window, uint64_t ops) {
+    struct ibv_wc wc[RDMA_POLL_MAX_BATCH];
+    uint64_t posted = 0, done = 0;
+
+    uint64_t t0 = rdma_now_ns();
+    for (; posted < window && posted < ops; posted++) {
+        if (raw_post(b, posted))
+            return 0;
+    }
+    while (done < ops) {
+        int n = ibv_poll_cq(b->rc->send_cq, RDMA_POLL_MAX_BATCH, wc);
+        if (n < 0) {
+            ERR("ibv_poll_cq failed");
+            return 0;
+        }
+        for (int i = 0; i < n; i++) {
+            if (wc[i].status != IBV_WC_SUCCESS) {
+                LOG("WR %lu failed status=%s", wc[i].wr_id, ibv_wc_status_str(wc[i].status));
+                return 0;
+            }
+            done++;
+            if (posted < ops) {
+                if (raw_post(b, wc[i].wr_id))
+                    return 0;
+                posted++;
+            }
+        }
+    }
+    return rdma_now_ns() - t0;
+}
+
+/* ---------- coroutines: one per operation in flight ---------- */
+
+static rdma::task worker(rdma::connection &c, struct bench *b, uint32_t slot, uint64_t ops) {
+    uint64_t off = (uint64_t)(slot % b->slots) * b->size;
+    rdma::buf l = {b->local + off, b->size, b->lkey};
+    rdma::remote r = {b->raddr + off, b->rkey};
+
+    for (uint64_t i = 0; i < ops; i++) {
+        rdma::result res = co_await (b->test == TEST_READ ? c.read(l, r) :
+                                     b->test == TEST_WRITE ? c.write(l, r) : c.send(l));
+        if (!res.ok()) {
+            LOG("%s failed status=%s", coro_test_name(b->test), ibv_wc_status_str(res.status));
+            b->bad++;
+            co_return;
+        }
+    }
+}
+
+static uint64_t run_coro(struct bench *b, uint32_t coros, uint64_t ops, uint64_t *parked) {
+    rdma::scheduler s(b->rc->send_cq);
+    rdma::connection c(s, b->rc);
+
+    uint64_t t0 = rdma_now_ns();
+    for (uint32_t i = 0; i < coros; i++)
+        s.spawn(worker(c, b, i, ops / coros + (i < ops % coros)));
+    if (s.run())
+        return 0;
+    uint64_t ns = rdma_now_ns() - t0;
+    *parked = c.parked();
+    return b->bad ? 0 : ns;
+}
+
+/* the machinery alone: a suspend and resume through the scheduler, no WR behind it */
+static rdma::task yielder(rdma::scheduler &s, uint64_t n) {
+    for (uint64_t i = 0; i < n; i++)
+        co_await s.yield();
+}
+
+static double switch_ns(uint32_t coros, uint64_t ops) {
+    rdma::scheduler s(NULL);
+
+    uint64_t t0 = rdma_now_ns();
+    for (uint32_t i = 0; i < coros; i++)
+        s.spawn(yielder(s, ops / coros));
+    s.run();
+    return (double)(rdma_now_ns() - t0) / (ops / coros * coros);
+}
+
+static void usage(const char *prog) {
+    printf("Usage: %s [options] <server_ip>\n"
+           "  -t <test>    read | write | send (default: read)\n"
+           "  -s <bytes>   message size (default: 64)\n"
+           "  -c <n>       operations in flight (default: 1024)\n"
+           "  -a           sweep 1 .. -c in flight in powers of two\n"
+           "  -n <ops>     operations per run (default: 1M)\n"
+           "  raw verbs keep at most %u WRs in flight; coroutines beyond that wait for a credit\n",
+           prog, CORO_MAX_WR);
+    rdma_cfg_usage();
+}
+
+int main(int argc, char **argv) {
+    struct rdma_cfg cfg;
+    rdma_cfg_init(&cfg);
+    cfg.access_flags = IBV_ACCESS_LOCAL_WRITE;
+    /* -t read: as many READs in flight as the device and the server allow */
+    cfg.max_rd_atomic = 0;
+
+    int test = TEST_READ, sweep = 0;
+    uint32_t size = 64, inflight = 1024;
+    uint64_t ops = 1000000;
+
+    static const struct option opts[] = {
+        RDMA_CFG_LONG_OPTIONS,
+        {NULL, 0, NULL, 0}
+    };
+    int c;
+    while ((c = getopt_long(argc, argv, "t:s:c:an:", opts, NULL)) != -1) {
+        switch (c) {
+        case 't':
+            if ((test = coro_parse_test(optarg)) < 0) {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 's': size = rdma_parse_size(optarg); break;
+        case 'c': inflight = atoi(optarg); break;
+        case 'a': sweep = 1; break;
+        case 'n': ops = rdma_parse_size(optarg); break;
+        default:
+            if (rdma_cfg_parse_opt(&cfg, c, optarg)) {
+                usage(argv[0]);
+                return 1;
+            }
+        }
+    }
+    if (optind >= argc || !size || size > CORO_REGION_MAX || !inflight || ops < inflight) {
+        usage(argv[0]);
+        return 1;
+    }
+    /* one slot per operation in flight, as far as the region allows */
+    struct coro_hello h = {
+        .test = (uint32_t)test,
+        .size = size,
+        .slots = inflight < CORO_REGION_MAX / size ? inflight : CORO_REGION_MAX / size
+    };
+    cfg.max_send_wr = inflight < CORO_MAX_WR ? inflight : CORO_MAX_WR;
+    cfg.max_recv_wr = 1;
+
+    LOG("Start");
+    struct rdma_dev *dev = rdma_dev_open(&cfg);
+    if (!dev)
+        return 1;
+    struct rdma_conn *rc = rdma_conn_create(dev, &cfg, NULL);
+    if (!rc)
+        return 1;
+    struct rdma_pool *pool = rdma_pool_create(dev->pd, (size_t)size * h.slots, 1, IBV_ACCESS_LOCAL_WRITE);
+    if (!pool)
+        return 1;
+    struct rdma_buf *lb = rdma_pool_get(pool);
+    memset(lb->addr, 'c', (size_t)size * h.slots);
+
+    int sock = rdma_tcp_connect(argv[optind], cfg.tcp_port);
+    if (sock < 0 || rdma_sock_write(sock, &h, sizeof(h)))
+        return 1;
+    if (rdma_conn_handshake(rc, sock, RDMA_ROLE_CLIENT))
+        return 1;
+
+    struct bench b = {};
+    b.rc = rc;
+    b.test = test;
+    b.size = size;
+    b.slots = h.slots;
+    b.local = (char *)lb->addr;
+    b.lkey = lb->lkey;
+    b.raddr = rc->remote.addr;
+    b.rkey = rc->remote.rkey;
+    LOG("%s, %u B, %lu ops per run, SQ depth %u, max_inline=%u",
+        coro_test_name(test), size, ops, rc->cfg.max_send_wr, rc->max_inline);
+    LOG("coroutine suspend + resume alone: %.1f ns", switch_ns(inflight, ops));
+
+    printf(" %-10s %-12s %-12s %-10s %-10s %-12s %-10s\n",
+           "#inflight", "raw ops/s", "coro ops/s", "raw ns", "coro ns", "overhead ns", "parked");
+    for (uint32_t n = sweep ? 1 : inflight;; n = n * 2 < inflight ? n * 2 : inflight) {
+        uint32_t window = n < rc->cfg.max_send_wr ? n : rc->cfg.max_send_wr;
+        uint64_t parked = 0;
+        uint64_t raw = run_raw(&b, window, ops);
+        uint64_t coro = raw ? run_coro(&b, n, ops, &parked) : 0;
+        if (!coro)
+            return 1;
+        printf(" %-10u %-12.0f %-12.0f %-10.1f %-10.1f %-12.1f %-10lu\n", n,
+               ops * 1e9 / raw, ops * 1e9 / coro, (double)raw / ops, (double)coro / ops,
+               ((double)coro - raw) / ops, parked);
+        if (n == inflight)
+            break;
+    }
+
+    /* the server stops when the socket becomes readable */
+    char done = 1;
+    if (rdma_sock_write(sock, &done, 1))
+        return 1;
+    LOG("Done");
+
+    rdma_pool_put(pool, lb);
+    rdma_pool_destroy(pool);
+    rdma_conn_destroy(rc);
+    rdma_dev_close(dev);
+    return 0;
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+
+/* work requests per queue; the coroutine layer parks anything beyond */
+#define CORO_MAX_WR     1024
+/* bytes of remote memory the slots may take */
+#define CORO_REGION_MAX (64u << 20)
+
+enum coro_test {
+    TEST_READ,
+    TEST_WRITE,
+    TEST_SEND,
+};
+
+/* client -> server, before the handshake */
+struct coro_hello {
+    uint32_t test;
+    uint32_t size;
+    uint32_t slots;         /* size-byte slots the server exports, or receives into */
+};
+
+static inline int coro_parse_test(const char *s) {
+    if (!strcmp(s, "read"))
+        return TEST_READ;
+    if (!strcmp(s, "write"))
+        return TEST_WRITE;
+    if (!strcmp(s, "send"))
+        return TEST_SEND;
+    return -1;
+}
+
+static inline const char *coro_test_name(int test) {
+    return test == TEST_READ ? "read" : test == TEST_WRITE ? "write" : "send";
+}
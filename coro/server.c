@@ -0,0 +1,152 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <getopt.h>
+#include <arpa/inet.h>
+#include <infiniband/verbs.h>
+#include "rdma_conn.h"
+#include "rdma_pool.h"
+#include "rdma_poll.h"
+#include "rdma_bench.h"
+#include "coro_proto.h"
+
+#define LOG(fmt, ...)  printf("[SERVER] " fmt "\n", ##__VA_ARGS__)
+#define ERR(fmt, ...)  printf("[SERVER][ERR] " fmt " (errno=%d:%s)\n", ##__VA_ARGS__, errno, strerror(errno))
+
+/* the client closes (or writes to) its socket when it is done */
+static int client_gone(int sock) {
+    struct pollfd pfd = { .fd = sock, .events = POLLIN };
+    return poll(&pfd, 1, 0) != 0;
+}
+
+static int post_recv(struct rdma_conn *rc, struct rdma_buf *b, uint32_t size, uint32_t slot) {
+    struct ibv_sge sge = {
+        .addr = (uintptr_t)b->addr + (uint64_t)slot * size,
+        .length = size,
+        .lkey = b->lkey
+    };
+    struct ibv_recv_wr wr = {
+        .wr_id = slot,
+        .sg_list = &sge,
+        .num_sge = 1
+    }, *bad;
+    if (ibv_post_recv(rc->qp, &wr, &bad)) {
+        ERR("ibv_post_recv failed");
+        return -1;
+    }
+    return 0;
+}
+
+static void usage(const char *prog) {
+    printf("Usage: %s [options]\n"
+           "  test, message size and slots come from the client\n", prog);
+    rdma_cfg_usage();
+}
+
+int main(int argc, char **argv) {
+    struct rdma_cfg cfg;
+    rdma_cfg_init(&cfg);
+    cfg.access_flags = IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_READ | IBV_ACCESS_REMOTE_WRITE;
+    /* serve as many of the client's READs at once as the device allows */
+    cfg.max_dest_rd_atomic = 0;
+
+    static const struct option opts[] = {
+        RDMA_CFG_LONG_OPTIONS,
+        {NULL, 0, NULL, 0}
+    };
+    int c;
+    while ((c = getopt_long(argc, argv, "", opts, NULL)) != -1) {
+        if (rdma_cfg_parse_opt(&cfg, c, optarg)) {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    LOG("Start");
+
+    struct rdma_dev *dev = rdma_dev_open(&cfg);
+    if (!dev)
+        return 1;
+
+    int lsock = rdma_tcp_listen(cfg.tcp_port, 1);
+    if (lsock < 0)
+        return 1;
+    int sock = accept(lsock, NULL, NULL);
+    struct coro_hello h;
+    if (sock < 0 || rdma_sock_read(sock, &h, sizeof(h))) {
+        ERR("accept failed");
+        return 1;
+    }
+    if (h.test > TEST_SEND || !h.size || !h.slots || (uint64_t)h.size * h.slots > CORO_REGION_MAX) {
+        LOG("Bad hello");
+        return 1;
+    }
+    /* SENDs land in the slots, one receive each, reposted as they complete */
+    uint32_t recvs = h.test != TEST_SEND ? 1 : h.slots < CORO_MAX_WR ? h.slots : CORO_MAX_WR;
+    cfg.max_recv_wr = recvs;
+
+    struct rdma_conn *rc = rdma_conn_create(dev, &cfg, NULL);
+    if (!rc)
+        return 1;
+    struct rdma_pool *pool = rdma_pool_create(dev->pd, (size_t)h.size * h.slots, 1, cfg.access_flags);
+    if (!pool)
+        return 1;
+    struct rdma_buf *b = rdma_pool_get(pool);
+    if (h.test == TEST_SEND) {
+        for (uint32_t i = 0; i < recvs; i++) {
+            if (post_recv(rc, b, h.size, i))
+                return 1;
+        }
+    }
+    rc->local.addr = (uintptr_t)b->addr;
+    rc->local.rkey = b->rkey;
+    rc->local.len = (uint64_t)h.size * h.slots;
+    if (rdma_conn_handshake(rc, sock, RDMA_ROLE_SERVER))
+        return 1;
+    LOG("%s, %u B, %u slots, %u receives, max_inline=%u",
+        coro_test_name(h.test), h.size, h.slots, h.test == TEST_SEND ? recvs : 0, rc->max_inline);
+
+    uint64_t received = 0, t0 = rdma_now_ns(), next_check = t0;
+    for (;;) {
+        if (h.test == TEST_SEND) {
+            struct ibv_wc wc[RDMA_POLL_MAX_BATCH];
+            int n = ibv_poll_cq(rc->recv_cq, RDMA_POLL_MAX_BATCH, wc);
+            if (n < 0) {
+                ERR("ibv_poll_cq failed");
+                return 1;
+            }
+            for (int i = 0; i < n; i++) {
+                if (wc[i].status != IBV_WC_SUCCESS) {
+                    LOG("RECV failed status=%s", ibv_wc_status_str(wc[i].status));
+                    return 1;
+                }
+                if (post_recv(rc, b, h.size, (uint32_t)wc[i].wr_id))
+                    return 1;
+            }
+            received += n;
+        } else {
+            /* one-sided: nothing to do but wait */
+            usleep(1000);
+        }
+        uint64_t now = rdma_now_ns();
+        if (now >= next_check) {
+            if (client_gone(sock))
+                break;
+            next_check = now + 1000000;
+        }
+    }
+    if (h.test == TEST_SEND)
+        LOG("Done: %lu messages received", received);
+    else
+        LOG("Done");
+
+    rdma_pool_put(pool, b);
+    rdma_pool_destroy(pool);
+    rdma_conn_destroy(rc);
+    close(lsock);
+    rdma_dev_close(dev);
+    return 0;
+}
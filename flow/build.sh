@@ -0,0 +1,7 @@
+#!/bin/bash
+
+COMMON="-I../common ../common/rdma_conn.c ../common/rdma_pool.c ../common/rdma_fc.c"
+
+gcc -O2 server.c $COMMON -o server -libverbs
+
+gcc -O2 client.c $COMMON -o client -libverbs
@@ -0,0 +1,240 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <arpa/inet.h>
+#include <infiniband/verbs.h>
+#include "rdma_conn.h"
+#include "rdma_pool.h"
+#include "rdma_poll.h"
+#include "rdma_fc.h"
+#include "rdma_bench.h"
+#include "flow_proto.h"
+
+#define LOG(fmt, ...)  printf("[CLIENT] " fmt "\n", ##__VA_ARGS__)
+#define ERR(fmt, ...)  printf("[CLIENT][ERR] " fmt " (errno=%d:%s)\n", ##__VA_ARGS__, errno, strerror(errno))
+
+/* the longest time the sender went without posting a message */
+struct gap {
+    uint64_t last;
+    uint64_t max;
+};
+
+static void gap_mark(struct gap *g) {
+    uint64_t now = rdma_now_ns();
+    if (g->last && now - g->last > g->max)
+        g->max = now - g->last;
+    g->last = now;
+}
+
+/* ---------- rnr: up to window SENDs in flight, whatever the server has posted ---------- */
+
+static int send_rnr(struct rdma_conn *rc, struct rdma_buf *b, const struct flow_hello *h,
+                    uint32_t window, struct gap *g) {
+    struct ibv_wc wc[RDMA_POLL_MAX_BATCH];
+    uint64_t posted = 0, done = 0;
+    struct ibv_sge sge = {
+        .addr = (uintptr_t)b->addr,
+        .length = h->size,
+        .lkey = b->lkey
+    };
+    struct ibv_send_wr wr = {
+        .sg_list = &sge,
+        .num_sge = 1,
+        .opcode = IBV_WR_SEND,
+        .send_flags = IBV_SEND_SIGNALED | rdma_inline_flag(rc, h->size)
+    }, *bad;
+
+    while (done < h->iters) {
+        while (posted < h->iters && posted - done < window) {
+            wr.wr_id = posted;
+            if (ibv_post_send(rc->qp, &wr, &bad)) {
+                ERR("ibv_post_send failed");
+                return -1;
+            }
+            gap_mark(g);
+            posted++;
+        }
+        int n = ibv_poll_cq(rc->send_cq, RDMA_POLL_MAX_BATCH, wc);
+        if (n < 0) {
+            ERR("ibv_poll_cq failed");
+            return -1;
+        }
+        for (int i = 0; i < n; i++) {
+            if (wc[i].status != IBV_WC_SUCCESS) {
+                LOG("SEND %lu failed status=%s", wc[i].wr_id, ibv_wc_status_str(wc[i].status));
+                return -1;
+            }
+        }
+        done += n;
+    }
+    return 0;
+}
+
+/* ---------- credit: only as many as the server has receives posted ---------- */
+
+static int send_credit(struct rdma_fc *fc, const void *msg, const struct flow_hello *h, struct gap *g) {
+    uint64_t sent = 0;
+
+    while (sent < h->iters) {
+        int ret = rdma_fc_send(fc, msg, h->size);
+        if (ret < 0)
+            return -1;
+        if (!ret) {
+            gap_mark(g);
+            sent++;
+        }
+        if (rdma_fc_poll(fc) < 0)
+            return -1;
+    }
+    /* every send buffer back: the last message has been ACKed */
+    while (fc->tx_nfree < fc->depth) {
+        if (rdma_fc_poll(fc) < 0)
+            return -1;
+    }
+    return 0;
+}
+
+/* one connection through one mode; prints its row */
+static int run(struct rdma_dev *dev, struct rdma_cfg *cfg, const char *host,
+               struct flow_hello *h, uint32_t window) {
+    cfg->max_send_wr = h->mode == MODE_RNR ? window : h->depth + 1;
+    cfg->max_recv_wr = h->depth;
+
+    struct rdma_conn *rc = rdma_conn_create(dev, cfg, NULL);
+    if (!rc)
+        return -1;
+    int sock = rdma_tcp_connect(host, cfg->tcp_port);
+    if (sock < 0) {
+        rdma_conn_destroy(rc);
+        return -1;
+    }
+    /* rc owns sock: rdma_conn_destroy hangs up, which the server waits for before the next run */
+    rc->sock = sock;
+    int ret = -1;
+    struct rdma_buf *b = NULL;
+    struct rdma_fc fc;
+    memset(&fc, 0, sizeof(fc));
+    struct rdma_pool *pool = rdma_pool_create(dev->pd, h->size, 1, IBV_ACCESS_LOCAL_WRITE);
+    if (!pool)
+        goto out;
+    b = rdma_pool_get(pool);
+    memset(b->addr, 'f', h->size);
+    if (h->mode == MODE_CREDIT && rdma_fc_init(&fc, rc, h->depth, h->size))
+        goto out;
+
+    if (rdma_sock_write(sock, h, sizeof(*h)) || rdma_conn_handshake(rc, sock, RDMA_ROLE_CLIENT))
+        goto out;
+
+    struct gap g = {0, 0};
+    uint64_t t0 = rdma_now_ns();
+    if (h->mode == MODE_RNR ? send_rnr(rc, b, h, window, &g) : send_credit(&fc, b->addr, h, &g))
+        goto out;
+    uint64_t ns = rdma_now_ns() - t0;
+    struct flow_result res;
+    if (rdma_sock_read(sock, &res, sizeof(res)))
+        goto out;
+
+    char rnr[24];
+    if (res.rnr_naks < 0)
+        snprintf(rnr, sizeof(rnr), "n/a");
+    else
+        snprintf(rnr, sizeof(rnr), "%ld", res.rnr_naks);
+    printf(" %-8s %-12.0f %-12.0f %-12.1f %-10s %-10lu\n", flow_mode_name(h->mode),
+           h->iters * 1e9 / ns, h->consume_ns ? 1e9 / h->consume_ns : 0.0, g.max / 1e3, rnr,
+           res.updates);
+    ret = 0;
+
+out:
+    if (h->mode == MODE_CREDIT)
+        rdma_fc_fini(&fc);
+    if (b)
+        rdma_pool_put(pool, b);
+    rdma_pool_destroy(pool);
+    rdma_conn_destroy(rc);
+    return ret;
+}
+
+static void usage(const char *prog) {
+    printf("Usage: %s [options] <server_ip>\n"
+           "  -m <mode>    rnr | credit | both (default: both)\n"
+           "  -s <bytes>   message size (default: 64)\n"
+           "  -d <n>       receives the server posts (default: 16)\n"
+           "  -w <n>       rnr: SENDs in flight (default: 4 * -d)\n"
+           "  -c <ns>      server time per message, the slow consumer (default: 2000)\n"
+           "  -n <msgs>    messages per mode (default: 100000)\n",
+           prog);
+    rdma_cfg_usage();
+}
+
+int main(int argc, char **argv) {
+    struct rdma_cfg cfg;
+    rdma_cfg_init(&cfg);
+    /* credit WRITEs land in the peer's credit word */
+    cfg.access_flags = IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_WRITE;
+
+    int mode = -1;
+    uint32_t size = 64, depth = 16, window = 0, consume_ns = 2000;
+    uint64_t iters = 100000;
+
+    static const struct option opts[] = {
+        RDMA_CFG_LONG_OPTIONS,
+        {NULL, 0, NULL, 0}
+    };
+    int c;
+    while ((c = getopt_long(argc, argv, "m:s:d:w:c:n:", opts, NULL)) != -1) {
+        switch (c) {
+        case 'm':
+            if (strcmp(optarg, "both") && (mode = flow_parse_mode(optarg)) < 0) {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 's': size = rdma_parse_size(optarg); break;
+        case 'd': depth = atoi(optarg); break;
+        case 'w': window = atoi(optarg); break;
+        case 'c': consume_ns = atoi(optarg); break;
+        case 'n': iters = rdma_parse_size(optarg); break;
+        default:
+            if (rdma_cfg_parse_opt(&cfg, c, optarg)) {
+                usage(argv[0]);
+                return 1;
+            }
+        }
+    }
+    if (!window)
+        window = 4 * depth;
+    if (optind >= argc || !size || !depth || !iters) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    LOG("Start");
+    struct rdma_dev *dev = rdma_dev_open(&cfg);
+    if (!dev)
+        return 1;
+    LOG("%u B, %u receives, rnr window %u, %u ns per message at the server, %lu messages, "
+        "rnr_retry=%u min_rnr_timer=%u", size, depth, window, consume_ns, iters, cfg.rnr_retry,
+        cfg.min_rnr_timer);
+
+    printf(" %-8s %-12s %-12s %-12s %-10s %-10s\n",
+           "mode", "msgs/s", "consumer/s", "max gap[us]", "RNR NAKs", "updates");
+    for (int m = mode < 0 ? 0 : mode; m < (mode < 0 ? MODE_NR : mode + 1); m++) {
+        struct flow_hello h = {
+            .mode = m,
+            .size = size,
+            .depth = depth,
+            .consume_ns = consume_ns,
+            .iters = iters,
+            .last = mode >= 0 || m == MODE_NR - 1
+        };
+        if (run(dev, &cfg, argv[optind], &h, window))
+            return 1;
+    }
+    LOG("Done");
+
+    rdma_dev_close(dev);
+    return 0;
+}
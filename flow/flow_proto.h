@@ -0,0 +1,39 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+
+enum flow_mode {
+    MODE_RNR,               /* plain SEND/RECV: a sender that runs ahead is held back by RNR NAKs */
+    MODE_CREDIT,            /* common/rdma_fc.c: it never posts without a credit */
+    MODE_NR
+};
+
+/* client -> server, one connection per mode */
+struct flow_hello {
+    uint32_t mode;
+    uint32_t size;
+    uint32_t depth;         /* receives the server posts */
+    uint32_t consume_ns;    /* server CPU time per message before its buffer is reposted */
+    uint64_t iters;
+    uint32_t last;          /* the server exits after this connection */
+    uint32_t rsvd;
+};
+
+/* server -> client once iters messages were consumed */
+struct flow_result {
+    int64_t  rnr_naks;      /* out_of_buffer delta, -1 if the driver has no such counter */
+    uint64_t updates;       /* MODE_CREDIT: standalone credit WRITEs into the client's credit word */
+    uint64_t ns;
+};
+
+static inline int flow_parse_mode(const char *s) {
+    if (!strcmp(s, "rnr"))
+        return MODE_RNR;
+    if (!strcmp(s, "credit"))
+        return MODE_CREDIT;
+    return -1;
+}
+
+static inline const char *flow_mode_name(int mode) {
+    return mode == MODE_RNR ? "rnr" : "credit";
+}
@@ -0,0 +1,203 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <arpa/inet.h>
+#include <infiniband/verbs.h>
+#include "rdma_conn.h"
+#include "rdma_pool.h"
+#include "rdma_poll.h"
+#include "rdma_fc.h"
+#include "rdma_bench.h"
+#include "flow_proto.h"
+
+#define LOG(fmt, ...)  printf("[SERVER] " fmt "\n", ##__VA_ARGS__)
+#define ERR(fmt, ...)  printf("[SERVER][ERR] " fmt " (errno=%d:%s)\n", ##__VA_ARGS__, errno, strerror(errno))
+
+/* the slow consumer: ns of CPU spent on every message before its buffer is reposted */
+static void consume(uint32_t ns) {
+    uint64_t end = rdma_now_ns() + ns;
+    while (rdma_now_ns() < end);
+}
+
+static int post_recv(struct rdma_conn *rc, struct rdma_buf *b, uint32_t size) {
+    struct ibv_sge sge = {
+        .addr = (uintptr_t)b->addr,
+        .length = size,
+        .lkey = b->lkey
+    };
+    struct ibv_recv_wr wr = {
+        .wr_id = b->idx,
+        .sg_list = &sge,
+        .num_sge = 1
+    }, *bad;
+    if (ibv_post_recv(rc->qp, &wr, &bad)) {
+        ERR("ibv_post_recv failed");
+        return -1;
+    }
+    return 0;
+}
+
+static int consume_rnr(struct rdma_conn *rc, struct rdma_pool *pool, const struct flow_hello *h) {
+    struct ibv_wc wc[RDMA_POLL_MAX_BATCH];
+    uint64_t received = 0;
+
+    while (received < h->iters) {
+        int n = ibv_poll_cq(rc->recv_cq, RDMA_POLL_MAX_BATCH, wc);
+        if (n < 0) {
+            ERR("ibv_poll_cq failed");
+            return -1;
+        }
+        for (int i = 0; i < n; i++) {
+            if (wc[i].status != IBV_WC_SUCCESS) {
+                LOG("RECV failed status=%s", ibv_wc_status_str(wc[i].status));
+                return -1;
+            }
+            consume(h->consume_ns);
+            if (post_recv(rc, &pool->bufs[wc[i].wr_id], h->size))
+                return -1;
+        }
+        received += n;
+    }
+    return 0;
+}
+
+static int consume_credit(struct rdma_fc *fc, const struct flow_hello *h) {
+    uint64_t consumed = 0;
+    uint32_t len;
+
+    while (consumed < h->iters) {
+        if (rdma_fc_poll(fc) < 0)
+            return -1;
+        while (rdma_fc_peek(fc, &len)) {
+            consume(h->consume_ns);
+            if (rdma_fc_release(fc))
+                return -1;
+            consumed++;
+        }
+    }
+    return 0;
+}
+
+/* one connection, one mode; returns 1 once the last one was served */
+static int serve(struct rdma_dev *dev, struct rdma_cfg *cfg, int sock) {
+    struct flow_hello h;
+    if (rdma_sock_read(sock, &h, sizeof(h))) {
+        close(sock);
+        return -1;
+    }
+    if (h.mode >= MODE_NR || !h.size || !h.depth || !h.iters) {
+        LOG("Bad hello");
+        close(sock);
+        return -1;
+    }
+    cfg->max_recv_wr = h.depth;
+    cfg->max_send_wr = h.depth + 1;
+
+    struct rdma_conn *rc = rdma_conn_create(dev, cfg, NULL);
+    if (!rc) {
+        close(sock);
+        return -1;
+    }
+    /* rc owns sock from here: rdma_conn_destroy closes it */
+    rc->sock = sock;
+    int ret = -1;
+    struct rdma_pool *pool = NULL;
+    struct rdma_fc fc;
+    memset(&fc, 0, sizeof(fc));
+    if (h.mode == MODE_RNR) {
+        pool = rdma_pool_create(dev->pd, h.size, h.depth, IBV_ACCESS_LOCAL_WRITE);
+        if (!pool)
+            goto out;
+        for (uint32_t i = 0; i < h.depth; i++) {
+            if (post_recv(rc, &pool->bufs[i], h.size))
+                goto out;
+        }
+    } else if (rdma_fc_init(&fc, rc, h.depth, h.size)) {
+        goto out;
+    }
+    if (rdma_conn_handshake(rc, sock, RDMA_ROLE_SERVER))
+        goto out;
+    LOG("%s: %u B, %u receives, %u ns per message", flow_mode_name(h.mode), h.size, h.depth,
+        h.consume_ns);
+
+    int64_t rnr0 = rdma_dev_counter(dev, "out_of_buffer");
+    uint64_t t0 = rdma_now_ns();
+    if (h.mode == MODE_RNR ? consume_rnr(rc, pool, &h) : consume_credit(&fc, &h))
+        goto out;
+    struct flow_result res = {
+        .rnr_naks = -1,
+        .updates = fc.updates,
+        .ns = rdma_now_ns() - t0
+    };
+    int64_t rnr1 = rdma_dev_counter(dev, "out_of_buffer");
+    if (rnr0 >= 0 && rnr1 >= 0)
+        res.rnr_naks = rnr1 - rnr0;
+    if (rdma_sock_write(sock, &res, sizeof(res)))
+        goto out;
+    /* the client's last sends may still wait for their ACKs: hold the QP until it hangs up */
+    char ch;
+    while (read(sock, &ch, 1) > 0);
+    ret = h.last ? 1 : 0;
+
+out:
+    if (h.mode == MODE_CREDIT)
+        rdma_fc_fini(&fc);
+    rdma_pool_destroy(pool);
+    rdma_conn_destroy(rc);
+    return ret;
+}
+
+static void usage(const char *prog) {
+    printf("Usage: %s [options]\n"
+           "  mode, size, receive depth and consumer speed come from the client\n", prog);
+    rdma_cfg_usage();
+}
+
+int main(int argc, char **argv) {
+    struct rdma_cfg cfg;
+    rdma_cfg_init(&cfg);
+    /* credit WRITEs land in the peer's credit word */
+    cfg.access_flags = IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_WRITE;
+
+    static const struct option opts[] = {
+        RDMA_CFG_LONG_OPTIONS,
+        {NULL, 0, NULL, 0}
+    };
+    int c;
+    while ((c = getopt_long(argc, argv, "", opts, NULL)) != -1) {
+        if (rdma_cfg_parse_opt(&cfg, c, optarg)) {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    LOG("Start");
+
+    struct rdma_dev *dev = rdma_dev_open(&cfg);
+    if (!dev)
+        return 1;
+    if (rdma_dev_counter(dev, "out_of_buffer") < 0)
+        LOG("No out_of_buffer port counter: RNR NAKs are not counted");
+
+    int lsock = rdma_tcp_listen(cfg.tcp_port, 1);
+    if (lsock < 0)
+        return 1;
+    int ret;
+    do {
+        int sock = accept(lsock, NULL, NULL);
+        if (sock < 0) {
+            ERR("accept failed");
+            return 1;
+        }
+        if ((ret = serve(dev, &cfg, sock)) < 0)
+            return 1;
+    } while (!ret);
+    LOG("Done");
+
+    close(lsock);
+    rdma_dev_close(dev);
+    return 0;
+}
@@ -0,0 +1,7 @@
+#!/bin/bash
+
+COMMON="-I../common ../common/rdma_conn.c ../common/rdma_hs.c"
+
+gcc -O2 server.c $COMMON -o server -libverbs -lpthread
+
+gcc -O2 client.c $COMMON -o client -libverbs -lpthread
@@ -0,0 +1,186 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <arpa/inet.h>
+#include <infiniband/verbs.h>
+#include "rdma_conn.h"
+#include "rdma_hs.h"
+
+#define MAX_SOCKS 64
+
+#define LOG(fmt, ...)  printf("[CLIENT] " fmt "\n", ##__VA_ARGS__)
+#define ERR(fmt, ...)  printf("[CLIENT][ERR] " fmt " (errno=%d:%s)\n", ##__VA_ARGS__, errno, strerror(errno))
+
+struct hs_stats {
+    uint64_t create_ns, exchange_ns, connect_ns;
+};
+
+/*
+ * Bring up n QPs against the server: create them, swap qp_info in
+ * batches over nsocks sockets (every socket has one batch in flight
+ * per round), then move all of them to RTS on nthreads threads.
+ */
+static int bring_up(struct rdma_dev *dev, const struct rdma_cfg *cfg, struct ibv_cq *cq,
+                    const char *host, uint32_t n, uint32_t batch, int nsocks, int nthreads,
+                    struct hs_stats *st) {
+    struct rdma_conn **conns = calloc(n, sizeof(*conns));
+    struct qp_info *recs = malloc(RDMA_HS_MAX_BATCH * sizeof(*recs));
+    int socks[MAX_SOCKS];
+    uint32_t next[MAX_SOCKS], end[MAX_SOCKS], sent[MAX_SOCKS];
+    int ret = -1;
+
+    uint64_t t0 = rdma_now_ns();
+    for (uint32_t i = 0; i < n; i++) {
+        conns[i] = rdma_conn_create(dev, cfg, cq);
+        if (!conns[i]) {
+            LOG("QP %u of %u: creation failed (device max_qp=%d)", i, n, dev->attr.max_qp);
+            n = i;
+            goto out;
+        }
+    }
+    uint64_t t1 = rdma_now_ns();
+
+    /* socket s carries QPs [next[s], end[s]) */
+    for (int s = 0; s < nsocks; s++) {
+        next[s] = (uint64_t)n * s / nsocks;
+        end[s] = (uint64_t)n * (s + 1) / nsocks;
+        socks[s] = rdma_tcp_connect(host, cfg->tcp_port);
+        if (socks[s] < 0) {
+            while (s--)
+                close(socks[s]);
+            goto out;
+        }
+    }
+    for (uint32_t round = 0;; round++) {
+        int busy = 0;
+        for (int s = 0; s < nsocks; s++) {
+            sent[s] = end[s] - next[s] < batch ? end[s] - next[s] : batch;
+            if (!sent[s])
+                continue;
+            busy = 1;
+            for (uint32_t i = 0; i < sent[s]; i++)
+                recs[i] = conns[next[s] + i]->local;
+            if (rdma_hs_send(socks[s], round, recs, sent[s]))
+                goto close;
+        }
+        if (!busy)
+            break;
+        for (int s = 0; s < nsocks; s++) {
+            if (!sent[s])
+                continue;
+            uint32_t seq;
+            if (rdma_hs_recv(socks[s], &seq, recs, sent[s]) != (int)sent[s] || seq != round) {
+                LOG("Bad handshake reply on socket %d", s);
+                goto close;
+            }
+            for (uint32_t i = 0; i < sent[s]; i++)
+                conns[next[s] + i]->remote = recs[i];
+            next[s] += sent[s];
+        }
+    }
+    uint64_t t2 = rdma_now_ns();
+
+    if (rdma_conn_connect_many(conns, n, nthreads))
+        goto close;
+    uint64_t t3 = rdma_now_ns();
+
+    st->create_ns = t1 - t0;
+    st->exchange_ns = t2 - t1;
+    st->connect_ns = t3 - t2;
+    ret = 0;
+
+close:
+    /* the server frees a socket's QPs when it closes */
+    for (int s = 0; s < nsocks; s++)
+        close(socks[s]);
+out:
+    for (uint32_t i = 0; i < n; i++)
+        rdma_conn_destroy(conns[i]);
+    free(recs);
+    free(conns);
+    return ret;
+}
+
+static void usage(const char *prog) {
+    printf("Usage: %s [options] <server_ip>\n"
+           "  -n <qps>     QPs to bring up (default: 1000)\n"
+           "  -a           sweep 1, 10, 100 .. -n QPs\n"
+           "  -b <recs>    qp_info records per round trip, 1..%d (default: 256)\n"
+           "  -c <socks>   bootstrap sockets used side by side (default: 1)\n"
+           "  -t <threads> threads moving QPs to RTS (default: 4)\n"
+           "  -b 1 -t 1 is the classic one-qp_info-per-round-trip, serial bring-up\n",
+           prog, RDMA_HS_MAX_BATCH);
+    rdma_cfg_usage();
+}
+
+int main(int argc, char **argv) {
+    struct rdma_cfg cfg;
+    rdma_cfg_init(&cfg);
+    cfg.max_send_wr = 1;
+    cfg.max_recv_wr = 1;
+    cfg.max_inline_data = 0;
+    uint32_t max_qps = 1000, batch = 256;
+    int sweep = 0, nsocks = 1, nthreads = 4;
+
+    static const struct option opts[] = {
+        RDMA_CFG_LONG_OPTIONS,
+        {NULL, 0, NULL, 0}
+    };
+    int c;
+    while ((c = getopt_long(argc, argv, "n:ab:c:t:", opts, NULL)) != -1) {
+        switch (c) {
+        case 'n': max_qps = atoi(optarg); break;
+        case 'a': sweep = 1; break;
+        case 'b': batch = atoi(optarg); break;
+        case 'c': nsocks = atoi(optarg); break;
+        case 't': nthreads = atoi(optarg); break;
+        default:
+            if (rdma_cfg_parse_opt(&cfg, c, optarg)) {
+                usage(argv[0]);
+                return 1;
+            }
+        }
+    }
+    if (optind >= argc || !max_qps || !batch || batch > RDMA_HS_MAX_BATCH ||
+        nsocks < 1 || nsocks > MAX_SOCKS) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    LOG("Start");
+
+    struct rdma_dev *dev = rdma_dev_open(&cfg);
+    if (!dev)
+        return 1;
+    int depth = cfg.cq_depth ? cfg.cq_depth : 4096;
+    if (depth > dev->attr.max_cqe)
+        depth = dev->attr.max_cqe;
+    struct ibv_cq *cq = ibv_create_cq(dev->ctx, depth, NULL, NULL, 0);
+    if (!cq) {
+        ERR("ibv_create_cq depth %d failed", depth);
+        return 1;
+    }
+
+    LOG("%u records per round trip, %d socket(s), %d RTS thread(s)", batch, nsocks, nthreads);
+    printf(" %-8s %-12s %-14s %-12s %-12s %-12s\n",
+           "#qps", "create[ms]", "exchange[ms]", "rts[ms]", "total[ms]", "conns/s");
+    for (uint32_t n = sweep ? 1 : max_qps; n <= max_qps; n = n < max_qps && n * 10 > max_qps ? max_qps : n * 10) {
+        struct hs_stats st;
+        int socks = (uint32_t)nsocks < n ? nsocks : (int)n;
+        if (bring_up(dev, &cfg, cq, argv[optind], n, batch, socks, nthreads, &st))
+            return 1;
+        uint64_t total = st.create_ns + st.exchange_ns + st.connect_ns;
+        printf(" %-8u %-12.2f %-14.2f %-12.2f %-12.2f %-12.0f\n", n,
+               st.create_ns / 1e6, st.exchange_ns / 1e6, st.connect_ns / 1e6,
+               total / 1e6, n / (total / 1e9));
+        if (n == max_qps)
+            break;
+    }
+
+    ibv_destroy_cq(cq);
+    rdma_dev_close(dev);
+    return 0;
+}
@@ -0,0 +1,261 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <arpa/inet.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <infiniband/verbs.h>
+#include "rdma_conn.h"
+#include "rdma_hs.h"
+
+#define MAX_EVENTS 64
+
+#define LOG(fmt, ...)  printf("[SERVER] " fmt "\n", ##__VA_ARGS__)
+#define ERR(fmt, ...)  printf("[SERVER][ERR] " fmt " (errno=%d:%s)\n", ##__VA_ARGS__, errno, strerror(errno))
+
+/* one bootstrap socket: partial reads and writes survive across epoll rounds */
+struct hs_peer {
+    int                sock;
+    char              *in;
+    size_t             in_len;
+    char              *out;
+    size_t             out_len, out_off;
+    struct rdma_conn **conns;       /* QPs this socket asked for; freed with it */
+    uint32_t           nconns, cap;
+};
+
+static struct rdma_dev *dev;
+static struct rdma_cfg cfg;
+static struct ibv_cq *cq;
+static int epfd, nthreads = 4;
+static uint64_t live_qps, total_qps, total_batches;
+
+static void peer_close(struct hs_peer *p) {
+    epoll_ctl(epfd, EPOLL_CTL_DEL, p->sock, NULL);
+    close(p->sock);
+    for (uint32_t i = 0; i < p->nconns; i++)
+        rdma_conn_destroy(p->conns[i]);
+    live_qps -= p->nconns;
+    free(p->conns);
+    free(p->in);
+    free(p->out);
+    free(p);
+}
+
+/* push out as much of the reply as the socket takes; 1 while some is left */
+static int peer_flush(struct hs_peer *p) {
+    while (p->out_off < p->out_len) {
+        ssize_t n = write(p->sock, p->out + p->out_off, p->out_len - p->out_off);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && errno == EAGAIN)
+            break;
+        if (n <= 0)
+            return -1;
+        p->out_off += n;
+    }
+
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = p };
+    if (p->out_off < p->out_len)
+        ev.events |= EPOLLOUT;
+    epoll_ctl(epfd, EPOLL_CTL_MOD, p->sock, &ev);
+    return p->out_off < p->out_len;
+}
+
+/* a whole batch is in: create, connect and answer with our side of each QP */
+static int serve_batch(struct hs_peer *p) {
+    struct rdma_hs_hdr *hdr = (struct rdma_hs_hdr *)p->in;
+    struct qp_info *remote = (struct qp_info *)(hdr + 1);
+    uint32_t n = hdr->count;
+
+    if (p->nconns + n > p->cap) {
+        uint32_t cap = p->cap ? p->cap : 64;
+        while (cap < p->nconns + n)
+            cap *= 2;
+        struct rdma_conn **conns = realloc(p->conns, cap * sizeof(*conns));
+        if (!conns)
+            return -1;
+        p->conns = conns;
+        p->cap = cap;
+    }
+    struct rdma_conn **batch = &p->conns[p->nconns];
+    for (uint32_t i = 0; i < n; i++) {
+        batch[i] = rdma_conn_create(dev, &cfg, cq);
+        if (!batch[i])
+            return -1;
+        batch[i]->remote = remote[i];
+        p->nconns++;
+        live_qps++;
+    }
+    if (rdma_conn_connect_many(batch, n, nthreads))
+        return -1;
+    total_qps += n;
+    total_batches++;
+
+    struct rdma_hs_hdr *reply = (struct rdma_hs_hdr *)p->out;
+    struct qp_info *local = (struct qp_info *)(reply + 1);
+    *reply = *hdr;
+    for (uint32_t i = 0; i < n; i++)
+        local[i] = batch[i]->local;
+    p->out_len = sizeof(*reply) + (size_t)n * sizeof(*local);
+    p->out_off = 0;
+
+    /* the client waits for this reply, so nothing else is buffered */
+    size_t used = sizeof(*hdr) + (size_t)n * sizeof(*remote);
+    memmove(p->in, p->in + used, p->in_len - used);
+    p->in_len -= used;
+    return peer_flush(p) < 0 ? -1 : 0;
+}
+
+static int batch_ready(const struct hs_peer *p) {
+    const struct rdma_hs_hdr *hdr = (const struct rdma_hs_hdr *)p->in;
+    return p->in_len >= sizeof(*hdr) &&
+           p->in_len >= sizeof(*hdr) + (size_t)hdr->count * sizeof(struct qp_info);
+}
+
+static void peer_readable(struct hs_peer *p) {
+    for (;;) {
+        ssize_t n = read(p->sock, p->in + p->in_len, RDMA_HS_MSG_MAX - p->in_len);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && errno == EAGAIN)
+            break;
+        if (n <= 0) {
+            if (p->nconns)
+                LOG("Peer closed, released %u QPs (%lu live, %lu served in %lu batches)",
+                    p->nconns, live_qps - p->nconns, total_qps, total_batches);
+            peer_close(p);
+            return;
+        }
+        p->in_len += n;
+        if (p->in_len == RDMA_HS_MSG_MAX)
+            break;
+    }
+
+    const struct rdma_hs_hdr *hdr = (const struct rdma_hs_hdr *)p->in;
+    if (p->in_len >= sizeof(*hdr) && hdr->count > RDMA_HS_MAX_BATCH) {
+        LOG("Batch of %u records is over the %u limit", hdr->count, RDMA_HS_MAX_BATCH);
+        peer_close(p);
+        return;
+    }
+    if (p->out_off == p->out_len && batch_ready(p) && serve_batch(p)) {
+        ERR("Batch failed, dropping peer");
+        peer_close(p);
+    }
+}
+
+static void accept_peers(int lsock) {
+    for (;;) {
+        int sock = accept(lsock, NULL, NULL);
+        if (sock < 0)
+            return;
+        int one = 1;
+        setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        fcntl(sock, F_SETFL, fcntl(sock, F_GETFL) | O_NONBLOCK);
+
+        struct hs_peer *p = calloc(1, sizeof(*p));
+        p->sock = sock;
+        p->in = malloc(RDMA_HS_MSG_MAX);
+        p->out = malloc(RDMA_HS_MSG_MAX);
+        struct epoll_event ev = { .events = EPOLLIN, .data.ptr = p };
+        if (!p->in || !p->out || epoll_ctl(epfd, EPOLL_CTL_ADD, sock, &ev)) {
+            ERR("peer setup failed");
+            peer_close(p);
+        }
+    }
+}
+
+static void usage(const char *prog) {
+    printf("Usage: %s [options]\n"
+           "  -t <threads> threads moving each batch's QPs to RTS (default: 4)\n",
+           prog);
+    rdma_cfg_usage();
+}
+
+int main(int argc, char **argv) {
+    rdma_cfg_init(&cfg);
+    cfg.max_send_wr = 1;
+    cfg.max_recv_wr = 1;
+    cfg.max_inline_data = 0;
+
+    static const struct option opts[] = {
+        RDMA_CFG_LONG_OPTIONS,
+        {NULL, 0, NULL, 0}
+    };
+    int c;
+    while ((c = getopt_long(argc, argv, "t:", opts, NULL)) != -1) {
+        switch (c) {
+        case 't': nthreads = atoi(optarg); break;
+        default:
+            if (rdma_cfg_parse_opt(&cfg, c, optarg)) {
+                usage(argv[0]);
+                return 1;
+            }
+        }
+    }
+
+    LOG("Start");
+
+    dev = rdma_dev_open(&cfg);
+    if (!dev)
+        return 1;
+
+    /* nothing is ever posted: one small CQ serves every QP */
+    int depth = cfg.cq_depth ? cfg.cq_depth : 4096;
+    if (depth > dev->attr.max_cqe)
+        depth = dev->attr.max_cqe;
+    cq = ibv_create_cq(dev->ctx, depth, NULL, NULL, 0);
+    if (!cq) {
+        ERR("ibv_create_cq depth %d failed", depth);
+        return 1;
+    }
+
+    int lsock = rdma_tcp_listen(cfg.tcp_port, 1024);
+    if (lsock < 0)
+        return 1;
+    fcntl(lsock, F_SETFL, fcntl(lsock, F_GETFL) | O_NONBLOCK);
+
+    epfd = epoll_create1(0);
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = NULL };
+    if (epfd < 0 || epoll_ctl(epfd, EPOLL_CTL_ADD, lsock, &ev)) {
+        ERR("epoll setup failed");
+        return 1;
+    }
+    LOG("Listening on port %u, device max_qp=%d", cfg.tcp_port, dev->attr.max_qp);
+
+    struct epoll_event events[MAX_EVENTS];
+    for (;;) {
+        int n = epoll_wait(epfd, events, MAX_EVENTS, -1);
+        if (n < 0 && errno != EINTR) {
+            ERR("epoll_wait failed");
+            return 1;
+        }
+        for (int i = 0; i < n; i++) {
+            struct hs_peer *p = events[i].data.ptr;
+            if (!p) {
+                accept_peers(lsock);
+                continue;
+            }
+            if (events[i].events & EPOLLOUT) {
+                int left = peer_flush(p);
+                if (left < 0) {
+                    peer_close(p);
+                    continue;
+                }
+                /* reply gone: a batch read meanwhile can be served now */
+                if (!left && batch_ready(p) && serve_batch(p)) {
+                    peer_close(p);
+                    continue;
+                }
+            }
+            if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+                peer_readable(p);
+        }
+    }
+
+    return 0;
+}
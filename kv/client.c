@@ -0,0 +1,515 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <math.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <infiniband/verbs.h>
+#include "rdma_conn.h"
+#include "rdma_poll.h"
+#include "rdma_pool.h"
+#include "rdma_sgl.h"
+#include "rdma_bench.h"
+#include "rdma_hist.h"
+#include "kv_proto.h"
+
+#define MAX_THREADS  64
+#define GET_RETRIES  16
+
+#define LOG(fmt, ...)  printf("[CLIENT] " fmt "\n", ##__VA_ARGS__)
+#define ERR(fmt, ...)  printf("[CLIENT][ERR] " fmt " (errno=%d:%s)\n", ##__VA_ARGS__, errno, strerror(errno))
+
+enum { BUF_BUCKET, BUF_REC, BUF_REQ, BUF_VAL, BUF_RESP, NBUFS };
+
+struct opts {
+    uint64_t keys;
+    uint32_t value_size;
+    uint32_t read_pct;      /* GETs per 100 ops, the rest are PUTs */
+    double   theta;         /* zipfian skew, 0: uniform */
+    uint64_t ops;           /* per thread */
+    int      loc_cache;     /* remember where values live: GETs of unchanged keys take one READ */
+    double   cpns;
+};
+
+/* YCSB's zipfian generator (Gray et al.), zeta(n) computed once and shared */
+struct zipf {
+    uint64_t n;
+    double   theta, alpha, zetan, eta, half_pow;
+};
+
+struct thr {
+    int                 id;
+    const struct opts  *o;
+    const struct zipf  *z;
+    struct rdma_conn   *rc;
+    struct kv_layout    layout;
+    struct rdma_pool   *pool;
+    struct rdma_poller  poller;
+    pthread_barrier_t  *start;
+    pthread_t           tid;
+    int                 ret;
+
+    uint64_t            rng;
+    uint64_t           *loc;        /* per key, -C: last location seen, 0 unknown */
+    uint64_t            sends, recvs, reads;
+    uint32_t            seq;
+
+    struct rdma_hist    get_hist, put_hist;
+    uint64_t            gets, puts, misses, retries, refused, get_reads;
+};
+
+/* ---------- key choice ---------- */
+
+static uint64_t rng_next(uint64_t *s) {
+    *s ^= *s >> 12;
+    *s ^= *s << 25;
+    *s ^= *s >> 27;
+    return *s * 0x2545f4914f6cdd1dull;
+}
+
+static double rng_unit(uint64_t *s) {
+    return (rng_next(s) >> 11) * (1.0 / (1ull << 53));
+}
+
+static void zipf_init(struct zipf *z, uint64_t n, double theta) {
+    z->n = n;
+    z->theta = theta;
+    if (theta <= 0)
+        return;
+    double zeta2 = 1 + pow(0.5, theta);
+    z->zetan = 0;
+    for (uint64_t i = 1; i <= n; i++)
+        z->zetan += 1 / pow((double)i, theta);
+    z->alpha = 1 / (1 - theta);
+    z->eta = (1 - pow(2.0 / n, 1 - theta)) / (1 - zeta2 / z->zetan);
+    z->half_pow = pow(0.5, theta);
+}
+
+/* key index in [0, n): rank from the zipfian, scrambled so hot keys scatter */
+static uint64_t zipf_next(const struct zipf *z, uint64_t *rng) {
+    double u = rng_unit(rng);
+    if (z->theta <= 0)
+        return (uint64_t)(u * z->n);
+
+    double uz = u * z->zetan;
+    uint64_t rank;
+    if (uz < 1)
+        rank = 0;
+    else if (uz < 1 + z->half_pow)
+        rank = 1;
+    else
+        rank = (uint64_t)(z->n * pow(z->eta * u - z->eta + 1, z->alpha));
+    if (rank >= z->n)
+        rank = z->n - 1;
+    return kv_hash(rank) % z->n;
+}
+
+/* ---------- completions ---------- */
+
+static int wc_done(void *arg, struct ibv_wc *wc) {
+    struct thr *t = arg;
+
+    if (wc->status != IBV_WC_SUCCESS) {
+        ERR("WC failed status=%s opcode=%d", ibv_wc_status_str(wc->status), wc->opcode);
+        return -1;
+    }
+    if (wc->opcode == IBV_WC_RECV)
+        t->recvs++;
+    else if (wc->opcode == IBV_WC_RDMA_READ)
+        t->reads++;
+    else
+        t->sends++;
+    return 0;
+}
+
+static int wait_count(struct thr *t, uint64_t *counter, uint64_t want) {
+    while (*counter < want) {
+        if (rdma_poller_poll(&t->poller) < 0)
+            return -1;
+    }
+    return 0;
+}
+
+static int read_remote(struct thr *t, int buf, uint64_t off, uint32_t len) {
+    struct rdma_buf *b = &t->pool->bufs[buf];
+    struct ibv_sge sge = {
+        .addr = (uintptr_t)b->addr,
+        .length = len,
+        .lkey = b->lkey
+    };
+    struct ibv_send_wr wr = {
+        .opcode = IBV_WR_RDMA_READ,
+        .sg_list = &sge,
+        .num_sge = 1,
+        .send_flags = IBV_SEND_SIGNALED,
+        .wr.rdma.remote_addr = t->rc->remote.addr + off,
+        .wr.rdma.rkey = t->rc->remote.rkey
+    }, *bad;
+    if (ibv_post_send(t->rc->qp, &wr, &bad)) {
+        ERR("ibv_post_send READ failed");
+        return -1;
+    }
+    t->get_reads++;
+    return wait_count(t, &t->reads, t->reads + 1);
+}
+
+/* ---------- GET: one READ with a cached location, else two ---------- */
+
+/* 1: found, 0: no such key, -1: error */
+static int index_lookup(struct thr *t, uint64_t key, uint64_t *loc) {
+    uint64_t b = kv_hash(key) % t->layout.nbuckets;
+    const struct kv_bucket *bk = t->pool->bufs[BUF_BUCKET].addr;
+
+    for (int p = 0; p < KV_PROBE; p++) {
+        uint64_t off = (b + p) % t->layout.nbuckets * sizeof(struct kv_bucket);
+        if (read_remote(t, BUF_BUCKET, off, sizeof(struct kv_bucket)))
+            return -1;
+        for (int i = 0; i < KV_SLOTS; i++) {
+            uint64_t k = __atomic_load_n(&bk->slot[i].key, __ATOMIC_ACQUIRE);
+            if (k == key) {
+                *loc = __atomic_load_n(&bk->slot[i].loc, __ATOMIC_ACQUIRE);
+                return 1;
+            }
+            if (!k)
+                return 0;
+        }
+    }
+    return 0;
+}
+
+static int kv_get(struct thr *t, uint64_t idx) {
+    uint64_t key = idx + 1;
+    const struct kv_rec *r = t->pool->bufs[BUF_REC].addr;
+
+    for (int attempt = 0; attempt < GET_RETRIES; attempt++) {
+        uint64_t loc = t->loc ? t->loc[idx] : 0;
+        if (!loc) {
+            int found = index_lookup(t, key, &loc);
+            if (found <= 0) {
+                t->misses += !found;
+                return found;
+            }
+        }
+
+        uint32_t len = kv_loc_len(loc);
+        uint64_t off = (uint64_t)kv_loc_off(loc) * KV_ALIGN;
+        if (len > KV_MAX_VALUE || off + kv_rec_size(len) > t->layout.log_size) {
+            LOG("key %lu: bad location 0x%lx", key, loc);
+            return -1;
+        }
+        if (read_remote(t, BUF_REC, t->layout.log_off + off, kv_rec_size(len)))
+            return -1;
+        if (r->key == key && r->len == len && r->ver == kv_loc_ver(loc) && !r->dead &&
+            r->csum == kv_csum(r, r + 1)) {
+            if (t->loc)
+                t->loc[idx] = loc;
+            return 1;
+        }
+        /* superseded, moved by the cleaner or caught mid-write */
+        if (t->loc)
+            t->loc[idx] = 0;
+        t->retries++;
+    }
+    LOG("key %lu: no consistent copy after %d tries", key, GET_RETRIES);
+    return -1;
+}
+
+/* ---------- PUT: SEND to the server, wait for its reply ---------- */
+
+static int kv_put(struct thr *t, uint64_t idx) {
+    struct rdma_buf *rb = &t->pool->bufs[BUF_RESP], *qb = &t->pool->bufs[BUF_REQ];
+    struct rdma_buf *vb = &t->pool->bufs[BUF_VAL];
+    struct kv_put_req *req = qb->addr;
+    const struct kv_put_resp *resp = rb->addr;
+
+    req->key = idx + 1;
+    req->len = t->o->value_size;
+    req->seq = ++t->seq;
+    memset(vb->addr, (int)(req->key ^ req->seq), req->len);
+
+    struct ibv_sge rsge = {
+        .addr = (uintptr_t)rb->addr,
+        .length = sizeof(*resp),
+        .lkey = rb->lkey
+    };
+    struct ibv_recv_wr rwr = {
+        .sg_list = &rsge,
+        .num_sge = 1
+    }, *rbad;
+    if (ibv_post_recv(t->rc->qp, &rwr, &rbad)) {
+        ERR("PUT post failed");
+        return -1;
+    }
+    /* the header and the caller's value go out as one SEND, gathered by the HCA */
+    struct rdma_sgl l;
+    rdma_sgl_reset(&l);
+    rdma_sgl_add(&l, req, sizeof(*req), qb->lkey);
+    rdma_sgl_add(&l, vb->addr, req->len, vb->lkey);
+    if (rdma_post_sgl(t->rc, IBV_WR_SEND, &l, 0, IBV_SEND_SIGNALED, 0, 0, 0))
+        return -1;
+    if (wait_count(t, &t->sends, t->sends + 1) || wait_count(t, &t->recvs, t->recvs + 1))
+        return -1;
+    if (resp->seq != req->seq) {
+        LOG("PUT reply for seq %u, expected %u", resp->seq, req->seq);
+        return -1;
+    }
+    if (resp->status == KV_FULL) {
+        t->refused++;
+        return 0;
+    }
+    if (resp->status != KV_OK) {
+        LOG("PUT key %lu refused with status %u", req->key, resp->status);
+        return -1;
+    }
+    if (t->loc)
+        t->loc[idx] = resp->loc;
+    return 0;
+}
+
+/* ---------- phases ---------- */
+
+static int load(struct thr *t, int nthreads) {
+    for (uint64_t i = t->id; i < t->o->keys; i += nthreads) {
+        if (kv_put(t, i))
+            return -1;
+    }
+    return 0;
+}
+
+static int run_ops(struct thr *t) {
+    const struct opts *o = t->o;
+
+    for (uint64_t i = 0; i < o->ops; i++) {
+        uint64_t idx = zipf_next(t->z, &t->rng);
+        int get = rng_next(&t->rng) % 100 < o->read_pct;
+
+        uint64_t c0 = rdma_cycles();
+        int ret = get ? kv_get(t, idx) : kv_put(t, idx);
+        if (ret < 0)
+            return -1;
+        uint64_t ns = (uint64_t)((rdma_cycles() - c0) / o->cpns);
+        if (get) {
+            rdma_hist_add(&t->get_hist, ns);
+            t->gets++;
+        } else {
+            rdma_hist_add(&t->put_hist, ns);
+            t->puts++;
+        }
+    }
+    return 0;
+}
+
+struct job {
+    struct thr *t;
+    int         nthreads;
+    int         loading;
+};
+
+static void *thr_main(void *arg) {
+    struct job *j = arg;
+
+    pthread_barrier_wait(j->t->start);
+    j->t->ret = j->loading ? load(j->t, j->nthreads) : run_ops(j->t);
+    return NULL;
+}
+
+/* all threads through one phase; returns its wall time in ns, 0 on error */
+static uint64_t phase(struct thr *thr, int n, int loading) {
+    pthread_barrier_t start;
+    struct job jobs[MAX_THREADS];
+
+    pthread_barrier_init(&start, NULL, n + 1);
+    for (int i = 0; i < n; i++) {
+        jobs[i] = (struct job){ .t = &thr[i], .nthreads = n, .loading = loading };
+        thr[i].start = &start;
+        if (pthread_create(&thr[i].tid, NULL, thr_main, &jobs[i])) {
+            ERR("pthread_create failed");
+            return 0;
+        }
+    }
+    pthread_barrier_wait(&start);
+    uint64_t t0 = rdma_now_ns();
+    int ret = 0;
+    for (int i = 0; i < n; i++) {
+        pthread_join(thr[i].tid, NULL);
+        ret |= thr[i].ret;
+    }
+    uint64_t ns = rdma_now_ns() - t0;
+    pthread_barrier_destroy(&start);
+    return ret ? 0 : ns;
+}
+
+static int parse_workload(struct opts *o, const char *s) {
+    /* YCSB core workloads that need only GET and PUT */
+    if (!strcmp(s, "a"))
+        o->read_pct = 50;
+    else if (!strcmp(s, "b"))
+        o->read_pct = 95;
+    else if (!strcmp(s, "c"))
+        o->read_pct = 100;
+    else
+        return -1;
+    return 0;
+}
+
+static void usage(const char *prog) {
+    printf("Usage: %s [options] <server_ip>\n"
+           "  -w <a|b|c>   YCSB workload: a 50%% GET, b 95%% GET, c 100%% GET (default: b)\n"
+           "  -r <pct>     GET percentage instead of -w\n"
+           "  -k <keys>    key space, loaded before the run (default: 100000)\n"
+           "  -s <bytes>   value size, up to %d (default: 100)\n"
+           "  -z <theta>   zipfian skew, 0 for uniform (default: 0.99)\n"
+           "  -n <ops>     operations per thread (default: 100000)\n"
+           "  -T <n>       threads, one QP each (default: 1)\n"
+           "  -C           cache value locations: GETs of unchanged keys take one READ\n"
+           "  -S           skip the load phase (keys already loaded by an earlier run)\n",
+           prog, KV_MAX_VALUE);
+    rdma_cfg_usage();
+}
+
+int main(int argc, char **argv) {
+    struct rdma_cfg cfg;
+    rdma_cfg_init(&cfg);
+    cfg.max_send_wr = 4;
+    cfg.max_recv_wr = 4;
+    cfg.max_send_sge = 2;
+    cfg.max_rd_atomic = 0;
+
+    struct opts o = {
+        .keys = 100000,
+        .value_size = 100,
+        .read_pct = 95,
+        .theta = 0.99,
+        .ops = 100000
+    };
+    int nthreads = 1, skip_load = 0;
+
+    static const struct option opts[] = {
+        RDMA_CFG_LONG_OPTIONS,
+        {NULL, 0, NULL, 0}
+    };
+    int c;
+    while ((c = getopt_long(argc, argv, "w:r:k:s:z:n:T:CS", opts, NULL)) != -1) {
+        switch (c) {
+        case 'w':
+            if (parse_workload(&o, optarg)) {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 'r': o.read_pct = atoi(optarg); break;
+        case 'k': o.keys = rdma_parse_size(optarg); break;
+        case 's': o.value_size = atoi(optarg); break;
+        case 'z': o.theta = atof(optarg); break;
+        case 'n': o.ops = rdma_parse_size(optarg); break;
+        case 'T': nthreads = atoi(optarg); break;
+        case 'C': o.loc_cache = 1; break;
+        case 'S': skip_load = 1; break;
+        default:
+            if (rdma_cfg_parse_opt(&cfg, c, optarg)) {
+                usage(argv[0]);
+                return 1;
+            }
+        }
+    }
+    if (optind >= argc || !o.keys || o.value_size > KV_MAX_VALUE || o.read_pct > 100 ||
+        o.theta >= 1 || nthreads < 1 || nthreads > MAX_THREADS) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    LOG("Start");
+    o.cpns = rdma_cycles_per_ns();
+    struct zipf z;
+    zipf_init(&z, o.keys, o.theta);
+
+    struct rdma_dev *dev = rdma_dev_open(&cfg);
+    if (!dev)
+        return 1;
+
+    struct thr *thr = calloc(nthreads, sizeof(*thr));
+    for (int i = 0; i < nthreads; i++) {
+        struct thr *t = &thr[i];
+        t->id = i;
+        t->o = &o;
+        t->z = &z;
+        t->rng = 0x9e3779b97f4a7c15ull * (i + 1) ^ rdma_now_ns();
+        t->rc = rdma_conn_create(dev, &cfg, NULL);
+        if (!t->rc)
+            return 1;
+        int sock = rdma_tcp_connect(argv[optind], cfg.tcp_port);
+        if (sock < 0 || rdma_conn_handshake(t->rc, sock, RDMA_ROLE_CLIENT) ||
+            rdma_sock_read(sock, &t->layout, sizeof(t->layout)))
+            return 1;
+        t->pool = rdma_pool_create(dev->pd, KV_MAX_REC, NBUFS, IBV_ACCESS_LOCAL_WRITE);
+        if (!t->pool)
+            return 1;
+        if (o.loc_cache && !(t->loc = calloc(o.keys, sizeof(*t->loc))))
+            return 1;
+        rdma_poller_init(&t->poller, t->rc->send_cq, cfg.poll_batch, wc_done, t);
+        rdma_hist_init(&t->get_hist);
+        rdma_hist_init(&t->put_hist);
+    }
+    LOG("Server index %lu buckets, log %.1f MB; %u%% GET, %lu keys, %u B values, theta %.2f%s",
+        thr[0].layout.nbuckets, thr[0].layout.log_size / 1e6, o.read_pct, o.keys,
+        o.value_size, o.theta, o.loc_cache ? ", location cache" : "");
+
+    if (!skip_load) {
+        uint64_t ns = phase(thr, nthreads, 1);
+        if (!ns)
+            return 1;
+        uint64_t refused = 0;
+        for (int i = 0; i < nthreads; i++) {
+            refused += thr[i].refused;
+            thr[i].refused = 0;
+            thr[i].get_reads = 0;
+        }
+        LOG("Loaded %lu keys in %.2f s (%.0f PUTs/s), %lu refused",
+            o.keys, ns / 1e9, o.keys / (ns / 1e9), refused);
+    }
+
+    uint64_t ns = phase(thr, nthreads, 0);
+    if (!ns)
+        return 1;
+
+    struct rdma_hist get, put;
+    uint64_t gets = 0, puts = 0, misses = 0, retries = 0, refused = 0, reads = 0;
+    rdma_hist_init(&get);
+    rdma_hist_init(&put);
+    for (int i = 0; i < nthreads; i++) {
+        struct thr *t = &thr[i];
+        rdma_hist_merge(&get, &t->get_hist);
+        rdma_hist_merge(&put, &t->put_hist);
+        gets += t->gets;
+        puts += t->puts;
+        misses += t->misses;
+        retries += t->retries;
+        refused += t->refused;
+        reads += t->get_reads;
+    }
+
+    double sec = ns / 1e9;
+    LOG("%d thread(s): %.0f ops/s (%.0f GET/s, %.0f PUT/s)",
+        nthreads, (gets + puts) / sec, gets / sec, puts / sec);
+    LOG("GET: %.2f READs each, %lu misses, %lu retried; PUT: %lu refused (server full)",
+        gets ? (double)reads / gets : 0.0, misses, retries, refused);
+    printf(" %-10s", "op");
+    rdma_hist_header();
+    printf(" %-10s", "GET");
+    rdma_hist_print(&get, o.value_size);
+    printf(" %-10s", "PUT");
+    rdma_hist_print(&put, o.value_size);
+
+    for (int i = 0; i < nthreads; i++) {
+        struct thr *t = &thr[i];
+        rdma_pool_destroy(t->pool);
+        free(t->loc);
+        rdma_conn_destroy(t->rc);
+    }
+    free(thr);
+    rdma_dev_close(dev);
+    return 0;
+}
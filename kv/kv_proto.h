@@ -0,0 +1,110 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * Exported region: [index | value log].
+ *
+ * The index is nbuckets cache-line buckets of KV_SLOTS slots. A slot is
+ * the key (0: empty, keys are never deleted) and a packed location that
+ * the server updates with a single 8-byte store, so a READ of the bucket
+ * never sees half of one. A key that finds its bucket full probes the
+ * next one, up to KV_PROBE buckets.
+ *
+ * The log holds records on 64 B boundaries: a kv_rec header, then the
+ * value. The checksum covers header and value, so a GET that raced the
+ * server overwriting the record (the log is circular and gets cleaned)
+ * sees a mismatch and retries from the index.
+ */
+#define KV_SLOTS        4
+#define KV_PROBE        8
+#define KV_ALIGN        64
+#define KV_MAX_VALUE    4096
+#define KV_MAX_REC      ((sizeof(struct kv_rec) + KV_MAX_VALUE + KV_ALIGN - 1) / KV_ALIGN * KV_ALIGN)
+
+struct kv_slot {
+    uint64_t key;
+    uint64_t loc;           /* kv_loc() */
+};
+
+struct kv_bucket {
+    struct kv_slot slot[KV_SLOTS];
+} __attribute__((aligned(KV_ALIGN)));
+
+struct kv_rec {
+    uint64_t key;           /* 0: padding up to the end of the log */
+    uint32_t len;           /* value bytes */
+    uint32_t csum;          /* kv_csum() of key, len, ver and value */
+    uint16_t ver;
+    uint16_t dead;          /* set once a newer version is in the index */
+    uint32_t rsvd;
+};
+
+/* offset in KV_ALIGN units from the log start | value length | version */
+static inline uint64_t kv_loc(uint32_t off, uint16_t len, uint16_t ver) {
+    return (uint64_t)off << 32 | (uint32_t)len << 16 | ver;
+}
+static inline uint32_t kv_loc_off(uint64_t loc) { return loc >> 32; }
+static inline uint16_t kv_loc_len(uint64_t loc) { return loc >> 16; }
+static inline uint16_t kv_loc_ver(uint64_t loc) { return loc; }
+
+static inline uint32_t kv_rec_size(uint32_t len) {
+    return (sizeof(struct kv_rec) + len + KV_ALIGN - 1) / KV_ALIGN * KV_ALIGN;
+}
+
+/* murmur3 finalizer: spreads sequential keys over the buckets */
+static inline uint64_t kv_hash(uint64_t key) {
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdull;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ull;
+    key ^= key >> 33;
+    return key;
+}
+
+/* 8 bytes per step: cheap enough to run on every GET */
+static inline uint32_t kv_csum(const struct kv_rec *r, const void *value) {
+    uint64_t h = kv_hash(r->key ^ ((uint64_t)r->len << 32 | r->ver));
+    const uint8_t *p = value;
+    uint32_t n = r->len;
+
+    for (; n >= 8; n -= 8, p += 8) {
+        uint64_t w;
+        memcpy(&w, p, 8);
+        h = (h ^ w) * 0x9e3779b97f4a7c15ull;
+        h ^= h >> 29;
+    }
+    if (n) {
+        uint64_t w = 0;
+        memcpy(&w, p, n);
+        h = (h ^ w) * 0x9e3779b97f4a7c15ull;
+    }
+    h = kv_hash(h);
+    return (uint32_t)(h ^ h >> 32);
+}
+
+/* server -> client over TCP right after the QP handshake */
+struct kv_layout {
+    uint64_t nbuckets;
+    uint64_t log_off;       /* bytes from the exported address */
+    uint64_t log_size;
+};
+
+/* PUTs travel as SENDs: kv_put_req and the value, answered by kv_put_resp */
+enum kv_status {
+    KV_OK,
+    KV_FULL,                /* no free slot within KV_PROBE buckets, or no log space */
+    KV_BAD,
+};
+
+struct kv_put_req {
+    uint64_t key;
+    uint32_t len;
+    uint32_t seq;           /* echoed back */
+};
+
+struct kv_put_resp {
+    uint32_t status;
+    uint32_t seq;
+    uint64_t loc;           /* where the value now lives */
+};
@@ -0,0 +1,374 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <getopt.h>
+#include <arpa/inet.h>
+#include <infiniband/verbs.h>
+#include "rdma_conn.h"
+#include "rdma_poll.h"
+#include "rdma_pool.h"
+#include "rdma_bench.h"
+#include "kv_proto.h"
+
+#define MAX_CLIENTS     64
+#define SOCK_CHECK_NS   1000000ull
+#define REPLY_WR_ID     UINT64_MAX
+/* relocating a live record during cleaning may cost a pad to the log end */
+#define LOG_RESERVE     (3 * KV_MAX_REC)
+
+#define LOG(fmt, ...)  printf("[SERVER] " fmt "\n", ##__VA_ARGS__)
+#define ERR(fmt, ...)  printf("[SERVER][ERR] " fmt " (errno=%d:%s)\n", ##__VA_ARGS__, errno, strerror(errno))
+
+struct kv_srv {
+    struct rdma_cfg    cfg;
+    struct rdma_dev   *dev;
+    struct ibv_cq     *cq;
+    struct rdma_buf   *region;
+    struct kv_bucket  *index;
+    char              *log;
+    struct kv_layout   layout;
+
+    uint64_t           head, tail;      /* logical log bytes, tail - head in use */
+    uint64_t           live;            /* bytes of records the index points to */
+    uint64_t           keys;
+
+    struct rdma_pool  *pool;            /* [0, n): receives, [n, 2n): replies */
+    uint32_t           ring;
+    struct rdma_conn  *conns[MAX_CLIENTS];
+    int                nconns;
+
+    uint64_t           puts, relocated, full;
+};
+
+/* ---------- index ---------- */
+
+static struct kv_slot *slot_find(struct kv_srv *s, uint64_t key, int insert) {
+    uint64_t b = kv_hash(key) % s->layout.nbuckets;
+
+    for (int p = 0; p < KV_PROBE; p++) {
+        struct kv_bucket *bk = &s->index[(b + p) % s->layout.nbuckets];
+        for (int i = 0; i < KV_SLOTS; i++) {
+            if (bk->slot[i].key == key)
+                return &bk->slot[i];
+            if (!bk->slot[i].key)
+                return insert ? &bk->slot[i] : NULL;
+        }
+    }
+    return NULL;
+}
+
+static void slot_publish(struct kv_slot *sl, uint64_t key, uint64_t loc) {
+    __atomic_store_n(&sl->loc, loc, __ATOMIC_RELEASE);
+    if (!sl->key)
+        __atomic_store_n(&sl->key, key, __ATOMIC_RELEASE);
+}
+
+/* ---------- value log ---------- */
+
+static struct kv_rec *rec_at(struct kv_srv *s, uint64_t logical) {
+    return (struct kv_rec *)(s->log + logical % s->layout.log_size);
+}
+
+/* caller made sure of the space; records never straddle the log end */
+static uint64_t log_append(struct kv_srv *s, uint32_t size) {
+    uint64_t phys = s->tail % s->layout.log_size;
+
+    if (phys + size > s->layout.log_size) {
+        struct kv_rec *pad = rec_at(s, s->tail);
+        pad->key = 0;
+        pad->len = s->layout.log_size - phys;
+        s->tail += s->layout.log_size - phys;
+    }
+    uint64_t at = s->tail;
+    s->tail += size;
+    return at;
+}
+
+/* retire the record at head, moving it to the tail when it is still live */
+static void log_clean_one(struct kv_srv *s) {
+    struct kv_rec *r = rec_at(s, s->head);
+
+    if (!r->key) {
+        s->head += r->len;
+        return;
+    }
+    uint32_t size = kv_rec_size(r->len);
+    uint32_t off = s->head % s->layout.log_size / KV_ALIGN;
+    struct kv_slot *sl = slot_find(s, r->key, 0);
+    if (sl && kv_loc_off(sl->loc) == off) {
+        uint64_t to = log_append(s, size);
+        struct kv_rec *nr = rec_at(s, to);
+        memcpy(nr, r, size);
+        slot_publish(sl, r->key, kv_loc(to % s->layout.log_size / KV_ALIGN, r->len, r->ver));
+        r->dead = 1;
+        s->relocated++;
+    }
+    s->head += size;
+}
+
+static int log_alloc(struct kv_srv *s, uint32_t size, uint64_t *at) {
+    if (s->live + size + LOG_RESERVE > s->layout.log_size)
+        return -1;
+    while (s->layout.log_size - (s->tail - s->head) < size + LOG_RESERVE)
+        log_clean_one(s);
+    *at = log_append(s, size);
+    return 0;
+}
+
+static enum kv_status kv_put(struct kv_srv *s, const struct kv_put_req *req, uint64_t *loc) {
+    if (!req->key || req->len > KV_MAX_VALUE)
+        return KV_BAD;
+    struct kv_slot *sl = slot_find(s, req->key, 1);
+    if (!sl)
+        return KV_FULL;
+
+    uint32_t size = kv_rec_size(req->len);
+    uint64_t at;
+    if (log_alloc(s, size, &at))
+        return KV_FULL;
+
+    /* cleaning may have just moved the old version: look at the slot again */
+    struct kv_rec *old = sl->key ? rec_at(s, (uint64_t)kv_loc_off(sl->loc) * KV_ALIGN) : NULL;
+    struct kv_rec *r = rec_at(s, at);
+    r->key = req->key;
+    r->len = req->len;
+    r->ver = old ? old->ver + 1 : 1;
+    r->dead = 0;
+    r->rsvd = 0;
+    memcpy(r + 1, req + 1, req->len);
+    r->csum = kv_csum(r, r + 1);
+
+    *loc = kv_loc(at % s->layout.log_size / KV_ALIGN, r->len, r->ver);
+    slot_publish(sl, req->key, *loc);
+    if (old) {
+        /* clients caching the old location notice on their next GET */
+        old->dead = 1;
+        s->live -= kv_rec_size(old->len);
+    } else {
+        s->keys++;
+    }
+    s->live += size;
+    s->puts++;
+    return KV_OK;
+}
+
+/* ---------- PUT transport ---------- */
+
+static int post_recv(struct kv_srv *s, uint32_t idx) {
+    struct rdma_buf *b = &s->pool->bufs[idx];
+    struct ibv_sge sge = {
+        .addr = (uintptr_t)b->addr,
+        .length = sizeof(struct kv_put_req) + KV_MAX_VALUE,
+        .lkey = b->lkey
+    };
+    struct ibv_recv_wr wr = {
+        .wr_id = idx,
+        .sg_list = &sge,
+        .num_sge = 1
+    };
+    struct ibv_recv_wr *bad;
+    return ibv_post_recv(s->conns[idx / s->ring]->qp, &wr, &bad);
+}
+
+static int recv_done(void *arg, struct ibv_wc *wc) {
+    struct kv_srv *s = arg;
+
+    if (wc->status != IBV_WC_SUCCESS) {
+        /* a departed client's receives and replies */
+        if (wc->status == IBV_WC_WR_FLUSH_ERR)
+            return 0;
+        ERR("WC failed status=%s", ibv_wc_status_str(wc->status));
+        return -1;
+    }
+    if (wc->wr_id == REPLY_WR_ID)
+        return 0;
+
+    uint32_t idx = wc->wr_id;
+    struct rdma_conn *rc = s->conns[idx / s->ring];
+    /* a request that landed before its client left: nobody to answer */
+    if (!rc)
+        return 0;
+    const struct kv_put_req *req = s->pool->bufs[idx].addr;
+    struct kv_put_resp *resp = s->pool->bufs[MAX_CLIENTS * s->ring + idx].addr;
+
+    resp->seq = req->seq;
+    resp->loc = 0;
+    if (wc->byte_len < sizeof(*req) || wc->byte_len - sizeof(*req) < req->len)
+        resp->status = KV_BAD;
+    else
+        resp->status = kv_put(s, req, &resp->loc);
+    if (resp->status == KV_FULL)
+        s->full++;
+
+    struct ibv_sge sge = {
+        .addr = (uintptr_t)resp,
+        .length = sizeof(*resp),
+        .lkey = s->pool->bufs[MAX_CLIENTS * s->ring + idx].lkey
+    };
+    struct ibv_send_wr swr = {
+        .wr_id = REPLY_WR_ID,
+        .opcode = IBV_WR_SEND,
+        .sg_list = &sge,
+        .num_sge = 1,
+        .send_flags = IBV_SEND_SIGNALED | rdma_inline_flag(rc, sizeof(*resp))
+    }, *bad;
+    if (post_recv(s, idx) || ibv_post_send(rc->qp, &swr, &bad)) {
+        ERR("reply post failed");
+        return -1;
+    }
+    return 0;
+}
+
+static int add_client(struct kv_srv *s, int sock) {
+    int slot = 0;
+    while (slot < MAX_CLIENTS && s->conns[slot])
+        slot++;
+    if (slot == MAX_CLIENTS) {
+        LOG("Too many clients, refusing one");
+        close(sock);
+        return 0;
+    }
+
+    struct rdma_conn *rc = rdma_conn_create(s->dev, &s->cfg, s->cq);
+    if (!rc)
+        return -1;
+    rc->local.addr = (uintptr_t)s->region->addr;
+    rc->local.rkey = s->region->rkey;
+    rc->local.len = s->layout.log_off + s->layout.log_size;
+    s->conns[slot] = rc;
+    for (uint32_t i = 0; i < s->ring; i++) {
+        if (post_recv(s, slot * s->ring + i)) {
+            ERR("ibv_post_recv failed");
+            return -1;
+        }
+    }
+    if (rdma_conn_handshake(rc, sock, RDMA_ROLE_SERVER) ||
+        rdma_sock_write(sock, &s->layout, sizeof(s->layout))) {
+        rdma_conn_destroy(rc);
+        s->conns[slot] = NULL;
+        return 0;
+    }
+    s->nconns++;
+    LOG("Client QP %u -> RTS (%d connected)", rc->remote.qp_num, s->nconns);
+    return 0;
+}
+
+static void usage(const char *prog) {
+    printf("Usage: %s [options]\n"
+           "  -k <keys>    index capacity in keys (default: 1M), %d slots per bucket\n"
+           "  -L <bytes>   value log size (default: 256M)\n"
+           "  --rq-depth   PUT receive ring per client (default: 16)\n"
+           "  GETs are RDMA READs of the index and the log; only PUTs reach this CPU\n",
+           prog, KV_SLOTS);
+    rdma_cfg_usage();
+}
+
+int main(int argc, char **argv) {
+    struct kv_srv s;
+    memset(&s, 0, sizeof(s));
+    rdma_cfg_init(&s.cfg);
+    s.cfg.max_send_wr = 16;
+    s.cfg.max_recv_wr = 16;
+    s.cfg.max_dest_rd_atomic = 0;
+    s.cfg.access_flags = IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_READ;
+    uint64_t keys = 1 << 20, log_size = 256ull << 20;
+
+    static const struct option opts[] = {
+        RDMA_CFG_LONG_OPTIONS,
+        {NULL, 0, NULL, 0}
+    };
+    int c;
+    while ((c = getopt_long(argc, argv, "k:L:", opts, NULL)) != -1) {
+        switch (c) {
+        case 'k': keys = rdma_parse_size(optarg); break;
+        case 'L': log_size = rdma_parse_size(optarg); break;
+        default:
+            if (rdma_cfg_parse_opt(&s.cfg, c, optarg)) {
+                usage(argv[0]);
+                return 1;
+            }
+        }
+    }
+    log_size = log_size / KV_ALIGN * KV_ALIGN;
+    if (!keys || log_size < 2 * LOG_RESERVE || log_size / KV_ALIGN > UINT32_MAX) {
+        usage(argv[0]);
+        return 1;
+    }
+    /* half-full buckets keep probes short */
+    s.layout.nbuckets = (keys * 2 + KV_SLOTS - 1) / KV_SLOTS;
+    s.layout.log_off = s.layout.nbuckets * sizeof(struct kv_bucket);
+    s.layout.log_size = log_size;
+    s.ring = s.cfg.max_recv_wr;
+    s.cfg.max_send_wr = s.ring;
+
+    LOG("Start");
+
+    s.dev = rdma_dev_open(&s.cfg);
+    if (!s.dev)
+        return 1;
+
+    /* the pool's mmap hands back zeroed memory: every slot starts empty */
+    struct rdma_pool *region = rdma_pool_create(s.dev->pd, s.layout.log_off + log_size, 1,
+                                                s.cfg.access_flags);
+    s.pool = rdma_pool_create(s.dev->pd, sizeof(struct kv_put_req) + KV_MAX_VALUE,
+                              2 * MAX_CLIENTS * s.ring, IBV_ACCESS_LOCAL_WRITE);
+    if (!region || !s.pool)
+        return 1;
+    s.region = rdma_pool_get(region);
+    s.index = s.region->addr;
+    s.log = (char *)s.region->addr + s.layout.log_off;
+    LOG("Index %lu buckets (%.1f MB), log %.1f MB",
+        s.layout.nbuckets, s.layout.log_off / 1e6, log_size / 1e6);
+
+    int depth = s.cfg.cq_depth ? s.cfg.cq_depth : (int)(2 * MAX_CLIENTS * s.ring);
+    if (depth > s.dev->attr.max_cqe)
+        depth = s.dev->attr.max_cqe;
+    s.cq = ibv_create_cq(s.dev->ctx, depth, NULL, NULL, 0);
+    if (!s.cq) {
+        ERR("ibv_create_cq depth %d failed", depth);
+        return 1;
+    }
+    struct rdma_poller poller;
+    rdma_poller_init(&poller, s.cq, s.cfg.poll_batch, recv_done, &s);
+
+    int lsock = rdma_tcp_listen(s.cfg.tcp_port, MAX_CLIENTS);
+    if (lsock < 0)
+        return 1;
+    uint64_t last_check = 0, wall0 = rdma_now_ns(), cpu0 = rdma_cpu_ns();
+
+    for (;;) {
+        if (rdma_poller_poll(&poller) < 0)
+            return 1;
+        uint64_t now = rdma_now_ns();
+        if (now - last_check < SOCK_CHECK_NS)
+            continue;
+        last_check = now;
+
+        struct pollfd pfd = { .fd = lsock, .events = POLLIN };
+        if (poll(&pfd, 1, 0) > 0) {
+            int sock = accept(lsock, NULL, NULL);
+            if (sock >= 0 && add_client(&s, sock))
+                return 1;
+        }
+
+        /* clients only close their socket, at EOF the QP goes */
+        for (int i = 0; i < MAX_CLIENTS; i++) {
+            if (!s.conns[i])
+                continue;
+            struct pollfd cp = { .fd = s.conns[i]->sock, .events = POLLIN };
+            char ch;
+            if (poll(&cp, 1, 0) <= 0 || read(cp.fd, &ch, 1) > 0)
+                continue;
+            rdma_conn_destroy(s.conns[i]);
+            s.conns[i] = NULL;
+            s.nconns--;
+            LOG("Client left (%d connected): %lu keys, %lu PUTs, %lu relocated, %lu refused, "
+                "log %.1f MB live, cpu %.1f%% since start",
+                s.nconns, s.keys, s.puts, s.relocated, s.full, s.live / 1e6,
+                100.0 * (rdma_cpu_ns() - cpu0) / (rdma_now_ns() - wall0));
+        }
+    }
+}
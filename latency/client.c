@@ -0,0 +1,313 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <arpa/inet.h>
+#include <infiniband/verbs.h>
+#include "rdma_conn.h"
+#include "rdma_poll.h"
+#include "rdma_bench.h"
+#include "rdma_hist.h"
+#include "lat_proto.h"
+
+#define LOG(fmt, ...)  printf("[CLIENT] " fmt "\n", ##__VA_ARGS__)
+#define ERR(fmt, ...)  printf("[CLIENT][ERR] " fmt " (errno=%d:%s)\n", ##__VA_ARGS__, errno, strerror(errno))
+
+struct lat_ctx {
+    struct rdma_conn *rc;
+    struct ibv_mr    *mr;
+    char             *rbuf;         /* pongs / READ data land here */
+    char             *sbuf;         /* pings go out from here */
+    uint32_t          max_size;
+    uint64_t          recvs, sends;
+    uint64_t         *samples;      /* TSC ticks per iteration */
+};
+
+static int post_recv(struct lat_ctx *lc) {
+    struct ibv_sge sge = {
+        .addr = (uintptr_t)lc->rbuf,
+        .length = lc->max_size,
+        .lkey = lc->mr->lkey
+    };
+    struct ibv_recv_wr wr = {
+        .sg_list = &sge,
+        .num_sge = 1
+    };
+    struct ibv_recv_wr *bad;
+    return ibv_post_recv(lc->rc->qp, &wr, &bad);
+}
+
+static int post_ping(struct lat_ctx *lc, enum ibv_wr_opcode opcode, uint32_t size) {
+    struct ibv_sge sge = {
+        .addr = (uintptr_t)(opcode == IBV_WR_RDMA_READ ? lc->rbuf : lc->sbuf),
+        .length = size,
+        .lkey = lc->mr->lkey
+    };
+    unsigned int inl = opcode == IBV_WR_RDMA_READ ? 0 : rdma_inline_flag(lc->rc, size);
+    struct ibv_send_wr wr = {
+        .opcode = opcode,
+        .sg_list = &sge,
+        .num_sge = 1,
+        .send_flags = IBV_SEND_SIGNALED | inl,
+        .wr.rdma.remote_addr = lc->rc->remote.addr,
+        .wr.rdma.rkey = lc->rc->remote.rkey
+    };
+    struct ibv_send_wr *bad;
+    return ibv_post_send(lc->rc->qp, &wr, &bad);
+}
+
+static int wc_done(void *arg, struct ibv_wc *wc) {
+    struct lat_ctx *lc = arg;
+
+    if (wc->status != IBV_WC_SUCCESS) {
+        ERR("WC error %s", ibv_wc_status_str(wc->status));
+        return -1;
+    }
+    if (wc->opcode & IBV_WC_RECV)
+        lc->recvs++;
+    else
+        lc->sends++;
+    return 0;
+}
+
+static int wait_count(struct rdma_poller *poller, uint64_t *counter, uint64_t want) {
+    while (*counter < want) {
+        if (rdma_poller_block(poller) < 0)
+            return -1;
+    }
+    return 0;
+}
+
+/*
+ * Round trip announced by a receive completion: SEND ping / SEND pong,
+ * or WRITE_WITH_IMM ping / WRITE_WITH_IMM pong.
+ */
+static int run_recv(struct lat_ctx *lc, struct rdma_poller *poller,
+                    enum ibv_wr_opcode opcode, uint32_t size, uint32_t n) {
+    for (uint32_t i = 0; i < n; i++) {
+        uint64_t t0 = rdma_cycles();
+        if (post_recv(lc) || post_ping(lc, opcode, size)) {
+            ERR("post failed");
+            return -1;
+        }
+        if (wait_count(poller, &lc->recvs, lc->recvs + 1))
+            return -1;
+        lc->samples[i] = rdma_cycles() - t0;
+
+        if (wait_count(poller, &lc->sends, lc->sends + 1))
+            return -1;
+    }
+    return 0;
+}
+
+/* round trip: WRITE ping, spin on the last byte of the WRITE pong */
+static int run_write(struct lat_ctx *lc, struct rdma_poller *poller, uint32_t size, uint32_t n) {
+    volatile uint8_t *last = (volatile uint8_t *)&lc->rbuf[size - 1];
+
+    for (uint32_t i = 0; i < n; i++) {
+        uint8_t m = lat_marker(i);
+        lc->sbuf[size - 1] = m;
+
+        uint64_t t0 = rdma_cycles();
+        if (post_ping(lc, IBV_WR_RDMA_WRITE, size)) {
+            ERR("post failed");
+            return -1;
+        }
+        while (*last != m);
+        lc->samples[i] = rdma_cycles() - t0;
+
+        if (wait_count(poller, &lc->sends, lc->sends + 1))
+            return -1;
+    }
+    return 0;
+}
+
+/* READ completes on our own CQ: post to CQE is the whole operation */
+static int run_read(struct lat_ctx *lc, struct rdma_poller *poller, uint32_t size, uint32_t n) {
+    for (uint32_t i = 0; i < n; i++) {
+        uint64_t t0 = rdma_cycles();
+        if (post_ping(lc, IBV_WR_RDMA_READ, size)) {
+            ERR("post failed");
+            return -1;
+        }
+        if (wait_count(poller, &lc->sends, lc->sends + 1))
+            return -1;
+        lc->samples[i] = rdma_cycles() - t0;
+    }
+    return 0;
+}
+
+static int parse_test(const char *s) {
+    if (!strcmp(s, "send"))
+        return LAT_SEND;
+    if (!strcmp(s, "write"))
+        return LAT_WRITE;
+    if (!strcmp(s, "read"))
+        return LAT_READ;
+    if (!strcmp(s, "write_imm"))
+        return LAT_WRITE_IMM;
+    return -1;
+}
+
+static void usage(const char *prog) {
+    printf("Usage: %s [options] <server_ip>\n"
+           "  -t <test>    send | write | read | write_imm (default: send)\n"
+           "               write polls the last byte, write_imm waits for the immediate\n"
+           "  -s <bytes>   message size (default: 2)\n"
+           "  -a           sweep sizes 2 B .. -s in powers of two\n"
+           "  -n <iters>   measured iterations per size (default: 10000)\n"
+           "  -w <iters>   warm-up iterations per size (default: 1000)\n"
+           "  with --spin-us both sides sleep on completion events after the spin budget;\n"
+           "  -t write always spins, it completes by memory polling\n",
+           prog);
+    rdma_cfg_usage();
+}
+
+int main(int argc, char **argv) {
+    struct rdma_cfg cfg;
+    rdma_cfg_init(&cfg);
+    cfg.max_send_wr = 4;
+    cfg.max_recv_wr = 4;
+    cfg.access_flags = IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_WRITE | IBV_ACCESS_REMOTE_READ;
+
+    struct lat_params lp = {
+        .test = LAT_SEND,
+        .max_size = 2,
+        .iters = 10000,
+        .warmup = 1000
+    };
+    int sweep = 0;
+
+    static const struct option opts[] = {
+        RDMA_CFG_LONG_OPTIONS,
+        {NULL, 0, NULL, 0}
+    };
+    int c;
+    while ((c = getopt_long(argc, argv, "t:s:an:w:", opts, NULL)) != -1) {
+        switch (c) {
+        case 't':
+            if ((c = parse_test(optarg)) < 0) {
+                usage(argv[0]);
+                return 1;
+            }
+            lp.test = c;
+            break;
+        case 's': lp.max_size = atoi(optarg); break;
+        case 'a': sweep = 1; break;
+        case 'n': lp.iters = atoi(optarg); break;
+        case 'w': lp.warmup = atoi(optarg); break;
+        default:
+            if (rdma_cfg_parse_opt(&cfg, c, optarg)) {
+                usage(argv[0]);
+                return 1;
+            }
+        }
+    }
+    if (optind >= argc || !lp.max_size || !lp.iters) {
+        usage(argv[0]);
+        return 1;
+    }
+    lp.min_size = sweep && lp.max_size > 2 ? 2 : lp.max_size;
+
+    LOG("Start");
+
+    double cpns = rdma_cycles_per_ns();
+    LOG("TSC %.3f ticks/ns", cpns);
+
+    struct rdma_dev *dev = rdma_dev_open(&cfg);
+    if (!dev)
+        return 1;
+
+    struct rdma_conn *rc = rdma_conn_create(dev, &cfg, NULL);
+    if (!rc)
+        return 1;
+
+    int sock = rdma_tcp_connect(argv[optind], cfg.tcp_port);
+    if (sock < 0)
+        return 1;
+    if (rdma_sock_write(sock, &lp, sizeof(lp)))
+        return 1;
+
+    struct lat_ctx lc = { .rc = rc, .max_size = lp.max_size };
+    char *buf = calloc(2, lp.max_size);
+    lc.rbuf = buf;
+    lc.sbuf = buf + lp.max_size;
+    lc.mr = ibv_reg_mr(dev->pd, buf, 2 * (size_t)lp.max_size, cfg.access_flags);
+    lc.samples = calloc(lp.iters + lp.warmup, sizeof(uint64_t));
+    if (!lc.mr) {
+        ERR("ibv_reg_mr failed");
+        return 1;
+    }
+
+    rc->local.addr = (uintptr_t)lc.rbuf;
+    rc->local.rkey = lc.mr->rkey;
+    rc->local.len = lp.max_size;
+    if (rdma_conn_handshake(rc, sock, RDMA_ROLE_CLIENT))
+        return 1;
+    LOG("QP -> RTS, remote qpn=%u, max_inline=%u", rc->remote.qp_num, rc->max_inline);
+
+    struct rdma_poller poller;
+    rdma_poller_init(&poller, rc->send_cq, cfg.poll_batch, wc_done, &lc);
+    if (rdma_poller_set_channel(&poller, rc->channel, cfg.spin_us))
+        return 1;
+
+    /* ping-pong tests report half the round trip, READ the full operation */
+    double div = lp.test == LAT_READ ? cpns : 2 * cpns;
+    static const char *names[] = { "SEND", "RDMA WRITE", "RDMA READ", "RDMA WRITE_WITH_IMM" };
+    LOG("%s latency (%s), %u warm-up + %u measured iterations per size",
+        names[lp.test], lp.test == LAT_READ ? "full operation" : "RTT/2",
+        lp.warmup, lp.iters);
+    rdma_hist_header();
+
+    /* CPU cost of each size, printed after the latency table */
+    struct { uint32_t size; double cpu; double sleeps; } cpu[32];
+    int nsizes = 0;
+
+    for (uint32_t size = lp.min_size; size <= lp.max_size; size *= 2) {
+        memset(buf, 0, 2 * (size_t)lp.max_size);
+        if (rdma_sock_barrier(sock))
+            return 1;
+
+        uint32_t n = lp.iters + lp.warmup;
+        uint64_t wall0 = rdma_now_ns(), cpu0 = rdma_cpu_ns(), sleeps0 = poller.sleeps;
+        int ret;
+        if (lp.test == LAT_SEND)
+            ret = run_recv(&lc, &poller, IBV_WR_SEND, size, n);
+        else if (lp.test == LAT_WRITE_IMM)
+            ret = run_recv(&lc, &poller, IBV_WR_RDMA_WRITE_WITH_IMM, size, n);
+        else if (lp.test == LAT_WRITE)
+            ret = run_write(&lc, &poller, size, n);
+        else
+            ret = run_read(&lc, &poller, size, n);
+        if (ret)
+            return 1;
+        if (nsizes < 32) {
+            cpu[nsizes].size = size;
+            cpu[nsizes].cpu = 100.0 * (rdma_cpu_ns() - cpu0) / (rdma_now_ns() - wall0);
+            cpu[nsizes++].sleeps = (double)(poller.sleeps - sleeps0) / n;
+        }
+
+        struct rdma_hist h;
+        rdma_hist_init(&h);
+        for (uint32_t i = lp.warmup; i < n; i++)
+            rdma_hist_add(&h, (uint64_t)(lc.samples[i] / div));
+        rdma_hist_print(&h, size);
+    }
+
+    if (rdma_sock_barrier(sock))
+        return 1;
+
+    printf(" %-10s %-10s %-12s\n", "#bytes", "cpu[%]", "sleeps/iter");
+    for (int i = 0; i < nsizes; i++)
+        printf(" %-10u %-10.1f %-12.3f\n", cpu[i].size, cpu[i].cpu, cpu[i].sleeps);
+
+    rdma_poller_close(&poller);
+    ibv_dereg_mr(lc.mr);
+    free(lc.samples);
+    free(buf);
+    rdma_conn_destroy(rc);
+    rdma_dev_close(dev);
+    return 0;
+}
@@ -0,0 +1,24 @@
+#pragma once
+#include <stdint.h>
+
+enum lat_test {
+    LAT_SEND,       /* SEND ping, SEND pong */
+    LAT_WRITE,      /* RDMA WRITE ping/pong, receiver polls the last byte */
+    LAT_READ,       /* RDMA READ, completion on the reader's CQ */
+    LAT_WRITE_IMM,  /* RDMA WRITE_WITH_IMM ping/pong, receiver waits for the recv CQE */
+    LAT_NTESTS
+};
+
+/* sent by the client before the qp_info exchange */
+struct lat_params {
+    uint32_t test;
+    uint32_t min_size;
+    uint32_t max_size;
+    uint32_t iters;
+    uint32_t warmup;
+};
+
+/* last byte of a WRITE ping/pong; never 0 so a zeroed buffer reads as "not yet" */
+static inline uint8_t lat_marker(uint32_t i) {
+    return (uint8_t)(i % 255 + 1);
+}
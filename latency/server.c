@@ -0,0 +1,231 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <arpa/inet.h>
+#include <infiniband/verbs.h>
+#include "rdma_conn.h"
+#include "rdma_poll.h"
+#include "rdma_bench.h"
+#include "lat_proto.h"
+
+#define LOG(fmt, ...)  printf("[SERVER] " fmt "\n", ##__VA_ARGS__)
+#define ERR(fmt, ...)  printf("[SERVER][ERR] " fmt " (errno=%d:%s)\n", ##__VA_ARGS__, errno, strerror(errno))
+
+struct lat_ctx {
+    struct rdma_conn *rc;
+    struct ibv_mr    *mr;
+    char             *rbuf;         /* pings land here */
+    char             *sbuf;         /* pongs go out from here */
+    uint32_t          max_size;
+    uint64_t          recvs, sends;
+};
+
+static int post_recv(struct lat_ctx *lc) {
+    struct ibv_sge sge = {
+        .addr = (uintptr_t)lc->rbuf,
+        .length = lc->max_size,
+        .lkey = lc->mr->lkey
+    };
+    struct ibv_recv_wr wr = {
+        .sg_list = &sge,
+        .num_sge = 1
+    };
+    struct ibv_recv_wr *bad;
+    return ibv_post_recv(lc->rc->qp, &wr, &bad);
+}
+
+static int post_pong(struct lat_ctx *lc, enum ibv_wr_opcode opcode, uint32_t size) {
+    struct ibv_sge sge = {
+        .addr = (uintptr_t)lc->sbuf,
+        .length = size,
+        .lkey = lc->mr->lkey
+    };
+    struct ibv_send_wr wr = {
+        .opcode = opcode,
+        .sg_list = &sge,
+        .num_sge = 1,
+        .send_flags = IBV_SEND_SIGNALED | rdma_inline_flag(lc->rc, size),
+        .wr.rdma.remote_addr = lc->rc->remote.addr,
+        .wr.rdma.rkey = lc->rc->remote.rkey
+    };
+    struct ibv_send_wr *bad;
+    return ibv_post_send(lc->rc->qp, &wr, &bad);
+}
+
+/* sends and receives share the CQ: count each kind */
+static int wc_done(void *arg, struct ibv_wc *wc) {
+    struct lat_ctx *lc = arg;
+
+    if (wc->status != IBV_WC_SUCCESS) {
+        ERR("WC error %s", ibv_wc_status_str(wc->status));
+        return -1;
+    }
+    if (wc->opcode & IBV_WC_RECV)
+        lc->recvs++;
+    else
+        lc->sends++;
+    return 0;
+}
+
+/* SEND and WRITE_WITH_IMM: a receive completion announces each ping */
+static int run_recv(struct lat_ctx *lc, struct rdma_poller *poller,
+                    enum ibv_wr_opcode opcode, uint32_t size, uint32_t n) {
+    for (uint32_t i = 0; i < n; i++) {
+        uint64_t want = lc->recvs + 1;
+        while (lc->recvs < want) {
+            if (rdma_poller_block(poller) < 0)
+                return -1;
+        }
+        if (post_recv(lc) || post_pong(lc, opcode, size)) {
+            ERR("post failed");
+            return -1;
+        }
+        want = lc->sends + 1;
+        while (lc->sends < want) {
+            if (rdma_poller_block(poller) < 0)
+                return -1;
+        }
+    }
+    return 0;
+}
+
+static int run_write(struct lat_ctx *lc, struct rdma_poller *poller, uint32_t size, uint32_t n) {
+    volatile uint8_t *last = (volatile uint8_t *)&lc->rbuf[size - 1];
+
+    for (uint32_t i = 0; i < n; i++) {
+        uint8_t m = lat_marker(i);
+        while (*last != m);
+
+        lc->sbuf[size - 1] = m;
+        if (post_pong(lc, IBV_WR_RDMA_WRITE, size)) {
+            ERR("post failed");
+            return -1;
+        }
+        uint64_t want = lc->sends + 1;
+        while (lc->sends < want) {
+            if (rdma_poller_block(poller) < 0)
+                return -1;
+        }
+    }
+    return 0;
+}
+
+static void usage(const char *prog) {
+    printf("Usage: %s [options]\n"
+           "  test, sizes and iterations come from the client\n", prog);
+    rdma_cfg_usage();
+}
+
+int main(int argc, char **argv) {
+    struct rdma_cfg cfg;
+    rdma_cfg_init(&cfg);
+    cfg.max_send_wr = 4;
+    cfg.max_recv_wr = 4;
+    cfg.access_flags = IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_WRITE | IBV_ACCESS_REMOTE_READ;
+
+    static const struct option opts[] = {
+        RDMA_CFG_LONG_OPTIONS,
+        {NULL, 0, NULL, 0}
+    };
+    int c;
+    while ((c = getopt_long(argc, argv, "", opts, NULL)) != -1) {
+        if (rdma_cfg_parse_opt(&cfg, c, optarg)) {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    LOG("Start");
+
+    struct rdma_dev *dev = rdma_dev_open(&cfg);
+    if (!dev)
+        return 1;
+
+    struct rdma_conn *rc = rdma_conn_create(dev, &cfg, NULL);
+    if (!rc)
+        return 1;
+
+    int sock = rdma_tcp_listen(cfg.tcp_port, 1);
+    if (sock < 0)
+        return 1;
+    int conn = accept(sock, NULL, NULL);
+    if (conn < 0) {
+        ERR("accept failed");
+        return 1;
+    }
+    LOG("TCP connected");
+
+    struct lat_params lp;
+    if (rdma_sock_read(conn, &lp, sizeof(lp)))
+        return 1;
+    LOG("Test %u sizes %u..%u iters %u warmup %u",
+        lp.test, lp.min_size, lp.max_size, lp.iters, lp.warmup);
+    if (lp.test >= LAT_NTESTS || !lp.min_size || lp.min_size > lp.max_size) {
+        LOG("Bad test parameters");
+        return 1;
+    }
+
+    struct lat_ctx lc = { .rc = rc, .max_size = lp.max_size };
+    char *buf = calloc(2, lp.max_size);
+    lc.rbuf = buf;
+    lc.sbuf = buf + lp.max_size;
+    lc.mr = ibv_reg_mr(dev->pd, buf, 2 * (size_t)lp.max_size, cfg.access_flags);
+    if (!lc.mr) {
+        ERR("ibv_reg_mr failed");
+        return 1;
+    }
+    if ((lp.test == LAT_SEND || lp.test == LAT_WRITE_IMM) && post_recv(&lc)) {
+        ERR("ibv_post_recv failed");
+        return 1;
+    }
+
+    rc->local.addr = (uintptr_t)lc.rbuf;
+    rc->local.rkey = lc.mr->rkey;
+    rc->local.len = lp.max_size;
+    if (rdma_conn_handshake(rc, conn, RDMA_ROLE_SERVER))
+        return 1;
+    LOG("QP -> RTS, remote qpn=%u", rc->remote.qp_num);
+
+    struct rdma_poller poller;
+    rdma_poller_init(&poller, rc->send_cq, cfg.poll_batch, wc_done, &lc);
+    if (rdma_poller_set_channel(&poller, rc->channel, cfg.spin_us))
+        return 1;
+
+    for (uint32_t size = lp.min_size; size <= lp.max_size; size *= 2) {
+        memset(buf, 0, 2 * (size_t)lp.max_size);
+        if (rdma_sock_barrier(conn))
+            return 1;
+
+        uint32_t n = lp.iters + lp.warmup;
+        uint64_t wall0 = rdma_now_ns(), cpu0 = rdma_cpu_ns(), sleeps0 = poller.sleeps;
+        int ret = 0;
+        if (lp.test == LAT_SEND)
+            ret = run_recv(&lc, &poller, IBV_WR_SEND, size, n);
+        else if (lp.test == LAT_WRITE_IMM)
+            ret = run_recv(&lc, &poller, IBV_WR_RDMA_WRITE_WITH_IMM, size, n);
+        else if (lp.test == LAT_WRITE)
+            ret = run_write(&lc, &poller, size, n);
+        /* LAT_READ: one-sided, nothing to do but stay up */
+        if (ret)
+            return 1;
+        if (lp.test != LAT_READ)
+            LOG("Size %u: cpu %.1f%%, %.3f sleeps/iter", size,
+                100.0 * (rdma_cpu_ns() - cpu0) / (rdma_now_ns() - wall0),
+                (double)(poller.sleeps - sleeps0) / n);
+    }
+
+    if (rdma_sock_barrier(conn))
+        return 1;
+    LOG("Done");
+
+    rdma_poller_close(&poller);
+    ibv_dereg_mr(lc.mr);
+    free(buf);
+    rdma_conn_destroy(rc);
+    close(sock);
+    rdma_dev_close(dev);
+    return 0;
+}
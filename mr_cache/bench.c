@@ -0,0 +1,185 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <infiniband/verbs.h>
+#include "rdma_conn.h"
+#include "rdma_mrc.h"
+#include "rdma_bench.h"
+
+#define LOG(fmt, ...)  printf("[BENCH] " fmt "\n", ##__VA_ARGS__)
+#define ERR(fmt, ...)  printf("[BENCH][ERR] " fmt " (errno=%d:%s)\n", ##__VA_ARGS__, errno, strerror(errno))
+
+#define UNCACHED_OPS_MAX 20000
+
+/*
+ * An application sending from its own buffers: nbufs malloc'd buffers
+ * of max_size / 2 .. max_size bytes, one picked at random per message,
+ * and freed and reallocated every so often.
+ */
+struct work {
+    char     **bufs;
+    size_t    *lens;
+    uint32_t   nbufs;
+    size_t     max_size;
+    uint64_t   bytes;
+    uint32_t   churn;       /* every churn-th message replaces a buffer, 0: never */
+    uint64_t   rng;
+};
+
+static uint64_t next_rand(uint64_t *s) {
+    *s ^= *s << 13;
+    *s ^= *s >> 7;
+    *s ^= *s << 17;
+    return *s;
+}
+
+static int work_alloc(struct work *w, uint32_t i) {
+    w->lens[i] = w->max_size / 2 + next_rand(&w->rng) % (w->max_size / 2 + 1);
+    w->bufs[i] = malloc(w->lens[i]);
+    if (!w->bufs[i])
+        return -1;
+    memset(w->bufs[i], i, w->lens[i]);
+    return 0;
+}
+
+/* the registration an ibv_post_send from buffer i would need: register, use once, deregister */
+static int run_uncached(struct rdma_dev *dev, struct work *w, uint64_t ops, double *ns_per_op) {
+    uint64_t t0 = rdma_now_ns();
+    for (uint64_t op = 0; op < ops; op++) {
+        uint32_t i = next_rand(&w->rng) % w->nbufs;
+        struct ibv_mr *mr = ibv_reg_mr(dev->pd, w->bufs[i], w->lens[i], IBV_ACCESS_LOCAL_WRITE);
+        if (!mr) {
+            ERR("ibv_reg_mr %zu bytes failed", w->lens[i]);
+            return -1;
+        }
+        if (ibv_dereg_mr(mr)) {
+            ERR("ibv_dereg_mr %zu bytes failed", w->lens[i]);
+            return -1;
+        }
+    }
+    *ns_per_op = (double)(rdma_now_ns() - t0) / ops;
+    return 0;
+}
+
+static int run_cached(struct rdma_dev *dev, struct work *w, uint64_t ops, size_t budget,
+                      double *ns_per_op, struct rdma_mrc_stats *st, double *saved_ms) {
+    struct rdma_mrc *c = rdma_mrc_create(dev->pd, IBV_ACCESS_LOCAL_WRITE, budget);
+    if (!c)
+        return -1;
+
+    uint64_t t0 = rdma_now_ns();
+    for (uint64_t op = 0; op < ops; op++) {
+        uint32_t i = next_rand(&w->rng) % w->nbufs;
+        if (w->churn && op % w->churn == w->churn - 1) {
+            rdma_mrc_invalidate(c, w->bufs[i], w->lens[i]);
+            free(w->bufs[i]);
+            if (work_alloc(w, i))
+                return -1;
+        }
+        struct rdma_mrc_entry *e = rdma_mrc_get(c, w->bufs[i], w->lens[i]);
+        if (!e) {
+            LOG("No registration for %zu bytes under a %zu byte budget", w->lens[i], budget);
+            return -1;
+        }
+        rdma_mrc_put(c, e);
+    }
+    *ns_per_op = (double)(rdma_now_ns() - t0) / ops;
+    *st = c->stats;
+    *saved_ms = rdma_mrc_saved_ns(c) / 1e6;
+    rdma_mrc_destroy(c);
+    return 0;
+}
+
+static void usage(const char *prog) {
+    printf("Usage: %s [options]\n"
+           "  -s <bytes>   largest buffer; sizes are uniform in [s/2, s] (default: 64K)\n"
+           "  -b <n>       application buffers, picked uniformly per message (default: 1024)\n"
+           "  -n <ops>     messages per budget (default: 200000)\n"
+           "  -M <bytes>   pinned-memory budget (default: half the buffers' bytes)\n"
+           "  -a           sweep budgets 1/8 .. 2x the buffers' bytes\n"
+           "  -c <n>       free and reallocate a buffer every n messages, 0 never (default: 0)\n",
+           prog);
+    rdma_cfg_usage();
+}
+
+int main(int argc, char **argv) {
+    struct rdma_cfg cfg;
+    rdma_cfg_init(&cfg);
+    struct work w = {
+        .nbufs = 1024,
+        .max_size = 64 << 10,
+        .rng = 88172645463325252ull
+    };
+    uint64_t ops = 200000, budget = 0;
+    int sweep = 0;
+
+    static const struct option opts[] = {
+        RDMA_CFG_LONG_OPTIONS,
+        {NULL, 0, NULL, 0}
+    };
+    int c;
+    while ((c = getopt_long(argc, argv, "s:b:n:M:ac:", opts, NULL)) != -1) {
+        switch (c) {
+        case 's': w.max_size = rdma_parse_size(optarg); break;
+        case 'b': w.nbufs = atoi(optarg); break;
+        case 'n': ops = strtoull(optarg, NULL, 0); break;
+        case 'M': budget = rdma_parse_size(optarg); break;
+        case 'a': sweep = 1; break;
+        case 'c': w.churn = atoi(optarg); break;
+        default:
+            if (rdma_cfg_parse_opt(&cfg, c, optarg)) {
+                usage(argv[0]);
+                return 1;
+            }
+        }
+    }
+    if (w.max_size < 2 || !w.nbufs || !ops) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    struct rdma_dev *dev = rdma_dev_open(&cfg);
+    if (!dev)
+        return 1;
+
+    w.bufs = calloc(w.nbufs, sizeof(*w.bufs));
+    w.lens = calloc(w.nbufs, sizeof(*w.lens));
+    for (uint32_t i = 0; i < w.nbufs; i++) {
+        if (work_alloc(&w, i)) {
+            ERR("malloc failed");
+            return 1;
+        }
+        w.bytes += w.lens[i];
+    }
+    LOG("%u buffers, %lu bytes, %lu messages per budget", w.nbufs, w.bytes, ops);
+
+    double uncached_ns;
+    if (run_uncached(dev, &w, ops < UNCACHED_OPS_MAX ? ops : UNCACHED_OPS_MAX, &uncached_ns))
+        return 1;
+    LOG("ibv_reg_mr + ibv_dereg_mr per message: %.0f ns", uncached_ns);
+
+    printf(" %-12s %-8s %-10s %-10s %-10s %-12s %-12s %-12s %-10s\n",
+           "budget", "hit[%]", "evicted", "merged", "invalid", "cached[ns]", "saved[ms]",
+           "measured[ms]", "speedup");
+    uint64_t lo = sweep ? w.bytes / 8 : (budget ? budget : w.bytes / 2);
+    uint64_t hi = sweep ? w.bytes * 2 : lo;
+    for (uint64_t b = lo; b <= hi; b *= 2) {
+        struct rdma_mrc_stats st;
+        double ns, saved_ms;
+        if (run_cached(dev, &w, ops, b, &ns, &st, &saved_ms))
+            return 1;
+        printf(" %-12lu %-8.1f %-10lu %-10lu %-10lu %-12.0f %-12.1f %-12.1f %-10.1f\n",
+               b, 100.0 * st.hits / st.lookups, st.evictions, st.merged, st.invalidations, ns,
+               saved_ms, (uncached_ns - ns) * ops / 1e6, uncached_ns / ns);
+    }
+
+    for (uint32_t i = 0; i < w.nbufs; i++)
+        free(w.bufs[i]);
+    free(w.bufs);
+    free(w.lens);
+    rdma_dev_close(dev);
+    return 0;
+}
@@ -0,0 +1,174 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <infiniband/verbs.h>
+#include "rdma_conn.h"
+#include "rdma_pool.h"
+#include "rdma_bench.h"
+
+#define LOG(fmt, ...)  printf("[BENCH] " fmt "\n", ##__VA_ARGS__)
+#define ERR(fmt, ...)  printf("[BENCH][ERR] " fmt " (errno=%d:%s)\n", ##__VA_ARGS__, errno, strerror(errno))
+
+#define TOUCH_PASSES 4
+
+struct result {
+    double reg_us;          /* allocate + register, per buffer */
+    double dereg_us;        /* deregister + free, per buffer */
+    double touch_gbps;      /* memset over every buffer */
+};
+
+static double touch(char **bufs, uint32_t n, size_t size) {
+    uint64_t start = rdma_now_ns();
+    for (int pass = 0; pass < TOUCH_PASSES; pass++)
+        for (uint32_t i = 0; i < n; i++)
+            memset(bufs[i], pass, size);
+    return (double)size * n * TOUCH_PASSES / (rdma_now_ns() - start);
+}
+
+/* today's pattern: malloc + ibv_reg_mr for every buffer */
+static int bench_reg_mr(struct rdma_dev *dev, size_t size, uint32_t n, struct result *r) {
+    char **bufs = calloc(n, sizeof(*bufs));
+    struct ibv_mr **mrs = calloc(n, sizeof(*mrs));
+
+    uint64_t start = rdma_now_ns();
+    for (uint32_t i = 0; i < n; i++) {
+        bufs[i] = malloc(size);
+        mrs[i] = bufs[i] ? ibv_reg_mr(dev->pd, bufs[i], size, IBV_ACCESS_LOCAL_WRITE) : NULL;
+        if (!mrs[i]) {
+            ERR("ibv_reg_mr %zu bytes failed", size);
+            return -1;
+        }
+    }
+    r->reg_us = (rdma_now_ns() - start) / 1e3 / n;
+
+    r->touch_gbps = touch(bufs, n, size);
+
+    start = rdma_now_ns();
+    for (uint32_t i = 0; i < n; i++) {
+        ibv_dereg_mr(mrs[i]);
+        free(bufs[i]);
+    }
+    r->dereg_us = (rdma_now_ns() - start) / 1e3 / n;
+
+    free(mrs);
+    free(bufs);
+    return 0;
+}
+
+/* hugepage slabs registered once, buffers handed out by the freelist */
+static int bench_pool(struct rdma_dev *dev, size_t size, uint32_t n, struct result *r,
+                      double *getput_ns) {
+    char **bufs = calloc(n, sizeof(*bufs));
+    struct rdma_buf **held = calloc(n, sizeof(*held));
+
+    uint64_t start = rdma_now_ns();
+    struct rdma_pool *pool = rdma_pool_create(dev->pd, size, n, IBV_ACCESS_LOCAL_WRITE);
+    if (!pool)
+        return -1;
+    for (uint32_t i = 0; i < n; i++) {
+        held[i] = rdma_pool_get(pool);
+        bufs[i] = held[i]->addr;
+    }
+    r->reg_us = (rdma_now_ns() - start) / 1e3 / n;
+
+    r->touch_gbps = touch(bufs, n, size);
+
+    /* steady state: what a connection pays per buffer once the pool exists */
+    for (uint32_t i = 0; i < n; i++)
+        rdma_pool_put(pool, held[i]);
+    uint64_t ops = 1000000;
+    start = rdma_now_ns();
+    for (uint64_t i = 0; i < ops; i++)
+        rdma_pool_put(pool, rdma_pool_get(pool));
+    *getput_ns = (double)(rdma_now_ns() - start) / ops;
+
+    start = rdma_now_ns();
+    rdma_pool_destroy(pool);
+    r->dereg_us = (rdma_now_ns() - start) / 1e3 / n;
+
+    free(held);
+    free(bufs);
+    return 0;
+}
+
+static void usage(const char *prog) {
+    printf("Usage: %s [options]\n"
+           "  -s <bytes>   buffer size, K/M/G suffixes allowed (default: 64K)\n"
+           "  -a           sweep buffer sizes 4K .. -s in powers of four\n"
+           "  -n <bufs>    buffers per size (default: 1024)\n"
+           "  -M <bytes>   cap on the memory of one run, lowers -n for big sizes (default: 256M)\n",
+           prog);
+    rdma_cfg_usage();
+}
+
+int main(int argc, char **argv) {
+    struct rdma_cfg cfg;
+    rdma_cfg_init(&cfg);
+    uint64_t max_size = 64 << 10, budget = 256 << 20;
+    uint32_t max_bufs = 1024;
+    int sweep = 0;
+
+    static const struct option opts[] = {
+        RDMA_CFG_LONG_OPTIONS,
+        {NULL, 0, NULL, 0}
+    };
+    int c;
+    while ((c = getopt_long(argc, argv, "s:an:M:", opts, NULL)) != -1) {
+        switch (c) {
+        case 's': max_size = rdma_parse_size(optarg); break;
+        case 'a': sweep = 1; break;
+        case 'n': max_bufs = atoi(optarg); break;
+        case 'M': budget = rdma_parse_size(optarg); break;
+        default:
+            if (rdma_cfg_parse_opt(&cfg, c, optarg)) {
+                usage(argv[0]);
+                return 1;
+            }
+        }
+    }
+    if (!max_size || !max_bufs) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    struct rdma_dev *dev = rdma_dev_open(&cfg);
+    if (!dev)
+        return 1;
+
+    struct {
+        size_t size;
+        uint32_t n;
+        struct result mr, pool;
+        double getput_ns;
+    } rows[32];
+    int nrows = 0;
+
+    for (uint64_t size = sweep && max_size > 4096 ? 4096 : max_size;
+         size <= max_size && nrows < 32; size *= 4) {
+        uint32_t n = budget / size < max_bufs ? budget / size : max_bufs;
+        if (!n)
+            n = 1;
+        rows[nrows].size = size;
+        rows[nrows].n = n;
+        if (bench_reg_mr(dev, size, n, &rows[nrows].mr) ||
+            bench_pool(dev, size, n, &rows[nrows].pool, &rows[nrows].getput_ns))
+            return 1;
+        nrows++;
+    }
+
+    /* the pool logs its slab layout while running, so print the table last */
+    printf(" %-10s %-7s %-14s %-14s %-14s %-14s %-12s %-14s %-14s\n",
+           "#bytes", "#bufs", "reg_mr[us]", "dereg_mr[us]", "pool_reg[us]", "pool_free[us]",
+           "get+put[ns]", "reg_mr[GB/s]", "pool[GB/s]");
+    for (int i = 0; i < nrows; i++)
+        printf(" %-10zu %-7u %-14.2f %-14.2f %-14.2f %-14.2f %-12.1f %-14.2f %-14.2f\n",
+               rows[i].size, rows[i].n, rows[i].mr.reg_us, rows[i].mr.dereg_us,
+               rows[i].pool.reg_us, rows[i].pool.dereg_us, rows[i].getput_ns,
+               rows[i].mr.touch_gbps, rows[i].pool.touch_gbps);
+
+    rdma_dev_close(dev);
+    return 0;
+}
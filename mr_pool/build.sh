@@ -0,0 +1,5 @@
+#!/bin/bash
+
+COMMON="-I../common ../common/rdma_conn.c ../common/rdma_pool.c"
+
+gcc -O2 bench.c $COMMON -o bench -libverbs
@@ -0,0 +1,286 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <arpa/inet.h>
+#include <infiniband/verbs.h>
+#include "rdma_conn.h"
+#include "rdma_pool.h"
+#include "rdma_msg.h"
+#include "rdma_bench.h"
+#include "rdma_hist.h"
+#include "msg_proto.h"
+
+#define MAX_SIZES 32
+
+#define LOG(fmt, ...)  printf("[CLIENT] " fmt "\n", ##__VA_ARGS__)
+#define ERR(fmt, ...)  printf("[CLIENT][ERR] " fmt " (errno=%d:%s)\n", ##__VA_ARGS__, errno, strerror(errno))
+
+enum { PATH_EAGER, PATH_RNDV, NPATHS };
+
+struct cli {
+    struct msg_hello    hello;
+    struct rdma_msg     m;
+    struct rdma_pool   *src;        /* what the application sends from */
+    struct rdma_pool   *dst;        /* TEST_LAT: where echoes end up */
+    uint32_t            size;
+    uint64_t            sent, recvd;
+    int                 failed;
+};
+
+static void *on_alloc(void *arg, uint32_t len, uint32_t *lkey) {
+    struct cli *cl = arg;
+    struct rdma_buf *b = len <= cl->dst->buf_size ? rdma_pool_get(cl->dst) : NULL;
+    if (!b)
+        return NULL;
+    *lkey = b->lkey;
+    return b->addr;
+}
+
+static void on_recv(void *arg, void *data, uint32_t len, int rndv) {
+    struct cli *cl = arg;
+
+    if (len != cl->size)
+        cl->failed = 1;
+    if (rndv) {
+        /* READ into a buffer on_alloc handed out */
+        for (uint32_t i = 0; i < cl->dst->nbufs; i++) {
+            if (cl->dst->bufs[i].addr == data) {
+                rdma_pool_put(cl->dst, &cl->dst->bufs[i]);
+                break;
+            }
+        }
+    } else {
+        /* eager: copied out of the receive buffer, as an application would */
+        struct rdma_buf *b = rdma_pool_get(cl->dst);
+        if (!b) {
+            cl->failed = 1;
+            return;
+        }
+        memcpy(b->addr, data, len);
+        rdma_pool_put(cl->dst, b);
+    }
+    cl->recvd++;
+}
+
+static void on_sent(void *arg, uint64_t ctx) {
+    struct cli *cl = arg;
+    rdma_pool_put(cl->src, &cl->src->bufs[ctx]);
+    cl->sent++;
+}
+
+/* one message from a free source buffer; 1 when none is free or the layer is full */
+static int send_one(struct cli *cl) {
+    struct rdma_buf *b = rdma_pool_get(cl->src);
+    if (!b)
+        return 1;
+    int ret = rdma_msg_send(&cl->m, b->addr, cl->size, b->mr, b->idx);
+    if (ret)
+        rdma_pool_put(cl->src, b);
+    return ret;
+}
+
+static int run_bw(struct cli *cl, int sock, double *gbps) {
+    uint64_t posted = 0, sent0 = cl->sent;
+    uint64_t t0 = rdma_now_ns();
+
+    while (posted < cl->hello.iters) {
+        int ret = send_one(cl);
+        if (ret < 0)
+            return -1;
+        if (!ret)
+            posted++;
+        else if (rdma_msg_poll(&cl->m) < 0)
+            return -1;
+    }
+    while (cl->sent < sent0 + posted) {
+        if (rdma_msg_poll(&cl->m) < 0)
+            return -1;
+    }
+    /* the server has everything once it says so */
+    char done;
+    if (rdma_sock_read(sock, &done, 1))
+        return -1;
+    *gbps = (double)cl->size * cl->hello.iters / (rdma_now_ns() - t0);
+    return 0;
+}
+
+static int run_lat(struct cli *cl, int sock, double cpns, double *p50_us) {
+    const struct msg_hello *h = &cl->hello;
+    struct rdma_hist hist;
+
+    rdma_hist_init(&hist);
+    for (uint32_t i = 0; i < h->iters + h->warmup; i++) {
+        uint64_t want = cl->recvd + 1;
+        uint64_t t0 = rdma_cycles();
+        int ret;
+        while ((ret = send_one(cl)) == 1) {
+            if (rdma_msg_poll(&cl->m) < 0)
+                return -1;
+        }
+        if (ret)
+            return -1;
+        while (cl->recvd < want && !cl->failed) {
+            if (rdma_msg_poll(&cl->m) < 0)
+                return -1;
+        }
+        if (i >= h->warmup)
+            rdma_hist_add(&hist, (uint64_t)((rdma_cycles() - t0) / (2 * cpns)));
+    }
+    char done;
+    if (rdma_sock_read(sock, &done, 1))
+        return -1;
+    *p50_us = rdma_hist_percentile(&hist, 0.5) / 1e3;
+    return 0;
+}
+
+static void usage(const char *prog) {
+    printf("Usage: %s [options] <server_ip>\n"
+           "  -t <test>    bw | lat (default: bw)\n"
+           "  -s <bytes>   largest message, also the eager buffer size (default: 1M)\n"
+           "  -a           sweep sizes 64 B .. -s in powers of two\n"
+           "  -n <iters>   messages per size and path (default: 10000 bw, 2000 lat)\n"
+           "  -w <iters>   lat warm-up round trips (default: 200)\n"
+           "  -D <n>       messages in flight and receives posted (default: 16)\n"
+           "  every size runs eager (SEND, receiver copies) and rendezvous (descriptor + RDMA READ);\n"
+           "  the crossover is the eager threshold to use\n",
+           prog);
+    rdma_cfg_usage();
+}
+
+int main(int argc, char **argv) {
+    struct rdma_cfg cfg;
+    rdma_cfg_init(&cfg);
+    cfg.max_send_sge = 2;
+    cfg.max_rd_atomic = cfg.max_dest_rd_atomic = 0;
+
+    struct cli cl;
+    memset(&cl, 0, sizeof(cl));
+    struct msg_hello *h = &cl.hello;
+    h->test = TEST_BW;
+    h->max_size = 1 << 20;
+    h->warmup = 200;
+    h->depth = 16;
+    int sweep = 0;
+
+    static const struct option opts[] = {
+        RDMA_CFG_LONG_OPTIONS,
+        {NULL, 0, NULL, 0}
+    };
+    int c;
+    while ((c = getopt_long(argc, argv, "t:s:an:w:D:", opts, NULL)) != -1) {
+        switch (c) {
+        case 't':
+            if ((c = msg_parse_test(optarg)) < 0) {
+                usage(argv[0]);
+                return 1;
+            }
+            h->test = c;
+            break;
+        case 's': h->max_size = rdma_parse_size(optarg); break;
+        case 'a': sweep = 1; break;
+        case 'n': h->iters = atoi(optarg); break;
+        case 'w': h->warmup = atoi(optarg); break;
+        case 'D': h->depth = atoi(optarg); break;
+        default:
+            if (rdma_cfg_parse_opt(&cfg, c, optarg)) {
+                usage(argv[0]);
+                return 1;
+            }
+        }
+    }
+    if (!h->iters)
+        h->iters = h->test == TEST_BW ? 10000 : 2000;
+    if (h->test == TEST_BW)
+        h->warmup = 0;
+    h->min_size = sweep && h->max_size > 64 ? 64 : h->max_size;
+    if (optind >= argc || !h->max_size || !h->depth) {
+        usage(argv[0]);
+        return 1;
+    }
+    cfg.max_send_wr = 3 * h->depth;
+    cfg.max_recv_wr = h->depth;
+
+    LOG("Start");
+    double cpns = rdma_cycles_per_ns();
+
+    struct rdma_dev *dev = rdma_dev_open(&cfg);
+    if (!dev)
+        return 1;
+    struct rdma_conn *rc = rdma_conn_create(dev, &cfg, NULL);
+    if (!rc)
+        return 1;
+    cl.src = rdma_pool_create(dev->pd, h->max_size, h->depth,
+                              IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_READ);
+    cl.dst = rdma_pool_create(dev->pd, h->max_size, h->depth + 1, IBV_ACCESS_LOCAL_WRITE);
+    if (!cl.src || !cl.dst)
+        return 1;
+    for (uint32_t i = 0; i < h->depth; i++)
+        memset(cl.src->bufs[i].addr, 'a' + i % 26, h->max_size);
+    struct rdma_msg_ops ops = {
+        .recv = on_recv,
+        .alloc = on_alloc,
+        .sent = on_sent
+    };
+    if (rdma_msg_init(&cl.m, rc, h->depth, h->max_size, &ops, &cl))
+        return 1;
+
+    int sock = rdma_tcp_connect(argv[optind], cfg.tcp_port);
+    if (sock < 0)
+        return 1;
+    if (rdma_sock_write(sock, h, sizeof(*h)) || rdma_conn_handshake(rc, sock, RDMA_ROLE_CLIENT))
+        return 1;
+    LOG("%s: QP -> RTS, depth %u, %u READs in flight", h->test == TEST_BW ? "bw" : "lat",
+        h->depth, cl.m.max_reads);
+
+    const char *unit = h->test == TEST_BW ? "[GB/s]" : "[us]";
+    printf(" %-10s eager%-8s rndv%-9s %-8s\n", "#bytes", unit, unit, "faster");
+    uint32_t sizes[MAX_SIZES];
+    int rndv_wins[MAX_SIZES], n = 0;
+    for (uint32_t size = h->min_size; size <= h->max_size && n < MAX_SIZES; size *= 2, n++) {
+        double v[NPATHS];
+        for (int p = 0; p < NPATHS; p++) {
+            /* threshold 0 sends everything by rendezvous */
+            struct msg_run run = {
+                .threshold = p == PATH_EAGER ? h->max_size : 0,
+                .size = size
+            };
+            cl.m.threshold = run.threshold;
+            cl.size = size;
+            if (rdma_sock_write(sock, &run, sizeof(run)))
+                return 1;
+            int ret = h->test == TEST_BW ? run_bw(&cl, sock, &v[p]) : run_lat(&cl, sock, cpns, &v[p]);
+            if (ret || cl.failed)
+                return 1;
+        }
+        sizes[n] = size;
+        rndv_wins[n] = h->test == TEST_BW ? v[PATH_RNDV] > v[PATH_EAGER] : v[PATH_RNDV] < v[PATH_EAGER];
+        printf(" %-10u %-13.3f %-13.3f %-8s\n", size, v[PATH_EAGER], v[PATH_RNDV],
+               rndv_wins[n] ? "rndv" : "eager");
+    }
+
+    /* the smallest size from which rendezvous wins at every larger size */
+    int from = n;
+    while (from > 0 && rndv_wins[from - 1])
+        from--;
+    if (from == n)
+        LOG("Eager wins up to %u bytes: threshold >= %u", sizes[n - 1], sizes[n - 1]);
+    else if (!from)
+        LOG("Rendezvous wins from %u bytes: threshold < %u", sizes[0], sizes[0]);
+    else
+        LOG("Crossover: rendezvous from %u bytes, eager threshold = %u", sizes[from], sizes[from - 1]);
+
+    struct msg_run end = { 0 };
+    if (rdma_sock_write(sock, &end, sizeof(end)))
+        return 1;
+    LOG("Done");
+
+    rdma_msg_fini(&cl.m);
+    rdma_conn_destroy(rc);
+    rdma_pool_destroy(cl.src);
+    rdma_pool_destroy(cl.dst);
+    rdma_dev_close(dev);
+    return 0;
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+
+enum msg_test {
+    TEST_BW,                /* the client streams, depth messages in flight */
+    TEST_LAT,               /* the server echoes every message back */
+};
+
+/* client -> server, before the handshake */
+struct msg_hello {
+    uint32_t test;
+    uint32_t min_size;
+    uint32_t max_size;      /* also the eager buffer size, so either path can carry any size */
+    uint32_t iters;
+    uint32_t warmup;        /* TEST_LAT only */
+    uint32_t depth;
+};
+
+/* client -> server before every run; size 0 ends the session */
+struct msg_run {
+    uint32_t threshold;     /* the server's echoes use it too */
+    uint32_t size;
+};
+
+static inline int msg_parse_test(const char *s) {
+    if (!strcmp(s, "bw"))
+        return TEST_BW;
+    if (!strcmp(s, "lat"))
+        return TEST_LAT;
+    return -1;
+}
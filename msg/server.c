@@ -0,0 +1,186 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <arpa/inet.h>
+#include <infiniband/verbs.h>
+#include "rdma_conn.h"
+#include "rdma_pool.h"
+#include "rdma_msg.h"
+#include "msg_proto.h"
+
+#define LOG(fmt, ...)  printf("[SERVER] " fmt "\n", ##__VA_ARGS__)
+#define ERR(fmt, ...)  printf("[SERVER][ERR] " fmt " (errno=%d:%s)\n", ##__VA_ARGS__, errno, strerror(errno))
+
+struct srv {
+    struct msg_hello    hello;
+    struct rdma_msg     m;
+    struct rdma_pool   *app;        /* where the application wants its messages */
+    uint32_t            size;
+    uint64_t            recvd;
+    struct rdma_buf    *echo;       /* TEST_LAT: received, not yet sent back */
+    int                 failed;
+};
+
+static void *on_alloc(void *arg, uint32_t len, uint32_t *lkey) {
+    struct srv *s = arg;
+    struct rdma_buf *b = len <= s->app->buf_size ? rdma_pool_get(s->app) : NULL;
+    if (!b)
+        return NULL;
+    *lkey = b->lkey;
+    return b->addr;
+}
+
+/* slabs need not be contiguous, and there are only a few buffers per message in flight */
+static struct rdma_buf *app_buf(struct srv *s, void *addr) {
+    for (uint32_t i = 0; i < s->app->nbufs; i++) {
+        if (s->app->bufs[i].addr == addr)
+            return &s->app->bufs[i];
+    }
+    return NULL;
+}
+
+static void on_recv(void *arg, void *data, uint32_t len, int rndv) {
+    struct srv *s = arg;
+    struct rdma_buf *b;
+
+    if (len != s->size)
+        s->failed = 1;
+    if (rndv) {
+        b = app_buf(s, data);
+        if (!b) {
+            s->failed = 1;
+            return;
+        }
+    } else {
+        /* eager data lives in the receive buffer: the application copies it out */
+        b = rdma_pool_get(s->app);
+        if (!b) {
+            s->failed = 1;
+            return;
+        }
+        memcpy(b->addr, data, len);
+    }
+    s->recvd++;
+    /* callbacks run inside rdma_msg_poll(): echoes are sent from the main loop */
+    if (s->hello.test == TEST_LAT)
+        s->echo = b;
+    else
+        rdma_pool_put(s->app, b);
+}
+
+static void on_sent(void *arg, uint64_t ctx) {
+    struct srv *s = arg;
+    rdma_pool_put(s->app, &s->app->bufs[ctx]);
+}
+
+static void usage(const char *prog) {
+    printf("Usage: %s [options]\n"
+           "  test, sizes and depth come from the client\n", prog);
+    rdma_cfg_usage();
+}
+
+int main(int argc, char **argv) {
+    struct rdma_cfg cfg;
+    rdma_cfg_init(&cfg);
+    cfg.max_send_sge = 2;
+    cfg.max_rd_atomic = cfg.max_dest_rd_atomic = 0;
+
+    static const struct option opts[] = {
+        RDMA_CFG_LONG_OPTIONS,
+        {NULL, 0, NULL, 0}
+    };
+    int c;
+    while ((c = getopt_long(argc, argv, "", opts, NULL)) != -1) {
+        if (rdma_cfg_parse_opt(&cfg, c, optarg)) {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    LOG("Start");
+
+    struct rdma_dev *dev = rdma_dev_open(&cfg);
+    if (!dev)
+        return 1;
+
+    int lsock = rdma_tcp_listen(cfg.tcp_port, 1);
+    if (lsock < 0)
+        return 1;
+    int sock = accept(lsock, NULL, NULL);
+    struct srv s;
+    memset(&s, 0, sizeof(s));
+    if (sock < 0 || rdma_sock_read(sock, &s.hello, sizeof(s.hello))) {
+        ERR("accept failed");
+        return 1;
+    }
+    struct msg_hello *h = &s.hello;
+    if (h->test > TEST_LAT || !h->min_size || h->min_size > h->max_size || !h->iters || !h->depth) {
+        LOG("Bad hello");
+        return 1;
+    }
+    LOG("%s: sizes %u..%u, %u iters, depth %u", h->test == TEST_BW ? "bw" : "lat",
+        h->min_size, h->max_size, h->iters, h->depth);
+
+    /* READs and FINs of every message in flight share the send queue with the echoes */
+    cfg.max_send_wr = 3 * h->depth;
+    cfg.max_recv_wr = h->depth;
+    struct rdma_conn *rc = rdma_conn_create(dev, &cfg, NULL);
+    if (!rc)
+        return 1;
+    /* one spare buffer per message in flight, plus the one an eager echo copies into */
+    s.app = rdma_pool_create(dev->pd, h->max_size, 2 * h->depth + 1,
+                             IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_READ);
+    if (!s.app)
+        return 1;
+    struct rdma_msg_ops ops = {
+        .recv = on_recv,
+        .alloc = on_alloc,
+        .sent = on_sent
+    };
+    if (rdma_msg_init(&s.m, rc, h->depth, h->max_size, &ops, &s))
+        return 1;
+    if (rdma_conn_handshake(rc, sock, RDMA_ROLE_SERVER))
+        return 1;
+    LOG("QP -> RTS, %u READs in flight", s.m.max_reads);
+
+    for (;;) {
+        struct msg_run run;
+        if (rdma_sock_read(sock, &run, sizeof(run)))
+            return 1;
+        if (!run.size)
+            break;
+        s.m.threshold = run.threshold < h->max_size ? run.threshold : h->max_size;
+        s.size = run.size;
+        uint64_t want = s.recvd + h->iters + (h->test == TEST_LAT ? h->warmup : 0);
+        while ((s.recvd < want || s.echo) && !s.failed) {
+            if (rdma_msg_poll(&s.m) < 0)
+                return 1;
+            if (s.echo) {
+                int ret = rdma_msg_send(&s.m, s.echo->addr, s.size, s.echo->mr, s.echo->idx);
+                if (ret < 0)
+                    return 1;
+                if (!ret)
+                    s.echo = NULL;
+            }
+        }
+        if (s.failed) {
+            LOG("Bad %u byte run", run.size);
+            return 1;
+        }
+        /* the client stops its clock when this arrives */
+        char done = 1;
+        if (rdma_sock_write(sock, &done, 1))
+            return 1;
+    }
+    LOG("Done: %lu eager, %lu rendezvous messages received", s.m.eager_recvd, s.m.rndv_recvd);
+
+    rdma_msg_fini(&s.m);
+    rdma_conn_destroy(rc);
+    rdma_pool_destroy(s.app);
+    close(lsock);
+    rdma_dev_close(dev);
+    return 0;
+}
@@ -0,0 +1,215 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <arpa/inet.h>
+#include <infiniband/verbs.h>
+#include "rdma_conn.h"
+#include "rdma_pool.h"
+#include "rdma_poll.h"
+#include "rdma_bench.h"
+#include "mtu_proto.h"
+
+#define MAX_SIZES 32
+
+#define LOG(fmt, ...)  printf("[CLIENT] " fmt "\n", ##__VA_ARGS__)
+#define ERR(fmt, ...)  printf("[CLIENT][ERR] " fmt " (errno=%d:%s)\n", ##__VA_ARGS__, errno, strerror(errno))
+
+/* iters one-sided ops of size bytes, depth in flight; returns ns, 0 on error */
+static uint64_t run_bw(struct rdma_conn *rc, struct rdma_buf *b, int test, uint32_t size,
+                       uint32_t depth, uint64_t iters) {
+    struct ibv_wc wc[RDMA_POLL_MAX_BATCH];
+    uint64_t posted = 0, done = 0;
+    struct ibv_sge sge = {
+        .addr = (uintptr_t)b->addr,
+        .length = size,
+        .lkey = b->lkey
+    };
+    struct ibv_send_wr wr = {
+        .sg_list = &sge,
+        .num_sge = 1,
+        .opcode = test == TEST_WRITE ? IBV_WR_RDMA_WRITE : IBV_WR_RDMA_READ,
+        .send_flags = IBV_SEND_SIGNALED
+    }, *bad;
+    wr.wr.rdma.remote_addr = rc->remote.addr;
+    wr.wr.rdma.rkey = rc->remote.rkey;
+
+    uint64_t t0 = rdma_now_ns();
+    while (done < iters) {
+        while (posted < iters && posted - done < depth) {
+            wr.wr_id = posted;
+            if (ibv_post_send(rc->qp, &wr, &bad)) {
+                ERR("ibv_post_send failed");
+                return 0;
+            }
+            posted++;
+        }
+        int n = ibv_poll_cq(rc->send_cq, RDMA_POLL_MAX_BATCH, wc);
+        if (n < 0) {
+            ERR("ibv_poll_cq failed");
+            return 0;
+        }
+        for (int i = 0; i < n; i++) {
+            if (wc[i].status != IBV_WC_SUCCESS) {
+                LOG("WR %lu failed status=%s", wc[i].wr_id, ibv_wc_status_str(wc[i].status));
+                return 0;
+            }
+        }
+        done += n;
+    }
+    return rdma_now_ns() - t0;
+}
+
+/* comma-separated MTUs in bytes; returns how many, 0 if one is not a valid MTU */
+static int parse_mtus(char *s, enum ibv_mtu *mtus) {
+    int n = 0;
+    for (char *tok = strtok(s, ","); tok; tok = strtok(NULL, ",")) {
+        if (n == MAX_MTUS || !(mtus[n] = rdma_mtu_from_int(atoi(tok))))
+            return 0;
+        n++;
+    }
+    return n;
+}
+
+static void usage(const char *prog) {
+    printf("Usage: %s [options] <server_ip>\n"
+           "  -t <test>    write | read (default: write)\n"
+           "  -M <list>    path MTUs to compare, one connection each (default: 1024,4096)\n"
+           "  -s <bytes>   message size (default: 1M)\n"
+           "  -a           sweep 256 .. -s in powers of two\n"
+           "  -d <n>       operations in flight (default: 32)\n"
+           "  -b <bytes>   moved per size and MTU (default: 1G)\n"
+           "  an MTU above either port's active MTU is lowered to it; RoCE ports need a\n"
+           "  netdev MTU of at least 4200 for 4096\n",
+           prog);
+    rdma_cfg_usage();
+}
+
+int main(int argc, char **argv) {
+    struct rdma_cfg cfg;
+    rdma_cfg_init(&cfg);
+    cfg.max_rd_atomic = 0;
+
+    int test = TEST_WRITE, sweep = 0;
+    uint32_t max_size = 1 << 20, depth = 32;
+    uint64_t total = 1ull << 30;
+    char mtu_list[] = "1024,4096";
+    enum ibv_mtu mtus[MAX_MTUS];
+    int nmtus = parse_mtus(mtu_list, mtus);
+
+    static const struct option opts[] = {
+        RDMA_CFG_LONG_OPTIONS,
+        {NULL, 0, NULL, 0}
+    };
+    int c;
+    while ((c = getopt_long(argc, argv, "t:M:s:ad:b:", opts, NULL)) != -1) {
+        switch (c) {
+        case 't':
+            if ((test = mtu_parse_test(optarg)) < 0) {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 'M':
+            if (!(nmtus = parse_mtus(optarg, mtus))) {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 's': max_size = rdma_parse_size(optarg); break;
+        case 'a': sweep = 1; break;
+        case 'd': depth = atoi(optarg); break;
+        case 'b': total = rdma_parse_size(optarg); break;
+        default:
+            if (rdma_cfg_parse_opt(&cfg, c, optarg)) {
+                usage(argv[0]);
+                return 1;
+            }
+        }
+    }
+    if (optind >= argc || max_size < 256 || !depth || !total) {
+        usage(argv[0]);
+        return 1;
+    }
+    cfg.max_send_wr = depth;
+
+    uint32_t sizes[MAX_SIZES];
+    int nsizes = 0;
+    for (uint32_t s = sweep ? 256 : max_size;; s = s * 2 < max_size ? s * 2 : max_size) {
+        sizes[nsizes++] = s;
+        if (s == max_size || nsizes == MAX_SIZES)
+            break;
+    }
+
+    LOG("Start");
+    struct rdma_dev *dev = rdma_dev_open(&cfg);
+    if (!dev)
+        return 1;
+    struct rdma_pool *pool = rdma_pool_create(dev->pd, max_size, 1, IBV_ACCESS_LOCAL_WRITE);
+    if (!pool)
+        return 1;
+    struct rdma_buf *b = rdma_pool_get(pool);
+    memset(b->addr, 'm', max_size);
+
+    double gbps[MAX_MTUS][MAX_SIZES];
+    int used[MAX_MTUS];
+    for (int m = 0; m < nmtus; m++) {
+        cfg.path_mtu = mtus[m];
+        struct rdma_conn *rc = rdma_conn_create(dev, &cfg, NULL);
+        if (!rc)
+            return 1;
+        struct mtu_hello h = {
+            .region = max_size,
+            .last = m == nmtus - 1
+        };
+        int sock = rdma_tcp_connect(argv[optind], cfg.tcp_port);
+        if (sock < 0) {
+            rdma_conn_destroy(rc);
+            return 1;
+        }
+        /* rc owns sock: rdma_conn_destroy hangs up, which the server waits for before the next MTU */
+        rc->sock = sock;
+        if (rdma_sock_write(sock, &h, sizeof(h)) || rdma_conn_handshake(rc, sock, RDMA_ROLE_CLIENT)) {
+            rdma_conn_destroy(rc);
+            return 1;
+        }
+        used[m] = rdma_mtu_to_int(rc->cfg.path_mtu);
+        if (used[m] != rdma_mtu_to_int(mtus[m]))
+            LOG("Path MTU %d lowered to %d by the ports' active MTU", rdma_mtu_to_int(mtus[m]), used[m]);
+
+        for (int i = 0; i < nsizes; i++) {
+            uint64_t iters = total / sizes[i] > 1000 ? total / sizes[i] : 1000;
+            uint64_t ns = run_bw(rc, b, test, sizes[i], depth, iters);
+            if (!ns) {
+                rdma_conn_destroy(rc);
+                return 1;
+            }
+            gbps[m][i] = (double)iters * sizes[i] * 8 / ns;
+        }
+        rdma_conn_destroy(rc);
+    }
+
+    printf(" %-10s", "#bytes");
+    for (int m = 0; m < nmtus; m++) {
+        char col[32];
+        snprintf(col, sizeof(col), "MTU %d[Gb/s]", used[m]);
+        printf(" %-16s", col);
+    }
+    printf(" %s\n", nmtus > 1 ? "last/first" : "");
+    for (int i = 0; i < nsizes; i++) {
+        printf(" %-10u", sizes[i]);
+        for (int m = 0; m < nmtus; m++)
+            printf(" %-16.2f", gbps[m][i]);
+        if (nmtus > 1)
+            printf(" %.2fx", gbps[nmtus - 1][i] / gbps[0][i]);
+        printf("\n");
+    }
+    LOG("Done");
+
+    rdma_pool_put(pool, b);
+    rdma_pool_destroy(pool);
+    rdma_dev_close(dev);
+    return 0;
+}
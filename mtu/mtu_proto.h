@@ -0,0 +1,24 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+
+#define MAX_MTUS 5
+
+enum mtu_test {
+    TEST_WRITE,
+    TEST_READ,
+};
+
+/* client -> server, one connection per path MTU */
+struct mtu_hello {
+    uint32_t region;        /* bytes the server exports */
+    uint32_t last;          /* the server exits after this connection */
+};
+
+static inline int mtu_parse_test(const char *s) {
+    if (!strcmp(s, "write"))
+        return TEST_WRITE;
+    if (!strcmp(s, "read"))
+        return TEST_READ;
+    return -1;
+}
@@ -0,0 +1,109 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <arpa/inet.h>
+#include <infiniband/verbs.h>
+#include "rdma_conn.h"
+#include "rdma_pool.h"
+#include "rdma_bench.h"
+#include "mtu_proto.h"
+
+#define LOG(fmt, ...)  printf("[SERVER] " fmt "\n", ##__VA_ARGS__)
+#define ERR(fmt, ...)  printf("[SERVER][ERR] " fmt " (errno=%d:%s)\n", ##__VA_ARGS__, errno, strerror(errno))
+
+/* export the region until the client hangs up; 1 after the last connection */
+static int serve(struct rdma_dev *dev, const struct rdma_cfg *cfg, int sock) {
+    struct mtu_hello h;
+    if (rdma_sock_read(sock, &h, sizeof(h))) {
+        close(sock);
+        return -1;
+    }
+    if (!h.region) {
+        LOG("Bad hello");
+        close(sock);
+        return -1;
+    }
+
+    struct rdma_conn *rc = rdma_conn_create(dev, cfg, NULL);
+    if (!rc) {
+        close(sock);
+        return -1;
+    }
+    /* rc owns sock from here: rdma_conn_destroy closes it */
+    rc->sock = sock;
+    int ret = -1;
+    struct rdma_buf *b = NULL;
+    struct rdma_pool *pool = rdma_pool_create(dev->pd, h.region, 1, cfg->access_flags);
+    if (!pool)
+        goto out;
+    b = rdma_pool_get(pool);
+    rc->local.addr = (uintptr_t)b->addr;
+    rc->local.rkey = b->rkey;
+    rc->local.len = h.region;
+    if (rdma_conn_handshake(rc, sock, RDMA_ROLE_SERVER))
+        goto out;
+    LOG("Path MTU %d, %u bytes exported", rdma_mtu_to_int(rc->cfg.path_mtu), h.region);
+
+    char ch;
+    while (read(sock, &ch, 1) > 0);
+    ret = h.last ? 1 : 0;
+
+out:
+    if (b)
+        rdma_pool_put(pool, b);
+    rdma_pool_destroy(pool);
+    rdma_conn_destroy(rc);
+    return ret;
+}
+
+static void usage(const char *prog) {
+    printf("Usage: %s [options]\n"
+           "  the client picks the path MTU of every connection; --mtu caps it here\n", prog);
+    rdma_cfg_usage();
+}
+
+int main(int argc, char **argv) {
+    struct rdma_cfg cfg;
+    rdma_cfg_init(&cfg);
+    cfg.access_flags = IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_WRITE | IBV_ACCESS_REMOTE_READ;
+    cfg.max_dest_rd_atomic = 0;
+
+    static const struct option opts[] = {
+        RDMA_CFG_LONG_OPTIONS,
+        {NULL, 0, NULL, 0}
+    };
+    int c;
+    while ((c = getopt_long(argc, argv, "", opts, NULL)) != -1) {
+        if (rdma_cfg_parse_opt(&cfg, c, optarg)) {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    LOG("Start");
+
+    struct rdma_dev *dev = rdma_dev_open(&cfg);
+    if (!dev)
+        return 1;
+    int lsock = rdma_tcp_listen(cfg.tcp_port, 1);
+    if (lsock < 0)
+        return 1;
+    int ret;
+    do {
+        int sock = accept(lsock, NULL, NULL);
+        if (sock < 0) {
+            ERR("accept failed");
+            return 1;
+        }
+        if ((ret = serve(dev, &cfg, sock)) < 0)
+            return 1;
+    } while (!ret);
+    LOG("Done");
+
+    close(lsock);
+    rdma_dev_close(dev);
+    return 0;
+}
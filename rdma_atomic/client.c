@@ -0,0 +1,402 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <infiniband/verbs.h>
+#include "rdma_conn.h"
+#include "rdma_poll.h"
+#include "rdma_pool.h"
+#include "rdma_bench.h"
+#include "rdma_hist.h"
+#include "rdma_atomic.h"
+
+#define MAX_THREADS  64
+#define LINE_WORDS   8          /* one contended word per 64 B cache line */
+
+#define LOG(fmt, ...)  printf("[CLIENT] " fmt "\n", ##__VA_ARGS__)
+#define ERR(fmt, ...)  printf("[CLIENT][ERR] " fmt " (errno=%d:%s)\n", ##__VA_ARGS__, errno, strerror(errno))
+
+enum test {
+    TEST_FAA,               /* FETCH_AND_ADD 1, pipelined */
+    TEST_CAS,               /* CMP_AND_SWP old -> old + 1, pipelined */
+    TEST_LOCK,              /* CAS spinlock around a READ / WRITE increment */
+};
+
+struct opts {
+    enum test test;
+    uint32_t  iters;        /* per thread */
+    uint32_t  words;        /* contended words (locks with -t lock) */
+    uint32_t  depth;        /* atomics outstanding per thread */
+    double    cpns;
+};
+
+struct thr {
+    int                 id;
+    const struct opts  *o;
+    struct rdma_conn   *rc;
+    struct rdma_atomic  at;         /* blocking ops: lock service, verification */
+    struct rdma_pool   *pool;       /* depth landing slots, a cache line each */
+    pthread_barrier_t  *start;
+    pthread_t           tid;
+    int                 ret;
+
+    uint64_t           *t0;         /* per slot: post time in TSC ticks */
+    uint64_t           *expect;     /* per slot: CAS compare value */
+    uint32_t           *word;       /* per slot: target word */
+    uint32_t            posted;
+
+    struct rdma_hist    hist;       /* per op, or per lock acquisition */
+    uint64_t            ops;        /* atomics completed */
+    uint64_t            ok;         /* increments that took effect */
+    uint64_t            hold_ns;    /* lock held, summed */
+};
+
+static uint64_t word_addr(const struct thr *t, uint32_t w) {
+    return t->rc->remote.addr + (uint64_t)w * LINE_WORDS * sizeof(uint64_t);
+}
+
+/* -t lock: lock k and the counter it guards sit on neighbouring lines */
+static uint64_t lock_addr(const struct thr *t, uint32_t k) {
+    return word_addr(t, 2 * k);
+}
+
+static uint64_t counter_addr(const struct thr *t, uint32_t k) {
+    return word_addr(t, 2 * k + 1);
+}
+
+static int post_op(struct thr *t, uint32_t slot) {
+    struct rdma_buf *b = &t->pool->bufs[slot];
+    struct ibv_sge sge = {
+        .addr = (uintptr_t)b->addr,
+        .length = sizeof(uint64_t),
+        .lkey = b->lkey
+    };
+    struct ibv_send_wr wr = {
+        .wr_id = slot,
+        .sg_list = &sge,
+        .num_sge = 1,
+        .send_flags = IBV_SEND_SIGNALED,
+        .wr.atomic.remote_addr = word_addr(t, t->word[slot]),
+        .wr.atomic.rkey = t->rc->remote.rkey
+    };
+    if (t->o->test == TEST_FAA) {
+        wr.opcode = IBV_WR_ATOMIC_FETCH_AND_ADD;
+        wr.wr.atomic.compare_add = 1;
+    } else {
+        wr.opcode = IBV_WR_ATOMIC_CMP_AND_SWP;
+        wr.wr.atomic.compare_add = t->expect[slot];
+        wr.wr.atomic.swap = t->expect[slot] + 1;
+    }
+    struct ibv_send_wr *bad;
+    t->t0[slot] = rdma_cycles();
+    t->posted++;
+    return ibv_post_send(t->rc->qp, &wr, &bad);
+}
+
+static int op_done(void *arg, struct ibv_wc *wc) {
+    struct thr *t = arg;
+    uint32_t slot = wc->wr_id;
+
+    if (wc->status != IBV_WC_SUCCESS) {
+        ERR("atomic failed status=%s", ibv_wc_status_str(wc->status));
+        return -1;
+    }
+    rdma_hist_add(&t->hist, (uint64_t)((rdma_cycles() - t->t0[slot]) / t->o->cpns));
+    t->ops++;
+
+    uint64_t old = *(volatile uint64_t *)t->pool->bufs[slot].addr;
+    if (t->o->test == TEST_FAA) {
+        t->ok++;
+    } else if (old == t->expect[slot]) {
+        t->ok++;
+        t->expect[slot] = old + 1;
+    } else {
+        /* lost the race: the failed CAS still told us the current value */
+        t->expect[slot] = old;
+    }
+
+    if (t->posted < t->o->iters && post_op(t, slot)) {
+        ERR("ibv_post_send failed");
+        return -1;
+    }
+    return 0;
+}
+
+static int run_pipe(struct thr *t) {
+    const struct opts *o = t->o;
+    struct rdma_poller poller;
+    rdma_poller_init(&poller, t->rc->send_cq, t->rc->cfg.poll_batch, op_done, t);
+
+    /* slots of all threads interleave over the words; -c 1 puts them on one */
+    for (uint32_t s = 0; s < o->depth && s < o->iters; s++) {
+        t->word[s] = (t->id * o->depth + s) % o->words;
+        if (post_op(t, s)) {
+            ERR("ibv_post_send failed");
+            return -1;
+        }
+    }
+    while (t->ops < o->iters) {
+        if (rdma_poller_poll(&poller) < 0)
+            return -1;
+    }
+    return 0;
+}
+
+static int run_lock(struct thr *t) {
+    const struct opts *o = t->o;
+    uint64_t id = (uint64_t)t->rc->local.qp_num << 32 | (uint32_t)getpid();
+
+    for (uint32_t i = 0; i < o->iters; i++) {
+        uint32_t k = (t->id + i) % o->words;
+        uint64_t retries = 0, val;
+
+        uint64_t c0 = rdma_cycles();
+        if (rdma_lock_acquire(&t->at, lock_addr(t, k), id, &retries))
+            return -1;
+        uint64_t c1 = rdma_cycles();
+
+        /* the critical section: a plain read-modify-write only the lock makes safe */
+        if (rdma_atomic_read(&t->at, counter_addr(t, k), &val) ||
+            rdma_atomic_write(&t->at, counter_addr(t, k), val + 1))
+            return -1;
+        uint64_t c2 = rdma_cycles();
+
+        if (rdma_lock_release(&t->at, lock_addr(t, k), id))
+            return -1;
+
+        rdma_hist_add(&t->hist, (uint64_t)((c1 - c0) / o->cpns));
+        t->hold_ns += (uint64_t)((c2 - c1) / o->cpns);
+        t->ops += retries + 4;
+        t->ok++;
+    }
+    return 0;
+}
+
+static void *thr_main(void *arg) {
+    struct thr *t = arg;
+
+    pthread_barrier_wait(t->start);
+    t->ret = t->o->test == TEST_LOCK ? run_lock(t) : run_pipe(t);
+    return NULL;
+}
+
+/* the words a test increments, read with FETCH_AND_ADD 0 so it is atomic too */
+static int sum_words(struct thr *t, uint64_t *sum) {
+    const struct opts *o = t->o;
+
+    *sum = 0;
+    for (uint32_t w = 0; w < o->words; w++) {
+        uint64_t v;
+        uint64_t addr = o->test == TEST_LOCK ? counter_addr(t, w) : word_addr(t, w);
+        if (rdma_atomic_fadd(&t->at, addr, 0, &v))
+            return -1;
+        *sum += v;
+    }
+    return 0;
+}
+
+static int run(struct thr *thr, int n, const struct opts *o) {
+    pthread_barrier_t start;
+    uint64_t before, after;
+
+    if (sum_words(&thr[0], &before))
+        return -1;
+    pthread_barrier_init(&start, NULL, n + 1);
+    for (int i = 0; i < n; i++) {
+        struct thr *t = &thr[i];
+        rdma_hist_init(&t->hist);
+        t->ops = t->ok = t->hold_ns = 0;
+        t->posted = 0;
+        t->start = &start;
+        memset(t->expect, 0, o->depth * sizeof(*t->expect));
+        if (pthread_create(&t->tid, NULL, thr_main, t)) {
+            ERR("pthread_create failed");
+            return -1;
+        }
+    }
+    pthread_barrier_wait(&start);
+    uint64_t t0 = rdma_now_ns();
+
+    struct rdma_hist total;
+    uint64_t ops = 0, ok = 0, hold_ns = 0;
+    int ret = 0;
+    rdma_hist_init(&total);
+    for (int i = 0; i < n; i++) {
+        pthread_join(thr[i].tid, NULL);
+        ret |= thr[i].ret;
+        rdma_hist_merge(&total, &thr[i].hist);
+        ops += thr[i].ops;
+        ok += thr[i].ok;
+        hold_ns += thr[i].hold_ns;
+    }
+    uint64_t ns = rdma_now_ns() - t0;
+    pthread_barrier_destroy(&start);
+    if (ret || sum_words(&thr[0], &after))
+        return -1;
+
+    /* -t lock: an op is an acquisition, "ok" the share of CASes that got the lock */
+    double sec = ns / 1e9;
+    printf(" %-9d %-12.3f %-12.3f %-10.2f %-10.2f %-10.2f %-10.2f %-8.1f %-10.2f %s\n",
+           n, ops / sec / 1e6, ok / sec / 1e6,
+           rdma_hist_percentile(&total, 0.50) / 1e3,
+           rdma_hist_percentile(&total, 0.99) / 1e3,
+           rdma_hist_percentile(&total, 0.999) / 1e3,
+           total.max / 1e3,
+           o->test == TEST_LOCK ? 100.0 * ok / (ops - 3 * ok) : 100.0 * ok / ops,
+           o->test == TEST_LOCK && ok ? hold_ns / 1e3 / ok : 0.0,
+           after - before == ok ? "ok" : after - before > ok ? "shared" : "LOST");
+    return 0;
+}
+
+static int parse_test(const char *s) {
+    if (!strcmp(s, "faa"))
+        return TEST_FAA;
+    if (!strcmp(s, "cas"))
+        return TEST_CAS;
+    if (!strcmp(s, "lock"))
+        return TEST_LOCK;
+    return -1;
+}
+
+static void usage(const char *prog) {
+    printf("Usage: %s [options] <server_ip>\n"
+           "  -t <test>    faa | cas | lock (default: faa)\n"
+           "               faa: FETCH_AND_ADD 1; cas: CMP_AND_SWP increment, a failed CAS\n"
+           "               retries with the value it fetched; lock: CAS spinlock around an\n"
+           "               RDMA READ + WRITE increment of the counter it guards\n"
+           "  -n <ops>     operations per thread (default: 100000)\n"
+           "  -T <n>       threads, one QP each (default: 1)\n"
+           "  -a           sweep threads 1..-T in powers of two\n"
+           "  -c <words>   words (locks) the threads spread over, 1 = all contend (default: 1)\n"
+           "  -D <ops>     atomics outstanding per thread, faa/cas (default: 1, max: max_rd_atomic)\n"
+           "  run several clients against one server for cross-host contention; the\n"
+           "  last column checks the words' growth against this client's increments\n"
+           "  (\"shared\" when other clients added to them meanwhile)\n",
+           prog);
+    rdma_cfg_usage();
+}
+
+int main(int argc, char **argv) {
+    struct rdma_cfg cfg;
+    rdma_cfg_init(&cfg);
+    cfg.max_send_wr = 64;
+    cfg.max_recv_wr = 1;
+    cfg.max_inline_data = 0;
+    cfg.max_rd_atomic = 0;
+
+    struct opts o = {
+        .test = TEST_FAA,
+        .iters = 100000,
+        .words = 1,
+        .depth = 1
+    };
+    int nthreads = 1, sweep = 0;
+
+    static const struct option opts[] = {
+        RDMA_CFG_LONG_OPTIONS,
+        {NULL, 0, NULL, 0}
+    };
+    int c;
+    while ((c = getopt_long(argc, argv, "t:n:T:ac:D:", opts, NULL)) != -1) {
+        switch (c) {
+        case 't':
+            if ((c = parse_test(optarg)) < 0) {
+                usage(argv[0]);
+                return 1;
+            }
+            o.test = c;
+            break;
+        case 'n': o.iters = atoi(optarg); break;
+        case 'T': nthreads = atoi(optarg); break;
+        case 'a': sweep = 1; break;
+        case 'c': o.words = atoi(optarg); break;
+        case 'D': o.depth = atoi(optarg); break;
+        default:
+            if (rdma_cfg_parse_opt(&cfg, c, optarg)) {
+                usage(argv[0]);
+                return 1;
+            }
+        }
+    }
+    if (optind >= argc || !o.iters || !o.words || !o.depth ||
+        nthreads < 1 || nthreads > MAX_THREADS) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (o.test == TEST_LOCK)
+        o.depth = 1;
+
+    LOG("Start");
+    o.cpns = rdma_cycles_per_ns();
+
+    struct rdma_dev *dev = rdma_dev_open(&cfg);
+    if (!dev)
+        return 1;
+
+    struct thr *thr = calloc(nthreads, sizeof(*thr));
+    for (int i = 0; i < nthreads; i++) {
+        struct thr *t = &thr[i];
+        t->id = i;
+        t->o = &o;
+        t->rc = rdma_conn_create(dev, &cfg, NULL);
+        if (!t->rc)
+            return 1;
+        int sock = rdma_tcp_connect(argv[optind], cfg.tcp_port);
+        if (sock < 0 || rdma_conn_handshake(t->rc, sock, RDMA_ROLE_CLIENT))
+            return 1;
+        if (rdma_atomic_init(&t->at, t->rc))
+            return 1;
+        if (i == 0) {
+            uint32_t lines = o.test == TEST_LOCK ? 2 * o.words : o.words;
+            if ((uint64_t)lines * LINE_WORDS * sizeof(uint64_t) > t->rc->remote.len) {
+                LOG("-c %u needs %u words, the server exports %lu",
+                    o.words, lines * LINE_WORDS, t->rc->remote.len / sizeof(uint64_t));
+                return 1;
+            }
+            if (o.depth > t->rc->cfg.max_rd_atomic)
+                o.depth = t->rc->cfg.max_rd_atomic;
+            if (o.depth > t->rc->cfg.max_send_wr)
+                o.depth = t->rc->cfg.max_send_wr;
+        }
+        t->pool = rdma_pool_create(dev->pd, sizeof(uint64_t), o.depth, IBV_ACCESS_LOCAL_WRITE);
+        t->t0 = calloc(o.depth, sizeof(*t->t0));
+        t->expect = calloc(o.depth, sizeof(*t->expect));
+        t->word = calloc(o.depth, sizeof(*t->word));
+        if (!t->pool || !t->t0 || !t->expect || !t->word)
+            return 1;
+    }
+
+    static const char *names[] = { "FETCH_AND_ADD", "CMP_AND_SWP", "CAS spinlock" };
+    LOG("%s: %u ops per thread, %u %s, depth %u, max_rd_atomic %u",
+        names[o.test], o.iters, o.words, o.test == TEST_LOCK ? "lock(s)" : "word(s)",
+        o.depth, thr[0].rc->cfg.max_rd_atomic);
+    if (o.test == TEST_LOCK)
+        LOG("latency is lock acquisition; Mops/s counts every CAS, READ and WRITE");
+    printf(" %-9s %-12s %-12s %-10s %-10s %-10s %-10s %-8s %-10s %s\n",
+           "#threads", "Mops/s", "Mincr/s", "p50[us]", "p99[us]", "p99.9[us]", "max[us]",
+           "ok[%]", "hold[us]", "check");
+
+    for (int n = sweep ? 1 : nthreads;; n = n * 2 < nthreads ? n * 2 : nthreads) {
+        if (run(thr, n, &o))
+            return 1;
+        if (n == nthreads)
+            break;
+    }
+
+    for (int i = 0; i < nthreads; i++) {
+        struct thr *t = &thr[i];
+        rdma_atomic_fini(&t->at);
+        rdma_pool_destroy(t->pool);
+        free(t->t0);
+        free(t->expect);
+        free(t->word);
+        rdma_conn_destroy(t->rc);
+    }
+    free(thr);
+    rdma_dev_close(dev);
+    return 0;
+}
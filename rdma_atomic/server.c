@@ -0,0 +1,156 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <getopt.h>
+#include <arpa/inet.h>
+#include <infiniband/verbs.h>
+#include "rdma_conn.h"
+#include "rdma_pool.h"
+#include "rdma_bench.h"
+
+#define MAX_CLIENTS 256
+
+#define LOG(fmt, ...)  printf("[SERVER] " fmt "\n", ##__VA_ARGS__)
+#define ERR(fmt, ...)  printf("[SERVER][ERR] " fmt " (errno=%d:%s)\n", ##__VA_ARGS__, errno, strerror(errno))
+
+static uint64_t word_sum(const volatile uint64_t *words, uint32_t n) {
+    uint64_t sum = 0;
+    for (uint32_t i = 0; i < n; i++)
+        sum += words[i];
+    return sum;
+}
+
+static void usage(const char *prog) {
+    printf("Usage: %s [options]\n"
+           "  -w <words>   64-bit words exported for atomics (default: 4096)\n"
+           "  -N <n>       exit once n clients have come and gone (default: run forever)\n"
+           "  clients connect one QP each; the server CPU only accepts and tears down\n",
+           prog);
+    rdma_cfg_usage();
+}
+
+int main(int argc, char **argv) {
+    struct rdma_cfg cfg;
+    rdma_cfg_init(&cfg);
+    cfg.max_send_wr = 1;
+    cfg.max_recv_wr = 1;
+    cfg.max_inline_data = 0;
+    cfg.max_dest_rd_atomic = 0;
+    cfg.access_flags = IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_READ |
+                       IBV_ACCESS_REMOTE_WRITE | IBV_ACCESS_REMOTE_ATOMIC;
+    uint32_t nwords = 4096;
+    int exit_after = 0;
+
+    static const struct option opts[] = {
+        RDMA_CFG_LONG_OPTIONS,
+        {NULL, 0, NULL, 0}
+    };
+    int c;
+    while ((c = getopt_long(argc, argv, "w:N:", opts, NULL)) != -1) {
+        switch (c) {
+        case 'w': nwords = atoi(optarg); break;
+        case 'N': exit_after = atoi(optarg); break;
+        default:
+            if (rdma_cfg_parse_opt(&cfg, c, optarg)) {
+                usage(argv[0]);
+                return 1;
+            }
+        }
+    }
+    if (!nwords) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    LOG("Start");
+
+    struct rdma_dev *dev = rdma_dev_open(&cfg);
+    if (!dev)
+        return 1;
+    if (dev->attr.atomic_cap == IBV_ATOMIC_NONE) {
+        LOG("Device has no RDMA atomics");
+        return 1;
+    }
+    LOG("atomic_cap %s, max_qp_rd_atom %d",
+        dev->attr.atomic_cap == IBV_ATOMIC_GLOB ? "GLOB" : "HCA", dev->attr.max_qp_rd_atom);
+
+    /* the pool's mmap hands back zeroed, 64 B aligned memory */
+    struct rdma_pool *pool = rdma_pool_create(dev->pd, (size_t)nwords * sizeof(uint64_t), 1,
+                                              cfg.access_flags);
+    if (!pool)
+        return 1;
+    struct rdma_buf *region = rdma_pool_get(pool);
+    volatile uint64_t *words = region->addr;
+    LOG("Exporting %u words at %p rkey 0x%x", nwords, region->addr, region->rkey);
+
+    int lsock = rdma_tcp_listen(cfg.tcp_port, 64);
+    if (lsock < 0)
+        return 1;
+
+    struct pollfd pfd[MAX_CLIENTS + 1];
+    struct rdma_conn *conns[MAX_CLIENTS + 1];
+    int nfds = 1, gone = 0;
+    pfd[0] = (struct pollfd){ .fd = lsock, .events = POLLIN };
+    uint64_t wall0 = rdma_now_ns(), cpu0 = rdma_cpu_ns();
+
+    while (!exit_after || gone < exit_after) {
+        if (poll(pfd, nfds, -1) < 0) {
+            ERR("poll failed");
+            return 1;
+        }
+
+        for (int i = nfds - 1; i >= 1; i--) {
+            if (!pfd[i].revents)
+                continue;
+            char ch;
+            if (read(pfd[i].fd, &ch, 1) > 0)
+                continue;
+            /* EOF: the client is done with its QP; destroy closes the socket */
+            rdma_conn_destroy(conns[i]);
+            pfd[i] = pfd[nfds - 1];
+            conns[i] = conns[nfds - 1];
+            nfds--;
+            gone++;
+            LOG("Client left (%d connected): word sum %lu, cpu %.2f%% since start",
+                nfds - 1, word_sum(words, nwords),
+                100.0 * (rdma_cpu_ns() - cpu0) / (rdma_now_ns() - wall0));
+        }
+
+        if (!(pfd[0].revents & POLLIN))
+            continue;
+        int sock = accept(lsock, NULL, NULL);
+        if (sock < 0) {
+            ERR("accept failed");
+            continue;
+        }
+        if (nfds > MAX_CLIENTS) {
+            LOG("Too many clients, refusing one");
+            close(sock);
+            continue;
+        }
+        struct rdma_conn *rc = rdma_conn_create(dev, &cfg, NULL);
+        if (!rc)
+            return 1;
+        rc->local.addr = (uintptr_t)region->addr;
+        rc->local.rkey = region->rkey;
+        rc->local.len = (uint64_t)nwords * sizeof(uint64_t);
+        if (rdma_conn_handshake(rc, sock, RDMA_ROLE_SERVER)) {
+            rdma_conn_destroy(rc);
+            continue;
+        }
+        conns[nfds] = rc;
+        pfd[nfds++] = (struct pollfd){ .fd = sock, .events = POLLIN };
+        LOG("Client QP %u -> RTS (%d connected)", rc->remote.qp_num, nfds - 1);
+    }
+
+    LOG("Done: word sum %lu", word_sum(words, nwords));
+    for (int i = 1; i < nfds; i++)
+        rdma_conn_destroy(conns[i]);
+    rdma_pool_destroy(pool);
+    close(lsock);
+    rdma_dev_close(dev);
+    return 0;
+}
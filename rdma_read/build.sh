@@ -1,5 +1,7 @@
 #!/bin/bash
 
-gcc server.c -o server -libverbs
+COMMON="-I../common ../common/rdma_conn.c ../common/rdma_poll.c ../common/rdma_pool.c ../common/rdma_bulk.c"
 
-gcc client.c -o client -libverbs
\ No newline at end of file
+gcc server.c $COMMON -o server -libverbs
+
+gcc client.c $COMMON -o client -libverbs
@@ -3,153 +3,212 @@
 #include <string.h>
 #include <errno.h>
 #include <unistd.h>
+#include <getopt.h>
 #include <arpa/inet.h>
 #include <infiniband/verbs.h>
-#include "rdma_common.h"
+#include "rdma_conn.h"
+#include "rdma_pool.h"
+#include "rdma_poll.h"
+#include "rdma_bench.h"
+#include "rdma_bulk.h"
 
-#define PORT 18515
-#define MSG "Hello from Client"
+#define MSG_SIZE 1024
 
 #define LOG(fmt, ...)  printf("[CLIENT] " fmt "\n", ##__VA_ARGS__)
 #define ERR(fmt, ...)  printf("[CLIENT][ERR] " fmt " (errno=%d:%s)\n", ##__VA_ARGS__, errno, strerror(errno))
 
+static int wr_done(void *arg, struct ibv_wc *wc) {
+    (void)arg;
+    if (wc->status != IBV_WC_SUCCESS) {
+        ERR("RDMA READ failed status=%s", ibv_wc_status_str(wc->status));
+        return -1;
+    }
+    return 0;
+}
+
+/* one bulk pass per repetition; returns GB/s or a negative value on error */
+static double bulk_pass(struct rdma_conn *rc, char *dst, uint32_t lkey,
+                        uint32_t chunk, uint32_t depth, int reps) {
+    uint64_t start = rdma_now_ns();
+    for (int r = 0; r < reps; r++) {
+        if (rdma_read_bulk(rc, dst, lkey, rc->remote.addr, rc->remote.rkey,
+                           rc->remote.len, chunk, depth))
+            return -1;
+    }
+    return (double)rc->remote.len * reps / (rdma_now_ns() - start);
+}
+
+/* the server stores each word's own offset in it */
+static int bulk_verify(const char *buf, uint64_t len) {
+    const uint64_t *w = (const uint64_t *)buf;
+    for (uint64_t i = 0; i < len / 8; i++) {
+        if (w[i] != i * 8) {
+            LOG("Mismatch at offset %lu: got %lu", i * 8, w[i]);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int run_bulk(struct rdma_conn *rc, uint32_t chunk, uint32_t depth,
+                    int reps, int sweep, int verify) {
+    uint64_t len = rc->remote.len;
+    struct rdma_pool *pool = rdma_pool_create(rc->dev->pd, len, 1, IBV_ACCESS_LOCAL_WRITE);
+    if (!pool)
+        return -1;
+    struct rdma_buf *b = rdma_pool_get(pool);
+    char *buf = b->addr;
+
+    uint32_t max_depth = rc->cfg.max_rd_atomic;
+    uint32_t chunk_lo = sweep ? 4096 : chunk, chunk_hi = sweep ? 4u << 20 : chunk;
+    uint32_t depth_lo = sweep ? 1 : depth, depth_hi = sweep && max_depth ? max_depth : depth;
+
+    LOG("Reading %lu bytes, %d pass(es) per point, max_rd_atomic=%u",
+        len, reps, max_depth);
+    printf(" %-12s %-8s %-12s\n", "#chunk", "#depth", "GB/s");
+    for (uint32_t ck = chunk_lo; ck <= chunk_hi; ck *= 4) {
+        /* powers of two, always ending on the device limit */
+        for (uint32_t d = depth_lo; ; d = d * 2 < depth_hi ? d * 2 : depth_hi) {
+            memset(buf, 0, len);
+            double gbps = bulk_pass(rc, buf, b->lkey, ck, d, reps);
+            if (gbps < 0 || (verify && bulk_verify(buf, len))) {
+                rdma_pool_destroy(pool);
+                return -1;
+            }
+            printf(" %-12u %-8u %-12.2f\n", ck, d, gbps);
+            if (d >= depth_hi)
+                break;
+        }
+    }
+
+    rdma_pool_put(pool, b);
+    rdma_pool_destroy(pool);
+    return 0;
+}
+
+static void usage(const char *prog) {
+    printf("Usage: %s [options] <server_ip>\n"
+           "  -b           bulk mode: pull the server's whole -S region\n"
+           "  -c <bytes>   READ chunk size, K/M suffixes allowed (default: 1M)\n"
+           "  -D <reads>   READs outstanding, at most and by default max_rd_atomic: the smaller\n"
+           "               of this device's max and the server's max_dest_rd_atomic\n"
+           "  -a           sweep chunks 4K..4M and depths 1..max_rd_atomic\n"
+           "  -n <passes>  passes over the region per point (default: 1)\n"
+           "  -V           verify the data after every pass\n",
+           prog);
+    rdma_cfg_usage();
+}
+
 int main(int argc, char **argv) {
-    if (argc < 2) {
-        printf("Usage: %s <server_ip>\n", argv[0]);
+    struct rdma_cfg cfg;
+    rdma_cfg_init(&cfg);
+    cfg.max_recv_wr = 0;
+    cfg.access_flags = IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_READ;
+    int bulk = 0, sweep = 0, verify = 0, reps = 1;
+    uint32_t chunk = 1 << 20, depth = 0;
+
+    static const struct option opts[] = {
+        RDMA_CFG_LONG_OPTIONS,
+        {NULL, 0, NULL, 0}
+    };
+    int c;
+    while ((c = getopt_long(argc, argv, "bc:D:an:V", opts, NULL)) != -1) {
+        switch (c) {
+        case 'b': bulk = 1; break;
+        case 'c': chunk = rdma_parse_size(optarg); break;
+        case 'D': depth = atoi(optarg); break;
+        case 'a': sweep = 1; break;
+        case 'n': reps = atoi(optarg); break;
+        case 'V': verify = 1; break;
+        default:
+            if (rdma_cfg_parse_opt(&cfg, c, optarg)) {
+                usage(argv[0]);
+                return 1;
+            }
+        }
+    }
+    if (bulk) {
+        /* as many READs in flight as the device allows, and room to post them */
+        cfg.max_rd_atomic = 0;
+        if (cfg.max_send_wr < 256)
+            cfg.max_send_wr = 256;
+    }
+    if (optind >= argc) {
+        usage(argv[0]);
         return 1;
     }
 
     LOG("Start");
 
-    struct ibv_device **dev_list = ibv_get_device_list(NULL);
-    struct ibv_context *ctx = ibv_open_device(dev_list[0]);
-    struct ibv_pd *pd = ibv_alloc_pd(ctx);
-    struct ibv_cq *cq = ibv_create_cq(ctx, 10, NULL, NULL, 0);
+    struct rdma_dev *dev = rdma_dev_open(&cfg);
+    if (!dev)
+        return 1;
 
-    struct ibv_qp_init_attr qpia = {
-        .send_cq = cq,
-        .recv_cq = cq,
-        .qp_type = IBV_QPT_RC,
-        .cap = {.max_send_wr = 10, .max_send_sge = 1}
-    };
-    struct ibv_qp *qp = ibv_create_qp(pd, &qpia);
-    LOG("QP created qpn=%u", qp->qp_num);
-
-    /* INIT */
-    struct ibv_qp_attr attr = {
-        .qp_state = IBV_QPS_INIT,
-        .port_num = 1,
-        .pkey_index = 0,
-        .qp_access_flags = IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_READ
-    };
-    ibv_modify_qp(qp, &attr,
-        IBV_QP_STATE |
-        IBV_QP_PORT |
-        IBV_QP_PKEY_INDEX |
-        IBV_QP_ACCESS_FLAGS);
+    struct rdma_conn *rc = rdma_conn_create(dev, &cfg, NULL);
+    if (!rc)
+        return 1;
+    LOG("QP created qpn=%u", rc->qp->qp_num);
     LOG("QP -> INIT");
 
     /* TCP */
-    int sock = socket(AF_INET, SOCK_STREAM, 0);
-    struct sockaddr_in addr = {
-        .sin_family = AF_INET,
-        .sin_port = htons(PORT)
-    };
-    inet_pton(AF_INET, argv[1], &addr.sin_addr);
-    connect(sock, (struct sockaddr*)&addr, sizeof(addr));
+    int sock = rdma_tcp_connect(argv[optind], cfg.tcp_port);
+    if (sock < 0)
+        return 1;
     LOG("TCP connected");
 
-    /* exchange QP */
-    struct qp_info local = {}, remote = {};
-    local.qp_num = qp->qp_num;
-
-    union ibv_gid gid;
-    ibv_query_gid(ctx, 1, 1, &gid);
-    memcpy(local.gid, &gid, 16);
-
-    read(sock, &remote, sizeof(remote));
-    write(sock, &local, sizeof(local));
-    LOG("Remote qpn=%u", remote.qp_num);
-
-    /* RTR */
-    memset(&attr, 0, sizeof(attr));
-    attr.qp_state = IBV_QPS_RTR;
-    attr.path_mtu = IBV_MTU_1024;
-    attr.dest_qp_num = remote.qp_num;
-    attr.rq_psn = 0;
-    attr.max_dest_rd_atomic = 1;
-    attr.min_rnr_timer = 12;
-
-    attr.ah_attr.is_global = 1;
-    attr.ah_attr.port_num = 1;
-    attr.ah_attr.grh.hop_limit = 64;
-    attr.ah_attr.grh.sgid_index = 1;
-    memcpy(&attr.ah_attr.grh.dgid, remote.gid, 16);
-
-    if (ibv_modify_qp(qp, &attr,
-        IBV_QP_STATE |
-        IBV_QP_AV |
-        IBV_QP_PATH_MTU |
-        IBV_QP_DEST_QPN |
-        IBV_QP_RQ_PSN |
-        IBV_QP_MAX_DEST_RD_ATOMIC |
-        IBV_QP_MIN_RNR_TIMER)) {
-        ERR("QP to RTR failed");
+    /* exchange QP, RTR, RTS */
+    if (rdma_conn_handshake(rc, sock, RDMA_ROLE_CLIENT))
         return 1;
-    }
-    LOG("QP -> RTR");
-
-    /* RTS */
-    memset(&attr, 0, sizeof(attr));
-    attr.qp_state = IBV_QPS_RTS;
-    attr.timeout = 14;
-    attr.retry_cnt = 7;
-    attr.rnr_retry = 7;
-    attr.sq_psn = 0;
-    attr.max_rd_atomic = 1;
-
-    ibv_modify_qp(qp, &attr,
-        IBV_QP_STATE |
-        IBV_QP_TIMEOUT |
-        IBV_QP_RETRY_CNT |
-        IBV_QP_RNR_RETRY |
-        IBV_QP_SQ_PSN |
-        IBV_QP_MAX_QP_RD_ATOMIC);
+    LOG("Remote qpn=%u", rc->remote.qp_num);
     LOG("QP -> RTS");
 
-    /* SEND */
-    char *buf = calloc(1024, 1);
-    memset(buf, 0, 1024);
-    struct ibv_mr *mr = ibv_reg_mr(pd, buf, 1024, IBV_ACCESS_LOCAL_WRITE);
-    if (!mr) {
-        ERR("ibv_reg_mr failed");
-        return 1;
+    if (bulk) {
+        /* more would only queue behind the READs the server takes at once */
+        if (!depth || depth > rc->cfg.max_rd_atomic) {
+            if (depth)
+                LOG("-D %u lowered to the negotiated max_rd_atomic %u", depth, rc->cfg.max_rd_atomic);
+            depth = rc->cfg.max_rd_atomic;
+        }
+        if (!chunk || !reps || run_bulk(rc, chunk, depth, reps, sweep, verify))
+            return 1;
+        rdma_conn_destroy(rc);
+        rdma_dev_close(dev);
+        return 0;
     }
+
+    /* READ */
+    struct rdma_pool *pool = rdma_pool_create(dev->pd, MSG_SIZE, 1, IBV_ACCESS_LOCAL_WRITE);
+    if (!pool)
+        return 1;
+    struct rdma_buf *b = rdma_pool_get(pool);
+    char *buf = b->addr;
     struct ibv_sge sge = {
         .addr = (uintptr_t)buf,
-        .length = 1024,
-        .lkey = mr->lkey
+        .length = MSG_SIZE,
+        .lkey = b->lkey
     };
     struct ibv_send_wr wr = {
         .opcode = IBV_WR_RDMA_READ,
         .sg_list = &sge,
         .num_sge = 1,
         .send_flags = IBV_SEND_SIGNALED,
-        .wr.rdma.remote_addr = remote.addr,
-        .wr.rdma.rkey = remote.rkey
+        .wr.rdma.remote_addr = rc->remote.addr,
+        .wr.rdma.rkey = rc->remote.rkey
     };
     struct ibv_send_wr *bad;
-    ibv_post_send(qp, &wr, &bad);
+    ibv_post_send(rc->qp, &wr, &bad);
 
-    struct ibv_wc wc;
-    while (ibv_poll_cq(cq, 1, &wc) == 0);
-    if (wc.status != IBV_WC_SUCCESS) {
-        ERR("RDMA WRITE failed status=%d", wc.status);
+    struct rdma_poller poller;
+    rdma_poller_init(&poller, rc->send_cq, cfg.poll_batch, wr_done, NULL);
+    if (rdma_poller_wait(&poller, 1))
         return 1;
-    }
 
-    LOG("Send done");
+    LOG("Read done");
     LOG("Client received: %s", buf);
 
+    rdma_pool_put(pool, b);
+    rdma_pool_destroy(pool);
+    rdma_conn_destroy(rc);
+    rdma_dev_close(dev);
     return 0;
 }
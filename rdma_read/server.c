@@ -1,143 +1,118 @@
-
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
 #include <unistd.h>
+#include <getopt.h>
 #include <arpa/inet.h>
 #include <infiniband/verbs.h>
-#include "rdma_common.h"
+#include "rdma_conn.h"
+#include "rdma_pool.h"
+#include "rdma_bench.h"
 
-#define PORT 18515
 #define MSG_SIZE 1024
 
 #define LOG(fmt, ...)  printf("[SERVER] " fmt "\n", ##__VA_ARGS__)
 #define ERR(fmt, ...)  printf("[SERVER][ERR] " fmt " (errno=%d:%s)\n", ##__VA_ARGS__, errno, strerror(errno))
 
-int main() {
+static void usage(const char *prog) {
+    printf("Usage: %s [options]\n"
+           "  -b           bulk mode: export -S bytes until the client disconnects\n"
+           "  -S <bytes>   bulk region size, K/M/G suffixes allowed (default: 1G)\n",
+           prog);
+    rdma_cfg_usage();
+}
+
+int main(int argc, char **argv) {
+    struct rdma_cfg cfg;
+    rdma_cfg_init(&cfg);
+    cfg.access_flags = IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_READ;
+    cfg.max_dest_rd_atomic = 0;
+    int bulk = 0;
+    uint64_t region = 1ull << 30;
+
+    static const struct option opts[] = {
+        RDMA_CFG_LONG_OPTIONS,
+        {NULL, 0, NULL, 0}
+    };
+    int c;
+    while ((c = getopt_long(argc, argv, "bS:", opts, NULL)) != -1) {
+        switch (c) {
+        case 'b': bulk = 1; break;
+        case 'S': region = rdma_parse_size(optarg); break;
+        default:
+            if (rdma_cfg_parse_opt(&cfg, c, optarg)) {
+                usage(argv[0]);
+                return 1;
+            }
+        }
+    }
+    uint64_t len = bulk ? region : MSG_SIZE;
+
     LOG("Start");
 
     /* ---------- RDMA device ---------- */
-    struct ibv_device **dev_list = ibv_get_device_list(NULL);
-    struct ibv_context *ctx = ibv_open_device(dev_list[0]);
-    struct ibv_pd *pd = ibv_alloc_pd(ctx);
-    struct ibv_cq *cq = ibv_create_cq(ctx, 10, NULL, NULL, 0);
-
-    struct ibv_qp_init_attr qpia = {
-        .send_cq = cq,
-        .recv_cq = cq,
-        .qp_type = IBV_QPT_RC,
-        .cap = {
-            .max_send_wr = 10,
-            .max_recv_wr = 10,
-            .max_send_sge = 1,
-            .max_recv_sge = 1
-        }
-    };
-    struct ibv_qp *qp = ibv_create_qp(pd, &qpia);
-    LOG("QP created qpn=%u", qp->qp_num);
+    struct rdma_dev *dev = rdma_dev_open(&cfg);
+    if (!dev)
+        return 1;
 
-    /* ---------- INIT ---------- */
-    struct ibv_qp_attr attr = {
-        .qp_state = IBV_QPS_INIT,
-        .port_num = 1,
-        .pkey_index = 0,
-        .qp_access_flags = IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_READ
-    };
-    ibv_modify_qp(qp, &attr,
-        IBV_QP_STATE |
-        IBV_QP_PORT |
-        IBV_QP_PKEY_INDEX |
-        IBV_QP_ACCESS_FLAGS);
+    struct rdma_conn *rc = rdma_conn_create(dev, &cfg, NULL);
+    if (!rc)
+        return 1;
+    LOG("QP created qpn=%u, max_dest_rd_atomic=%u", rc->qp->qp_num, rc->cfg.max_dest_rd_atomic);
     LOG("QP -> INIT");
 
     /* ---------- TCP ---------- */
-    int sock = socket(AF_INET, SOCK_STREAM, 0);
-    struct sockaddr_in addr = {
-        .sin_family = AF_INET,
-        .sin_port = htons(PORT),
-        .sin_addr.s_addr = INADDR_ANY
-    };
-    bind(sock, (struct sockaddr*)&addr, sizeof(addr));
-    listen(sock, 1);
+    int sock = rdma_tcp_listen(cfg.tcp_port, 1);
+    if (sock < 0)
+        return 1;
     int conn = accept(sock, NULL, NULL);
+    if (conn < 0) {
+        ERR("accept failed");
+        return 1;
+    }
     LOG("TCP connected");
 
     /* ---------- exchange QP info ---------- */
 
-    char *buf = calloc(1, MSG_SIZE);
-    struct ibv_mr *mr = ibv_reg_mr(pd, buf, MSG_SIZE, IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_READ);
-    if (!mr) {
-        ERR("ibv_reg_mr failed");
+    struct rdma_pool *pool = rdma_pool_create(dev->pd, len, 1, IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_READ);
+    if (!pool)
         return 1;
+    struct rdma_buf *b = rdma_pool_get(pool);
+    char *buf = b->addr;
+    if (bulk) {
+        /* every word holds its own offset so the client can verify */
+        for (uint64_t i = 0; i < len / 8; i++)
+            ((uint64_t *)buf)[i] = i * 8;
+        LOG("Exporting %lu bytes", len);
+    } else {
+        strcpy(buf, "Hello from Server via RDMA READ");
     }
-    strcpy(buf, "Hello from Server via RDMA READ");
-    sleep(1);
-    
-    struct qp_info local = {}, remote = {};
-    local.qp_num = qp->qp_num;
-    local.addr = (uintptr_t)buf;
-    local.rkey = mr->rkey;
-
-    union ibv_gid gid;
-    ibv_query_gid(ctx, 1, 1, &gid);   // 使用 GID[1]（IPv4）
-    memcpy(local.gid, &gid, 16);
-
-    write(conn, &local, sizeof(local));
-    read(conn, &remote, sizeof(remote));
-    LOG("Remote qpn=%u", remote.qp_num);
 
+    rc->local.addr = (uintptr_t)buf;
+    rc->local.rkey = b->rkey;
+    rc->local.len = len;
 
-    /* ---------- RTR ---------- */
-    memset(&attr, 0, sizeof(attr));
-    attr.qp_state = IBV_QPS_RTR;
-    attr.path_mtu = IBV_MTU_1024;
-    attr.dest_qp_num = remote.qp_num;
-    attr.rq_psn = 0;
-    attr.max_dest_rd_atomic = 1;
-    attr.min_rnr_timer = 12;
-
-    attr.ah_attr.is_global = 1;
-    attr.ah_attr.port_num = 1;
-    attr.ah_attr.grh.hop_limit = 64;
-    attr.ah_attr.grh.sgid_index = 1;
-    memcpy(&attr.ah_attr.grh.dgid, remote.gid, 16);
-
-    if (ibv_modify_qp(qp, &attr,
-        IBV_QP_STATE |
-        IBV_QP_AV |
-        IBV_QP_PATH_MTU |
-        IBV_QP_DEST_QPN |
-        IBV_QP_RQ_PSN |
-        IBV_QP_MAX_DEST_RD_ATOMIC |
-        IBV_QP_MIN_RNR_TIMER)) {
-        ERR("QP to RTR failed");
+    if (rdma_conn_handshake(rc, conn, RDMA_ROLE_SERVER))
         return 1;
-    }
-    LOG("QP -> RTR");
-
-    /* ---------- RTS ---------- */
-    memset(&attr, 0, sizeof(attr));
-    attr.qp_state = IBV_QPS_RTS;
-    attr.timeout = 14;
-    attr.retry_cnt = 7;
-    attr.rnr_retry = 7;
-    attr.sq_psn = 0;
-    attr.max_rd_atomic = 1;
-
-    ibv_modify_qp(qp, &attr,
-        IBV_QP_STATE |
-        IBV_QP_TIMEOUT |
-        IBV_QP_RETRY_CNT |
-        IBV_QP_RNR_RETRY |
-        IBV_QP_SQ_PSN |
-        IBV_QP_MAX_QP_RD_ATOMIC);
+    LOG("Remote qpn=%u", rc->remote.qp_num);
     LOG("QP -> RTS");
 
+    if (bulk) {
+        /* the client closes the socket once its last READ completed */
+        char ch;
+        while (read(conn, &ch, 1) > 0);
+        LOG("Client done");
+    } else {
+        sleep(3);
+        //server no recv CQ
+        LOG("Server Received: %s", buf);
+    }
 
-    sleep(3);
-    //server no recv CQ
-    LOG("Server Received: %s", buf);
- 
+    rdma_pool_put(pool, b);
+    rdma_pool_destroy(pool);
+    rdma_conn_destroy(rc);
+    close(sock);
+    rdma_dev_close(dev);
     return 0;
 }
@@ -3,151 +3,236 @@
 #include <string.h>
 #include <errno.h>
 #include <unistd.h>
+#include <getopt.h>
 #include <arpa/inet.h>
 #include <infiniband/verbs.h>
-#include "rdma_common.h"
+#include "rdma_conn.h"
+#include "rdma_pool.h"
+#include "rdma_bench.h"
+#include "rdma_poll.h"
+#include "rdma_sq.h"
+#include "notify.h"
 
-#define PORT 18515
 #define MSG "Hello from Client"
 
 #define LOG(fmt, ...)  printf("[CLIENT] " fmt "\n", ##__VA_ARGS__)
 #define ERR(fmt, ...)  printf("[CLIENT][ERR] " fmt " (errno=%d:%s)\n", ##__VA_ARGS__, errno, strerror(errno))
 
+static int wr_done(void *arg, struct ibv_wc *wc) {
+    (void)arg;
+    if (wc->status != IBV_WC_SUCCESS) {
+        ERR("RDMA WRITE failed status=%s", ibv_wc_status_str(wc->status));
+        return -1;
+    }
+    return 0;
+}
+
+static int bw_done(void *arg, struct ibv_wc *wc) {
+    return rdma_sq_complete(arg, wc);
+}
+
+/*
+ * Keep up to depth WRITEs outstanding until iters have completed,
+ * signaling every signal_every-th WR and posting batch WRs per doorbell.
+ * Payloads up to max_inline bytes are posted inline.
+ */
+static int run_bw(struct rdma_conn *rc, struct ibv_send_wr *wr, long iters, uint32_t depth,
+                  int signal_every, int batch, uint32_t max_inline, int verbose) {
+    struct rdma_sq sq;
+    struct rdma_poller poller;
+
+    rdma_sq_init(&sq, rc->qp, depth, signal_every, batch);
+    sq.max_inline = max_inline;
+    rdma_poller_init(&poller, rc->send_cq, rc->cfg.poll_batch, bw_done, &sq);
+    poller.hist_on = rc->cfg.cq_hist;
+
+    uint64_t start = rdma_now_ns();
+    while (sq.completed < (uint64_t)iters) {
+        if (sq.posted < (uint64_t)iters &&
+            rdma_sq_post(&sq, wr, iters - sq.posted) < 0)
+            return -1;
+
+        if (rdma_poller_poll(&poller) < 0)
+            return -1;
+    }
+    uint64_t ns = rdma_now_ns() - start;
+
+    rdma_bw_print(wr->sg_list->length, iters, ns);
+    if (!verbose)
+        return 0;
+    LOG("signal every %d, %d WRs per doorbell: %lu doorbells, %.2f WRs per doorbell",
+        sq.signal_every, sq.batch, sq.doorbells, (double)iters / sq.doorbells);
+    if (poller.hist_on)
+        rdma_poller_print_hist(&poller);
+    return 0;
+}
+
+/* 8 B .. max_size, each size with and without IBV_SEND_INLINE */
+static int run_inline_sweep(struct rdma_conn *rc, struct ibv_send_wr *wr, size_t max_size,
+                            long iters, uint32_t depth, int signal_every, int batch) {
+    LOG("Inline sweep, max_inline_data=%u", rc->max_inline);
+    for (int inl = 0; inl <= 1; inl++) {
+        printf("%s\n", inl ? "IBV_SEND_INLINE:" : "DMA from registered MR:");
+        rdma_bw_header();
+        for (size_t sz = 8; sz <= max_size; sz *= 2) {
+            if (inl && sz > rc->max_inline)
+                break;
+            wr->sg_list->length = sz;
+            if (run_bw(rc, wr, iters, depth, signal_every, batch,
+                       inl ? rc->max_inline : 0, 0))
+                return -1;
+        }
+    }
+    return 0;
+}
+
+static void usage(const char *prog) {
+    printf("Usage: %s [options] <server_ip>\n"
+           "  -b           bandwidth mode: stream -n WRITEs of -s bytes\n"
+           "  -n <iters>   WRITEs in bandwidth mode (default: 100000)\n"
+           "  -s <bytes>   WRITE size in bandwidth mode, <= server -s (default: 1024)\n"
+           "  -D <depth>   WRITEs in flight (default: 64)\n"
+           "  -k <n>       signal every n-th WRITE (default: 1)\n"
+           "  -B <n>       WRITEs chained per ibv_post_send (default: 1)\n"
+           "  -S           inline sweep: 8 B .. -s, inline vs. non-inline\n"
+           "  -N <mode>    arrival notification, as on the server: imm | poll (default: imm)\n",
+           prog);
+    rdma_cfg_usage();
+}
+
 int main(int argc, char **argv) {
-    if (argc < 2) {
-        printf("Usage: %s <server_ip>\n", argv[0]);
+    struct rdma_cfg cfg;
+    rdma_cfg_init(&cfg);
+    cfg.max_recv_wr = 0;
+    cfg.access_flags = IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_WRITE;
+    int bw = 0, sweep = 0, signal_every = 1, batch = 1, notify = NOTIFY_IMM;
+    long iters = 100000;
+    size_t size = 1024;
+    uint32_t depth = 64;
+
+    static const struct option opts[] = {
+        RDMA_CFG_LONG_OPTIONS,
+        {NULL, 0, NULL, 0}
+    };
+    int c;
+    while ((c = getopt_long(argc, argv, "bn:s:D:k:B:SN:", opts, NULL)) != -1) {
+        switch (c) {
+        case 'b': bw = 1; break;
+        case 'n': iters = atol(optarg); break;
+        case 's': size = atol(optarg); break;
+        case 'D': depth = atoi(optarg); break;
+        case 'k': signal_every = atoi(optarg); break;
+        case 'B': batch = atoi(optarg); break;
+        case 'S': bw = sweep = 1; break;
+        case 'N':
+            if ((notify = notify_parse(optarg)) < 0) {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        default:
+            if (rdma_cfg_parse_opt(&cfg, c, optarg)) {
+                usage(argv[0]);
+                return 1;
+            }
+        }
+    }
+    if (bw)
+        cfg.max_send_wr = depth;
+    if (sweep && cfg.max_inline_data < size)
+        cfg.max_inline_data = size;
+    if (optind >= argc) {
+        usage(argv[0]);
         return 1;
     }
 
     LOG("Start");
 
-    struct ibv_device **dev_list = ibv_get_device_list(NULL);
-    struct ibv_context *ctx = ibv_open_device(dev_list[0]);
-    struct ibv_pd *pd = ibv_alloc_pd(ctx);
-    struct ibv_cq *cq = ibv_create_cq(ctx, 10, NULL, NULL, 0);
+    struct rdma_dev *dev = rdma_dev_open(&cfg);
+    if (!dev)
+        return 1;
 
-    struct ibv_qp_init_attr qpia = {
-        .send_cq = cq,
-        .recv_cq = cq,
-        .qp_type = IBV_QPT_RC,
-        .cap = {.max_send_wr = 10, .max_send_sge = 1}
-    };
-    struct ibv_qp *qp = ibv_create_qp(pd, &qpia);
-    LOG("QP created qpn=%u", qp->qp_num);
-
-    /* INIT */
-    struct ibv_qp_attr attr = {
-        .qp_state = IBV_QPS_INIT,
-        .port_num = 1,
-        .pkey_index = 0,
-        .qp_access_flags = IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_WRITE
-    };
-    ibv_modify_qp(qp, &attr,
-        IBV_QP_STATE |
-        IBV_QP_PORT |
-        IBV_QP_PKEY_INDEX |
-        IBV_QP_ACCESS_FLAGS);
+    struct rdma_conn *rc = rdma_conn_create(dev, &cfg, NULL);
+    if (!rc)
+        return 1;
+    LOG("QP created qpn=%u", rc->qp->qp_num);
     LOG("QP -> INIT");
 
     /* TCP */
-    int sock = socket(AF_INET, SOCK_STREAM, 0);
-    struct sockaddr_in addr = {
-        .sin_family = AF_INET,
-        .sin_port = htons(PORT)
-    };
-    inet_pton(AF_INET, argv[1], &addr.sin_addr);
-    connect(sock, (struct sockaddr*)&addr, sizeof(addr));
+    int sock = rdma_tcp_connect(argv[optind], cfg.tcp_port);
+    if (sock < 0)
+        return 1;
     LOG("TCP connected");
 
-    /* exchange QP */
-    struct qp_info local = {}, remote = {};
-    local.qp_num = qp->qp_num;
-
-    union ibv_gid gid;
-    ibv_query_gid(ctx, 1, 1, &gid);
-    memcpy(local.gid, &gid, 16);
-
-    read(sock, &remote, sizeof(remote));
-    write(sock, &local, sizeof(local));
-    LOG("Remote qpn=%u", remote.qp_num);
-
-    /* RTR */
-    memset(&attr, 0, sizeof(attr));
-    attr.qp_state = IBV_QPS_RTR;
-    attr.path_mtu = IBV_MTU_1024;
-    attr.dest_qp_num = remote.qp_num;
-    attr.rq_psn = 0;
-    attr.max_dest_rd_atomic = 1;
-    attr.min_rnr_timer = 12;
-
-    attr.ah_attr.is_global = 1;
-    attr.ah_attr.port_num = 1;
-    attr.ah_attr.grh.hop_limit = 64;
-    attr.ah_attr.grh.sgid_index = 1;
-    memcpy(&attr.ah_attr.grh.dgid, remote.gid, 16);
-
-    if (ibv_modify_qp(qp, &attr,
-        IBV_QP_STATE |
-        IBV_QP_AV |
-        IBV_QP_PATH_MTU |
-        IBV_QP_DEST_QPN |
-        IBV_QP_RQ_PSN |
-        IBV_QP_MAX_DEST_RD_ATOMIC |
-        IBV_QP_MIN_RNR_TIMER)) {
-        ERR("QP to RTR failed");
+    /* exchange QP, RTR, RTS */
+    if (rdma_conn_handshake(rc, sock, RDMA_ROLE_CLIENT))
         return 1;
-    }
-    LOG("QP -> RTR");
-
-    /* RTS */
-    memset(&attr, 0, sizeof(attr));
-    attr.qp_state = IBV_QPS_RTS;
-    attr.timeout = 14;
-    attr.retry_cnt = 7;
-    attr.rnr_retry = 7;
-    attr.sq_psn = 0;
-    attr.max_rd_atomic = 1;
-
-    ibv_modify_qp(qp, &attr,
-        IBV_QP_STATE |
-        IBV_QP_TIMEOUT |
-        IBV_QP_RETRY_CNT |
-        IBV_QP_RNR_RETRY |
-        IBV_QP_SQ_PSN |
-        IBV_QP_MAX_QP_RD_ATOMIC);
+    LOG("Remote qpn=%u", rc->remote.qp_num);
     LOG("QP -> RTS");
 
-    /* SEND */
-    char *buf = strdup(MSG);
-    struct ibv_mr *mr = ibv_reg_mr(pd, buf, 1024, IBV_ACCESS_LOCAL_WRITE);
-    if (!mr) {
-        ERR("ibv_reg_mr failed");
-        return 1;
+    /* WRITE */
+    enum ibv_wr_opcode opcode = IBV_WR_RDMA_WRITE;
+    if (bw) {
+        if (size > rc->remote.len) {
+            ERR("-s %zu exceeds the server's %lu byte buffer", size, rc->remote.len);
+            return 1;
+        }
+    } else if (notify == NOTIFY_IMM) {
+        size = strlen(MSG) + 1;
+        opcode = IBV_WR_RDMA_WRITE_WITH_IMM;
+    } else {
+        /* cover the whole buffer so the sequence word lands last */
+        size = rc->remote.len;
     }
+    struct rdma_pool *pool = rdma_pool_create(dev->pd, size > sizeof(MSG) ? size : sizeof(MSG),
+                                              1, IBV_ACCESS_LOCAL_WRITE);
+    if (!pool)
+        return 1;
+    struct rdma_buf *b = rdma_pool_get(pool);
+    char *buf = b->addr;
+    strcpy(buf, MSG);
+    if (!bw && notify == NOTIFY_POLL)
+        *notify_seq_word(buf, size) = 1;
     struct ibv_sge sge = {
         .addr = (uintptr_t)buf,
-        .length = strlen(buf) + 1,
-        .lkey = mr->lkey
+        .length = size,
+        .lkey = b->lkey
     };
     struct ibv_send_wr wr = {
-        .opcode = IBV_WR_RDMA_WRITE,
+        .opcode = opcode,
         .sg_list = &sge,
         .num_sge = 1,
-        .send_flags = IBV_SEND_SIGNALED,
-        .wr.rdma.remote_addr = remote.addr,
-        .wr.rdma.rkey = remote.rkey
+        .send_flags = IBV_SEND_SIGNALED | rdma_inline_flag(rc, size),
+        .imm_data = htonl(size),
+        .wr.rdma.remote_addr = rc->remote.addr,
+        .wr.rdma.rkey = rc->remote.rkey
     };
-    struct ibv_send_wr *bad;
-    ibv_post_send(qp, &wr, &bad);
 
-    struct ibv_wc wc;
-    while (ibv_poll_cq(cq, 1, &wc) == 0);
-    if (wc.status != IBV_WC_SUCCESS) {
-        ERR("RDMA WRITE failed status=%d", wc.status);
-        return 1;
+    if (sweep) {
+        if (run_inline_sweep(rc, &wr, size, iters, depth, signal_every, batch))
+            return 1;
+    } else if (bw) {
+        rdma_bw_header();
+        if (run_bw(rc, &wr, iters, depth, signal_every, batch, rc->max_inline, 1))
+            return 1;
+    } else {
+        struct ibv_send_wr *bad;
+        if (ibv_post_send(rc->qp, &wr, &bad)) {
+            ERR("ibv_post_send failed");
+            return 1;
+        }
+
+        struct rdma_poller poller;
+        rdma_poller_init(&poller, rc->send_cq, cfg.poll_batch, wr_done, NULL);
+        if (rdma_poller_wait(&poller, 1))
+            return 1;
+
+        LOG("Send done");
     }
 
-    LOG("Send done");
-
+    rdma_pool_put(pool, b);
+    rdma_pool_destroy(pool);
+    rdma_conn_destroy(rc);
+    rdma_dev_close(dev);
     return 0;
 }
@@ -0,0 +1,26 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+
+/* how the server learns that a WRITE has landed */
+enum notify_mode {
+    NOTIFY_IMM,     /* IBV_WR_RDMA_WRITE_WITH_IMM consumes a pre-posted receive */
+    NOTIFY_POLL,    /* WRITE covers the whole buffer, ending in a sequence word */
+};
+
+static inline int notify_parse(const char *s) {
+    if (!strcmp(s, "imm"))
+        return NOTIFY_IMM;
+    if (!strcmp(s, "poll"))
+        return NOTIFY_POLL;
+    return -1;
+}
+
+/* poll mode: the exported buffer is the payload area plus this word */
+static inline size_t notify_buf_len(size_t payload) {
+    return ((payload + 7) & ~(size_t)7) + sizeof(uint64_t);
+}
+
+static inline volatile uint64_t *notify_seq_word(char *buf, size_t len) {
+    return (volatile uint64_t *)(buf + len - sizeof(uint64_t));
+}
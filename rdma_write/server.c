@@ -1,137 +1,150 @@
-
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
 #include <unistd.h>
+#include <getopt.h>
 #include <arpa/inet.h>
 #include <infiniband/verbs.h>
-#include "rdma_common.h"
+#include "rdma_conn.h"
+#include "rdma_pool.h"
+#include "rdma_poll.h"
+#include "notify.h"
 
-#define PORT 18515
 #define MSG_SIZE 1024
 
 #define LOG(fmt, ...)  printf("[SERVER] " fmt "\n", ##__VA_ARGS__)
 #define ERR(fmt, ...)  printf("[SERVER][ERR] " fmt " (errno=%d:%s)\n", ##__VA_ARGS__, errno, strerror(errno))
 
-int main() {
+static int post_recv(struct rdma_conn *rc) {
+    /* WRITE_WITH_IMM only needs a receive WR, no buffer */
+    struct ibv_recv_wr wr = {
+        .sg_list = NULL,
+        .num_sge = 0
+    };
+    struct ibv_recv_wr *bad;
+    return ibv_post_recv(rc->qp, &wr, &bad);
+}
+
+static int imm_done(void *arg, struct ibv_wc *wc) {
+    if (wc->status != IBV_WC_SUCCESS || wc->opcode != IBV_WC_RECV_RDMA_WITH_IMM) {
+        ERR("unexpected WC status=%s opcode=%d", ibv_wc_status_str(wc->status), wc->opcode);
+        return -1;
+    }
+    *(uint32_t *)arg = ntohl(wc->imm_data);
+    return 0;
+}
+
+static void usage(const char *prog) {
+    printf("Usage: %s [options]\n"
+           "  -b           bandwidth mode: export -s bytes until the client disconnects\n"
+           "  -s <bytes>   exported buffer size (default: %d)\n"
+           "  -N <mode>    arrival notification: imm | poll (default: imm)\n",
+           prog, MSG_SIZE);
+    rdma_cfg_usage();
+}
+
+int main(int argc, char **argv) {
+    struct rdma_cfg cfg;
+    rdma_cfg_init(&cfg);
+    cfg.access_flags = IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_WRITE;
+    int bw = 0, notify = NOTIFY_IMM;
+    size_t size = MSG_SIZE;
+
+    static const struct option opts[] = {
+        RDMA_CFG_LONG_OPTIONS,
+        {NULL, 0, NULL, 0}
+    };
+    int c;
+    while ((c = getopt_long(argc, argv, "bs:N:", opts, NULL)) != -1) {
+        switch (c) {
+        case 'b': bw = 1; break;
+        case 's': size = atol(optarg); break;
+        case 'N':
+            if ((notify = notify_parse(optarg)) < 0) {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        default:
+            if (rdma_cfg_parse_opt(&cfg, c, optarg)) {
+                usage(argv[0]);
+                return 1;
+            }
+        }
+    }
+
     LOG("Start");
 
     /* ---------- RDMA device ---------- */
-    struct ibv_device **dev_list = ibv_get_device_list(NULL);
-    struct ibv_context *ctx = ibv_open_device(dev_list[0]);
-    struct ibv_pd *pd = ibv_alloc_pd(ctx);
-    struct ibv_cq *cq = ibv_create_cq(ctx, 10, NULL, NULL, 0);
-
-    struct ibv_qp_init_attr qpia = {
-        .send_cq = cq,
-        .recv_cq = cq,
-        .qp_type = IBV_QPT_RC,
-        .cap = {
-            .max_send_wr = 10,
-            .max_recv_wr = 10,
-            .max_send_sge = 1,
-            .max_recv_sge = 1
-        }
-    };
-    struct ibv_qp *qp = ibv_create_qp(pd, &qpia);
-    LOG("QP created qpn=%u", qp->qp_num);
-
-    /* ---------- INIT ---------- */
-    struct ibv_qp_attr attr = {
-        .qp_state = IBV_QPS_INIT,
-        .port_num = 1,
-        .pkey_index = 0,
-        .qp_access_flags = IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_WRITE
-    };
-    ibv_modify_qp(qp, &attr,
-        IBV_QP_STATE |
-        IBV_QP_PORT |
-        IBV_QP_PKEY_INDEX |
-        IBV_QP_ACCESS_FLAGS);
+    struct rdma_dev *dev = rdma_dev_open(&cfg);
+    if (!dev)
+        return 1;
+
+    struct rdma_conn *rc = rdma_conn_create(dev, &cfg, NULL);
+    if (!rc)
+        return 1;
+    LOG("QP created qpn=%u", rc->qp->qp_num);
     LOG("QP -> INIT");
 
     /* ---------- TCP ---------- */
-    int sock = socket(AF_INET, SOCK_STREAM, 0);
-    struct sockaddr_in addr = {
-        .sin_family = AF_INET,
-        .sin_port = htons(PORT),
-        .sin_addr.s_addr = INADDR_ANY
-    };
-    bind(sock, (struct sockaddr*)&addr, sizeof(addr));
-    listen(sock, 1);
+    int sock = rdma_tcp_listen(cfg.tcp_port, 1);
+    if (sock < 0)
+        return 1;
     int conn = accept(sock, NULL, NULL);
+    if (conn < 0) {
+        ERR("accept failed");
+        return 1;
+    }
     LOG("TCP connected");
 
     /* ---------- exchange QP info ---------- */
 
-    char *buf = calloc(1, MSG_SIZE);
-    struct ibv_mr *mr = ibv_reg_mr(pd, buf, MSG_SIZE, IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_WRITE);
-
-    struct qp_info local = {}, remote = {};
-    local.qp_num = qp->qp_num;
-    local.addr = (uintptr_t)buf;
-    local.rkey = mr->rkey;
-
-    union ibv_gid gid;
-    ibv_query_gid(ctx, 1, 1, &gid);   // 使用 GID[1]（IPv4）
-    memcpy(local.gid, &gid, 16);
-
-    write(conn, &local, sizeof(local));
-    read(conn, &remote, sizeof(remote));
-    LOG("Remote qpn=%u", remote.qp_num);
-
-
-    /* ---------- RTR ---------- */
-    memset(&attr, 0, sizeof(attr));
-    attr.qp_state = IBV_QPS_RTR;
-    attr.path_mtu = IBV_MTU_1024;
-    attr.dest_qp_num = remote.qp_num;
-    attr.rq_psn = 0;
-    attr.max_dest_rd_atomic = 1;
-    attr.min_rnr_timer = 12;
-
-    attr.ah_attr.is_global = 1;
-    attr.ah_attr.port_num = 1;
-    attr.ah_attr.grh.hop_limit = 64;
-    attr.ah_attr.grh.sgid_index = 1;
-    memcpy(&attr.ah_attr.grh.dgid, remote.gid, 16);
-
-    if (ibv_modify_qp(qp, &attr,
-        IBV_QP_STATE |
-        IBV_QP_AV |
-        IBV_QP_PATH_MTU |
-        IBV_QP_DEST_QPN |
-        IBV_QP_RQ_PSN |
-        IBV_QP_MAX_DEST_RD_ATOMIC |
-        IBV_QP_MIN_RNR_TIMER)) {
-        ERR("QP to RTR failed");
+    size_t len = !bw && notify == NOTIFY_POLL ? notify_buf_len(size) : size;
+    struct rdma_pool *pool = rdma_pool_create(dev->pd, len, 1, IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_WRITE);
+    if (!pool)
+        return 1;
+    struct rdma_buf *b = rdma_pool_get(pool);
+    char *buf = b->addr;
+
+    /* the receive must be there before the client's WRITE_WITH_IMM */
+    if (!bw && notify == NOTIFY_IMM && post_recv(rc)) {
+        ERR("ibv_post_recv failed");
         return 1;
     }
-    LOG("QP -> RTR");
-
-    /* ---------- RTS ---------- */
-    memset(&attr, 0, sizeof(attr));
-    attr.qp_state = IBV_QPS_RTS;
-    attr.timeout = 14;
-    attr.retry_cnt = 7;
-    attr.rnr_retry = 7;
-    attr.sq_psn = 0;
-    attr.max_rd_atomic = 1;
-
-    ibv_modify_qp(qp, &attr,
-        IBV_QP_STATE |
-        IBV_QP_TIMEOUT |
-        IBV_QP_RETRY_CNT |
-        IBV_QP_RNR_RETRY |
-        IBV_QP_SQ_PSN |
-        IBV_QP_MAX_QP_RD_ATOMIC);
+
+    rc->local.addr = (uintptr_t)buf;
+    rc->local.rkey = b->rkey;
+    rc->local.len = len;
+
+    if (rdma_conn_handshake(rc, conn, RDMA_ROLE_SERVER))
+        return 1;
+    LOG("Remote qpn=%u", rc->remote.qp_num);
     LOG("QP -> RTS");
 
+    if (bw) {
+        /* the client closes the socket once its last WRITE completed */
+        char ch;
+        while (read(conn, &ch, 1) > 0);
+        LOG("Client done");
+    } else if (notify == NOTIFY_IMM) {
+        uint32_t imm;
+        struct rdma_poller poller;
+        rdma_poller_init(&poller, rc->recv_cq, cfg.poll_batch, imm_done, &imm);
+        if (rdma_poller_wait(&poller, 1))
+            return 1;
+        LOG("Server Received (imm=%u): %s", imm, buf);
+    } else {
+        /* the sequence word is the last thing the WRITE places */
+        volatile uint64_t *seq = notify_seq_word(buf, len);
+        while (*seq == 0);
+        LOG("Server Received (seq=%lu): %s", *seq, buf);
+    }
 
-    sleep(3);
-    //server no recv CQ
-    LOG("Server Received: %s", buf);
- 
+    rdma_pool_put(pool, b);
+    rdma_pool_destroy(pool);
+    rdma_conn_destroy(rc);
+    close(sock);
+    rdma_dev_close(dev);
     return 0;
 }
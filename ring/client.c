@@ -0,0 +1,398 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <infiniband/verbs.h>
+#include "rdma_conn.h"
+#include "rdma_poll.h"
+#include "rdma_pool.h"
+#include "rdma_sq.h"
+#include "rdma_ring.h"
+#include "rdma_bench.h"
+#include "rdma_hist.h"
+#include "ring_proto.h"
+
+#define MAX_PRODUCERS 64
+
+#define LOG(fmt, ...)  printf("[CLIENT] " fmt "\n", ##__VA_ARGS__)
+#define ERR(fmt, ...)  printf("[CLIENT][ERR] " fmt " (errno=%d:%s)\n", ##__VA_ARGS__, errno, strerror(errno))
+
+enum { BUF_SEND, BUF_RECV };
+
+struct prod {
+    int                 id;
+    const struct ring_hello *h;
+    struct rdma_conn   *rc;
+    struct rdma_pool   *pool;       /* MODE_RING: the ring region; MODE_SEND: send + recv buffer */
+    struct rdma_ring    ring;
+    pthread_barrier_t  *start;
+    pthread_t           tid;
+    uint32_t            size;
+    int                 ret;
+    uint64_t            sends, recvs;
+};
+
+static int wc_done(void *arg, struct ibv_wc *wc) {
+    struct prod *p = arg;
+
+    if (wc->status != IBV_WC_SUCCESS) {
+        ERR("WC failed status=%s", ibv_wc_status_str(wc->status));
+        return -1;
+    }
+    if (wc->opcode & IBV_WC_RECV)
+        p->recvs++;
+    else
+        p->sends++;
+    return 0;
+}
+
+static int sq_done(void *arg, struct ibv_wc *wc) {
+    return rdma_sq_complete(arg, wc);
+}
+
+/* ---------- bandwidth: every producer streams iters messages ---------- */
+
+static int ring_bw(struct prod *p) {
+    char *msg = (char *)p->pool->bufs[0].addr + rdma_ring_region_len(p->h->ring);
+
+    for (uint32_t i = 0; i < p->h->iters; i++) {
+        int ret;
+        while ((ret = rdma_ring_send(&p->ring, msg, p->size)) == 1);
+        if (ret)
+            return -1;
+    }
+    return 0;
+}
+
+static int send_bw(struct prod *p) {
+    struct rdma_buf *b = &p->pool->bufs[BUF_SEND];
+    struct rdma_sq sq;
+    struct rdma_poller poller;
+    uint32_t depth = p->h->depth;
+
+    rdma_sq_init(&sq, p->rc->qp, depth, depth < 16 ? depth : 16, 16);
+    sq.max_inline = p->rc->max_inline;
+    rdma_poller_init(&poller, p->rc->send_cq, p->rc->cfg.poll_batch, sq_done, &sq);
+
+    struct ibv_sge sge = {
+        .addr = (uintptr_t)b->addr,
+        .length = p->size,
+        .lkey = b->lkey
+    };
+    struct ibv_send_wr wr = {
+        .opcode = IBV_WR_SEND,
+        .sg_list = &sge,
+        .num_sge = 1
+    };
+    while (sq.completed < p->h->iters) {
+        if (sq.posted < p->h->iters && rdma_sq_post(&sq, &wr, p->h->iters - sq.posted) < 0)
+            return -1;
+        if (rdma_poller_poll(&poller) < 0)
+            return -1;
+    }
+    return 0;
+}
+
+static void *prod_main(void *arg) {
+    struct prod *p = arg;
+
+    pthread_barrier_wait(p->start);
+    p->ret = p->h->mode == MODE_RING ? ring_bw(p) : send_bw(p);
+    return NULL;
+}
+
+static int run_bw(struct prod *prods, int n, int sock, uint32_t size) {
+    pthread_barrier_t start;
+    uint64_t stalls0 = 0, stalls = 0;
+
+    pthread_barrier_init(&start, NULL, n + 1);
+    for (int i = 0; i < n; i++) {
+        prods[i].size = size;
+        prods[i].start = &start;
+        stalls0 += prods[i].ring.stalls;
+        if (pthread_create(&prods[i].tid, NULL, prod_main, &prods[i])) {
+            ERR("pthread_create failed");
+            return -1;
+        }
+    }
+    pthread_barrier_wait(&start);
+    uint64_t t0 = rdma_now_ns();
+
+    /* the consumer says when the last message of every producer is in */
+    char done;
+    if (rdma_sock_read(sock, &done, 1))
+        return -1;
+    uint64_t ns = rdma_now_ns() - t0;
+
+    int ret = 0;
+    for (int i = 0; i < n; i++) {
+        pthread_join(prods[i].tid, NULL);
+        ret |= prods[i].ret;
+        stalls += prods[i].ring.stalls;
+    }
+    pthread_barrier_destroy(&start);
+    if (ret)
+        return -1;
+
+    uint64_t msgs = (uint64_t)n * prods[0].h->iters;
+    rdma_bw_print(size, msgs, ns);
+    if (prods[0].h->mode == MODE_RING && stalls > stalls0)
+        LOG("  %.3f credit stalls per message", (double)(stalls - stalls0) / msgs);
+    return 0;
+}
+
+/* ---------- latency: producer 0 ping-pongs with the consumer's echo ---------- */
+
+static int ring_lat(struct prod *p, uint64_t *samples) {
+    char *msg = (char *)p->pool->bufs[0].addr + rdma_ring_region_len(p->h->ring);
+
+    for (uint32_t i = 0; i < p->h->iters + p->h->warmup; i++) {
+        uint64_t t0 = rdma_cycles();
+        int ret;
+        while ((ret = rdma_ring_send(&p->ring, msg, p->size)) == 1);
+        if (ret)
+            return -1;
+
+        uint32_t len;
+        while (!rdma_ring_peek(&p->ring, &len));
+        samples[i] = rdma_cycles() - t0;
+        if (len != p->size || rdma_ring_release(&p->ring))
+            return -1;
+    }
+    return 0;
+}
+
+static int send_lat(struct prod *p, uint64_t *samples) {
+    struct rdma_buf *sb = &p->pool->bufs[BUF_SEND], *rb = &p->pool->bufs[BUF_RECV];
+    struct rdma_poller poller;
+    uint64_t recvs0 = p->recvs, sends0 = p->sends;
+
+    rdma_poller_init(&poller, p->rc->send_cq, p->rc->cfg.poll_batch, wc_done, p);
+    for (uint32_t i = 0; i < p->h->iters + p->h->warmup; i++) {
+        struct ibv_sge rsge = {
+            .addr = (uintptr_t)rb->addr,
+            .length = p->h->max_size,
+            .lkey = rb->lkey
+        };
+        struct ibv_recv_wr rwr = {
+            .sg_list = &rsge,
+            .num_sge = 1
+        }, *rbad;
+        struct ibv_sge sge = {
+            .addr = (uintptr_t)sb->addr,
+            .length = p->size,
+            .lkey = sb->lkey
+        };
+        struct ibv_send_wr wr = {
+            .opcode = IBV_WR_SEND,
+            .sg_list = &sge,
+            .num_sge = 1,
+            .send_flags = IBV_SEND_SIGNALED | rdma_inline_flag(p->rc, p->size)
+        }, *bad;
+
+        uint64_t t0 = rdma_cycles();
+        if (ibv_post_recv(p->rc->qp, &rwr, &rbad) || ibv_post_send(p->rc->qp, &wr, &bad)) {
+            ERR("post failed");
+            return -1;
+        }
+        while (p->recvs < recvs0 + i + 1) {
+            if (rdma_poller_poll(&poller) < 0)
+                return -1;
+        }
+        samples[i] = rdma_cycles() - t0;
+        while (p->sends < sends0 + i + 1) {
+            if (rdma_poller_poll(&poller) < 0)
+                return -1;
+        }
+    }
+    return 0;
+}
+
+static void usage(const char *prog) {
+    printf("Usage: %s [options] <server_ip>\n"
+           "  -m <mode>    ring | send (default: ring)\n"
+           "               ring: RDMA WRITE into the server's ring, credits written back;\n"
+           "               send: SEND into pre-posted receives\n"
+           "  -t <test>    bw | lat (default: bw)\n"
+           "  -s <bytes>   message size (default: 64)\n"
+           "  -a           sweep sizes 8 B .. -s in powers of two\n"
+           "  -n <iters>   messages per producer and size (default: 1000000 bw, 10000 lat)\n"
+           "  -w <iters>   lat warm-up round trips (default: 1000)\n"
+           "  -p <n>       bw producers, one thread and QP each, into one consumer (default: 1)\n"
+           "  -R <bytes>   ring size per producer (default: 64K); messages up to a quarter\n"
+           "  -D <n>       send: receives posted per QP and SENDs in flight (default: 64)\n",
+           prog);
+    rdma_cfg_usage();
+}
+
+int main(int argc, char **argv) {
+    struct rdma_cfg cfg;
+    rdma_cfg_init(&cfg);
+    cfg.max_send_wr = 64;
+    cfg.max_recv_wr = 4;
+    cfg.access_flags = IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_WRITE;
+
+    struct ring_hello h = {
+        .mode = MODE_RING,
+        .test = TEST_BW,
+        .max_size = 64,
+        .warmup = 1000,
+        .ring = 64 << 10,
+        .depth = 64,
+        .producers = 1
+    };
+    int sweep = 0;
+
+    static const struct option opts[] = {
+        RDMA_CFG_LONG_OPTIONS,
+        {NULL, 0, NULL, 0}
+    };
+    int c;
+    while ((c = getopt_long(argc, argv, "m:t:s:an:w:p:R:D:", opts, NULL)) != -1) {
+        switch (c) {
+        case 'm':
+            if ((c = ring_parse_mode(optarg)) < 0) {
+                usage(argv[0]);
+                return 1;
+            }
+            h.mode = c;
+            break;
+        case 't':
+            if ((c = ring_parse_test(optarg)) < 0) {
+                usage(argv[0]);
+                return 1;
+            }
+            h.test = c;
+            break;
+        case 's': h.max_size = rdma_parse_size(optarg); break;
+        case 'a': sweep = 1; break;
+        case 'n': h.iters = atoi(optarg); break;
+        case 'w': h.warmup = atoi(optarg); break;
+        case 'p': h.producers = atoi(optarg); break;
+        case 'R': h.ring = rdma_parse_size(optarg); break;
+        case 'D': h.depth = atoi(optarg); break;
+        default:
+            if (rdma_cfg_parse_opt(&cfg, c, optarg)) {
+                usage(argv[0]);
+                return 1;
+            }
+        }
+    }
+    if (!h.iters)
+        h.iters = h.test == TEST_BW ? 1000000 : 10000;
+    if (h.test == TEST_LAT)
+        h.producers = 1;
+    else
+        h.warmup = 0;
+    h.min_size = sweep && h.max_size > 8 ? 8 : h.max_size;
+    if (optind >= argc || !h.max_size || !h.depth ||
+        h.producers < 1 || h.producers > MAX_PRODUCERS) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (h.mode == MODE_RING &&
+        h.max_size > h.ring / 4 - sizeof(struct rdma_ring_hdr) - sizeof(struct rdma_ring_trl)) {
+        LOG("-s %u does not fit a quarter of the %u byte ring", h.max_size, h.ring);
+        return 1;
+    }
+    if (h.mode == MODE_SEND && h.depth > cfg.max_send_wr)
+        cfg.max_send_wr = h.depth;
+
+    LOG("Start");
+    double cpns = rdma_cycles_per_ns();
+
+    struct rdma_dev *dev = rdma_dev_open(&cfg);
+    if (!dev)
+        return 1;
+
+    struct prod *prods = calloc(h.producers, sizeof(*prods));
+    int sock0 = -1;
+    for (uint32_t i = 0; i < h.producers; i++) {
+        struct prod *p = &prods[i];
+        p->id = i;
+        p->h = &h;
+        p->rc = rdma_conn_create(dev, &cfg, NULL);
+        if (!p->rc)
+            return 1;
+
+        /* ring: our own ring region (for echoes) plus the message source behind it */
+        if (h.mode == MODE_RING)
+            p->pool = rdma_pool_create(dev->pd, rdma_ring_region_len(h.ring) + h.max_size, 1,
+                                       cfg.access_flags);
+        else
+            p->pool = rdma_pool_create(dev->pd, h.max_size, 2, IBV_ACCESS_LOCAL_WRITE);
+        if (!p->pool)
+            return 1;
+        memset((char *)p->pool->bufs[0].addr + (h.mode == MODE_RING ? rdma_ring_region_len(h.ring) : 0),
+               'r', h.max_size);
+        if (h.mode == MODE_RING) {
+            p->rc->local.addr = (uintptr_t)p->pool->bufs[0].addr;
+            p->rc->local.rkey = p->pool->bufs[0].rkey;
+            p->rc->local.len = rdma_ring_region_len(h.ring);
+        }
+
+        int sock = rdma_tcp_connect(argv[optind], cfg.tcp_port);
+        if (sock < 0)
+            return 1;
+        if (!i) {
+            sock0 = sock;
+            if (rdma_sock_write(sock, &h, sizeof(h)))
+                return 1;
+        }
+        if (rdma_conn_handshake(p->rc, sock, RDMA_ROLE_CLIENT))
+            return 1;
+        if (h.mode == MODE_RING &&
+            rdma_ring_init(&p->ring, p->rc, p->pool->bufs[0].addr, p->pool->bufs[0].lkey, h.ring))
+            return 1;
+    }
+    LOG("%s %s: %u producer(s), %u QP(s) -> RTS, max_inline=%u",
+        h.mode == MODE_RING ? "ring" : "send", h.test == TEST_BW ? "bw" : "lat",
+        h.producers, h.producers, prods[0].rc->max_inline);
+
+    uint64_t *samples = NULL;
+    if (h.test == TEST_BW) {
+        rdma_bw_header();
+    } else {
+        samples = calloc(h.iters + h.warmup, sizeof(*samples));
+        LOG("Latency RTT/2, %u warm-up + %u measured round trips per size", h.warmup, h.iters);
+        rdma_hist_header();
+    }
+
+    for (uint32_t size = h.min_size; size <= h.max_size; size *= 2) {
+        if (rdma_sock_barrier(sock0))
+            return 1;
+        if (h.test == TEST_BW) {
+            if (run_bw(prods, h.producers, sock0, size))
+                return 1;
+            continue;
+        }
+
+        prods[0].size = size;
+        int ret = h.mode == MODE_RING ? ring_lat(&prods[0], samples) : send_lat(&prods[0], samples);
+        char done;
+        if (ret || rdma_sock_read(sock0, &done, 1))
+            return 1;
+        struct rdma_hist hist;
+        rdma_hist_init(&hist);
+        for (uint32_t i = h.warmup; i < h.iters + h.warmup; i++)
+            rdma_hist_add(&hist, (uint64_t)(samples[i] / (2 * cpns)));
+        rdma_hist_print(&hist, size);
+    }
+
+    if (rdma_sock_barrier(sock0))
+        return 1;
+    LOG("Done");
+
+    free(samples);
+    for (uint32_t i = 0; i < h.producers; i++) {
+        rdma_conn_destroy(prods[i].rc);
+        rdma_pool_destroy(prods[i].pool);
+    }
+    free(prods);
+    rdma_dev_close(dev);
+    return 0;
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+
+enum ring_mode {
+    MODE_RING,              /* RDMA WRITE into a ring the consumer polls, credits written back */
+    MODE_SEND,              /* two-sided SEND into pre-posted receives */
+};
+
+enum ring_test {
+    TEST_BW,                /* producers stream, the consumer counts */
+    TEST_LAT,               /* one producer, the consumer echoes every message */
+};
+
+/* client -> server on the first connection, before any QP handshake */
+struct ring_hello {
+    uint32_t mode;
+    uint32_t test;
+    uint32_t min_size;
+    uint32_t max_size;
+    uint32_t iters;         /* per producer and size */
+    uint32_t warmup;        /* TEST_LAT only */
+    uint32_t ring;          /* MODE_RING: ring bytes per producer */
+    uint32_t depth;         /* MODE_SEND: receives per QP, SENDs in flight */
+    uint32_t producers;     /* one QP each; TEST_LAT uses one */
+};
+
+static inline int ring_parse_mode(const char *s) {
+    if (!strcmp(s, "ring"))
+        return MODE_RING;
+    if (!strcmp(s, "send"))
+        return MODE_SEND;
+    return -1;
+}
+
+static inline int ring_parse_test(const char *s) {
+    if (!strcmp(s, "bw"))
+        return TEST_BW;
+    if (!strcmp(s, "lat"))
+        return TEST_LAT;
+    return -1;
+}
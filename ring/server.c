@@ -0,0 +1,284 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <arpa/inet.h>
+#include <infiniband/verbs.h>
+#include "rdma_conn.h"
+#include "rdma_poll.h"
+#include "rdma_pool.h"
+#include "rdma_ring.h"
+#include "ring_proto.h"
+
+#define MAX_PRODUCERS 64
+
+#define LOG(fmt, ...)  printf("[SERVER] " fmt "\n", ##__VA_ARGS__)
+#define ERR(fmt, ...)  printf("[SERVER][ERR] " fmt " (errno=%d:%s)\n", ##__VA_ARGS__, errno, strerror(errno))
+
+struct peer {
+    struct rdma_conn   *rc;
+    struct rdma_ring    ring;
+    struct rdma_poller  poller;     /* MODE_SEND */
+};
+
+struct srv {
+    struct ring_hello   hello;
+    struct peer         peers[MAX_PRODUCERS];
+    struct rdma_pool   *pool;
+    uint64_t            recvs, sends;
+};
+
+/* ---------- MODE_SEND ---------- */
+
+static int post_recv(struct srv *s, struct peer *p, uint32_t idx) {
+    struct rdma_buf *b = &s->pool->bufs[idx];
+    struct ibv_sge sge = {
+        .addr = (uintptr_t)b->addr,
+        .length = s->hello.max_size,
+        .lkey = b->lkey
+    };
+    struct ibv_recv_wr wr = {
+        .wr_id = idx,
+        .sg_list = &sge,
+        .num_sge = 1
+    }, *bad;
+    return ibv_post_recv(p->rc->qp, &wr, &bad);
+}
+
+/* receives are re-posted as soon as they are seen, in either test */
+static int wc_done(void *arg, struct ibv_wc *wc) {
+    struct srv *s = arg;
+
+    if (wc->status != IBV_WC_SUCCESS) {
+        ERR("WC failed status=%s", ibv_wc_status_str(wc->status));
+        return -1;
+    }
+    if (!(wc->opcode & IBV_WC_RECV)) {
+        s->sends++;
+        return 0;
+    }
+    s->recvs++;
+    if (post_recv(s, &s->peers[wc->wr_id / s->hello.depth], wc->wr_id)) {
+        ERR("ibv_post_recv failed");
+        return -1;
+    }
+    return 0;
+}
+
+static int send_bw(struct srv *s, int n) {
+    uint64_t want = s->recvs + (uint64_t)n * s->hello.iters;
+
+    while (s->recvs < want) {
+        for (int i = 0; i < n; i++) {
+            if (rdma_poller_poll(&s->peers[i].poller) < 0)
+                return -1;
+        }
+    }
+    return 0;
+}
+
+static int send_lat(struct srv *s, uint32_t size) {
+    struct peer *p = &s->peers[0];
+    struct rdma_buf *sb = &s->pool->bufs[s->pool->nbufs - 1];
+
+    uint64_t recvs0 = s->recvs, sends0 = s->sends;
+
+    /* the next ping may be counted while we still wait for our pong's CQE */
+    for (uint32_t i = 0; i < s->hello.iters + s->hello.warmup; i++) {
+        while (s->recvs < recvs0 + i + 1) {
+            if (rdma_poller_poll(&p->poller) < 0)
+                return -1;
+        }
+
+        struct ibv_sge sge = {
+            .addr = (uintptr_t)sb->addr,
+            .length = size,
+            .lkey = sb->lkey
+        };
+        struct ibv_send_wr wr = {
+            .opcode = IBV_WR_SEND,
+            .sg_list = &sge,
+            .num_sge = 1,
+            .send_flags = IBV_SEND_SIGNALED | rdma_inline_flag(p->rc, size)
+        }, *bad;
+        if (ibv_post_send(p->rc->qp, &wr, &bad)) {
+            ERR("ibv_post_send failed");
+            return -1;
+        }
+        while (s->sends < sends0 + i + 1) {
+            if (rdma_poller_poll(&p->poller) < 0)
+                return -1;
+        }
+    }
+    return 0;
+}
+
+/* ---------- MODE_RING ---------- */
+
+static int ring_bw(struct srv *s, int n, uint32_t size) {
+    uint64_t want = (uint64_t)n * s->hello.iters, got = 0;
+
+    while (got < want) {
+        for (int i = 0; i < n; i++) {
+            struct rdma_ring *r = &s->peers[i].ring;
+            uint32_t len;
+            while (rdma_ring_peek(r, &len)) {
+                if (len != size) {
+                    LOG("Producer %d: %u byte message, expected %u", i, len, size);
+                    return -1;
+                }
+                if (rdma_ring_release(r))
+                    return -1;
+                got++;
+            }
+        }
+    }
+    return 0;
+}
+
+static int ring_lat(struct srv *s) {
+    struct rdma_ring *r = &s->peers[0].ring;
+
+    for (uint32_t i = 0; i < s->hello.iters + s->hello.warmup; i++) {
+        const void *msg;
+        uint32_t len;
+        while (!(msg = rdma_ring_peek(r, &len)));
+
+        int ret;
+        while ((ret = rdma_ring_send(r, msg, len)) == 1);
+        if (ret || rdma_ring_release(r))
+            return -1;
+    }
+    return 0;
+}
+
+static void usage(const char *prog) {
+    printf("Usage: %s [options]\n"
+           "  mode, test, sizes and producer count come from the client\n", prog);
+    rdma_cfg_usage();
+}
+
+int main(int argc, char **argv) {
+    struct rdma_cfg cfg;
+    rdma_cfg_init(&cfg);
+    cfg.max_send_wr = 64;
+    cfg.access_flags = IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_WRITE;
+
+    static const struct option opts[] = {
+        RDMA_CFG_LONG_OPTIONS,
+        {NULL, 0, NULL, 0}
+    };
+    int c;
+    while ((c = getopt_long(argc, argv, "", opts, NULL)) != -1) {
+        if (rdma_cfg_parse_opt(&cfg, c, optarg)) {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    LOG("Start");
+
+    struct rdma_dev *dev = rdma_dev_open(&cfg);
+    if (!dev)
+        return 1;
+
+    int lsock = rdma_tcp_listen(cfg.tcp_port, MAX_PRODUCERS);
+    if (lsock < 0)
+        return 1;
+    int sock0 = accept(lsock, NULL, NULL);
+    struct srv s;
+    memset(&s, 0, sizeof(s));
+    if (sock0 < 0 || rdma_sock_read(sock0, &s.hello, sizeof(s.hello))) {
+        ERR("accept failed");
+        return 1;
+    }
+    struct ring_hello *h = &s.hello;
+    int n = h->test == TEST_LAT ? 1 : (int)h->producers;
+    if (h->mode > MODE_SEND || h->test > TEST_LAT || !h->min_size || h->min_size > h->max_size ||
+        !h->iters || n < 1 || n > MAX_PRODUCERS || (h->mode == MODE_SEND && !h->depth)) {
+        LOG("Bad hello");
+        return 1;
+    }
+    LOG("%s %s: %d producer(s), sizes %u..%u, %u iters",
+        h->mode == MODE_RING ? "ring" : "send", h->test == TEST_BW ? "bw" : "lat",
+        n, h->min_size, h->max_size, h->iters);
+
+    if (h->mode == MODE_SEND) {
+        cfg.max_recv_wr = h->depth;
+        s.pool = rdma_pool_create(dev->pd, h->max_size, n * h->depth + 1, IBV_ACCESS_LOCAL_WRITE);
+    } else {
+        cfg.max_recv_wr = 1;
+        s.pool = rdma_pool_create(dev->pd, rdma_ring_region_len(h->ring), n, cfg.access_flags);
+    }
+    if (!s.pool)
+        return 1;
+
+    for (int i = 0; i < n; i++) {
+        struct peer *p = &s.peers[i];
+        int sock = i ? accept(lsock, NULL, NULL) : sock0;
+        if (sock < 0) {
+            ERR("accept failed");
+            return 1;
+        }
+        p->rc = rdma_conn_create(dev, &cfg, NULL);
+        if (!p->rc)
+            return 1;
+        rdma_poller_init(&p->poller, p->rc->send_cq, cfg.poll_batch, wc_done, &s);
+        if (h->mode == MODE_SEND) {
+            /* peer i owns receive buffers [i * depth, (i + 1) * depth) */
+            for (uint32_t j = 0; j < h->depth; j++) {
+                if (post_recv(&s, p, i * h->depth + j)) {
+                    ERR("ibv_post_recv failed");
+                    return 1;
+                }
+            }
+        } else {
+            struct rdma_buf *b = &s.pool->bufs[i];
+            p->rc->local.addr = (uintptr_t)b->addr;
+            p->rc->local.rkey = b->rkey;
+            p->rc->local.len = rdma_ring_region_len(h->ring);
+        }
+        if (rdma_conn_handshake(p->rc, sock, RDMA_ROLE_SERVER))
+            return 1;
+        if (h->mode == MODE_RING &&
+            rdma_ring_init(&p->ring, p->rc, s.pool->bufs[i].addr, s.pool->bufs[i].lkey, h->ring))
+            return 1;
+    }
+    LOG("%d QP(s) -> RTS", n);
+
+    for (uint32_t size = h->min_size; size <= h->max_size; size *= 2) {
+        if (rdma_sock_barrier(sock0))
+            return 1;
+        int ret;
+        if (h->mode == MODE_RING)
+            ret = h->test == TEST_BW ? ring_bw(&s, n, size) : ring_lat(&s);
+        else
+            ret = h->test == TEST_BW ? send_bw(&s, n) : send_lat(&s, size);
+        if (ret)
+            return 1;
+        /* the client stops its clock when this arrives */
+        char done = 1;
+        if (rdma_sock_write(sock0, &done, 1))
+            return 1;
+    }
+
+    if (rdma_sock_barrier(sock0))
+        return 1;
+    if (h->mode == MODE_RING) {
+        uint64_t stalls = 0;
+        for (int i = 0; i < n; i++)
+            stalls += s.peers[i].ring.stalls;
+        if (h->test == TEST_LAT)
+            LOG("Echo stalls waiting for credits: %lu", stalls);
+    }
+    LOG("Done");
+
+    for (int i = 0; i < n; i++)
+        rdma_conn_destroy(s.peers[i].rc);
+    rdma_pool_destroy(s.pool);
+    close(lsock);
+    rdma_dev_close(dev);
+    return 0;
+}
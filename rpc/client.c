@@ -0,0 +1,233 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <infiniband/verbs.h>
+#include "rdma_conn.h"
+#include "rdma_rpc.h"
+#include "rdma_bench.h"
+#include "rdma_hist.h"
+#include "rpc_proto.h"
+
+#define LOG(fmt, ...)  printf("[CLIENT] " fmt "\n", ##__VA_ARGS__)
+#define ERR(fmt, ...)  printf("[CLIENT][ERR] " fmt " (errno=%d:%s)\n", ##__VA_ARGS__, errno, strerror(errno))
+
+struct thr {
+    struct rdma_conn   *rc;
+    struct rdma_rpc     rpc;
+    pthread_barrier_t  *start;
+    pthread_t           tid;
+    int                 ret;
+
+    /* this run */
+    int                 method;
+    uint32_t            size;
+    uint32_t            outstanding;
+    uint64_t            calls;
+    double              cpns;
+    char               *arg;
+    struct rdma_hist    hist;
+    uint64_t            done, bad;
+};
+
+static void on_reply(void *arg, uint64_t ctx, int status, const void *resp, uint32_t len) {
+    struct thr *t = arg;
+
+    rdma_hist_add(&t->hist, (uint64_t)((rdma_cycles() - ctx) / t->cpns));
+    if (status != RDMA_RPC_OK || len != (t->method == RPC_ECHO ? t->size : 0) ||
+        (len && memcmp(resp, t->arg, len)))
+        t->bad++;
+    t->done++;
+}
+
+static int run_calls(struct thr *t) {
+    uint64_t issued = 0;
+
+    t->done = 0;
+    while (t->done < t->calls) {
+        while (issued < t->calls && rdma_rpc_inflight(&t->rpc) < t->outstanding) {
+            int ret = rdma_rpc_call(&t->rpc, t->method, t->arg, t->size, on_reply, t, rdma_cycles());
+            if (ret < 0)
+                return -1;
+            if (ret)
+                break;
+            issued++;
+        }
+        if (rdma_rpc_poll(&t->rpc) < 0)
+            return -1;
+    }
+    return 0;
+}
+
+static void *thr_main(void *arg) {
+    struct thr *t = arg;
+
+    pthread_barrier_wait(t->start);
+    t->ret = run_calls(t);
+    return NULL;
+}
+
+/* all threads through one run; returns its wall time in ns, 0 on error */
+static uint64_t run(struct thr *thr, int n) {
+    pthread_barrier_t start;
+
+    pthread_barrier_init(&start, NULL, n + 1);
+    for (int i = 0; i < n; i++) {
+        thr[i].start = &start;
+        rdma_hist_init(&thr[i].hist);
+        if (pthread_create(&thr[i].tid, NULL, thr_main, &thr[i])) {
+            ERR("pthread_create failed");
+            return 0;
+        }
+    }
+    pthread_barrier_wait(&start);
+    uint64_t t0 = rdma_now_ns();
+    int ret = 0;
+    for (int i = 0; i < n; i++) {
+        pthread_join(thr[i].tid, NULL);
+        ret |= thr[i].ret;
+    }
+    uint64_t ns = rdma_now_ns() - t0;
+    pthread_barrier_destroy(&start);
+    return ret ? 0 : ns;
+}
+
+static void usage(const char *prog) {
+    printf("Usage: %s [options] <server_ip>\n"
+           "  -m <method>  echo | null (default: echo)\n"
+           "  -s <bytes>   call arguments (echo: and results) size (default: 64)\n"
+           "  -o <n>       calls outstanding per QP (default: 16)\n"
+           "  -a           sweep outstanding calls 1 .. -o in powers of two\n"
+           "  -n <calls>   calls per thread and run (default: 200000)\n"
+           "  -T <n>       threads, one QP each (default: 1)\n",
+           prog);
+    rdma_cfg_usage();
+}
+
+int main(int argc, char **argv) {
+    struct rdma_cfg cfg;
+    rdma_cfg_init(&cfg);
+
+    int method = RPC_ECHO, nthreads = 1, sweep = 0;
+    uint32_t size = 64, outstanding = 16;
+    uint64_t calls = 200000;
+
+    static const struct option opts[] = {
+        RDMA_CFG_LONG_OPTIONS,
+        {NULL, 0, NULL, 0}
+    };
+    int c;
+    while ((c = getopt_long(argc, argv, "m:s:o:an:T:", opts, NULL)) != -1) {
+        switch (c) {
+        case 'm':
+            if ((method = rpc_parse_method(optarg)) < 0) {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 's': size = rdma_parse_size(optarg); break;
+        case 'o': outstanding = atoi(optarg); break;
+        case 'a': sweep = 1; break;
+        case 'n': calls = rdma_parse_size(optarg); break;
+        case 'T': nthreads = atoi(optarg); break;
+        default:
+            if (rdma_cfg_parse_opt(&cfg, c, optarg)) {
+                usage(argv[0]);
+                return 1;
+            }
+        }
+    }
+    if (optind >= argc || !outstanding || !calls || nthreads < 1 || nthreads > MAX_THREADS) {
+        usage(argv[0]);
+        return 1;
+    }
+    struct rpc_hello h = {
+        .threads = nthreads,
+        .depth = outstanding,
+        .max_msg = size ? size : 1
+    };
+    cfg.max_send_wr = 2 * h.depth;
+    cfg.max_recv_wr = 2 * h.depth;
+
+    LOG("Start");
+    double cpns = rdma_cycles_per_ns();
+
+    struct rdma_dev *dev = rdma_dev_open(&cfg);
+    if (!dev)
+        return 1;
+
+    struct thr *thr = calloc(nthreads, sizeof(*thr));
+    char *arg = malloc(h.max_msg);
+    for (uint32_t i = 0; i < h.max_msg; i++)
+        arg[i] = 'a' + i % 26;
+    int sock0 = -1;
+    for (int i = 0; i < nthreads; i++) {
+        struct thr *t = &thr[i];
+        t->rc = rdma_conn_create(dev, &cfg, NULL);
+        if (!t->rc || rdma_rpc_init(&t->rpc, t->rc, h.depth, h.max_msg, NULL))
+            return 1;
+        int sock = rdma_tcp_connect(argv[optind], cfg.tcp_port);
+        if (sock < 0)
+            return 1;
+        if (!i) {
+            sock0 = sock;
+            if (rdma_sock_write(sock, &h, sizeof(h)))
+                return 1;
+        }
+        if (rdma_conn_handshake(t->rc, sock, RDMA_ROLE_CLIENT))
+            return 1;
+        t->method = method;
+        t->size = size;
+        t->calls = calls;
+        t->cpns = cpns;
+        t->arg = arg;
+    }
+    LOG("%s, %u B, %d QP(s), %lu calls per QP and run, max_inline=%u",
+        method == RPC_ECHO ? "echo" : "null", size, nthreads, calls, thr[0].rc->max_inline);
+
+    printf(" %-8s %-6s %-12s %-10s %-10s %-10s %-10s\n",
+           "#outst", "#QPs", "ops/s", "p50[us]", "p99[us]", "p99.9[us]", "max[us]");
+    for (uint32_t o = sweep ? 1 : outstanding;; o = o * 2 < outstanding ? o * 2 : outstanding) {
+        for (int i = 0; i < nthreads; i++)
+            thr[i].outstanding = o;
+        uint64_t ns = run(thr, nthreads);
+        if (!ns)
+            return 1;
+        struct rdma_hist all;
+        uint64_t bad = 0;
+        rdma_hist_init(&all);
+        for (int i = 0; i < nthreads; i++) {
+            rdma_hist_merge(&all, &thr[i].hist);
+            bad += thr[i].bad;
+        }
+        printf(" %-8u %-6d %-12.0f %-10.2f %-10.2f %-10.2f %-10.2f\n", o, nthreads,
+               (double)calls * nthreads * 1e9 / ns,
+               rdma_hist_percentile(&all, 0.5) / 1e3, rdma_hist_percentile(&all, 0.99) / 1e3,
+               rdma_hist_percentile(&all, 0.999) / 1e3, rdma_hist_percentile(&all, 1) / 1e3);
+        if (bad) {
+            LOG("%lu replies with a bad status or payload", bad);
+            return 1;
+        }
+        if (o == outstanding)
+            break;
+    }
+
+    /* the server stops when the first socket becomes readable */
+    char done = 1;
+    if (rdma_sock_write(sock0, &done, 1))
+        return 1;
+    LOG("Done");
+
+    for (int i = 0; i < nthreads; i++) {
+        rdma_rpc_fini(&thr[i].rpc);
+        rdma_conn_destroy(thr[i].rc);
+    }
+    free(thr);
+    free(arg);
+    rdma_dev_close(dev);
+    return 0;
+}
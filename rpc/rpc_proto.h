@@ -0,0 +1,25 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+
+#define MAX_THREADS 64
+
+enum rpc_method {
+    RPC_NULL = 1,           /* empty reply */
+    RPC_ECHO,               /* the arguments back */
+};
+
+/* client -> server on the first connection, before any QP handshake */
+struct rpc_hello {
+    uint32_t threads;       /* one QP each */
+    uint32_t depth;         /* calls outstanding per QP at most */
+    uint32_t max_msg;
+};
+
+static inline int rpc_parse_method(const char *s) {
+    if (!strcmp(s, "null"))
+        return RPC_NULL;
+    if (!strcmp(s, "echo"))
+        return RPC_ECHO;
+    return -1;
+}
@@ -0,0 +1,132 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <getopt.h>
+#include <arpa/inet.h>
+#include <infiniband/verbs.h>
+#include "rdma_conn.h"
+#include "rdma_rpc.h"
+#include "rdma_bench.h"
+#include "rpc_proto.h"
+
+#define LOG(fmt, ...)  printf("[SERVER] " fmt "\n", ##__VA_ARGS__)
+#define ERR(fmt, ...)  printf("[SERVER][ERR] " fmt " (errno=%d:%s)\n", ##__VA_ARGS__, errno, strerror(errno))
+
+/* ---------- handlers ---------- */
+
+static int rpc_null(void *arg, const void *req, uint32_t len, void *resp, uint32_t *resp_len) {
+    (void)arg; (void)req; (void)len; (void)resp;
+    *resp_len = 0;
+    return RDMA_RPC_OK;
+}
+
+static int rpc_echo(void *arg, const void *req, uint32_t len, void *resp, uint32_t *resp_len) {
+    (void)arg;
+    memcpy(resp, req, len);
+    *resp_len = len;
+    return RDMA_RPC_OK;
+}
+
+/* the client closes (or writes to) its first socket when it is done */
+static int client_gone(int sock) {
+    struct pollfd pfd = { .fd = sock, .events = POLLIN };
+    return poll(&pfd, 1, 0) != 0;
+}
+
+static void usage(const char *prog) {
+    printf("Usage: %s [options]\n"
+           "  QPs, depth and message size come from the client\n", prog);
+    rdma_cfg_usage();
+}
+
+int main(int argc, char **argv) {
+    struct rdma_cfg cfg;
+    rdma_cfg_init(&cfg);
+
+    static const struct option opts[] = {
+        RDMA_CFG_LONG_OPTIONS,
+        {NULL, 0, NULL, 0}
+    };
+    int c;
+    while ((c = getopt_long(argc, argv, "", opts, NULL)) != -1) {
+        if (rdma_cfg_parse_opt(&cfg, c, optarg)) {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    LOG("Start");
+
+    struct rdma_rpc_registry reg;
+    memset(&reg, 0, sizeof(reg));
+    if (rdma_rpc_register(&reg, RPC_NULL, rpc_null, NULL) ||
+        rdma_rpc_register(&reg, RPC_ECHO, rpc_echo, NULL))
+        return 1;
+
+    struct rdma_dev *dev = rdma_dev_open(&cfg);
+    if (!dev)
+        return 1;
+
+    int lsock = rdma_tcp_listen(cfg.tcp_port, MAX_THREADS);
+    if (lsock < 0)
+        return 1;
+    struct rpc_hello h;
+    int sock0 = accept(lsock, NULL, NULL);
+    if (sock0 < 0 || rdma_sock_read(sock0, &h, sizeof(h))) {
+        ERR("accept failed");
+        return 1;
+    }
+    if (!h.threads || h.threads > MAX_THREADS || !h.depth || !h.max_msg) {
+        LOG("Bad hello");
+        return 1;
+    }
+    cfg.max_send_wr = 2 * h.depth;
+    cfg.max_recv_wr = 2 * h.depth;
+
+    struct rdma_conn *rc[MAX_THREADS];
+    struct rdma_rpc *eps = calloc(h.threads, sizeof(*eps));
+    for (uint32_t i = 0; i < h.threads; i++) {
+        int sock = i ? accept(lsock, NULL, NULL) : sock0;
+        if (sock < 0) {
+            ERR("accept failed");
+            return 1;
+        }
+        rc[i] = rdma_conn_create(dev, &cfg, NULL);
+        if (!rc[i] || rdma_rpc_init(&eps[i], rc[i], h.depth, h.max_msg, &reg) ||
+            rdma_conn_handshake(rc[i], sock, RDMA_ROLE_SERVER))
+            return 1;
+    }
+    LOG("%u QP(s) -> RTS, depth %u, %u B messages, max_inline=%u",
+        h.threads, h.depth, h.max_msg, rc[0]->max_inline);
+
+    uint64_t cpu0 = rdma_cpu_ns(), t0 = rdma_now_ns(), next_check = t0;
+    for (;;) {
+        for (uint32_t i = 0; i < h.threads; i++) {
+            if (rdma_rpc_poll(&eps[i]) < 0)
+                return 1;
+        }
+        uint64_t now = rdma_now_ns();
+        if (now >= next_check) {
+            if (client_gone(sock0))
+                break;
+            next_check = now + 1000000;
+        }
+    }
+    uint64_t served = 0;
+    for (uint32_t i = 0; i < h.threads; i++)
+        served += eps[i].served;
+    LOG("Done: %lu calls served, cpu %.0f%%", served,
+        100.0 * (rdma_cpu_ns() - cpu0) / (rdma_now_ns() - t0));
+
+    for (uint32_t i = 0; i < h.threads; i++) {
+        rdma_rpc_fini(&eps[i]);
+        rdma_conn_destroy(rc[i]);
+    }
+    free(eps);
+    close(lsock);
+    rdma_dev_close(dev);
+    return 0;
+}
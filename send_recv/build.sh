@@ -1,4 +1,9 @@
 #!/bin/bash
 
-gcc server4.c -o server -libverbs
+COMMON="-I../common ../common/rdma_conn.c ../common/rdma_poll.c ../common/rdma_sq.c ../common/rdma_pool.c"
 
+gcc server4.c $COMMON -o server -libverbs
+
+gcc client4.c $COMMON -o client -libverbs
+
+gcc server_multi.c $COMMON -o server_multi -libverbs
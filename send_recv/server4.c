@@ -3,143 +3,177 @@
 #include <string.h>
 #include <errno.h>
 #include <unistd.h>
+#include <getopt.h>
 #include <arpa/inet.h>
 #include <infiniband/verbs.h>
-#include "rdma_common.h"
+#include "rdma_conn.h"
+#include "rdma_bench.h"
+#include "rdma_poll.h"
+#include "rdma_pool.h"
 
-#define PORT 18515
 #define MSG_SIZE 1024
 
 #define LOG(fmt, ...)  printf("[SERVER] " fmt "\n", ##__VA_ARGS__)
 #define ERR(fmt, ...)  printf("[SERVER][ERR] " fmt " (errno=%d:%s)\n", ##__VA_ARGS__, errno, strerror(errno))
 
-int main() {
+static int post_recv(struct rdma_conn *rc, const struct rdma_buf *b, size_t size) {
+    struct ibv_sge sge = {
+        .addr = (uintptr_t)b->addr,
+        .length = size,
+        .lkey = b->lkey
+    };
+    struct ibv_recv_wr wr = {
+        .wr_id = b->idx,
+        .sg_list = &sge,
+        .num_sge = 1
+    };
+    struct ibv_recv_wr *bad;
+    return ibv_post_recv(rc->qp, &wr, &bad);
+}
+
+struct bw_ctx {
+    struct rdma_conn *rc;
+    struct rdma_pool *pool;         /* one ring slot per buffer */
+    size_t            size;
+    long              done;
+    uint64_t          bytes;
+    uint64_t          start;
+};
+
+static int recv_done(void *arg, struct ibv_wc *wc) {
+    struct bw_ctx *bc = arg;
+
+    if (wc->status != IBV_WC_SUCCESS) {
+        ERR("RECV failed status=%s", ibv_wc_status_str(wc->status));
+        return -1;
+    }
+    if (!bc->done)
+        bc->start = rdma_now_ns();
+    bc->done++;
+    bc->bytes += wc->byte_len;
+
+    /* keep the ring full; the slots beyond iters are never consumed */
+    if (post_recv(bc->rc, &bc->pool->bufs[wc->wr_id], bc->size)) {
+        ERR("ibv_post_recv failed");
+        return -1;
+    }
+    return 0;
+}
+
+/* consume iters messages, re-posting each ring slot as it completes */
+static int run_bw(struct rdma_conn *rc, struct rdma_pool *pool, size_t size, long iters) {
+    struct bw_ctx bc = { .rc = rc, .pool = pool, .size = size };
+    struct rdma_poller poller;
+
+    rdma_poller_init(&poller, rc->recv_cq, rc->cfg.poll_batch, recv_done, &bc);
+    poller.hist_on = rc->cfg.cq_hist;
+
+    while (bc.done < iters) {
+        if (rdma_poller_poll(&poller) < 0)
+            return -1;
+    }
+    uint64_t ns = rdma_now_ns() - bc.start;
+
+    rdma_bw_header();
+    rdma_bw_print(bc.done ? bc.bytes / bc.done : 0, bc.done, ns);
+    if (poller.hist_on)
+        rdma_poller_print_hist(&poller);
+    return 0;
+}
+
+static void usage(const char *prog) {
+    printf("Usage: %s [options]\n"
+           "  -b           bandwidth mode: receive -n messages through a ring of -D buffers\n"
+           "  -n <iters>   messages to receive in bandwidth mode (default: 1000)\n"
+           "  -s <bytes>   receive buffer size (default: %d)\n"
+           "  -D <depth>   receive ring depth in bandwidth mode (default: 64)\n",
+           prog, MSG_SIZE);
+    rdma_cfg_usage();
+}
+
+int main(int argc, char **argv) {
+    struct rdma_cfg cfg;
+    rdma_cfg_init(&cfg);
+    int bw = 0;
+    long iters = 1000;
+    size_t size = MSG_SIZE;
+    uint32_t depth = 64;
+
+    static const struct option opts[] = {
+        RDMA_CFG_LONG_OPTIONS,
+        {NULL, 0, NULL, 0}
+    };
+    int c;
+    while ((c = getopt_long(argc, argv, "bn:s:D:", opts, NULL)) != -1) {
+        switch (c) {
+        case 'b': bw = 1; break;
+        case 'n': iters = atol(optarg); break;
+        case 's': size = atol(optarg); break;
+        case 'D': depth = atoi(optarg); break;
+        default:
+            if (rdma_cfg_parse_opt(&cfg, c, optarg)) {
+                usage(argv[0]);
+                return 1;
+            }
+        }
+    }
+    if (!bw)
+        depth = 1;
+    cfg.max_recv_wr = depth;
+
     LOG("Start");
 
     /* ---------- RDMA device ---------- */
-    struct ibv_device **dev_list = ibv_get_device_list(NULL);
-    struct ibv_context *ctx = ibv_open_device(dev_list[0]);
-    struct ibv_pd *pd = ibv_alloc_pd(ctx);
-    struct ibv_cq *cq = ibv_create_cq(ctx, 10, NULL, NULL, 0);
-
-    struct ibv_qp_init_attr qpia = {
-        .send_cq = cq,
-        .recv_cq = cq,
-        .qp_type = IBV_QPT_RC,
-        .cap = {
-            .max_send_wr = 10,
-            .max_recv_wr = 10,
-            .max_send_sge = 1,
-            .max_recv_sge = 1
-        }
-    };
-    struct ibv_qp *qp = ibv_create_qp(pd, &qpia);
-    LOG("QP created qpn=%u", qp->qp_num);
-
-    /* ---------- INIT ---------- */
-    struct ibv_qp_attr attr = {
-        .qp_state = IBV_QPS_INIT,
-        .port_num = 1,
-        .pkey_index = 0,
-        .qp_access_flags = IBV_ACCESS_LOCAL_WRITE
-    };
-    ibv_modify_qp(qp, &attr,
-        IBV_QP_STATE |
-        IBV_QP_PORT |
-        IBV_QP_PKEY_INDEX |
-        IBV_QP_ACCESS_FLAGS);
+    struct rdma_dev *dev = rdma_dev_open(&cfg);
+    if (!dev)
+        return 1;
+
+    struct rdma_conn *rc = rdma_conn_create(dev, &cfg, NULL);
+    if (!rc)
+        return 1;
+    LOG("QP created qpn=%u", rc->qp->qp_num);
     LOG("QP -> INIT");
 
     /* ---------- TCP ---------- */
-    int sock = socket(AF_INET, SOCK_STREAM, 0);
-    struct sockaddr_in addr = {
-        .sin_family = AF_INET,
-        .sin_port = htons(PORT),
-        .sin_addr.s_addr = INADDR_ANY
-    };
-    bind(sock, (struct sockaddr*)&addr, sizeof(addr));
-    listen(sock, 1);
+    int sock = rdma_tcp_listen(cfg.tcp_port, 1);
+    if (sock < 0)
+        return 1;
     int conn = accept(sock, NULL, NULL);
+    if (conn < 0) {
+        ERR("accept failed");
+        return 1;
+    }
     LOG("TCP connected");
 
-    /* ---------- exchange QP info ---------- */
-    struct qp_info local = {}, remote = {};
-    local.qp_num = qp->qp_num;
-
-    union ibv_gid gid;
-    ibv_query_gid(ctx, 1, 1, &gid);   // 使用 GID[1]（IPv4）
-    memcpy(local.gid, &gid, 16);
-
-    write(conn, &local, sizeof(local));
-    read(conn, &remote, sizeof(remote));
-    LOG("Remote qpn=%u", remote.qp_num);
-
-    /* ---------- RTR ---------- */
-    memset(&attr, 0, sizeof(attr));
-    attr.qp_state = IBV_QPS_RTR;
-    attr.path_mtu = IBV_MTU_1024;
-    attr.dest_qp_num = remote.qp_num;
-    attr.rq_psn = 0;
-    attr.max_dest_rd_atomic = 1;
-    attr.min_rnr_timer = 12;
-
-    attr.ah_attr.is_global = 1;
-    attr.ah_attr.port_num = 1;
-    attr.ah_attr.grh.hop_limit = 64;
-    attr.ah_attr.grh.sgid_index = 1;
-    memcpy(&attr.ah_attr.grh.dgid, remote.gid, 16);
-
-    if (ibv_modify_qp(qp, &attr,
-        IBV_QP_STATE |
-        IBV_QP_AV |
-        IBV_QP_PATH_MTU |
-        IBV_QP_DEST_QPN |
-        IBV_QP_RQ_PSN |
-        IBV_QP_MAX_DEST_RD_ATOMIC |
-        IBV_QP_MIN_RNR_TIMER)) {
-        ERR("QP to RTR failed");
+    /* ---------- post recv ring before the client may send ---------- */
+    struct rdma_pool *pool = rdma_pool_create(dev->pd, size, depth, IBV_ACCESS_LOCAL_WRITE);
+    if (!pool)
         return 1;
+    for (uint32_t i = 0; i < depth; i++) {
+        if (post_recv(rc, rdma_pool_get(pool), size)) {
+            ERR("ibv_post_recv failed");
+            return 1;
+        }
     }
-    LOG("QP -> RTR");
-
-    /* ---------- RTS ---------- */
-    memset(&attr, 0, sizeof(attr));
-    attr.qp_state = IBV_QPS_RTS;
-    attr.timeout = 14;
-    attr.retry_cnt = 7;
-    attr.rnr_retry = 7;
-    attr.sq_psn = 0;
-    attr.max_rd_atomic = 1;
-
-    ibv_modify_qp(qp, &attr,
-        IBV_QP_STATE |
-        IBV_QP_TIMEOUT |
-        IBV_QP_RETRY_CNT |
-        IBV_QP_RNR_RETRY |
-        IBV_QP_SQ_PSN |
-        IBV_QP_MAX_QP_RD_ATOMIC);
-    LOG("QP -> RTS");
 
-    /* ---------- post recv ---------- */
-    char *buf = calloc(1, MSG_SIZE);
-    struct ibv_mr *mr = ibv_reg_mr(pd, buf, MSG_SIZE, IBV_ACCESS_LOCAL_WRITE);
-
-    struct ibv_sge sge = {
-        .addr = (uintptr_t)buf,
-        .length = MSG_SIZE,
-        .lkey = mr->lkey
-    };
-    struct ibv_recv_wr wr = {
-        .sg_list = &sge,
-        .num_sge = 1
-    };
-    struct ibv_recv_wr *bad;
-    ibv_post_recv(qp, &wr, &bad);
+    /* ---------- exchange QP info, RTR, RTS ---------- */
+    if (rdma_conn_handshake(rc, conn, RDMA_ROLE_SERVER))
+        return 1;
+    LOG("Remote qpn=%u", rc->remote.qp_num);
+    LOG("QP -> RTS");
 
-    struct ibv_wc wc;
-    while (ibv_poll_cq(cq, 1, &wc) == 0);
-    LOG("Received: %s", buf);
+    if (bw) {
+        if (run_bw(rc, pool, size, iters))
+            return 1;
+    } else {
+        struct ibv_wc wc;
+        while (ibv_poll_cq(rc->recv_cq, 1, &wc) == 0);
+        LOG("Received: %s", (char *)pool->bufs[wc.wr_id].addr);
+    }
 
+    rdma_pool_destroy(pool);
+    rdma_conn_destroy(rc);
+    close(sock);
+    rdma_dev_close(dev);
     return 0;
 }
-
@@ -0,0 +1,460 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <getopt.h>
+#include <arpa/inet.h>
+#include <infiniband/verbs.h>
+#include "rdma_conn.h"
+#include "rdma_poll.h"
+#include "rdma_pool.h"
+
+#define MSG_SIZE   1024
+#define MAX_CONNS  256
+#define SOCK_CHECK_NS  1000000ull      /* look at the sockets every 1 ms */
+#define QPN_HASH   1024                 /* > 2 * MAX_CONNS */
+#define SRQ_POST_BATCH 64
+
+#define LOG(fmt, ...)  printf("[SERVER] " fmt "\n", ##__VA_ARGS__)
+#define ERR(fmt, ...)  printf("[SERVER][ERR] " fmt " (errno=%d:%s)\n", ##__VA_ARGS__, errno, strerror(errno))
+
+/* wr_id = slot << 32 | receive buffer index; with the SRQ just the buffer index */
+#define WR_ID(slot, idx)   (((uint64_t)(slot) << 32) | (idx))
+#define WR_SLOT(wr_id)     ((uint32_t)((wr_id) >> 32))
+#define WR_IDX(wr_id)      ((uint32_t)(wr_id))
+
+struct peer {
+    struct rdma_conn *rc;
+    struct rdma_buf **ring;         /* rq_depth receive buffers from the shared pool */
+    uint32_t          ring_len;
+    char              name[32];
+    uint64_t          start_ns;
+    uint64_t          msgs, bytes;
+    uint64_t          last_msgs, last_bytes;
+};
+
+static struct peer *peers[MAX_CONNS];
+static int nr_peers;
+static uint32_t msg_size = MSG_SIZE;
+static struct rdma_pool *pool;      /* registered once, lent to every peer */
+
+/*
+ * SRQ mode: every QP receives from one queue of srq_depth buffers.
+ * Consumed buffers wait in pending[] and go back in one chained post
+ * once fewer than srq_limit remain posted. The device's IBV_SRQ_LIMIT
+ * event, armed at half that, catches the queue running low between
+ * polls.
+ */
+static struct ibv_srq *srq;
+static uint32_t srq_depth, srq_limit;
+static uint32_t *pending, npending;
+static uint64_t srq_posted, srq_consumed, srq_limit_events;
+
+/* SRQ completions carry no slot: find the peer by QP number */
+static int16_t qpn_slot[QPN_HASH];
+
+static int post_recv(struct peer *p, uint32_t slot, uint32_t idx) {
+    struct ibv_sge sge = {
+        .addr = (uintptr_t)p->ring[idx]->addr,
+        .length = msg_size,
+        .lkey = p->ring[idx]->lkey
+    };
+    struct ibv_recv_wr wr = {
+        .wr_id = WR_ID(slot, idx),
+        .sg_list = &sge,
+        .num_sge = 1
+    };
+    struct ibv_recv_wr *bad;
+    return ibv_post_recv(p->rc->qp, &wr, &bad);
+}
+
+static void qpn_index_rebuild(void) {
+    memset(qpn_slot, -1, sizeof(qpn_slot));
+    for (int i = 0; i < MAX_CONNS; i++) {
+        if (!peers[i])
+            continue;
+        uint32_t h = peers[i]->rc->qp->qp_num % QPN_HASH;
+        while (qpn_slot[h] >= 0)
+            h = (h + 1) % QPN_HASH;
+        qpn_slot[h] = i;
+    }
+}
+
+static struct peer *peer_by_qpn(uint32_t qpn) {
+    for (uint32_t h = qpn % QPN_HASH; qpn_slot[h] >= 0; h = (h + 1) % QPN_HASH) {
+        struct peer *p = peers[qpn_slot[h]];
+        if (p->rc->qp->qp_num == qpn)
+            return p;
+    }
+    return NULL;
+}
+
+static int srq_refill(void) {
+    struct ibv_sge sge[SRQ_POST_BATCH];
+    struct ibv_recv_wr wr[SRQ_POST_BATCH], *bad;
+
+    while (npending) {
+        uint32_t n = npending < SRQ_POST_BATCH ? npending : SRQ_POST_BATCH;
+        for (uint32_t i = 0; i < n; i++) {
+            struct rdma_buf *b = &pool->bufs[pending[npending - n + i]];
+            sge[i] = (struct ibv_sge) {
+                .addr = (uintptr_t)b->addr,
+                .length = msg_size,
+                .lkey = b->lkey
+            };
+            wr[i] = (struct ibv_recv_wr) {
+                .wr_id = b->idx,
+                .sg_list = &sge[i],
+                .num_sge = 1,
+                .next = i + 1 < n ? &wr[i + 1] : NULL
+            };
+        }
+        if (ibv_post_srq_recv(srq, wr, &bad)) {
+            ERR("ibv_post_srq_recv failed");
+            return -1;
+        }
+        npending -= n;
+        srq_posted += n;
+    }
+    return 0;
+}
+
+static int srq_arm_limit(void) {
+    /* a limit of 0 disarms the event */
+    struct ibv_srq_attr attr = { .srq_limit = srq_limit > 1 ? srq_limit / 2 : 1 };
+    if (ibv_modify_srq(srq, &attr, IBV_SRQ_LIMIT)) {
+        ERR("ibv_modify_srq IBV_SRQ_LIMIT failed");
+        return -1;
+    }
+    return 0;
+}
+
+static int srq_create(struct rdma_dev *dev) {
+    struct ibv_srq_init_attr init = {
+        .attr = {
+            .max_wr = srq_depth,
+            .max_sge = 1
+        }
+    };
+    srq = ibv_create_srq(dev->pd, &init);
+    pending = calloc(srq_depth, sizeof(*pending));
+    if (!srq || !pending) {
+        ERR("ibv_create_srq depth %u failed", srq_depth);
+        return -1;
+    }
+    for (uint32_t i = 0; i < srq_depth; i++)
+        pending[npending++] = rdma_pool_get(pool)->idx;
+    if (srq_refill() || srq_arm_limit())
+        return -1;
+
+    /* limit events are picked up on the 1 ms tick */
+    int fd = dev->ctx->async_fd;
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    return 0;
+}
+
+static void check_async(struct rdma_dev *dev) {
+    struct ibv_async_event ev;
+
+    while (!ibv_get_async_event(dev->ctx, &ev)) {
+        if (ev.event_type == IBV_EVENT_SRQ_LIMIT_REACHED) {
+            srq_limit_events++;
+            srq_refill();
+            srq_arm_limit();
+        } else {
+            LOG("Async event %s", ibv_event_type_str(ev.event_type));
+        }
+        ibv_ack_async_event(&ev);
+    }
+}
+
+static void peer_free(struct peer *p) {
+    if (p->rc)
+        rdma_conn_destroy(p->rc);
+    for (uint32_t i = 0; i < p->ring_len; i++)
+        rdma_pool_put(pool, p->ring[i]);
+    free(p->ring);
+    free(p);
+}
+
+static void peer_report(const struct peer *p, const char *tag) {
+    double sec = (rdma_now_ns() - p->start_ns) / 1e9;
+    LOG("%s %s qpn=%u msgs=%lu bytes=%lu %.2f s %.0f msgs/s %.2f MB/s",
+        tag, p->name, p->rc->qp->qp_num, p->msgs, p->bytes, sec,
+        p->msgs / sec, p->bytes / sec / 1e6);
+}
+
+static void accept_peer(struct rdma_dev *dev, const struct rdma_cfg *cfg,
+                        struct ibv_cq *cq, int lsock) {
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    int conn = accept(lsock, (struct sockaddr*)&addr, &len);
+    if (conn < 0)
+        return;
+
+    int slot;
+    for (slot = 0; slot < MAX_CONNS && peers[slot]; slot++);
+    if (slot == MAX_CONNS) {
+        LOG("Connection table full, dropping peer");
+        close(conn);
+        return;
+    }
+
+    struct peer *p = calloc(1, sizeof(*p));
+    snprintf(p->name, sizeof(p->name), "%s:%u",
+             inet_ntoa(addr.sin_addr), ntohs(addr.sin_port));
+
+    uint32_t ring = srq ? 0 : cfg->max_recv_wr;
+    p->rc = rdma_conn_create_srq(dev, cfg, cq, srq);
+    p->ring = calloc(ring + 1, sizeof(*p->ring));
+    while (p->ring && p->ring_len < ring &&
+           (p->ring[p->ring_len] = rdma_pool_get(pool)))
+        p->ring_len++;
+    if (!p->rc || p->ring_len < ring) {
+        ERR("peer %s setup failed", p->name);
+        close(conn);
+        peer_free(p);
+        return;
+    }
+
+    /* the receive ring is live before the client can send */
+    for (uint32_t i = 0; i < ring; i++) {
+        if (post_recv(p, slot, i)) {
+            ERR("ibv_post_recv failed");
+            close(conn);
+            peer_free(p);
+            return;
+        }
+    }
+
+    if (rdma_conn_handshake(p->rc, conn, RDMA_ROLE_SERVER)) {
+        ERR("peer %s handshake failed", p->name);
+        peer_free(p);
+        return;
+    }
+
+    p->start_ns = rdma_now_ns();
+    peers[slot] = p;
+    nr_peers++;
+    qpn_index_rebuild();
+    LOG("Peer %s connected slot=%d qpn=%u remote qpn=%u (%d active)",
+        p->name, slot, p->rc->qp->qp_num, p->rc->remote.qp_num, nr_peers);
+}
+
+static int handle_srq_wc(struct ibv_wc *wc) {
+    /* the buffer belongs to the SRQ whatever became of the QP */
+    pending[npending++] = wc->wr_id;
+    srq_consumed++;
+    if (srq_posted - srq_consumed <= srq_limit && srq_refill())
+        return -1;
+
+    struct peer *p = peer_by_qpn(wc->qp_num);
+    if (!p)
+        return 0;
+    if (wc->status != IBV_WC_SUCCESS) {
+        if (wc->status != IBV_WC_WR_FLUSH_ERR)
+            LOG("Peer %s WC error %s", p->name, ibv_wc_status_str(wc->status));
+        return 0;
+    }
+    p->msgs++;
+    p->bytes += wc->byte_len;
+    return 0;
+}
+
+static int handle_wc(void *arg, struct ibv_wc *wc) {
+    (void)arg;
+    if (srq)
+        return handle_srq_wc(wc);
+
+    uint32_t slot = WR_SLOT(wc->wr_id);
+    struct peer *p = slot < MAX_CONNS ? peers[slot] : NULL;
+
+    /* completions of a peer that already left: its QP is gone */
+    if (!p || p->rc->qp->qp_num != wc->qp_num)
+        return 0;
+
+    if (wc->status != IBV_WC_SUCCESS) {
+        if (wc->status != IBV_WC_WR_FLUSH_ERR)
+            LOG("Peer %s WC error %s", p->name, ibv_wc_status_str(wc->status));
+        return 0;
+    }
+
+    p->msgs++;
+    p->bytes += wc->byte_len;
+    if (post_recv(p, slot, WR_IDX(wc->wr_id)))
+        ERR("re-post recv for %s failed", p->name);
+    return 0;
+}
+
+static void drain_cq(struct rdma_poller *poller) {
+    while (rdma_poller_poll(poller) > 0);
+}
+
+/* a readable peer socket means the client closed it */
+static void check_peers(struct rdma_poller *poller) {
+    struct pollfd pfd[MAX_CONNS];
+    int slots[MAX_CONNS], n = 0;
+
+    for (int i = 0; i < MAX_CONNS; i++) {
+        if (!peers[i])
+            continue;
+        pfd[n].fd = peers[i]->rc->sock;
+        pfd[n].events = POLLIN;
+        slots[n++] = i;
+    }
+    if (!n || poll(pfd, n, 0) <= 0)
+        return;
+
+    for (int i = 0; i < n; i++) {
+        if (!pfd[i].revents)
+            continue;
+        char c;
+        if (read(pfd[i].fd, &c, 1) > 0)
+            continue;
+
+        /* the last sends were acked before the client closed */
+        drain_cq(poller);
+        struct peer *p = peers[slots[i]];
+        peer_report(p, "Peer done");
+        peers[slots[i]] = NULL;
+        nr_peers--;
+        qpn_index_rebuild();
+        peer_free(p);
+    }
+}
+
+static void report(const struct rdma_cfg *cfg, uint64_t interval_ns, int verbose) {
+    uint64_t msgs = 0, bytes = 0;
+    double sec = interval_ns / 1e9;
+
+    for (int i = 0; i < MAX_CONNS; i++) {
+        struct peer *p = peers[i];
+        if (!p)
+            continue;
+        uint64_t dm = p->msgs - p->last_msgs;
+        uint64_t db = p->bytes - p->last_bytes;
+        p->last_msgs = p->msgs;
+        p->last_bytes = p->bytes;
+        msgs += dm;
+        bytes += db;
+        if (verbose)
+            LOG("  %-21s %10.0f msgs/s %10.2f MB/s", p->name, dm / sec, db / sec / 1e6);
+    }
+    if (!nr_peers)
+        return;
+
+    /* receive memory registered for all MAX_CONNS rings or the SRQ, and how much of it is posted */
+    uint64_t rx_bufs = srq ? srq_depth : (uint64_t)nr_peers * cfg->max_recv_wr;
+    LOG("Aggregate: %d conns %.0f msgs/s %.2f MB/s, rx memory %.2f MB registered (%u buffers), "
+        "%lu posted", nr_peers, msgs / sec, bytes / sec / 1e6,
+        (double)pool->nbufs * pool->buf_size / 1e6, pool->nbufs, rx_bufs);
+    if (srq)
+        LOG("  SRQ: %lu posted, %u pending refill, %lu limit events",
+            srq_posted - srq_consumed, npending, srq_limit_events);
+}
+
+static void usage(const char *prog) {
+    printf("Usage: %s [options]\n"
+           "  -s <bytes>   receive buffer size (default: %d)\n"
+           "  -i <sec>     report interval (default: 1)\n"
+           "  -v           per-connection throughput in every report\n"
+           "  -S <wr>      share one SRQ of wr receives between all QPs instead of --rq-depth each\n"
+           "  -L <wr>      refill the SRQ when fewer than wr receives remain (default: -S / 4)\n",
+           prog, MSG_SIZE);
+    rdma_cfg_usage();
+}
+
+int main(int argc, char **argv) {
+    struct rdma_cfg cfg;
+    rdma_cfg_init(&cfg);
+    cfg.max_recv_wr = 64;
+    int interval = 1, verbose = 0;
+
+    static const struct option opts[] = {
+        RDMA_CFG_LONG_OPTIONS,
+        {NULL, 0, NULL, 0}
+    };
+    int c;
+    while ((c = getopt_long(argc, argv, "s:i:vS:L:", opts, NULL)) != -1) {
+        switch (c) {
+        case 'S': srq_depth = atoi(optarg); break;
+        case 'L': srq_limit = atoi(optarg); break;
+        case 's': msg_size = atoi(optarg); break;
+        case 'i': interval = atoi(optarg); break;
+        case 'v': verbose = 1; break;
+        default:
+            if (rdma_cfg_parse_opt(&cfg, c, optarg)) {
+                usage(argv[0]);
+                return 1;
+            }
+        }
+    }
+
+    LOG("Start");
+
+    struct rdma_dev *dev = rdma_dev_open(&cfg);
+    if (!dev)
+        return 1;
+
+    if (srq_depth && !srq_limit)
+        srq_limit = srq_depth / 4;
+
+    /* one CQ for every peer: room for all of their receive rings, or the SRQ */
+    int rx = srq_depth ? (int)srq_depth : MAX_CONNS * (int)cfg.max_recv_wr;
+    int depth = cfg.cq_depth ? cfg.cq_depth : rx + MAX_CONNS * (int)cfg.max_send_wr;
+    if (depth > dev->attr.max_cqe)
+        depth = dev->attr.max_cqe;
+    struct ibv_cq *cq = ibv_create_cq(dev->ctx, depth, NULL, NULL, 0);
+    if (!cq) {
+        ERR("ibv_create_cq depth %d failed", depth);
+        return 1;
+    }
+    pool = rdma_pool_create(dev->pd, msg_size, rx, IBV_ACCESS_LOCAL_WRITE);
+    if (!pool)
+        return 1;
+    qpn_index_rebuild();
+    if (srq_depth) {
+        if (srq_create(dev))
+            return 1;
+        LOG("Shared CQ depth=%d, SRQ depth=%u refilled below %u", depth, srq_depth, srq_limit);
+    } else {
+        LOG("Shared CQ depth=%d, rq depth=%u per peer", depth, cfg.max_recv_wr);
+    }
+
+    int lsock = rdma_tcp_listen(cfg.tcp_port, MAX_CONNS);
+    if (lsock < 0)
+        return 1;
+    fcntl(lsock, F_SETFL, fcntl(lsock, F_GETFL) | O_NONBLOCK);
+    LOG("Listening on port %u", cfg.tcp_port);
+
+    struct rdma_poller poller;
+    rdma_poller_init(&poller, cq, cfg.poll_batch, handle_wc, NULL);
+    poller.hist_on = cfg.cq_hist;
+
+    uint64_t last_check = rdma_now_ns(), last_report = last_check;
+    for (;;) {
+        drain_cq(&poller);
+
+        uint64_t now = rdma_now_ns();
+        if (now - last_check < SOCK_CHECK_NS)
+            continue;
+        last_check = now;
+
+        accept_peer(dev, &cfg, cq, lsock);
+        check_peers(&poller);
+        if (srq)
+            check_async(dev);
+
+        if (now - last_report >= (uint64_t)interval * 1000000000ull) {
+            report(&cfg, now - last_report, verbose);
+            if (poller.hist_on && nr_peers)
+                rdma_poller_print_hist(&poller);
+            last_report = now;
+        }
+    }
+
+    return 0;
+}
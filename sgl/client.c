@@ -0,0 +1,243 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <arpa/inet.h>
+#include <infiniband/verbs.h>
+#include "rdma_conn.h"
+#include "rdma_poll.h"
+#include "rdma_pool.h"
+#include "rdma_sgl.h"
+#include "rdma_bench.h"
+#include "sgl_proto.h"
+
+#define LOG(fmt, ...)  printf("[CLIENT] " fmt "\n", ##__VA_ARGS__)
+#define ERR(fmt, ...)  printf("[CLIENT][ERR] " fmt " (errno=%d:%s)\n", ##__VA_ARGS__, errno, strerror(errno))
+
+struct cli {
+    struct sgl_hello    hello;
+    struct rdma_conn   *rc[MODE_NR];
+    struct rdma_poller  poller[MODE_NR];
+    struct rdma_pool   *app;        /* the application's payloads, never copied in MODE_SGE */
+    struct rdma_pool   *hdr;
+    struct rdma_pool   *stage;      /* MODE_COPY: header + payload, contiguous */
+    uint32_t            signal_every;
+    uint64_t            completed;
+};
+
+struct result {
+    uint64_t ns;
+    uint64_t prep_ns;               /* building WRs, copies included */
+    struct sgl_result srv;
+};
+
+static int wc_done(void *arg, struct ibv_wc *wc) {
+    struct cli *cl = arg;
+
+    if (wc->status != IBV_WC_SUCCESS) {
+        ERR("WR %lu failed status=%s", wc->wr_id, ibv_wc_status_str(wc->status));
+        return -1;
+    }
+    /* signaled every signal_every: retires the unsignaled WRs before it */
+    cl->completed = wc->wr_id + 1;
+    return 0;
+}
+
+static int run(struct cli *cl, int sock, int mode, uint32_t size, double cpns, struct result *res) {
+    const struct sgl_hello *h = &cl->hello;
+    struct rdma_conn *rc = cl->rc[mode];
+    enum ibv_wr_opcode op = h->test == TEST_SEND ? IBV_WR_SEND : IBV_WR_RDMA_WRITE;
+    struct sgl_run r = { .mode = mode, .size = size };
+    uint64_t prep = 0;
+
+    if (rdma_sock_write(sock, &r, sizeof(r)))
+        return -1;
+    cl->completed = 0;
+
+    uint64_t t0 = rdma_now_ns();
+    for (uint64_t seq = 0; seq < h->iters; seq++) {
+        while (seq - cl->completed >= h->depth) {
+            if (rdma_poller_poll(&cl->poller[mode]) < 0)
+                return -1;
+        }
+        /* slot i was last used by WR seq - depth, which has completed */
+        uint32_t i = seq % h->depth;
+        struct rdma_buf *app = &cl->app->bufs[i], *hb = &cl->hdr->bufs[i];
+        struct rdma_sgl l;
+
+        uint64_t c0 = rdma_cycles();
+        struct sgl_hdr *hdr = hb->addr;
+        hdr->seq = seq;
+        hdr->len = size;
+        rdma_sgl_reset(&l);
+        if (mode == MODE_COPY) {
+            char *msg = cl->stage->bufs[i].addr;
+            memcpy(msg, hdr, SGL_HDR);
+            memcpy(msg + SGL_HDR, app->addr, size);
+            rdma_sgl_add(&l, msg, SGL_HDR + size, cl->stage->bufs[i].lkey);
+        } else {
+            rdma_sgl_add(&l, hdr, SGL_HDR, hb->lkey);
+            rdma_sgl_add(&l, app->addr, size, app->lkey);
+        }
+        prep += rdma_cycles() - c0;
+
+        int signal = (seq + 1) % cl->signal_every == 0 || seq + 1 == h->iters;
+        if (rdma_post_sgl(rc, op, &l, seq, signal ? IBV_SEND_SIGNALED : 0,
+                          rc->remote.addr, rc->remote.rkey, 0))
+            return -1;
+    }
+    while (cl->completed < h->iters) {
+        if (rdma_poller_poll(&cl->poller[mode]) < 0)
+            return -1;
+    }
+    res->ns = rdma_now_ns() - t0;
+    res->prep_ns = (uint64_t)(prep / cpns);
+
+    /* a WRITE's completion means it is placed; the server then checks the last header */
+    char done = 1;
+    if (h->test == TEST_WRITE && rdma_sock_write(sock, &done, 1))
+        return -1;
+    return rdma_sock_read(sock, &res->srv, sizeof(res->srv));
+}
+
+static void usage(const char *prog) {
+    printf("Usage: %s [options] <server_ip>\n"
+           "  -t <test>    send | write (default: send)\n"
+           "  -s <bytes>   payload size (default: 1M)\n"
+           "  -a           sweep payloads 4K .. -s in powers of two\n"
+           "  -n <iters>   messages per size and mode (default: 5000)\n"
+           "  -D <n>       messages in flight, receives posted per QP (default: 16)\n"
+           "  every size runs twice: copy (header + payload memcpy'd into one SGE) and\n"
+           "  sge (header and payload gathered from their own buffers, scattered on receive)\n",
+           prog);
+    rdma_cfg_usage();
+}
+
+int main(int argc, char **argv) {
+    struct rdma_cfg cfg;
+    rdma_cfg_init(&cfg);
+    cfg.max_recv_wr = 1;
+    cfg.access_flags = IBV_ACCESS_LOCAL_WRITE;
+
+    struct cli cl;
+    memset(&cl, 0, sizeof(cl));
+    struct sgl_hello *h = &cl.hello;
+    h->test = TEST_SEND;
+    h->max_size = 1 << 20;
+    h->iters = 5000;
+    h->depth = 16;
+    int sweep = 0;
+
+    static const struct option opts[] = {
+        RDMA_CFG_LONG_OPTIONS,
+        {NULL, 0, NULL, 0}
+    };
+    int c;
+    while ((c = getopt_long(argc, argv, "t:s:an:D:", opts, NULL)) != -1) {
+        switch (c) {
+        case 't':
+            if ((c = sgl_parse_test(optarg)) < 0) {
+                usage(argv[0]);
+                return 1;
+            }
+            h->test = c;
+            break;
+        case 's': h->max_size = rdma_parse_size(optarg); break;
+        case 'a': sweep = 1; break;
+        case 'n': h->iters = atoi(optarg); break;
+        case 'D': h->depth = atoi(optarg); break;
+        default:
+            if (rdma_cfg_parse_opt(&cfg, c, optarg)) {
+                usage(argv[0]);
+                return 1;
+            }
+        }
+    }
+    h->min_size = sweep && h->max_size > 4096 ? 4096 : h->max_size;
+    if (optind >= argc || !h->max_size || !h->iters || !h->depth) {
+        usage(argv[0]);
+        return 1;
+    }
+    cfg.max_send_wr = h->depth;
+    if (cfg.max_send_sge < 2)
+        cfg.max_send_sge = 2;
+    cl.signal_every = h->depth / 2 ? h->depth / 2 : 1;
+
+    LOG("Start");
+    double cpns = rdma_cycles_per_ns();
+
+    struct rdma_dev *dev = rdma_dev_open(&cfg);
+    if (!dev)
+        return 1;
+
+    cl.app = rdma_pool_create(dev->pd, h->max_size, h->depth, IBV_ACCESS_LOCAL_WRITE);
+    cl.hdr = rdma_pool_create(dev->pd, SGL_HDR, h->depth, IBV_ACCESS_LOCAL_WRITE);
+    cl.stage = rdma_pool_create(dev->pd, SGL_HDR + h->max_size, h->depth, IBV_ACCESS_LOCAL_WRITE);
+    if (!cl.app || !cl.hdr || !cl.stage)
+        return 1;
+    for (uint32_t i = 0; i < h->depth; i++)
+        memset(cl.app->bufs[i].addr, 'a' + i % 26, h->max_size);
+
+    int sock0 = -1;
+    for (int m = 0; m < MODE_NR; m++) {
+        cl.rc[m] = rdma_conn_create(dev, &cfg, NULL);
+        if (!cl.rc[m])
+            return 1;
+        if (cl.rc[m]->cfg.max_send_sge < 2) {
+            LOG("Device takes %u SGEs per send", cl.rc[m]->cfg.max_send_sge);
+            return 1;
+        }
+        rdma_poller_init(&cl.poller[m], cl.rc[m]->send_cq, cfg.poll_batch, wc_done, &cl);
+
+        int sock = rdma_tcp_connect(argv[optind], cfg.tcp_port);
+        if (sock < 0)
+            return 1;
+        if (!m) {
+            sock0 = sock;
+            if (rdma_sock_write(sock, h, sizeof(*h)))
+                return 1;
+        }
+        if (rdma_conn_handshake(cl.rc[m], sock, RDMA_ROLE_CLIENT))
+            return 1;
+    }
+    LOG("%s: one QP per mode -> RTS, %u in flight, %u iters per size",
+        h->test == TEST_SEND ? "send" : "write", h->depth, h->iters);
+
+    printf(" %-10s %-6s %-10s %-12s %-12s %-12s\n",
+           "#bytes", "mode", "BW[GB/s]", "tx[ns/msg]", "rx[ns/msg]", "saved[ns/msg]");
+    for (uint32_t size = h->min_size; size <= h->max_size; size *= 2) {
+        struct result res[MODE_NR];
+        for (int m = 0; m < MODE_NR; m++) {
+            if (run(&cl, sock0, m, size, cpns, &res[m]))
+                return 1;
+            if (res[m].srv.bad)
+                LOG("  %lu messages arrived with a bad header", res[m].srv.bad);
+        }
+        double cost[MODE_NR];
+        for (int m = 0; m < MODE_NR; m++) {
+            struct result *r = &res[m];
+            double tx = (double)r->prep_ns / h->iters, rx = (double)r->srv.copy_ns / h->iters;
+            cost[m] = tx + rx;
+            printf(" %-10u %-6s %-10.3f %-12.1f %-12.1f", size, sgl_mode_name(m),
+                   (double)size * h->iters / r->ns, tx, rx);
+            if (m == MODE_SGE)
+                printf(" %-12.1f", cost[MODE_COPY] - cost[MODE_SGE]);
+            printf("\n");
+        }
+    }
+
+    struct sgl_run end = { 0 };
+    if (rdma_sock_write(sock0, &end, sizeof(end)))
+        return 1;
+    LOG("Done");
+
+    for (int m = 0; m < MODE_NR; m++)
+        rdma_conn_destroy(cl.rc[m]);
+    rdma_pool_destroy(cl.app);
+    rdma_pool_destroy(cl.hdr);
+    rdma_pool_destroy(cl.stage);
+    rdma_dev_close(dev);
+    return 0;
+}
@@ -0,0 +1,221 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <arpa/inet.h>
+#include <infiniband/verbs.h>
+#include "rdma_conn.h"
+#include "rdma_poll.h"
+#include "rdma_pool.h"
+#include "rdma_sgl.h"
+#include "rdma_bench.h"
+#include "sgl_proto.h"
+
+#define LOG(fmt, ...)  printf("[SERVER] " fmt "\n", ##__VA_ARGS__)
+#define ERR(fmt, ...)  printf("[SERVER][ERR] " fmt " (errno=%d:%s)\n", ##__VA_ARGS__, errno, strerror(errno))
+
+struct srv {
+    struct sgl_hello    hello;
+    struct rdma_conn   *rc[MODE_NR];
+    struct rdma_poller  poller[MODE_NR];
+    struct rdma_pool   *app;        /* where the application wants its payloads */
+    struct rdma_pool   *hdr;        /* MODE_SGE: headers scatter here */
+    struct rdma_pool   *stage;      /* MODE_COPY: whole messages land here; TEST_WRITE: the region */
+
+    /* current run */
+    int                 mode;
+    uint32_t            size;
+    uint64_t            recvs;
+    uint64_t            copy_cycles;
+    uint64_t            bad;
+};
+
+/* receive i: one contiguous SGE to copy out of, or header and payload scattered apart */
+static int post_recv(struct srv *s, int mode, uint32_t i) {
+    struct rdma_sgl l;
+
+    rdma_sgl_reset(&l);
+    if (mode == MODE_COPY) {
+        rdma_sgl_add(&l, s->stage->bufs[i].addr, SGL_HDR + s->hello.max_size, s->stage->bufs[i].lkey);
+    } else {
+        rdma_sgl_add(&l, s->hdr->bufs[i].addr, SGL_HDR, s->hdr->bufs[i].lkey);
+        rdma_sgl_add(&l, s->app->bufs[i].addr, s->hello.max_size, s->app->bufs[i].lkey);
+    }
+    return rdma_post_recv_sgl(s->rc[mode], &l, i);
+}
+
+static int wc_done(void *arg, struct ibv_wc *wc) {
+    struct srv *s = arg;
+
+    if (wc->status != IBV_WC_SUCCESS) {
+        ERR("WC failed status=%s", ibv_wc_status_str(wc->status));
+        return -1;
+    }
+    if (!(wc->opcode & IBV_WC_RECV))
+        return 0;
+
+    uint32_t i = wc->wr_id;
+    const struct sgl_hdr *h;
+    if (wc->byte_len < SGL_HDR) {
+        s->bad++;
+        s->recvs++;
+        return post_recv(s, s->mode, i);
+    }
+    uint64_t t0 = rdma_cycles();
+    if (s->mode == MODE_COPY) {
+        const char *msg = s->stage->bufs[i].addr;
+        h = (const struct sgl_hdr *)msg;
+        memcpy(s->app->bufs[i].addr, msg + SGL_HDR, wc->byte_len - SGL_HDR);
+    } else {
+        h = s->hdr->bufs[i].addr;
+    }
+    s->copy_cycles += rdma_cycles() - t0;
+
+    if (wc->byte_len != SGL_HDR + s->size || h->len != s->size || h->seq != s->recvs)
+        s->bad++;
+    s->recvs++;
+    return post_recv(s, s->mode, i);
+}
+
+static void usage(const char *prog) {
+    printf("Usage: %s [options]\n"
+           "  test, sizes and depth come from the client\n", prog);
+    rdma_cfg_usage();
+}
+
+int main(int argc, char **argv) {
+    struct rdma_cfg cfg;
+    rdma_cfg_init(&cfg);
+    cfg.max_send_wr = 16;
+    cfg.access_flags = IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_WRITE;
+
+    static const struct option opts[] = {
+        RDMA_CFG_LONG_OPTIONS,
+        {NULL, 0, NULL, 0}
+    };
+    int c;
+    while ((c = getopt_long(argc, argv, "", opts, NULL)) != -1) {
+        if (rdma_cfg_parse_opt(&cfg, c, optarg)) {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    /* header + payload */
+    if (cfg.max_send_sge < 2)
+        cfg.max_send_sge = 2;
+    if (cfg.max_recv_sge < 2)
+        cfg.max_recv_sge = 2;
+
+    LOG("Start");
+
+    struct rdma_dev *dev = rdma_dev_open(&cfg);
+    if (!dev)
+        return 1;
+
+    int lsock = rdma_tcp_listen(cfg.tcp_port, MODE_NR);
+    if (lsock < 0)
+        return 1;
+    int sock[MODE_NR];
+    struct srv s;
+    memset(&s, 0, sizeof(s));
+    sock[0] = accept(lsock, NULL, NULL);
+    if (sock[0] < 0 || rdma_sock_read(sock[0], &s.hello, sizeof(s.hello))) {
+        ERR("accept failed");
+        return 1;
+    }
+    struct sgl_hello *h = &s.hello;
+    if (h->test > TEST_WRITE || !h->min_size || h->min_size > h->max_size || !h->iters || !h->depth) {
+        LOG("Bad hello");
+        return 1;
+    }
+    LOG("%s: sizes %u..%u, %u iters, depth %u",
+        h->test == TEST_SEND ? "send" : "write", h->min_size, h->max_size, h->iters, h->depth);
+
+    cfg.max_recv_wr = h->depth;
+    s.app = rdma_pool_create(dev->pd, h->max_size, h->depth, IBV_ACCESS_LOCAL_WRITE);
+    s.hdr = rdma_pool_create(dev->pd, SGL_HDR, h->depth, IBV_ACCESS_LOCAL_WRITE);
+    s.stage = rdma_pool_create(dev->pd, SGL_HDR + h->max_size, h->depth, cfg.access_flags);
+    if (!s.app || !s.hdr || !s.stage)
+        return 1;
+
+    for (int m = 0; m < MODE_NR; m++) {
+        if (m && (sock[m] = accept(lsock, NULL, NULL)) < 0) {
+            ERR("accept failed");
+            return 1;
+        }
+        s.rc[m] = rdma_conn_create(dev, &cfg, NULL);
+        if (!s.rc[m]) {
+            close(sock[m]);
+            return 1;
+        }
+        /* rc owns the socket: rdma_conn_destroy closes it, sock[1] included */
+        s.rc[m]->sock = sock[m];
+        if (s.rc[m]->cfg.max_recv_sge < 2) {
+            LOG("Device takes %u SGEs per receive", s.rc[m]->cfg.max_recv_sge);
+            return 1;
+        }
+        rdma_poller_init(&s.poller[m], s.rc[m]->recv_cq, cfg.poll_batch, wc_done, &s);
+        for (uint32_t i = 0; h->test == TEST_SEND && i < h->depth; i++) {
+            if (post_recv(&s, m, i))
+                return 1;
+        }
+        /* WRITEs land in the first staging buffer whatever the mode */
+        s.rc[m]->local.addr = (uintptr_t)s.stage->bufs[0].addr;
+        s.rc[m]->local.rkey = s.stage->bufs[0].rkey;
+        s.rc[m]->local.len = SGL_HDR + h->max_size;
+        if (rdma_conn_handshake(s.rc[m], sock[m], RDMA_ROLE_SERVER))
+            return 1;
+    }
+    LOG("%d QPs -> RTS", MODE_NR);
+
+    double cpn = rdma_cycles_per_ns();
+    for (;;) {
+        struct sgl_run run;
+        if (rdma_sock_read(sock[0], &run, sizeof(run)))
+            return 1;
+        if (!run.size)
+            break;
+        if (run.mode >= MODE_NR || run.size > h->max_size) {
+            LOG("Bad run");
+            return 1;
+        }
+        s.mode = run.mode;
+        s.size = run.size;
+        s.recvs = 0;
+        s.copy_cycles = 0;
+        s.bad = 0;
+
+        if (h->test == TEST_SEND) {
+            while (s.recvs < h->iters) {
+                if (rdma_poller_poll(&s.poller[s.mode]) < 0)
+                    return 1;
+            }
+        } else {
+            char done;
+            if (rdma_sock_read(sock[0], &done, 1))
+                return 1;
+            const struct sgl_hdr *last = s.stage->bufs[0].addr;
+            if (last->len != run.size || last->seq != h->iters - 1)
+                s.bad++;
+        }
+
+        struct sgl_result res = {
+            .copy_ns = (uint64_t)(s.copy_cycles / cpn),
+            .bad = s.bad
+        };
+        if (rdma_sock_write(sock[0], &res, sizeof(res)))
+            return 1;
+    }
+    LOG("Done");
+
+    for (int m = 0; m < MODE_NR; m++)
+        rdma_conn_destroy(s.rc[m]);
+    rdma_pool_destroy(s.app);
+    rdma_pool_destroy(s.hdr);
+    rdma_pool_destroy(s.stage);
+    close(lsock);
+    rdma_dev_close(dev);
+    return 0;
+}
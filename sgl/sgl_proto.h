@@ -0,0 +1,58 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+
+#define SGL_HDR 64
+
+enum sgl_test {
+    TEST_SEND,              /* SEND into pre-posted receives */
+    TEST_WRITE,             /* RDMA WRITE into the server's region */
+};
+
+/* how a header plus a payload in its own buffer become one message */
+enum sgl_mode {
+    MODE_COPY,              /* memcpy both into a bounce buffer, one SGE; the receiver copies out */
+    MODE_SGE,               /* gather header + payload, scatter them into their own buffers */
+    MODE_NR,
+};
+
+/* the application header that travels in front of every payload */
+struct sgl_hdr {
+    uint64_t seq;
+    uint32_t len;
+    uint32_t rsvd;
+    uint8_t  pad[SGL_HDR - 16];
+};
+
+/* client -> server, before the handshake; one QP per mode */
+struct sgl_hello {
+    uint32_t test;
+    uint32_t min_size;
+    uint32_t max_size;
+    uint32_t iters;
+    uint32_t depth;         /* messages in flight, receives per QP */
+};
+
+/* client -> server before every run */
+struct sgl_run {
+    uint32_t mode;
+    uint32_t size;
+};
+
+/* server -> client after every run */
+struct sgl_result {
+    uint64_t copy_ns;       /* receiver time spent delivering payloads */
+    uint64_t bad;           /* messages whose header did not match */
+};
+
+static inline int sgl_parse_test(const char *s) {
+    if (!strcmp(s, "send"))
+        return TEST_SEND;
+    if (!strcmp(s, "write"))
+        return TEST_WRITE;
+    return -1;
+}
+
+static inline const char *sgl_mode_name(int mode) {
+    return mode == MODE_COPY ? "copy" : "sge";
+}
@@ -0,0 +1,219 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <arpa/inet.h>
+#include <infiniband/verbs.h>
+#include "rdma_conn.h"
+#include "rdma_poll.h"
+#include "rdma_pool.h"
+#include "rdma_sq.h"
+#include "rdma_shard.h"
+#include "shard_proto.h"
+
+#define MAX_SHARDS 64
+
+#define LOG(fmt, ...)  printf("[CLIENT] " fmt "\n", ##__VA_ARGS__)
+#define ERR(fmt, ...)  printf("[CLIENT][ERR] " fmt " (errno=%d:%s)\n", ##__VA_ARGS__, errno, strerror(errno))
+
+/* per-shard send state: one credit window and WR template per QP */
+struct tx {
+    struct rdma_sq     *sq;
+    struct ibv_send_wr *wr;
+    struct ibv_sge     *sge;
+    uint64_t           *iters;
+};
+
+static uint64_t shard_iters;
+static int signal_every = 1, batch = 1;
+
+static int send_done(void *arg, struct ibv_wc *wc) {
+    struct rdma_shard *s = arg;
+    struct tx *tx = s->arg;
+
+    for (int i = 0; i < s->nconns; i++) {
+        if (s->conns[i]->qp->qp_num == wc->qp_num)
+            return rdma_sq_complete(&tx->sq[i], wc);
+    }
+    return 0;
+}
+
+/* shard thread: send shard_iters messages spread over the shard's QPs */
+static int shard_run(struct rdma_shard *s) {
+    struct tx *tx = s->arg;
+    struct rdma_poller poller;
+    rdma_poller_init(&poller, s->cq, s->conns[0]->cfg.poll_batch, send_done, s);
+
+    for (int i = 0; i < s->nconns; i++) {
+        struct rdma_conn *rc = s->conns[i];
+        rdma_sq_init(&tx->sq[i], rc->qp, rc->cfg.max_send_wr, signal_every, batch);
+        tx->sq[i].max_inline = rc->max_inline;
+        tx->iters[i] = shard_iters / s->nconns + (i < (int)(shard_iters % s->nconns));
+    }
+
+    uint64_t start = rdma_now_ns();
+    for (;;) {
+        int busy = 0;
+        for (int i = 0; i < s->nconns; i++) {
+            struct rdma_sq *sq = &tx->sq[i];
+            if (sq->completed < tx->iters[i])
+                busy = 1;
+            if (sq->posted < tx->iters[i] &&
+                rdma_sq_post(sq, &tx->wr[i], tx->iters[i] - sq->posted) < 0)
+                return -1;
+        }
+        if (!busy)
+            break;
+        if (rdma_poller_poll(&poller) < 0)
+            return -1;
+    }
+    s->ns = rdma_now_ns() - start;
+    s->msgs = shard_iters;
+    s->bytes = shard_iters * tx->sge[0].length;
+    return 0;
+}
+
+static void usage(const char *prog) {
+    printf("Usage: %s [options] <server_ip>\n"
+           "  -t <shards>  run 1..shards sending threads, one CQ + pool each (default: 1)\n"
+           "  -C <cpus>    cores to pin shard i to, e.g. 0,2,4-7 (default: shard i on cpu i)\n"
+           "  -q <qps>     QPs per shard (default: 1)\n"
+           "  -s <bytes>   message size (default: 64)\n"
+           "  -n <msgs>    messages per shard and step (default: 1000000)\n"
+           "  -D <depth>   outstanding SENDs per QP, at most the server rq depth (default: 64)\n"
+           "  -k <n>       signal every n-th SEND (default: 1)\n"
+           "  -B <n>       SENDs per doorbell (default: 1)\n",
+           prog);
+    rdma_cfg_usage();
+}
+
+int main(int argc, char **argv) {
+    struct rdma_cfg cfg;
+    rdma_cfg_init(&cfg);
+    cfg.max_recv_wr = 1;
+    int nshards = 1, cpus[MAX_SHARDS], ncpus = 0, qps = 1;
+    uint32_t size = 64, depth = 64;
+    shard_iters = 1000000;
+
+    static const struct option opts[] = {
+        RDMA_CFG_LONG_OPTIONS,
+        {NULL, 0, NULL, 0}
+    };
+    int c;
+    while ((c = getopt_long(argc, argv, "t:C:q:s:n:D:k:B:", opts, NULL)) != -1) {
+        switch (c) {
+        case 't': nshards = atoi(optarg); break;
+        case 'C':
+            if ((ncpus = rdma_parse_cpus(optarg, cpus, MAX_SHARDS)) < 0) {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 'q': qps = atoi(optarg); break;
+        case 's': size = atoi(optarg); break;
+        case 'n': shard_iters = atol(optarg); break;
+        case 'D': depth = atoi(optarg); break;
+        case 'k': signal_every = atoi(optarg); break;
+        case 'B': batch = atoi(optarg); break;
+        default:
+            if (rdma_cfg_parse_opt(&cfg, c, optarg)) {
+                usage(argv[0]);
+                return 1;
+            }
+        }
+    }
+    if (optind >= argc || nshards < 1 || nshards > MAX_SHARDS ||
+        qps < 1 || qps > RDMA_SHARD_MAX_CONNS || !size || !depth || !shard_iters) {
+        usage(argv[0]);
+        return 1;
+    }
+    cfg.max_send_wr = depth;
+
+    LOG("Start");
+
+    struct rdma_dev *dev = rdma_dev_open(&cfg);
+    if (!dev)
+        return 1;
+
+    struct rdma_shard shards[MAX_SHARDS];
+    struct tx txs[MAX_SHARDS];
+    for (int i = 0; i < nshards; i++) {
+        int cpu = ncpus ? cpus[i % ncpus] : i;
+        if (rdma_shard_init(&shards[i], dev, i, cpu, qps * (cfg.max_send_wr + cfg.max_recv_wr),
+                            size, qps, IBV_ACCESS_LOCAL_WRITE))
+            return 1;
+        txs[i].sq = calloc(qps, sizeof(*txs[i].sq));
+        txs[i].wr = calloc(qps, sizeof(*txs[i].wr));
+        txs[i].sge = calloc(qps, sizeof(*txs[i].sge));
+        txs[i].iters = calloc(qps, sizeof(*txs[i].iters));
+    }
+
+    /* ---------- connection i lands on shard i % nshards ---------- */
+    struct shard_hello hello = { .nconns = nshards * qps, .size = size };
+    int first = -1;
+    for (uint32_t i = 0; i < hello.nconns; i++) {
+        int sock = rdma_tcp_connect(argv[optind], cfg.tcp_port);
+        if (sock < 0 || rdma_sock_write(sock, &hello, sizeof(hello)))
+            return 1;
+        if (first < 0)
+            first = sock;
+
+        struct rdma_shard *s = &shards[i % nshards];
+        struct rdma_conn *rc = rdma_shard_add_conn(s, &cfg);
+        if (!rc || rdma_conn_handshake(rc, sock, RDMA_ROLE_CLIENT))
+            return 1;
+
+        struct tx *tx = &txs[s->id];
+        int j = s->nconns - 1;
+        struct rdma_buf *b = rdma_pool_get(s->pool);
+        tx->sge[j] = (struct ibv_sge) {
+            .addr = (uintptr_t)b->addr,
+            .length = size,
+            .lkey = b->lkey
+        };
+        tx->wr[j] = (struct ibv_send_wr) {
+            .opcode = IBV_WR_SEND,
+            .sg_list = &tx->sge[j],
+            .num_sge = 1
+        };
+    }
+    LOG("%u QPs -> RTS over %d shard(s)", hello.nconns, nshards);
+    if (rdma_sock_barrier(first))
+        return 1;
+
+    /* ---------- step the number of active shards up to nshards ---------- */
+    printf(" %-8s %-8s %-10s %-14s %-12s %-10s\n",
+           "#shards", "#qps", "#bytes", "msgs/s", "BW[GB/s]", "speedup");
+    double base = 0;
+    for (int t = 1; t <= nshards; t++) {
+        for (int i = 0; i < t; i++) {
+            if (rdma_shard_start(&shards[i], shard_run, &txs[i]))
+                return 1;
+        }
+        uint64_t msgs = 0, ns = 0;
+        for (int i = 0; i < t; i++) {
+            if (rdma_shard_join(&shards[i]))
+                return 1;
+            msgs += shards[i].msgs;
+            if (shards[i].ns > ns)
+                ns = shards[i].ns;
+        }
+        double rate = msgs / (ns / 1e9);
+        if (t == 1)
+            base = rate;
+        printf(" %-8d %-8d %-10u %-14.0f %-12.3f %-10.2f\n",
+               t, t * qps, size, rate, rate * size / 1e9, rate / base);
+    }
+
+    for (int i = 0; i < nshards; i++) {
+        rdma_shard_destroy(&shards[i]);
+        free(txs[i].sq);
+        free(txs[i].wr);
+        free(txs[i].sge);
+        free(txs[i].iters);
+    }
+    rdma_dev_close(dev);
+    return 0;
+}
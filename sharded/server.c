@@ -0,0 +1,199 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <arpa/inet.h>
+#include <infiniband/verbs.h>
+#include "rdma_conn.h"
+#include "rdma_poll.h"
+#include "rdma_pool.h"
+#include "rdma_shard.h"
+#include "shard_proto.h"
+
+#define MAX_SHARDS 64
+
+#define LOG(fmt, ...)  printf("[SERVER] " fmt "\n", ##__VA_ARGS__)
+#define ERR(fmt, ...)  printf("[SERVER][ERR] " fmt " (errno=%d:%s)\n", ##__VA_ARGS__, errno, strerror(errno))
+
+static uint32_t msg_size;
+
+static int post_recv(struct rdma_shard *s, int conn, struct rdma_buf *b) {
+    struct ibv_sge sge = {
+        .addr = (uintptr_t)b->addr,
+        .length = msg_size,
+        .lkey = b->lkey
+    };
+    struct ibv_recv_wr wr = {
+        .wr_id = SHARD_WR_ID(conn, b->idx),
+        .sg_list = &sge,
+        .num_sge = 1
+    };
+    struct ibv_recv_wr *bad;
+    return ibv_post_recv(s->conns[conn]->qp, &wr, &bad);
+}
+
+static int recv_done(void *arg, struct ibv_wc *wc) {
+    struct rdma_shard *s = arg;
+
+    if (wc->status != IBV_WC_SUCCESS) {
+        if (wc->status == IBV_WC_WR_FLUSH_ERR)
+            return 0;
+        ERR("shard %d: RECV failed status=%s", s->id, ibv_wc_status_str(wc->status));
+        return -1;
+    }
+    s->msgs++;
+    s->bytes += wc->byte_len;
+    if (post_recv(s, SHARD_WR_CONN(wc->wr_id), &s->pool->bufs[SHARD_WR_BUF(wc->wr_id)])) {
+        ERR("shard %d: ibv_post_recv failed", s->id);
+        return -1;
+    }
+    return 0;
+}
+
+/* shard thread: drain the shard's CQ until told to stop */
+static int shard_run(struct rdma_shard *s) {
+    struct rdma_poller poller;
+    rdma_poller_init(&poller, s->cq, s->conns[0]->cfg.poll_batch, recv_done, s);
+
+    uint64_t start = rdma_now_ns();
+    while (!s->stop) {
+        if (rdma_poller_poll(&poller) < 0)
+            return -1;
+    }
+    s->ns = rdma_now_ns() - start;
+    return 0;
+}
+
+static void usage(const char *prog) {
+    printf("Usage: %s [options]\n"
+           "  -t <shards>  polling threads, one CQ + pool each (default: 1)\n"
+           "  -C <cpus>    cores to pin shard i to, e.g. 0,2,4-7 (default: shard i on cpu i)\n"
+           "  connection count and message size come from the client\n",
+           prog);
+    rdma_cfg_usage();
+}
+
+int main(int argc, char **argv) {
+    struct rdma_cfg cfg;
+    rdma_cfg_init(&cfg);
+    cfg.max_recv_wr = 64;
+    int nshards = 1, cpus[MAX_SHARDS], ncpus = 0;
+
+    static const struct option opts[] = {
+        RDMA_CFG_LONG_OPTIONS,
+        {NULL, 0, NULL, 0}
+    };
+    int c;
+    while ((c = getopt_long(argc, argv, "t:C:", opts, NULL)) != -1) {
+        switch (c) {
+        case 't': nshards = atoi(optarg); break;
+        case 'C':
+            if ((ncpus = rdma_parse_cpus(optarg, cpus, MAX_SHARDS)) < 0) {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        default:
+            if (rdma_cfg_parse_opt(&cfg, c, optarg)) {
+                usage(argv[0]);
+                return 1;
+            }
+        }
+    }
+    if (nshards < 1 || nshards > MAX_SHARDS) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    LOG("Start");
+
+    struct rdma_dev *dev = rdma_dev_open(&cfg);
+    if (!dev)
+        return 1;
+
+    int lsock = rdma_tcp_listen(cfg.tcp_port, RDMA_SHARD_MAX_CONNS);
+    if (lsock < 0)
+        return 1;
+
+    /* ---------- the first connection says how many follow ---------- */
+    int sock = accept(lsock, NULL, NULL);
+    struct shard_hello hello;
+    if (sock < 0 || rdma_sock_read(sock, &hello, sizeof(hello))) {
+        ERR("accept failed");
+        return 1;
+    }
+    if ((uint32_t)nshards > hello.nconns)
+        nshards = hello.nconns;         /* an idle shard would only spin */
+    uint32_t per_shard = hello.nconns ? (hello.nconns + nshards - 1) / nshards : 0;
+    if (!hello.nconns || !hello.size || per_shard > RDMA_SHARD_MAX_CONNS) {
+        LOG("Bad hello: %u conns of %u bytes", hello.nconns, hello.size);
+        return 1;
+    }
+    msg_size = hello.size;
+    LOG("%u connections, %u bytes, %d shard(s)", hello.nconns, hello.size, nshards);
+
+    struct rdma_shard shards[MAX_SHARDS];
+    for (int i = 0; i < nshards; i++) {
+        int cpu = ncpus ? cpus[i % ncpus] : i;
+        if (rdma_shard_init(&shards[i], dev, i, cpu,
+                            per_shard * (cfg.max_recv_wr + cfg.max_send_wr),
+                            msg_size, per_shard * cfg.max_recv_wr, IBV_ACCESS_LOCAL_WRITE))
+            return 1;
+    }
+
+    /* ---------- connection i lands on shard i % nshards ---------- */
+    int first = sock;
+    for (uint32_t i = 0; i < hello.nconns; i++) {
+        if (i) {
+            sock = accept(lsock, NULL, NULL);
+            if (sock < 0 || rdma_sock_read(sock, &hello, sizeof(hello))) {
+                ERR("accept failed");
+                return 1;
+            }
+        }
+        struct rdma_shard *s = &shards[i % nshards];
+        struct rdma_conn *rc = rdma_shard_add_conn(s, &cfg);
+        if (!rc)
+            return 1;
+        for (uint32_t j = 0; j < cfg.max_recv_wr; j++) {
+            if (post_recv(s, s->nconns - 1, rdma_pool_get(s->pool))) {
+                ERR("ibv_post_recv failed");
+                return 1;
+            }
+        }
+        if (rdma_conn_handshake(rc, sock, RDMA_ROLE_SERVER))
+            return 1;
+    }
+    LOG("All QPs -> RTS");
+
+    for (int i = 0; i < nshards; i++) {
+        if (rdma_shard_start(&shards[i], shard_run, NULL))
+            return 1;
+    }
+    if (rdma_sock_barrier(first))
+        return 1;
+
+    /* the client closes its sockets after the last phase */
+    char ch;
+    while (read(first, &ch, 1) > 0);
+
+    uint64_t msgs = 0, bytes = 0;
+    for (int i = 0; i < nshards; i++) {
+        shards[i].stop = 1;
+        if (rdma_shard_join(&shards[i]))
+            LOG("Shard %d failed", i);
+        LOG("Shard %d cpu %d: %d conns %lu msgs %lu bytes",
+            i, shards[i].cpu, shards[i].nconns, shards[i].msgs, shards[i].bytes);
+        msgs += shards[i].msgs;
+        bytes += shards[i].bytes;
+    }
+    LOG("Total: %lu msgs %lu bytes", msgs, bytes);
+
+    for (int i = 0; i < nshards; i++)
+        rdma_shard_destroy(&shards[i]);
+    close(lsock);
+    rdma_dev_close(dev);
+    return 0;
+}
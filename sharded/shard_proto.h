@@ -0,0 +1,17 @@
+#pragma once
+#include <stdint.h>
+
+/*
+ * Every TCP connection carries one QP. Before its qp_info exchange the
+ * client sends this on each of them; the server reads nconns from the
+ * first and then accepts the rest.
+ */
+struct shard_hello {
+    uint32_t nconns;
+    uint32_t size;          /* message size */
+};
+
+/* receive wr_id: connection index within the shard << 32 | pool buffer index */
+#define SHARD_WR_ID(conn, buf)  (((uint64_t)(conn) << 32) | (buf))
+#define SHARD_WR_CONN(wr_id)    ((uint32_t)((wr_id) >> 32))
+#define SHARD_WR_BUF(wr_id)     ((uint32_t)(wr_id))
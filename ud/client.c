@@ -0,0 +1,316 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <arpa/inet.h>
+#include <sys/resource.h>
+#include <infiniband/verbs.h>
+#include "rdma_conn.h"
+#include "rdma_poll.h"
+#include "rdma_pool.h"
+#include "rdma_hs.h"
+#include "rdma_shard.h"
+#include "rdma_ud.h"
+#include "ud_proto.h"
+
+#define MAX_THREADS 64
+
+#define LOG(fmt, ...)  printf("[CLIENT] " fmt "\n", ##__VA_ARGS__)
+#define ERR(fmt, ...)  printf("[CLIENT][ERR] " fmt " (errno=%d:%s)\n", ##__VA_ARGS__, errno, strerror(errno))
+
+/* one sending thread: its flows are f with f % threads == shard id */
+struct tx {
+    struct rdma_ud       *ud;           /* UD: the thread's only QP */
+    struct rdma_ah_entry *dest;         /* UD: the server, from the AH cache */
+    struct rdma_conn    **conns;        /* RC: one QP per flow */
+    uint32_t              nflows;
+    uint32_t              first_flow;
+    uint32_t             *seq;          /* next seq per flow */
+    uint32_t             *inflight;     /* RC: outstanding SENDs per QP */
+    uint32_t             *slot_flow;    /* send buffer -> flow it carries */
+    uint32_t             *free_slots, nfree;
+    uint64_t              posted, completed;
+};
+
+static uint32_t msg_size, threads, sq_depth;
+static uint64_t iters;
+
+static int send_done(void *arg, struct ibv_wc *wc) {
+    struct rdma_shard *s = arg;
+    struct tx *tx = s->arg;
+
+    if (wc->status != IBV_WC_SUCCESS) {
+        ERR("SEND failed status=%s", ibv_wc_status_str(wc->status));
+        return -1;
+    }
+    if (!tx->ud)
+        tx->inflight[tx->slot_flow[wc->wr_id]]--;
+    tx->free_slots[tx->nfree++] = wc->wr_id;
+    tx->completed++;
+    return 0;
+}
+
+static int post_one(struct rdma_shard *s, struct tx *tx, uint32_t f) {
+    uint32_t slot = tx->free_slots[--tx->nfree];
+    struct rdma_buf *b = &s->pool->bufs[slot];
+    struct rdma_ud_hdr *h = b->addr;
+    h->flow = tx->first_flow + f * threads;
+    h->seq = tx->seq[f]++;
+    tx->slot_flow[slot] = f;
+
+    uint32_t max_inline = tx->ud ? tx->ud->max_inline : tx->conns[f]->max_inline;
+    struct ibv_sge sge = {
+        .addr = (uintptr_t)b->addr,
+        .length = msg_size,
+        .lkey = b->lkey
+    };
+    struct ibv_send_wr wr = {
+        .wr_id = slot,
+        .opcode = IBV_WR_SEND,
+        .sg_list = &sge,
+        .num_sge = 1,
+        .send_flags = IBV_SEND_SIGNALED | (msg_size <= max_inline ? IBV_SEND_INLINE : 0)
+    }, *bad;
+    struct ibv_qp *qp;
+    if (tx->ud) {
+        rdma_ud_wr_dest(&wr, tx->dest);
+        qp = tx->ud->qp;
+    } else {
+        tx->inflight[f]++;
+        qp = tx->conns[f]->qp;
+    }
+    if (ibv_post_send(qp, &wr, &bad)) {
+        ERR("ibv_post_send failed");
+        return -1;
+    }
+    tx->posted++;
+    return 0;
+}
+
+/* shard thread: round-robin iters SENDs over the thread's flows */
+static int shard_run(struct rdma_shard *s) {
+    struct tx *tx = s->arg;
+    struct rdma_poller poller;
+    rdma_poller_init(&poller, s->cq, 16, send_done, s);
+    uint32_t cursor = 0;
+
+    uint64_t start = rdma_now_ns();
+    while (tx->completed < iters) {
+        while (tx->posted < iters && tx->nfree) {
+            /* RC flows whose send queue is full are skipped */
+            uint32_t tries = 0;
+            while (!tx->ud && tx->inflight[cursor] >= sq_depth && tries++ < tx->nflows)
+                cursor = (cursor + 1) % tx->nflows;
+            if (tries > tx->nflows)
+                break;
+            if (post_one(s, tx, cursor))
+                return -1;
+            cursor = (cursor + 1) % tx->nflows;
+        }
+        if (rdma_poller_poll(&poller) < 0)
+            return -1;
+    }
+    s->ns = rdma_now_ns() - start;
+    s->msgs = tx->completed;
+    return 0;
+}
+
+static void usage(const char *prog) {
+    printf("Usage: %s [options] <server_ip>\n"
+           "  -m <mode>    rc | ud (default: ud)\n"
+           "  -p <flows>   logical peers; RC needs a QP per flow on each side (default: 1000)\n"
+           "  -t <threads> sending threads, one CQ (and in UD one QP) each (default: 1)\n"
+           "  -s <bytes>   message size incl. the 8 byte flow/seq header, at most the MTU (default: 64)\n"
+           "  -n <msgs>    messages per thread (default: 1000000)\n"
+           "  -D <depth>   outstanding SENDs per thread (default: 128)\n"
+           "  --sq-depth   RC send queue per QP (default: 16)\n",
+           prog);
+    rdma_cfg_usage();
+}
+
+int main(int argc, char **argv) {
+    struct rdma_cfg cfg;
+    rdma_cfg_init(&cfg);
+    cfg.max_send_wr = 16;
+    cfg.max_recv_wr = 1;
+    int mode = MODE_UD;
+    uint32_t flows = 1000, depth = 128;
+    threads = 1;
+    msg_size = 64;
+    iters = 1000000;
+
+    static const struct option opts[] = {
+        RDMA_CFG_LONG_OPTIONS,
+        {NULL, 0, NULL, 0}
+    };
+    int c;
+    while ((c = getopt_long(argc, argv, "m:p:t:s:n:D:", opts, NULL)) != -1) {
+        switch (c) {
+        case 'm':
+            if ((mode = ud_parse_mode(optarg)) < 0) {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 'p': flows = atoi(optarg); break;
+        case 't': threads = atoi(optarg); break;
+        case 's': msg_size = atoi(optarg); break;
+        case 'n': iters = atol(optarg); break;
+        case 'D': depth = atoi(optarg); break;
+        default:
+            if (rdma_cfg_parse_opt(&cfg, c, optarg)) {
+                usage(argv[0]);
+                return 1;
+            }
+        }
+    }
+    if (optind >= argc || threads < 1 || threads > MAX_THREADS || flows < threads ||
+        msg_size < sizeof(struct rdma_ud_hdr) || !depth || !iters) {
+        usage(argv[0]);
+        return 1;
+    }
+    sq_depth = cfg.max_send_wr;
+
+    LOG("Start");
+
+    struct rdma_dev *dev = rdma_dev_open(&cfg);
+    if (!dev)
+        return 1;
+
+    int sock = rdma_tcp_connect(argv[optind], cfg.tcp_port);
+    struct ud_hello hello = { .mode = mode, .flows = flows, .size = msg_size, .threads = threads };
+    if (sock < 0 || rdma_sock_write(sock, &hello, sizeof(hello)))
+        return 1;
+
+    /* ---------- per-thread CQ, send buffers and QP(s) ---------- */
+    struct rdma_shard shards[MAX_THREADS];
+    struct tx txs[MAX_THREADS];
+    struct rdma_conn **all = mode == MODE_RC ? calloc(flows, sizeof(*all)) : NULL;
+    for (uint32_t i = 0; i < threads; i++) {
+        struct tx *tx = &txs[i];
+        memset(tx, 0, sizeof(*tx));
+        tx->first_flow = i;
+        tx->nflows = (flows - i + threads - 1) / threads;
+        int cq_depth = depth + (mode == MODE_RC ? tx->nflows * cfg.max_recv_wr : cfg.max_recv_wr);
+        if (rdma_shard_init(&shards[i], dev, i, i, cq_depth, msg_size, depth, IBV_ACCESS_LOCAL_WRITE))
+            return 1;
+
+        tx->seq = calloc(tx->nflows, sizeof(*tx->seq));
+        tx->inflight = calloc(tx->nflows, sizeof(*tx->inflight));
+        tx->slot_flow = calloc(depth, sizeof(*tx->slot_flow));
+        tx->free_slots = calloc(depth, sizeof(*tx->free_slots));
+        for (uint32_t j = 0; j < depth; j++)
+            tx->free_slots[tx->nfree++] = rdma_pool_get(shards[i].pool)->idx;
+
+        if (mode == MODE_UD) {
+            struct rdma_cfg ucfg = cfg;
+            ucfg.max_send_wr = depth;
+            tx->ud = rdma_ud_create(dev, &ucfg, shards[i].cq);
+            if (!tx->ud)
+                return 1;
+            if (msg_size > tx->ud->mtu) {
+                LOG("-s %u exceeds the %u byte UD MTU", msg_size, tx->ud->mtu);
+                return 1;
+            }
+        } else {
+            tx->conns = calloc(tx->nflows, sizeof(*tx->conns));
+            for (uint32_t f = 0; f < tx->nflows; f++) {
+                tx->conns[f] = rdma_conn_create(dev, &cfg, shards[i].cq);
+                if (!tx->conns[f])
+                    return 1;
+                all[i + f * threads] = tx->conns[f];
+            }
+        }
+    }
+
+    /* ---------- bootstrap ---------- */
+    uint64_t t0 = rdma_now_ns();
+    struct rdma_ah_cache ahc;
+    struct qp_info *recs = malloc(RDMA_HS_MAX_BATCH * sizeof(*recs));
+    if (mode == MODE_UD) {
+        if (rdma_hs_recv(sock, NULL, recs, 1) != 1 || rdma_ah_cache_init(&ahc, dev, &cfg, 16))
+            return 1;
+        struct rdma_ah_entry *server = rdma_ah_lookup(&ahc, &recs[0]);
+        if (!server)
+            return 1;
+        for (uint32_t i = 0; i < threads; i++) {
+            txs[i].dest = server;
+            recs[i] = txs[i].ud->local;
+        }
+        if (rdma_hs_send(sock, 0, recs, threads))
+            return 1;
+    } else {
+        for (uint32_t done = 0, seq = 0; done < flows; seq++) {
+            uint32_t n = flows - done < RDMA_HS_MAX_BATCH ? flows - done : RDMA_HS_MAX_BATCH;
+            for (uint32_t i = 0; i < n; i++)
+                recs[i] = all[done + i]->local;
+            if (rdma_hs_send(sock, seq, recs, n) || rdma_hs_recv(sock, NULL, recs, n) != (int)n)
+                return 1;
+            for (uint32_t i = 0; i < n; i++)
+                all[done + i]->remote = recs[i];
+            done += n;
+        }
+        if (rdma_conn_connect_many(all, flows, 4))
+            return 1;
+    }
+    uint64_t setup_ns = rdma_now_ns() - t0;
+    if (rdma_sock_barrier(sock))
+        return 1;
+    LOG("%s: %u flows over %u QP(s), bootstrap %.2f ms",
+        mode == MODE_UD ? "UD" : "RC", flows, mode == MODE_UD ? threads : flows, setup_ns / 1e6);
+
+    /* ---------- run ---------- */
+    for (uint32_t i = 0; i < threads; i++) {
+        if (rdma_shard_start(&shards[i], shard_run, &txs[i]))
+            return 1;
+    }
+    uint64_t msgs = 0, ns = 0;
+    for (uint32_t i = 0; i < threads; i++) {
+        if (rdma_shard_join(&shards[i]))
+            return 1;
+        msgs += shards[i].msgs;
+        if (shards[i].ns > ns)
+            ns = shards[i].ns;
+    }
+
+    struct ud_stats st;
+    char ch = 0;
+    if (rdma_sock_write(sock, &ch, 1) || rdma_sock_read(sock, &st, sizeof(st)))
+        return 1;
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+
+    printf(" %-5s %-8s %-8s %-8s %-8s %-12s %-12s %-8s %-10s %-12s %-12s\n",
+           "#mode", "#flows", "#bytes", "cli_qps", "srv_qps", "sent/s", "rcvd/s",
+           "loss[%]", "srv_rx[MB]", "cli_rss[KB]", "srv_rss[KB]");
+    printf(" %-5s %-8u %-8u %-8u %-8lu %-12.0f %-12.0f %-8.3f %-10.2f %-12ld %-12lu\n",
+           mode == MODE_UD ? "ud" : "rc", flows, msg_size, mode == MODE_UD ? threads : flows,
+           st.qps, msgs / (ns / 1e9), st.ns ? st.msgs / (st.ns / 1e9) : 0.0,
+           msgs ? 100.0 * (msgs - st.msgs) / msgs : 0.0, st.rx_bytes / 1e6,
+           ru.ru_maxrss, st.maxrss_kb);
+    if (st.reordered)
+        LOG("Server saw %lu reordered messages", st.reordered);
+
+    if (mode == MODE_UD)
+        rdma_ah_cache_destroy(&ahc);
+    for (uint32_t i = 0; i < threads; i++) {
+        struct tx *tx = &txs[i];
+        if (tx->ud)
+            rdma_ud_destroy(tx->ud);
+        for (uint32_t f = 0; tx->conns && f < tx->nflows; f++)
+            rdma_conn_destroy(tx->conns[f]);
+        rdma_shard_destroy(&shards[i]);
+        free(tx->conns);
+        free(tx->seq);
+        free(tx->inflight);
+        free(tx->slot_flow);
+        free(tx->free_slots);
+    }
+    free(all);
+    free(recs);
+    close(sock);
+    rdma_dev_close(dev);
+    return 0;
+}
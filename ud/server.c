@@ -0,0 +1,274 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <getopt.h>
+#include <arpa/inet.h>
+#include <sys/resource.h>
+#include <infiniband/verbs.h>
+#include "rdma_conn.h"
+#include "rdma_poll.h"
+#include "rdma_pool.h"
+#include "rdma_hs.h"
+#include "rdma_ud.h"
+#include "ud_proto.h"
+
+#define SOCK_CHECK_NS  1000000ull
+
+#define LOG(fmt, ...)  printf("[SERVER] " fmt "\n", ##__VA_ARGS__)
+#define ERR(fmt, ...)  printf("[SERVER][ERR] " fmt " (errno=%d:%s)\n", ##__VA_ARGS__, errno, strerror(errno))
+
+struct rx_ctx {
+    struct ud_hello    hello;
+    struct rdma_pool  *pool;
+    uint32_t           buf_len;
+    uint32_t           offset;      /* RDMA_UD_GRH in UD mode */
+    struct rdma_ud    *ud;
+    struct rdma_conn **conns;       /* RC: conns[i] owns buffers [i * ring, (i + 1) * ring) */
+    uint32_t           ring;
+    uint32_t          *next_seq;    /* per flow */
+    struct ud_stats    st;
+    uint64_t           first_ns, last_ns;
+};
+
+static int post_recv(struct rx_ctx *rx, uint32_t idx) {
+    struct rdma_buf *b = &rx->pool->bufs[idx];
+    struct ibv_sge sge = {
+        .addr = (uintptr_t)b->addr,
+        .length = rx->buf_len,
+        .lkey = b->lkey
+    };
+    struct ibv_recv_wr wr = {
+        .wr_id = idx,
+        .sg_list = &sge,
+        .num_sge = 1
+    };
+    struct ibv_recv_wr *bad;
+    struct ibv_qp *qp = rx->ud ? rx->ud->qp : rx->conns[idx / rx->ring]->qp;
+    return ibv_post_recv(qp, &wr, &bad);
+}
+
+static int recv_done(void *arg, struct ibv_wc *wc) {
+    struct rx_ctx *rx = arg;
+
+    if (wc->status != IBV_WC_SUCCESS) {
+        if (wc->status == IBV_WC_WR_FLUSH_ERR)
+            return 0;
+        ERR("RECV failed status=%s", ibv_wc_status_str(wc->status));
+        return -1;
+    }
+
+    const struct rdma_ud_hdr *h =
+        (const struct rdma_ud_hdr *)((char *)rx->pool->bufs[wc->wr_id].addr + rx->offset);
+    if (h->flow < rx->hello.flows) {
+        uint32_t *next = &rx->next_seq[h->flow];
+        if (h->seq >= *next) {
+            rx->st.lost += h->seq - *next;
+            *next = h->seq + 1;
+        } else {
+            rx->st.reordered++;
+        }
+    }
+    if (!rx->st.msgs)
+        rx->first_ns = rdma_now_ns();
+    rx->last_ns = rdma_now_ns();
+    rx->st.msgs++;
+    rx->st.bytes += wc->byte_len - rx->offset;
+
+    if (post_recv(rx, wc->wr_id)) {
+        ERR("ibv_post_recv failed");
+        return -1;
+    }
+    return 0;
+}
+
+/* RC: one QP per flow, qp_info swapped in batches the client sends first */
+static int setup_rc(struct rx_ctx *rx, struct rdma_dev *dev, struct rdma_cfg *cfg,
+                    struct ibv_cq *cq, int sock) {
+    uint32_t n = rx->hello.flows;
+    rx->ring = cfg->max_recv_wr;
+    rx->conns = calloc(n, sizeof(*rx->conns));
+    rx->pool = rdma_pool_create(dev->pd, rx->buf_len, n * rx->ring, IBV_ACCESS_LOCAL_WRITE);
+    if (!rx->conns || !rx->pool)
+        return -1;
+
+    struct qp_info *recs = malloc(RDMA_HS_MAX_BATCH * sizeof(*recs));
+    for (uint32_t done = 0; done < n;) {
+        uint32_t seq;
+        int got = rdma_hs_recv(sock, &seq, recs, RDMA_HS_MAX_BATCH);
+        if (got <= 0 || done + got > n)
+            return -1;
+        for (int i = 0; i < got; i++) {
+            struct rdma_conn *rc = rdma_conn_create(dev, cfg, cq);
+            if (!rc)
+                return -1;
+            rx->conns[done + i] = rc;
+            rc->remote = recs[i];
+            recs[i] = rc->local;
+            for (uint32_t j = 0; j < rx->ring; j++) {
+                if (post_recv(rx, (done + i) * rx->ring + j))
+                    return -1;
+            }
+        }
+        if (rdma_conn_connect_many(&rx->conns[done], got, 4) ||
+            rdma_hs_send(sock, seq, recs, got))
+            return -1;
+        done += got;
+    }
+    free(recs);
+    rx->st.qps = n;
+    return 0;
+}
+
+/* UD: a single QP and one receive ring for every flow */
+static int setup_ud(struct rx_ctx *rx, struct rdma_dev *dev, struct rdma_cfg *cfg,
+                    struct ibv_cq *cq, int sock, uint32_t ring) {
+    cfg->max_recv_wr = ring;
+    rx->ud = rdma_ud_create(dev, cfg, cq);
+    if (!rx->ud)
+        return -1;
+    if (rx->hello.size > rx->ud->mtu) {
+        LOG("%u byte messages exceed the %u byte UD MTU", rx->hello.size, rx->ud->mtu);
+        return -1;
+    }
+    rx->offset = RDMA_UD_GRH;
+    rx->buf_len += RDMA_UD_GRH;
+    rx->pool = rdma_pool_create(dev->pd, rx->buf_len, ring, IBV_ACCESS_LOCAL_WRITE);
+    if (!rx->pool)
+        return -1;
+    for (uint32_t i = 0; i < ring; i++) {
+        if (post_recv(rx, rdma_pool_get(rx->pool)->idx))
+            return -1;
+    }
+
+    /* the client only needs our address; theirs is in every GRH */
+    struct qp_info recs[RDMA_HS_MAX_BATCH];
+    if (rdma_hs_send(sock, 0, &rx->ud->local, 1) ||
+        rdma_hs_recv(sock, NULL, recs, RDMA_HS_MAX_BATCH) < 0)
+        return -1;
+    rx->st.qps = 1;
+    return 0;
+}
+
+static void usage(const char *prog) {
+    printf("Usage: %s [options]\n"
+           "  -R <wr>      UD receive ring, shared by all flows (default: 4096)\n"
+           "  --rq-depth   RC receive ring per QP (default: 16)\n"
+           "  mode, flows and message size come from the client\n",
+           prog);
+    rdma_cfg_usage();
+}
+
+int main(int argc, char **argv) {
+    struct rdma_cfg cfg;
+    rdma_cfg_init(&cfg);
+    cfg.max_send_wr = 1;
+    cfg.max_recv_wr = 16;
+    cfg.max_inline_data = 0;
+    uint32_t ud_ring = 4096;
+
+    static const struct option opts[] = {
+        RDMA_CFG_LONG_OPTIONS,
+        {NULL, 0, NULL, 0}
+    };
+    int c;
+    while ((c = getopt_long(argc, argv, "R:", opts, NULL)) != -1) {
+        switch (c) {
+        case 'R': ud_ring = atoi(optarg); break;
+        default:
+            if (rdma_cfg_parse_opt(&cfg, c, optarg)) {
+                usage(argv[0]);
+                return 1;
+            }
+        }
+    }
+
+    LOG("Start");
+
+    struct rdma_dev *dev = rdma_dev_open(&cfg);
+    if (!dev)
+        return 1;
+
+    int lsock = rdma_tcp_listen(cfg.tcp_port, 1);
+    if (lsock < 0)
+        return 1;
+    int sock = accept(lsock, NULL, NULL);
+    struct rx_ctx rx;
+    memset(&rx, 0, sizeof(rx));
+    if (sock < 0 || rdma_sock_read(sock, &rx.hello, sizeof(rx.hello))) {
+        ERR("accept failed");
+        return 1;
+    }
+    if (rx.hello.mode > MODE_UD || !rx.hello.flows || rx.hello.size < sizeof(struct rdma_ud_hdr)) {
+        LOG("Bad hello");
+        return 1;
+    }
+    LOG("%s: %u flows, %u byte messages, %u client threads",
+        rx.hello.mode == MODE_UD ? "UD" : "RC", rx.hello.flows, rx.hello.size, rx.hello.threads);
+    rx.buf_len = rx.hello.size;
+    rx.next_seq = calloc(rx.hello.flows, sizeof(*rx.next_seq));
+
+    uint64_t rx_wr = rx.hello.mode == MODE_UD ? ud_ring : (uint64_t)rx.hello.flows * cfg.max_recv_wr;
+    int depth = cfg.cq_depth ? cfg.cq_depth : (int)rx_wr + 64;
+    if (depth > dev->attr.max_cqe)
+        depth = dev->attr.max_cqe;
+    struct ibv_cq *cq = ibv_create_cq(dev->ctx, depth, NULL, NULL, 0);
+    if (!cq) {
+        ERR("ibv_create_cq depth %d failed", depth);
+        return 1;
+    }
+
+    int ret = rx.hello.mode == MODE_UD ? setup_ud(&rx, dev, &cfg, cq, sock, ud_ring)
+                                       : setup_rc(&rx, dev, &cfg, cq, sock);
+    if (ret || rdma_sock_barrier(sock))
+        return 1;
+    rx.st.rx_bytes = (uint64_t)rx.pool->nbufs * rx.pool->buf_size;
+    LOG("%lu QP(s), %lu receive buffers (%.2f MB)", rx.st.qps, rx_wr, rx.st.rx_bytes / 1e6);
+
+    struct rdma_poller poller;
+    rdma_poller_init(&poller, cq, cfg.poll_batch, recv_done, &rx);
+
+    /* the client writes one byte when its last message completed */
+    uint64_t last_check = rdma_now_ns();
+    for (;;) {
+        if (rdma_poller_poll(&poller) < 0)
+            return 1;
+        uint64_t now = rdma_now_ns();
+        if (now - last_check < SOCK_CHECK_NS)
+            continue;
+        last_check = now;
+        struct pollfd pfd = { .fd = sock, .events = POLLIN };
+        if (poll(&pfd, 1, 0) > 0)
+            break;
+    }
+    char ch;
+    if (rdma_sock_read(sock, &ch, 1))
+        return 1;
+    /* UD messages still on the wire */
+    for (uint64_t until = rdma_now_ns() + SOCK_CHECK_NS; rdma_now_ns() < until;)
+        rdma_poller_poll(&poller);
+
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    rx.st.maxrss_kb = ru.ru_maxrss;
+    rx.st.ns = rx.last_ns - rx.first_ns;
+    LOG("Received %lu msgs, %lu lost, %lu reordered, max RSS %lu KB",
+        rx.st.msgs, rx.st.lost, rx.st.reordered, rx.st.maxrss_kb);
+    if (rdma_sock_write(sock, &rx.st, sizeof(rx.st)))
+        return 1;
+
+    if (rx.ud)
+        rdma_ud_destroy(rx.ud);
+    for (uint32_t i = 0; rx.conns && i < rx.hello.flows; i++)
+        rdma_conn_destroy(rx.conns[i]);
+    rdma_pool_destroy(rx.pool);
+    ibv_destroy_cq(cq);
+    free(rx.conns);
+    free(rx.next_seq);
+    close(sock);
+    close(lsock);
+    rdma_dev_close(dev);
+    return 0;
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+
+enum ud_mode {
+    MODE_RC,                /* one RC QP per flow on both sides */
+    MODE_UD,                /* one UD QP per client thread, one on the server */
+};
+
+/* client -> server before anything else */
+struct ud_hello {
+    uint32_t mode;
+    uint32_t flows;         /* logical peers */
+    uint32_t size;          /* message size, struct rdma_ud_hdr included */
+    uint32_t threads;       /* client threads: UD QPs the client sends from */
+};
+
+/* server -> client once the client says it is done */
+struct ud_stats {
+    uint64_t msgs;
+    uint64_t bytes;
+    uint64_t lost;          /* seq gaps */
+    uint64_t reordered;     /* seq below what the flow already saw */
+    uint64_t ns;            /* first to last message */
+    uint64_t qps;
+    uint64_t rx_bytes;      /* registered receive buffers */
+    uint64_t maxrss_kb;
+};
+
+static inline int ud_parse_mode(const char *s) {
+    if (!strcmp(s, "rc"))
+        return MODE_RC;
+    if (!strcmp(s, "ud"))
+        return MODE_UD;
+    return -1;
+}